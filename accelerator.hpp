@@ -6,11 +6,18 @@
 #include "xaccelerator_hw.h"
 #include "config_struct.hpp"
 #include "types.hpp"
+#include "register_trace.hpp"
+#include "perf_model.hpp"
+#include "embedding_gather.hpp"
+#include "lm_head_topk.hpp"
+#include "constrained_decoding.hpp"
+#include "candidate_search.hpp"
 #include <cstdint>
 #include <vector>
 #include <cstdio>
 #include <unistd.h>
 #include <cstring>
+#include <chrono>
 
 class Accelerator {
 private:
@@ -21,23 +28,399 @@ private:
     uint32_t config_words[38];
     uint32_t status_words[4];
     
-    std::vector<uint32_t> input_buffer;
+    // Ping-pong prompt buffers: the next task's prompt is written into
+    // the idle slot while the current task runs
+    static const size_t INPUT_SLOT_WORDS = 2048;
+    std::vector<uint32_t> input_buffers[2];
+    int active_input;
+    uint64_t input_base_addr;
+    
+    // Host-side embedding (CONFIG_FLAG_HOST_EMBED): ping-pong FP16 row
+    // buffers after the token id slots. Prompts longer than
+    // embed_max_tokens are sent as token ids.
+    std::vector<uint16_t> embed_buffers[2];
+    uint32_t embed_max_tokens;
+    uint32_t embed_row_bytes;
+    EmbeddingGather* embed_gather;
+    
+    // Constrained decoding (CONFIG_FLAG_TOKEN_MASK): ping-pong token masks
+    // after the embedding slots. The staged task's first mask goes in the
+    // idle slot; the running task's is rewritten after every token.
+    // mask_loaded avoids copying a mask the slot already holds.
+    std::vector<uint64_t> mask_buffers[2];
+    const uint64_t* mask_loaded[2];
+    uint32_t mask_words;
+    uint64_t mask_writes;
+    uint64_t mask_reuses;
+    
+    // Candidate runs (CONFIG_FLAG_CANDIDATES): ping-pong KV block tables
+    // after the masks, one row per candidate, rewritten before each step.
+    // Steps are counted in status tokens_generated.
+    std::vector<uint32_t> table_buffers[2];
+    uint32_t table_stride;
+    uint32_t candidate_steps_read;
+    uint64_t block_copies;
+    uint32_t model_batch;
+    
     std::vector<uint32_t> output_buffer;
-    std::vector<uint32_t> kv_cache;
+    
+    // Split lm_head: hidden size of the partial the kernel writes to the
+    // output buffer each step (0 = kernel samples the full vocabulary)
+    uint32_t lm_head_hidden;
+    
+    // Simulated KV contents per slot, entries in position order; stands
+    // in for the KV region that readKv/writeKv would map
+    std::vector<std::vector<uint8_t>> kv_cache;
+    
+    // KV region carved into per-sequence slots; a suspended run keeps its
+    // slot while others use the rest. reset() wipes every slot and bumps
+    // the epoch so stale resume state can be detected.
+    uint64_t kv_base_addr;
+    uint64_t kv_slot_bytes;
+    uint32_t kv_epoch;
+    
+    // Shadow config for the staged task (not yet written to hardware)
+    ConfigIn staged_config;
+    int staged_input;
+    bool has_staged;
+    
+    // ap_ctrl_hs: once ap_ready fires the kernel has latched config_in,
+    // so the staged config may be written while the run continues
+    bool ready_seen;
+    bool staged_preloaded;
+    uint64_t preload_count;
+    
+    // Simulated ap_ctrl_hs handshake. AP_START latches config_in,
+    // ap_ready follows once inputs are consumed, ap_done when the run
+    // ends. ap_ready/ap_done are clear-on-read.
+    struct SimControl {
+        bool running;
+        bool ready_reported;
+        bool done_pending;
+        bool has_run;
+        std::chrono::steady_clock::time_point start_time;
+        std::chrono::steady_clock::time_point done_time;
+        uint32_t latched_task_id;
+        uint32_t sample_step;       // Counter-based sampler position
+        std::vector<float> hidden_state;    // Split lm_head: made-up final hidden state
+        uint64_t runs;
+        uint64_t back_to_back;      // Runs started within 1 ms of previous done
+        uint64_t dead_us;           // Idle time between done and next start
+        uint64_t max_dead_us;
+        
+        // Token pacing from the perf model. The kernel starts the next
+        // token once the previous one has been read from status_out.
+        uint32_t context;
+        std::chrono::steady_clock::time_point next_token_time;
+        
+        // Candidate run latched at start (config_in may already hold the
+        // next run's); a step is out and the next inputs aren't in yet
+        uint32_t candidate_rows;
+        uint32_t last_prompt_token;
+        bool awaiting_inputs;
+        
+        uint32_t kv_slot;           // Slot the run's KV entries go to
+        bool token_mask;            // Constrained run: tokens follow its mask
+    } sim;
+    
+    PerfModel perf;
+    
+    // Register trace: recorder logs every access, replay serves reads
+    // from a recording instead of the simulator
+    RegisterRecorder* recorder;
+    RegisterReplay* replay;
+    RegScope scope;
+    
+    // Top-level operation entry: marks the trace so replay can re-issue it
+    void enterCall(RegScope s, uint16_t arg16 = 0, uint32_t arg32 = 0) {
+        scope = s;
+        if (recorder) {
+            recorder->call(RegSource::ACCEL, s, arg16, arg32);
+        }
+    }
+    
+    static const int SIM_READY_DELAY_US = 200;
+    static const int SOFT_RESET_POLLS = 100;
+    static const uint32_t SUSPEND_MIN_WAIT_US = 50000;
+    static constexpr float SIM_KERNEL_LOGIT = 16.0f;
+    
+    void simStart() {
+        auto now = std::chrono::steady_clock::now();
+        
+        if (!sim.running && sim.has_run) {
+            uint64_t dead = std::chrono::duration_cast<std::chrono::microseconds>(
+                now - sim.done_time).count();
+            sim.dead_us += dead;
+            if (dead > sim.max_dead_us) sim.max_dead_us = dead;
+            if (dead < 1000) sim.back_to_back++;
+        }
+        
+        sim.running = true;
+        sim.ready_reported = false;
+        sim.start_time = now;
+        sim.latched_task_id = config_words[15];
+        sim.runs++;
+        
+        // A resumed run has its context in KV already: straight to decode
+        sim.context = config.prompt_length;
+        sim.sample_step = config.sample_offset;
+        sim.candidate_rows = (config.flags & CONFIG_FLAG_CANDIDATES) ? config.batch_size : 0;
+        sim.last_prompt_token = config.prompt_length > 0
+            ? input_buffers[active_input][config.prompt_length - 1] : 0;
+        sim.awaiting_inputs = false;
+        sim.kv_slot = kv_slot_bytes
+            ? (uint32_t)((config.kv_cache_addr - kv_base_addr) / kv_slot_bytes) : 0;
+        sim.token_mask = (config.flags & CONFIG_FLAG_TOKEN_MASK) != 0;
+        sim.next_token_time = now + std::chrono::microseconds((int64_t)firstTokenUs());
+        
+        // Prefill writes the prompt's KV entries; a continuation's go
+        // after the restored ones
+        if (config.task_type == TASK_TYPE_RESUME || sim.candidate_rows > 0) {
+            return;
+        }
+        uint32_t prefix = 0;
+        if (config.task_type == TASK_TYPE_CONTINUE) {
+            prefix = config.kv_prefix_length;
+            sim.context += prefix;
+            simCheckKvPrefix(prefix);
+        }
+        simTruncateKv(prefix);
+        for (uint32_t i = 0; i < config.prompt_length && i < INPUT_SLOT_WORDS; i++) {
+            simWriteKv(prefix + i, input_buffers[active_input][i]);
+        }
+    }
+    
+    std::vector<uint8_t>& simKvSlot() {
+        if (sim.kv_slot >= kv_cache.size()) {
+            kv_cache.resize(sim.kv_slot + 1);
+        }
+        return kv_cache[sim.kv_slot];
+    }
+    
+    void simTruncateKv(uint32_t positions) {
+        std::vector<uint8_t>& slot = simKvSlot();
+        uint64_t bytes = (uint64_t)positions * perf.kvBytesPerToken();
+        if (slot.size() > bytes) {
+            slot.resize(bytes);
+        }
+    }
+    
+    // Stand-in KV entry: token and position, then a fill derived from
+    // them, so a restored prefix can be checked
+    void simWriteKv(uint32_t position, uint32_t token) {
+        uint64_t bytes = perf.kvBytesPerToken();
+        if (bytes < 8) {
+            return;
+        }
+        std::vector<uint8_t>& slot = simKvSlot();
+        if (slot.size() < (position + 1) * bytes) {
+            slot.resize((position + 1) * bytes);
+        }
+        uint8_t* entry = slot.data() + position * bytes;
+        memcpy(entry, &token, 4);
+        memcpy(entry + 4, &position, 4);
+        memset(entry + 8, (uint8_t)(token * 31 + position), bytes - 8);
+    }
+    
+    // A continuation attends over entries it didn't write; report any
+    // the restore left missing or out of place
+    void simCheckKvPrefix(uint32_t prefix) {
+        uint64_t bytes = perf.kvBytesPerToken();
+        if (bytes < 8) {
+            return;
+        }
+        const std::vector<uint8_t>& slot = simKvSlot();
+        uint32_t good = 0;
+        for (uint32_t p = 0; p < prefix && (p + 1) * bytes <= slot.size(); p++) {
+            uint32_t stored;
+            memcpy(&stored, slot.data() + p * bytes + 4, 4);
+            good += stored == p ? 1 : 0;
+        }
+        if (good != prefix) {
+            printf("[SIM] KV slot %u holds %u of %u restored positions\n", sim.kv_slot, good, prefix);
+        }
+    }
+    
+    // Split lm_head: the kernel's pick dominates its partial so streams
+    // match kernel-only runs while it falls in the kernel's rows; the
+    // hidden state is small noise
+    void simLmHeadPartial(uint32_t token) {
+        sim.hidden_state.resize(lm_head_hidden);
+        uint32_t seed = sim.sample_step * 2654435761u;
+        for (float& v : sim.hidden_state) {
+            seed = seed * 1664525u + 1013904223u;
+            v = ((int32_t)(seed >> 8) - (1 << 23)) * (0.05f / (1 << 23));
+        }
+        LogitTopK part;
+        if (token < config.lm_head_rows) {
+            part.top.push_back(LogitCandidate{token, SIM_KERNEL_LOGIT});
+            part.max_logit = SIM_KERNEL_LOGIT;
+            part.sum_exp = 1.0;
+        }
+        packLmHeadPartial(part, sim.hidden_state.data(), lm_head_hidden, output_buffer.data());
+    }
+    
+    // Constrained run: the first allowed token at or after the nominal
+    // one. Ends (true) when due and the mask allows EOS, or when the mask
+    // allows nothing else.
+    bool simMaskedToken(uint32_t& token, bool eos_due) const {
+        const std::vector<uint64_t>& mask = mask_buffers[active_input];
+        uint32_t vocab = config.vocab_size;
+        bool eos_allowed = (mask[vocab >> 6] >> (vocab & 63)) & 1;
+        if (eos_due && eos_allowed) {
+            return true;
+        }
+        for (uint32_t i = 0; i < vocab; i++) {
+            uint32_t t = (token + i) % vocab;
+            if ((mask[t >> 6] >> (t & 63)) & 1) {
+                token = t;
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Candidate run: lowercase letters that follow from the row's input,
+    // falling logits and an EOS that gains on them step by step. Each row
+    // samples with its own hash; the first step samples every row from
+    // the prompt's last token.
+    void simCandidateRow(uint32_t prev, uint32_t step, uint32_t row, CandidateRow& out) const {
+        out = CandidateRow();
+        out.sampled = EOS_TOKEN;
+        out.sampled_logit = 0;
+        if (prev == EOS_TOKEN) {
+            return;     // Idle
+        }
+        uint32_t base = (prev * 7 + step * 3) % 26;
+        for (uint32_t j = 0; j < LM_HEAD_TOP_K; j++) {
+            float jitter = (float)((prev * 31 + step * 17 + j * 13) % 10) * 0.03f;
+            out.top.top.push_back(LogitCandidate{97 + (base + 3 * j) % 26, 8.0f - 1.1f * j + jitter});
+        }
+        LogitCandidate eos{EOS_TOKEN, -6.0f + (float)step};
+        if (eos.logit > out.top.top.back().logit) {
+            out.top.top.back() = eos;
+            std::stable_sort(out.top.top.begin(), out.top.top.end(),
+                             [](const LogitCandidate& a, const LogitCandidate& b) {
+                                 return a.logit > b.logit;
+                             });
+        }
+        out.top.max_logit = out.top.top[0].logit;
+        double listed = 0;
+        for (const LogitCandidate& c : out.top.top) {
+            listed += std::exp(c.logit - out.top.max_logit);
+        }
+        // The rest of the vocabulary at logit 0
+        out.top.sum_exp = listed + (config.vocab_size - LM_HEAD_TOP_K) *
+                                   std::exp(-(double)out.top.max_logit);
+        
+        uint32_t h = (row + 1) * 2654435761u ^ (step + 1) * 40503u ^ prev * 97u;
+        h ^= h >> 15;
+        h *= 2246822519u;
+        h ^= h >> 13;
+        double u = (h >> 8) * (1.0 / (1 << 24)) * listed;
+        out.sampled = out.top.top.back().token;
+        out.sampled_logit = out.top.top.back().logit;
+        for (const LogitCandidate& c : out.top.top) {
+            u -= std::exp(c.logit - out.top.max_logit);
+            if (u <= 0) {
+                out.sampled = c.token;
+                out.sampled_logit = c.logit;
+                break;
+            }
+        }
+    }
+    
+    // Produce the next candidate step once the kernel would have it
+    void simCandidateStep() {
+        if (!sim.running || sim.awaiting_inputs) {
+            return;
+        }
+        if (perf.valid() && std::chrono::steady_clock::now() < sim.next_token_time) {
+            return;
+        }
+        const std::vector<uint32_t>& in = input_buffers[active_input];
+        uint32_t step = status.tokens_generated;
+        std::vector<CandidateRow> rows(sim.candidate_rows);
+        for (uint32_t r = 0; r < rows.size(); r++) {
+            simCandidateRow(step == 0 ? sim.last_prompt_token : in[r], step, r, rows[r]);
+        }
+        packCandidateStep(rows, output_buffer.data());
+        status.tokens_generated++;
+        status.pack_to_words(status_words);
+        sim.awaiting_inputs = true;
+    }
+    
+    void simFinish() {
+        if (!sim.running) return;
+        sim.running = false;
+        sim.done_pending = true;
+        sim.has_run = true;
+        sim.done_time = std::chrono::steady_clock::now();
+    }
+    
+    uint32_t simControl() {
+        uint32_t value = 0;
+        
+        if (!sim.running) {
+            value |= XACCELERATOR_AP_CTRL_IDLE;
+        } else if (!sim.ready_reported) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - sim.start_time).count();
+            if (elapsed >= SIM_READY_DELAY_US) {
+                value |= XACCELERATOR_AP_CTRL_READY;
+                sim.ready_reported = true;
+            }
+        }
+        
+        if (sim.done_pending) {
+            value |= XACCELERATOR_AP_CTRL_DONE;
+            sim.done_pending = false;
+        }
+        
+        return value;
+    }
     
     void writeReg(uint32_t offset, uint32_t value) {
+        if (recorder) {
+            recorder->write(RegSource::ACCEL, scope, offset, value);
+        }
+        if (replay) {
+            replay->write(RegSource::ACCEL, offset, value);
+            return;
+        }
+        
         // Simulated write
         printf("[HW_WRITE] 0x%04X = 0x%08X\n", offset, value);
         usleep(100); // Simulate I/O delay
+        
+        if (offset == XACCELERATOR_CTRL_ADDR_AP_CTRL) {
+            // ap_ctrl_hs: clearing ap_start doesn't stop a run in flight
+            if (value & XACCELERATOR_AP_CTRL_START) {
+                simStart();
+            }
+        } else if (offset == XACCELERATOR_SUSPEND_IN && value) {
+            // Tokens are computed when read, so the kernel is always
+            // between tokens here
+            simFinish();
+        }
     }
     
     uint32_t readReg(uint32_t offset) {
-        // Simulated read
         uint32_t value = 0;
         
+        if (replay) {
+            value = replay->read(RegSource::ACCEL, offset);
+            if (recorder) {
+                recorder->read(RegSource::ACCEL, scope, offset, value);
+            }
+            return value;
+        }
+        
+        // Simulated read
+        
         // Simulate different register responses
         if (offset == XACCELERATOR_CTRL_ADDR_AP_CTRL) {
-            value = XACCELERATOR_AP_CTRL_IDLE | XACCELERATOR_AP_CTRL_DONE;
+            value = simControl();
         } else if (offset >= XACCELERATOR_STATUS_OUT_BASE && 
                    offset < XACCELERATOR_STATUS_OUT_BASE + 16) {
             // Return status words
@@ -51,26 +434,144 @@ private:
         
         printf("[HW_READ] 0x%04X = 0x%08X\n", offset, value);
         usleep(100);
+        
+        if (recorder) {
+            recorder->read(RegSource::ACCEL, scope, offset, value);
+        }
         return value;
     }
 
+    uint64_t inputSlotAddr(int slot) const {
+        return input_base_addr + (uint64_t)slot * INPUT_SLOT_WORDS * sizeof(uint32_t);
+    }
+    
+    uint64_t embedSlotAddr(int slot) const {
+        return inputSlotAddr(2) + (uint64_t)slot * embed_max_tokens * embed_row_bytes;
+    }
+    
+    uint64_t maskSlotAddr(int slot) const {
+        return embedSlotAddr(2) + (uint64_t)slot * mask_words * sizeof(uint64_t);
+    }
+    
+    uint64_t tableSlotAddr(int slot) const {
+        return maskSlotAddr(2) + (uint64_t)slot * kvTableWords(MAX_CANDIDATES, table_stride) *
+                                 sizeof(uint32_t);
+    }
+    
+    // Copy mask into a slot's buffer unless it's already there. Masks
+    // come from a TokenConstraint, which stores each distinct one once.
+    void loadMask(int slot, const uint64_t* mask) {
+        if (mask_loaded[slot] == mask) {
+            mask_reuses++;
+            return;
+        }
+        memcpy(mask_buffers[slot].data(), mask, mask_words * sizeof(uint64_t));
+        mask_loaded[slot] = mask;
+        mask_writes++;
+    }
+    
+    // Staged run's first mask; false (unconstrained) without one
+    bool stageMask(const uint64_t* mask) {
+        if (!mask || mask_words == 0) {
+            return false;
+        }
+        enterCall(RegScope::TOKEN_MASK);
+        loadMask(staged_input, mask);
+        return true;
+    }
+    
+    uint64_t kvSlotAddr(uint32_t slot) const {
+        return kv_base_addr + (uint64_t)slot * kv_slot_bytes;
+    }
+    
+    // Shadow config for the next run; input already in the idle slot.
+    // candidate_rows > 0 is a candidate run addressing the whole KV
+    // region through the idle slot's block table.
+    void stageConfig(int task_id, uint32_t length, uint32_t task_type,
+                     uint32_t kv_slot, uint32_t sample_offset, bool host_embed = false,
+                     bool masked = false, uint32_t candidate_rows = 0, uint32_t kv_prefix = 0) {
+        const uint32_t candidate_flags = CONFIG_FLAG_CANDIDATES | CONFIG_FLAG_KV_BLOCK_TABLE;
+        bool candidates = candidate_rows > 0;
+        staged_config = config;
+        staged_config.input_buffer_addr = host_embed ? embedSlotAddr(staged_input)
+                                                     : inputSlotAddr(staged_input);
+        staged_config.flags = host_embed ? (config.flags | CONFIG_FLAG_HOST_EMBED)
+                                         : (config.flags & ~CONFIG_FLAG_HOST_EMBED);
+        staged_config.flags = masked ? (staged_config.flags | CONFIG_FLAG_TOKEN_MASK)
+                                     : (staged_config.flags & ~CONFIG_FLAG_TOKEN_MASK);
+        staged_config.token_mask_addr = masked ? maskSlotAddr(staged_input) : 0;
+        staged_config.flags = candidates ? (staged_config.flags | candidate_flags)
+                                         : (staged_config.flags & ~candidate_flags);
+        // Candidates need every row's top-k, so the kernel scores the
+        // whole lm_head for them
+        staged_config.flags = (lm_head_hidden && !candidates)
+                            ? (staged_config.flags | CONFIG_FLAG_SPLIT_LM_HEAD)
+                            : (staged_config.flags & ~CONFIG_FLAG_SPLIT_LM_HEAD);
+        staged_config.kv_block_table_addr = candidates ? tableSlotAddr(staged_input) : 0;
+        staged_config.batch_size = candidates ? candidate_rows : model_batch;
+        staged_config.kv_cache_addr = candidates ? kv_base_addr : kvSlotAddr(kv_slot);
+        staged_config.task_id = task_id;
+        staged_config.prompt_length = length;
+        staged_config.task_type = task_type;
+        staged_config.sample_offset = sample_offset;
+        staged_config.kv_prefix_length = kv_prefix;
+        has_staged = true;
+        staged_preloaded = false;
+        
+        if (ready_seen) {
+            preloadStaged();
+        }
+    }
+    
+    // Write only the config_in words that differ from what the kernel holds
+    int writeConfigDiff(const ConfigIn& next) {
+        uint32_t next_words[XACCELERATOR_CONFIG_IN_WORDS];
+        next.pack(next_words);
+        
+        int written = 0;
+        for (int i = 0; i < XACCELERATOR_CONFIG_IN_WORDS; i++) {
+            if (next_words[i] != config_words[i]) {
+                writeReg(XACCELERATOR_CONFIG_IN_OFFSET(i), next_words[i]);
+                config_words[i] = next_words[i];
+                written++;
+            }
+        }
+        
+        config = next;
+        return written;
+    }
+
 public:
-    Accelerator() : base_addr(XACCELERATOR_BASEADDR) {
-        input_buffer.resize(4096);
+    Accelerator() : base_addr(XACCELERATOR_BASEADDR), active_input(0),
+                    input_base_addr(0), embed_max_tokens(0), embed_row_bytes(0),
+                    embed_gather(nullptr), mask_words(0), mask_writes(0), mask_reuses(0),
+                    table_stride(0), candidate_steps_read(0), block_copies(0), model_batch(1),
+                    lm_head_hidden(0), kv_base_addr(0), kv_slot_bytes(0), kv_epoch(0),
+                    staged_input(1), has_staged(false),
+                    ready_seen(false), staged_preloaded(false), preload_count(0),
+                    recorder(nullptr), replay(nullptr), scope(RegScope::NONE) {
+        input_buffers[0].resize(INPUT_SLOT_WORDS);
+        input_buffers[1].resize(INPUT_SLOT_WORDS);
+        mask_loaded[0] = mask_loaded[1] = nullptr;
         output_buffer.resize(1024);
-        kv_cache.resize(65536);
         memset(config_words, 0, sizeof(config_words));
         memset(status_words, 0, sizeof(status_words));
+        sim = SimControl();
     }
     
   
     void configure(uint64_t input_addr, uint64_t output_addr, 
                    uint64_t kv_cache_addr, uint32_t stride, 
                    uint32_t max_tokens) {
+        enterCall(RegScope::CONFIGURE);
         printf("[ACCEL] Configuring accelerator with 1216-bit config_in...\n");
         
 
-        config.input_buffer_addr = input_addr;
+        input_base_addr = input_addr;
+        active_input = 0;
+        kv_base_addr = kv_cache_addr;
+        
+        config.input_buffer_addr = inputSlotAddr(active_input);
         config.output_buffer_addr = output_addr;
         config.kv_cache_addr = kv_cache_addr;
         config.stride = stride;
@@ -88,40 +589,427 @@ public:
                XACCELERATOR_CONFIG_IN_WORDS);
     }
     
+    // Model shape carried in config_in; written to the kernel by the next
+    // configure() or launch. Also sets the shape the simulator paces by.
+    void setModelConfig(const ModelShape& shape) {
+        config.num_layers = shape.num_layers;
+        config.hidden_size = shape.hidden_size;
+        config.num_heads = shape.num_heads;
+        config.vocab_size = shape.vocab_size;
+        config.sequence_length = shape.max_seq_len;
+        config.batch_size = shape.batch_size;
+        model_batch = shape.batch_size;
+        perf.setShape(shape);
+    }
+    
+    // Size of one sequence's KV slot; 0 = every run uses the KV base
+    void configureKvSlots(uint64_t slot_bytes) {
+        enterCall(RegScope::KV_SLOTS, (uint16_t)(slot_bytes >> 32), (uint32_t)slot_bytes);
+        kv_slot_bytes = slot_bytes;
+    }
+    
+    // Gather prompts of up to max_tokens rows of row_bytes on the host.
+    // Without a gather (replay) runs are addressed the same but the
+    // buffers stay empty. max_tokens 0 = kernel always looks up ids.
+    void configureHostEmbedding(uint32_t max_tokens, uint32_t row_bytes,
+                                EmbeddingGather* gather = nullptr) {
+        enterCall(RegScope::HOST_EMBED, (uint16_t)max_tokens, row_bytes);
+        embed_max_tokens = max_tokens;
+        embed_row_bytes = row_bytes;
+        embed_gather = gather;
+        
+        size_t elements = gather ? (size_t)max_tokens * row_bytes / 2 : 0;
+        embed_buffers[0].assign(elements, 0);
+        embed_buffers[1].assign(elements, 0);
+        
+        if (max_tokens > 0) {
+            printf("[ACCEL] Host embedding for prompts up to %u tokens (2 x %.2f MB at 0x%lx)\n",
+                   max_tokens, (double)max_tokens * row_bytes / (1024.0 * 1024.0),
+                   (unsigned long)embedSlotAddr(0));
+        }
+    }
+    
+    // Input region reserved for the two token masks
+    static const size_t TOKEN_MASK_REGION_BYTES = 64 * 1024;
+    
+    static bool tokenMasksFit(uint32_t vocab_size) {
+        return 2 * TokenConstraint::maskWordsFor(vocab_size) * sizeof(uint64_t) <=
+               TOKEN_MASK_REGION_BYTES;
+    }
+    
+    // Token masks of vocab_size + 1 bits for constrained runs. False (runs
+    // stay unconstrained) if the vocabulary is too large for the region.
+    bool configureTokenMasks(uint32_t vocab_size) {
+        enterCall(RegScope::TOKEN_MASKS, 0, vocab_size);
+        if (!tokenMasksFit(vocab_size)) {
+            printf("[ACCEL] Vocabulary of %u too large for token masks\n", vocab_size);
+            mask_words = 0;
+            return false;
+        }
+        mask_words = TokenConstraint::maskWordsFor(vocab_size);
+        for (int slot = 0; slot < 2; slot++) {
+            mask_buffers[slot].assign(mask_words, ~0ull);
+            mask_loaded[slot] = nullptr;
+        }
+        printf("[ACCEL] Token masks: 2 x %u words at 0x%lx\n", mask_words,
+               (unsigned long)maskSlotAddr(0));
+        return true;
+    }
+    
+    // Next step's mask for the running task; no register traffic
+    void setTokenMask(const uint64_t* mask) {
+        if (mask_words > 0) {
+            loadMask(active_input, mask);
+        }
+    }
+    
+    uint64_t getMaskWrites() const { return mask_writes; }
+    uint64_t getMaskReuses() const { return mask_reuses; }
+    
+    // Input region reserved for the two KV block tables
+    static const size_t KV_TABLE_REGION_BYTES = 64 * 1024;
+    
+    static bool kvTablesFit(uint32_t stride) {
+        return 2 * kvTableWords(MAX_CANDIDATES, stride) * sizeof(uint32_t) <= KV_TABLE_REGION_BYTES;
+    }
+    
+    // Block tables of blocks_per_slot entries per row for candidate runs.
+    // False (no candidate runs) if a slot has too many blocks for the
+    // region.
+    bool configureKvTables(uint32_t block_tokens, uint32_t blocks_per_slot) {
+        enterCall(RegScope::KV_TABLES, (uint16_t)block_tokens, blocks_per_slot);
+        if (block_tokens == 0 || !kvTablesFit(blocks_per_slot)) {
+            printf("[ACCEL] %u blocks per slot too many for KV block tables\n", blocks_per_slot);
+            table_stride = 0;
+            return false;
+        }
+        table_stride = blocks_per_slot;
+        config.kv_block_tokens = block_tokens;
+        config.kv_block_table_stride = blocks_per_slot;
+        for (int slot = 0; slot < 2; slot++) {
+            table_buffers[slot].assign(kvTableWords(MAX_CANDIDATES, table_stride), 0);
+        }
+        if (output_buffer.size() < candidateStepWords(MAX_CANDIDATES)) {
+            output_buffer.resize(candidateStepWords(MAX_CANDIDATES));
+        }
+        printf("[ACCEL] KV block tables: 2 x %u rows of %u blocks at 0x%lx\n", MAX_CANDIDATES,
+               table_stride, (unsigned long)tableSlotAddr(0));
+        return true;
+    }
+    
+    uint32_t getKvTableStride() const { return table_stride; }
+    uint64_t getBlockCopies() const { return block_copies; }
+    
+    // Every row's output for the candidate step the kernel finished last.
+    // False until a step newer than the last one read is out.
+    // todo map the DMA output region; output_buffer stands in for it
+    bool readCandidateStep(std::vector<CandidateRow>& rows) {
+        enterCall(RegScope::CANDIDATE_STEP);
+        readStatus();
+        if (!status.isValid() || status.isDone() || status.hasError()) {
+            return false;
+        }
+        if (!replay) {
+            simCandidateStep();
+        }
+        if (status.tokens_generated == candidate_steps_read) {
+            return false;
+        }
+        candidate_steps_read = status.tokens_generated;
+        return unpackCandidateStep(output_buffer.data(), output_buffer.size(), rows);
+    }
+    
+    // Next step's input tokens (EOS = idle row) and block tables, in the
+    // running slot; no register traffic. All rows idle ends the run.
+    void feedbackCandidates(const std::vector<uint32_t>& inputs,
+                            const std::vector<uint32_t>& tables) {
+        std::vector<uint32_t>& in = input_buffers[active_input];
+        std::vector<uint32_t>& table = table_buffers[active_input];
+        uint32_t live = 0;
+        for (size_t r = 0; r < inputs.size() && r < in.size(); r++) {
+            in[r] = inputs[r];
+            live += inputs[r] != EOS_TOKEN ? 1 : 0;
+        }
+        std::copy(tables.begin(), tables.begin() + std::min(tables.size(), table.size()),
+                  table.begin());
+        size_t copies_at = (size_t)inputs.size() * table_stride;
+        if (copies_at < tables.size()) {
+            block_copies += tables[copies_at];
+        }
+        
+        if (replay) {
+            return;
+        }
+        if (live == 0) {
+            simFinish();
+            return;
+        }
+        sim.awaiting_inputs = false;
+        sim.next_token_time = std::chrono::steady_clock::now() +
+            std::chrono::microseconds((int64_t)perf.decodeUs(sim.context, live));
+        sim.context++;
+    }
+    
+    // Kernel scores lm_head rows [0, kernel_rows) and leaves a partial
+    // (lm_head_topk.hpp) for the host, which scores the rest
+    void configureLmHeadSplit(uint32_t kernel_rows, uint32_t hidden_size) {
+        enterCall(RegScope::LM_HEAD_SPLIT, (uint16_t)hidden_size, kernel_rows);
+        config.lm_head_rows = kernel_rows;
+        config.flags |= CONFIG_FLAG_SPLIT_LM_HEAD;
+        lm_head_hidden = hidden_size;
+        if (output_buffer.size() < lmHeadPartialWords(hidden_size)) {
+            output_buffer.resize(lmHeadPartialWords(hidden_size));
+        }
+        perf.setLmHeadSplit(kernel_rows);
+        
+        printf("[ACCEL] lm_head split: kernel scores %u rows, host the rest\n", kernel_rows);
+    }
+    
+    // The kernel's candidates and hidden state for the token just read
+    // by getNextToken. False when the lm_head isn't split.
+    // todo map the DMA output region; output_buffer stands in for it
+    bool readLmHeadPartial(LogitTopK& part, std::vector<float>& hidden_state) const {
+        if (lm_head_hidden == 0) {
+            return false;
+        }
+        return unpackLmHeadPartial(output_buffer.data(), output_buffer.size(), lm_head_hidden,
+                                   part, hidden_state);
+    }
+    
+    // Split lm_head: the host's pick is the next step's input token, read
+    // by the kernel from word 0 of the active input slot
+    void feedbackToken(uint32_t token) {
+        input_buffers[active_input][0] = token;
+    }
+    
+    uint32_t getKvEpoch() const { return kv_epoch; }
+    
+    // K and V of every layer for one position
+    uint64_t kvPositionBytes() const { return perf.kvBytesPerToken(); }
+    
+    // A slot's first positions KV entries, in position order. False if
+    // the slot holds fewer. No register traffic; valid between the run
+    // that wrote them and the next one in that slot.
+    // todo map the KV region and gather from the kernel's per-layer
+    // layout; kv_cache stands in for it
+    bool readKv(uint32_t slot, uint32_t positions, uint8_t* dst) const {
+        uint64_t bytes = (uint64_t)positions * kvPositionBytes();
+        if (slot >= kv_cache.size() || kv_cache[slot].size() < bytes) {
+            return false;
+        }
+        memcpy(dst, kv_cache[slot].data(), bytes);
+        return true;
+    }
+    
+    // Put back positions KV entries read by readKv into a slot no run is
+    // using, ahead of stageContinue
+    void writeKv(uint32_t slot, const uint8_t* src, uint32_t positions) {
+        if (slot >= kv_cache.size()) {
+            kv_cache.resize(slot + 1);
+        }
+        uint64_t bytes = (uint64_t)positions * kvPositionBytes();
+        kv_cache[slot].assign(src, src + bytes);
+    }
+    
+    const PerfModel& getPerfModel() const { return perf; }
+    
+    // Modeled time from AP_START to the current run's first token: its
+    // prompt pass, or one decode step for a resume. 0 without a model.
+    double firstTokenUs() const {
+        return config.task_type == TASK_TYPE_RESUME
+            ? perf.decodeUs(config.prompt_length)
+            : perf.prefillUs(config.prompt_length, (config.flags & CONFIG_FLAG_HOST_EMBED) != 0);
+    }
+    void setPerfParams(const AccelPerfParams& params) { perf.setParams(params); }
+    
     void setTaskConfig(int task_id, uint32_t prompt_len) {
+        enterCall(RegScope::TASK_CONFIG, (uint16_t)prompt_len, (uint32_t)task_id);
         printf("[ACCEL] Setting task config - ID: %d, PromptLen: %u\n", 
                task_id, prompt_len);
         
-
-        config.task_id = task_id;
-        config.prompt_length = prompt_len;
-        config.task_type = 0; 
+        ConfigIn next = config;
+        next.task_id = task_id;
+        next.prompt_length = prompt_len;
+        next.task_type = 0; 
         
-
-        config.pack(config_words);
+        writeConfigDiff(next);
+    }
+    
+    // Prompt into the idle input slot, with its embedding rows (from
+    // position start_pos) when they fit; returns the tokens staged
+    uint32_t loadPrompt(int task_id, const std::vector<uint32_t>& tokens, uint32_t kv_slot,
+                        bool& host_embed, uint32_t start_pos = 0) {
+        std::vector<uint32_t>& buf = input_buffers[staged_input];
+        
+        size_t n = tokens.size() < buf.size() ? tokens.size() : buf.size();
+        enterCall(RegScope::KV_SLOT, (uint16_t)kv_slot, 0);
+        enterCall(RegScope::STAGE, (uint16_t)n, (uint32_t)task_id);
+        for (size_t i = 0; i < n; i++) {
+            buf[i] = tokens[i];
+        }
         
-        // Only write the changed words (optimization)
-        // todo write the relevant section
-        writeReg(XACCELERATOR_CONFIG_IN_OFFSET(14), config_words[14]); // prompt_length
-        writeReg(XACCELERATOR_CONFIG_IN_OFFSET(15), config_words[15]); // task_id
-        writeReg(XACCELERATOR_CONFIG_IN_OFFSET(16), config_words[16]); // task_type
+        // Embedding rows go in while the current run still decodes
+        host_embed = false;
+        if (embed_max_tokens > 0 && n > 0) {
+            if (n > embed_max_tokens) {
+                if (embed_gather) embed_gather->skipped();
+            } else {
+                host_embed = !embed_gather ||
+                    embed_gather->gather(buf.data(), n, start_pos, embed_buffers[staged_input].data());
+            }
+        }
+        return (uint32_t)n;
     }
     
-    void startInference(int task_id, const std::vector<uint32_t>& tokens) {
-        printf("[ACCEL] Starting inference - Task ID: %d, Tokens: %zu\n", 
-               task_id, tokens.size());
-        setTaskConfig(task_id, tokens.size());
+    // Prepare the next run while the current one is still decoding:
+    // prompt goes to the idle input slot, config to the shadow copy.
+    // Nothing touches the kernel until launchStaged(). mask, if given,
+    // constrains the first sampled token.
+    void stageTask(int task_id, const std::vector<uint32_t>& tokens, uint32_t kv_slot = 0,
+                   const uint64_t* mask = nullptr) {
+        staged_input = 1 - active_input;
+        bool masked = stageMask(mask);
+        bool host_embed;
+        uint32_t n = loadPrompt(task_id, tokens, kv_slot, host_embed);
+        
+        printf("[ACCEL] Staged task %d (%u tokens%s%s) in input slot %d, KV slot %u\n",
+               task_id, n, host_embed ? ", host embedded" : "", masked ? ", constrained" : "",
+               staged_input, kv_slot);
+        stageConfig(task_id, n, TASK_TYPE_GENERATE, kv_slot, 0, host_embed, masked);
+    }
+    
+    // Stage a candidate run of rows sequences over one prefill. tables
+    // (kvTableWords(rows, stride)) maps row 0 onto the prompt's blocks
+    // in kv_slot.
+    void stageCandidates(int task_id, const std::vector<uint32_t>& tokens, uint32_t kv_slot,
+                         uint32_t rows, const std::vector<uint32_t>& tables) {
+        staged_input = 1 - active_input;
+        enterCall(RegScope::CANDIDATES, (uint16_t)rows, 0);
+        bool host_embed;
+        uint32_t n = loadPrompt(task_id, tokens, kv_slot, host_embed);
+        std::vector<uint32_t>& table = table_buffers[staged_input];
+        std::copy(tables.begin(), tables.begin() + std::min(tables.size(), table.size()),
+                  table.begin());
         
-        for (size_t i = 0; i < tokens.size() && i < input_buffer.size(); i++) {
-            input_buffer[i] = tokens[i];
+        printf("[ACCEL] Staged task %d (%u tokens%s, %u candidates) in input slot %d, KV slot %u\n",
+               task_id, n, host_embed ? ", host embedded" : "", rows, staged_input, kv_slot);
+        stageConfig(task_id, n, TASK_TYPE_GENERATE, kv_slot, 0, host_embed, false, rows);
+    }
+    
+    // Stage a turn that extends a context already in kv_slot (put back
+    // with writeKv): tokens are only the new ones, prefilled from
+    // position kv_prefix
+    void stageContinue(int task_id, const std::vector<uint32_t>& tokens, uint32_t kv_slot,
+                       uint32_t kv_prefix, const uint64_t* mask = nullptr) {
+        staged_input = 1 - active_input;
+        bool masked = stageMask(mask);
+        enterCall(RegScope::KV_PREFIX, 0, kv_prefix);
+        bool host_embed;
+        uint32_t n = loadPrompt(task_id, tokens, kv_slot, host_embed, kv_prefix);
+        
+        printf("[ACCEL] Staged task %d (%u tokens after %u in KV%s%s) in input slot %d, KV slot %u\n",
+               task_id, n, kv_prefix, host_embed ? ", host embedded" : "",
+               masked ? ", constrained" : "", staged_input, kv_slot);
+        stageConfig(task_id, n, TASK_TYPE_CONTINUE, kv_slot, 0, host_embed, masked, 0, kv_prefix);
+    }
+    
+    // Stage a suspended run to continue from its KV slot: the input is
+    // the last sampled token, no prefill
+    void stageResume(int task_id, const ResumeState& state, const uint64_t* mask = nullptr) {
+        staged_input = 1 - active_input;
+        bool masked = stageMask(mask);
+        enterCall(RegScope::KV_SLOT, (uint16_t)state.kv_slot, state.generated);
+        enterCall(RegScope::STAGE_RESUME, (uint16_t)state.position, (uint32_t)task_id);
+        input_buffers[staged_input][0] = state.last_token;
+        
+        printf("[ACCEL] Staged resume of task %d at position %u in KV slot %u\n",
+               task_id, state.position, state.kv_slot);
+        stageConfig(task_id, state.position, TASK_TYPE_RESUME, state.kv_slot, state.generated,
+                    false, masked);
+    }
+    
+    // Write the staged config into config_in. Only legal once the current
+    // run has signalled ap_ready (or the kernel is idle).
+    int preloadStaged() {
+        if (!has_staged || staged_preloaded) {
+            return 0;
         }
         
-        printf("[ACCEL] Writing AP_START...\n");
+        RegScope outer = scope;
+        scope = RegScope::PRELOAD;
+        int written = writeConfigDiff(staged_config);
+        scope = outer;
+        staged_preloaded = true;
+        preload_count++;
+        
+        printf("[ACCEL] Preloaded config for task %u (%d words)\n",
+               staged_config.task_id, written);
+        return written;
+    }
+    
+    // Read AP_CTRL once and act on the handshake bits: on ap_ready the
+    // staged config is preloaded. Returns the AP_CTRL value.
+    uint32_t serviceControl() {
+        enterCall(RegScope::CONTROL);
+        uint32_t ctrl = readReg(XACCELERATOR_CTRL_ADDR_AP_CTRL);
+        
+        if (ctrl & (XACCELERATOR_AP_CTRL_READY | XACCELERATOR_AP_CTRL_IDLE)) {
+            ready_seen = true;
+        }
+        if (ready_seen) {
+            preloadStaged();
+        }
+        
+        return ctrl;
+    }
+    
+    // Commit the staged run: dirty config words (none if preloaded on
+    // ap_ready), then AP_START. Returns the number of config words written.
+    int launchStaged() {
+        if (!has_staged) {
+            return -1;
+        }
+        
+        enterCall(RegScope::LAUNCH);
+        int written = writeConfigDiff(staged_config);
+        active_input = staged_input;
+        has_staged = false;
+        staged_preloaded = false;
+        ready_seen = false;
+        
+        printf("[ACCEL] Writing AP_START (task %u, %d config words)...\n",
+               config.task_id, written);
         writeReg(XACCELERATOR_CTRL_ADDR_AP_CTRL, XACCELERATOR_AP_CTRL_START);
         
         status.tokens_generated = 0;
         status.flags = 0x01; // valid
-        status.pack_to_words();
+        candidate_steps_read = 0;
+        status.pack_to_words(status_words);
+        
+        return written;
+    }
+    
+    // Forget the staged run before launch
+    void dropStaged() {
+        has_staged = false;
+        staged_preloaded = false;
+    }
+    
+    bool hasStagedTask() const { return has_staged; }
+    bool isStagedPreloaded() const { return staged_preloaded; }
+    uint64_t getPreloadCount() const { return preload_count; }
+    
+    // Simulator: idle time between ap_done and the next AP_START
+    uint64_t getSimRuns() const { return sim.runs; }
+    uint64_t getSimDeadTimeUs() const { return sim.dead_us; }
+    uint64_t getSimMaxDeadTimeUs() const { return sim.max_dead_us; }
+    uint64_t getSimBackToBackRuns() const { return sim.back_to_back; }
+    
+    void startInference(int task_id, const std::vector<uint32_t>& tokens) {
+        printf("[ACCEL] Starting inference - Task ID: %d, Tokens: %zu\n", 
+               task_id, tokens.size());
+        stageTask(task_id, tokens);
+        launchStaged();
     }
     
     void readStatus() {
@@ -139,24 +1027,48 @@ public:
     }
     
     bool getNextToken(uint32_t& token) {
+        enterCall(RegScope::STATUS, 0);
         readStatus();
         
-        if (status.isValid() && !status.isDone()) {
+        if (status.isValid() && !status.isDone() && !status.hasError()) {
             token = status.current_token;
             
-            static int token_counter = 0;
-            if (token_counter++ > 10) {
+            if (replay) {
+                if (recorder) recorder->token(token);
+                return true;
+            }
+            
+            auto now = std::chrono::steady_clock::now();
+            if (perf.valid() && now < sim.next_token_time) {
+                return false;  // Kernel still computing the token
+            }
+            
+            token = 101 + sim.sample_step;
+            bool eos = sim.sample_step++ > 10;
+            if (sim.token_mask) {
+                eos = simMaskedToken(token, eos);
+            }
+            if (eos) {
                 token = EOS_TOKEN;
                 status.flags |= 0x02; 
-                token_counter = 0;
+                simFinish();
             } else {
-                token = 100 + token_counter; 
                 status.tokens_generated++;
+                if (lm_head_hidden) {
+                    simLmHeadPartial(token);
+                }
+                simWriteKv(sim.context, token);
+                
+                if (sim.next_token_time < now) sim.next_token_time = now;
+                sim.next_token_time += std::chrono::microseconds(
+                    (int64_t)perf.decodeUs(sim.context));
+                sim.context++;
             }
             
             status.current_token = token;
-            status.pack_to_words();
+            status.pack_to_words(status_words);
             
+            if (recorder) recorder->token(token);
             return true;
         }
         
@@ -175,22 +1087,103 @@ public:
     
 
     void reset() {
+        enterCall(RegScope::RESET);
         printf("[ACCEL] Resetting accelerator...\n");
         
         writeReg(XACCELERATOR_IRQ_CLEAR_IN, 0xFFFFFFFF);
         writeReg(XACCELERATOR_CTRL_ADDR_AP_CTRL, 0x00);
         
-        for (size_t i = 0; i < kv_cache.size(); i++) {
-            kv_cache[i] = 0;
-        }
+        kv_cache.clear();
+        kv_epoch++;
         
         printf("[ACCEL] Reset complete, KV cache cleared\n");
     }
 
+    // Recover from a kernel error without wiping the KV cache: clear
+    // pending IRQs, drop ap_start and wait for ap_idle. A kernel that
+    // reported an error has left its loop; one still running (a hang)
+    // can't be stopped from here, so this fails and the caller escalates.
+    bool softReset() {
+        enterCall(RegScope::SOFT_RESET);
+        printf("[ACCEL] Soft reset (KV cache preserved)...\n");
+        
+        writeReg(XACCELERATOR_IRQ_CLEAR_IN, 0xFFFFFFFF);
+        writeReg(XACCELERATOR_CTRL_ADDR_AP_CTRL, 0x00);
+        
+        bool idle = false;
+        for (int i = 0; i < SOFT_RESET_POLLS && !idle; i++) {
+            idle = (readReg(XACCELERATOR_CTRL_ADDR_AP_CTRL) & XACCELERATOR_AP_CTRL_IDLE) != 0;
+        }
+        
+        status = StatusOut();
+        status.pack_to_words(status_words);
+        ready_seen = idle;
+        
+        printf("[ACCEL] Soft reset %s\n", idle ? "complete" : "failed: kernel not idle");
+        return idle;
+    }
+
+    // Stop the current run at a token boundary, keeping its KV slot:
+    // raise suspend_in, wait for ap_idle (the kernel ends the run with
+    // ap_done before its next token), then lower it. A token computed
+    // but not yet read is recomputed on resume. False if the kernel
+    // didn't stop within two token times (it is still running).
+    bool suspendRun() {
+        enterCall(RegScope::SUSPEND);
+        printf("[ACCEL] Suspending run (KV preserved)...\n");
+        
+        writeReg(XACCELERATOR_SUSPEND_IN, 1);
+        
+        uint32_t wait_us = SUSPEND_MIN_WAIT_US;
+        if (perf.valid() && 2 * perf.decodeUs(config.max_tokens) > wait_us) {
+            wait_us = (uint32_t)(2 * perf.decodeUs(config.max_tokens));
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(wait_us);
+        bool idle = false;
+        while (!idle) {
+            idle = (readReg(XACCELERATOR_CTRL_ADDR_AP_CTRL) & XACCELERATOR_AP_CTRL_IDLE) != 0;
+            if (!idle && std::chrono::steady_clock::now() > deadline) {
+                break;
+            }
+        }
+        writeReg(XACCELERATOR_SUSPEND_IN, 0);
+        if (!idle) {
+            // It may have taken the request just before it was lowered
+            idle = (readReg(XACCELERATOR_CTRL_ADDR_AP_CTRL) & XACCELERATOR_AP_CTRL_IDLE) != 0;
+        }
+        if (!idle) {
+            printf("[ACCEL] Suspend failed: kernel still running after %u us\n", wait_us);
+            return false;
+        }
+        
+        status = StatusOut();
+        status.pack_to_words(status_words);
+        ready_seen = true;
+        return true;
+    }
+    
     StatusOut getStatus() {
+        enterCall(RegScope::STATUS, 1);
         readStatus();
         return status;
     }
+    
+    void setRecorder(RegisterRecorder* rec) { recorder = rec; }
+    void setReplay(RegisterReplay* rep) { replay = rep; }
+    
+    // Status from the most recent readStatus(), without touching hardware
+    const StatusOut& lastStatus() const { return status; }
+    bool lastStatusHasError() const { return status.hasError(); }
+    uint32_t lastErrorCode() const { return status.error_code; }
+    
+    // Simulation: make the running kernel report an error. Like the
+    // hardware kernel, it then leaves its loop and raises ap_done.
+    void simInjectError(uint32_t error_code) {
+        status.flags |= 0x04;
+        status.error_code = error_code;
+        status.pack_to_words(status_words);
+        simFinish();
+    }
 };
 
 #endif // ACCELERATOR_HPP
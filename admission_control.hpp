@@ -0,0 +1,322 @@
+// admission_control.hpp
+// Decides at submit time whether a task should be queued, based on what
+// it will cost and how long it would wait, instead of only on whether
+// the queue has a free entry.
+//
+//   cost      prompt + output tokens; KV bytes; run time from the perf
+//             model, scaled by what runs actually took (calibration)
+//   wait      predicted work already queued + what is left of the
+//             current run
+//
+// A task whose tokens can't fit a KV slot is rejected outright (it would
+// fail later). Candidates tasks (candidate_search.hpp) cost one prefill
+// and a batched decode, and fit if their shared blocks do. A task that
+// would wait longer than the SLO, or finds the queue full, is deferred
+// with a retry hint.
+
+#ifndef ADMISSION_CONTROL_HPP
+#define ADMISSION_CONTROL_HPP
+
+#include "types.hpp"
+#include "perf_model.hpp"
+#include "capacity_planner.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+
+struct AdmissionPolicy {
+    uint32_t max_queue_wait_ms;     // SLO; 0 = never defer on wait
+    uint32_t max_queued;            // Tasks admitted but not started
+    uint32_t default_max_tokens;    // For tasks with max_tokens = 0
+
+    AdmissionPolicy() : max_queue_wait_ms(30000), max_queued(100), default_max_tokens(50) {}
+};
+
+enum class AdmissionDecision {
+    ADMIT,
+    DEFER_QUEUE_FULL,
+    DEFER_OVER_SLO,
+    REJECT_TOO_LARGE        // prompt + output exceed a KV slot
+};
+
+struct AdmissionEstimate {
+    AdmissionDecision decision;
+    uint32_t prompt_tokens;
+    uint32_t output_tokens;         // Requested (max_tokens or default)
+    uint64_t kv_bytes;
+    double run_ms;                  // This task, calibrated
+    double queue_wait_ms;           // Before it would start
+    uint32_t retry_after_ms;        // Deferred only
+
+    AdmissionEstimate() : decision(AdmissionDecision::ADMIT), prompt_tokens(0),
+                          output_tokens(0), kv_bytes(0), run_ms(0),
+                          queue_wait_ms(0), retry_after_ms(0) {}
+
+    bool admitted() const { return decision == AdmissionDecision::ADMIT; }
+};
+
+class AdmissionController {
+public:
+    static constexpr double CALIBRATION_ALPHA = 0.2;
+    static const uint32_t MIN_RETRY_MS = 100;
+
+private:
+    PerfModel model;
+    CapacityPlan plan;
+    uint32_t context_tokens;
+    AdmissionPolicy policy;
+
+    mutable std::mutex mutex;
+
+    // Uncalibrated model ms of admitted tasks, by task id
+    std::unordered_map<int, double> pending;
+    double pending_ms;
+
+    bool running;
+    double running_ms;                  // Calibrated prediction
+    std::chrono::steady_clock::time_point running_since;
+
+    // Observed / predicted run time, and generated / requested tokens
+    double time_scale;
+    double output_ratio;
+
+    // Stats
+    uint64_t admitted;
+    uint64_t deferred_full;
+    uint64_t deferred_slo;
+    uint64_t rejected;
+    uint64_t calibrations;
+    double max_admitted_wait_ms;
+
+    static const char* decisionName(AdmissionDecision d) {
+        switch (d) {
+            case AdmissionDecision::ADMIT:            return "admit";
+            case AdmissionDecision::DEFER_QUEUE_FULL: return "queue full";
+            case AdmissionDecision::DEFER_OVER_SLO:   return "over wait SLO";
+            case AdmissionDecision::REJECT_TOO_LARGE: return "too large for KV slot";
+        }
+        return "unknown";
+    }
+
+    // Raw model time for the tokens this task is expected to produce;
+    // candidates decode as a batch of that many rows
+    double modelMs(uint32_t prompt_tokens, uint32_t output_tokens, uint32_t candidates = 0) const {
+        uint32_t expected = (uint32_t)(output_tokens * output_ratio + 0.5);
+        if (expected < 1) expected = 1;
+        return model.runUs(prompt_tokens, expected, candidates) / 1000.0;
+    }
+
+    double waitMsLocked() const {
+        double wait = pending_ms * time_scale;
+        if (running) {
+            double elapsed = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - running_since).count();
+            if (running_ms > elapsed) {
+                wait += running_ms - elapsed;
+            }
+        }
+        return wait;
+    }
+
+    AdmissionEstimate estimateLocked(uint32_t prompt_tokens, int max_tokens,
+                                     uint32_t candidates = 0) const {
+        AdmissionEstimate est;
+        est.prompt_tokens = prompt_tokens;
+        est.output_tokens = max_tokens > 0 ? (uint32_t)max_tokens : policy.default_max_tokens;
+        est.kv_bytes = (uint64_t)(est.prompt_tokens + est.output_tokens) * model.kvBytesPerToken();
+        est.run_ms = modelMs(est.prompt_tokens, est.output_tokens, candidates) * time_scale;
+        est.queue_wait_ms = waitMsLocked();
+
+        bool too_large = context_tokens > 0 &&
+                         est.prompt_tokens + est.output_tokens > context_tokens;
+        if (candidates > 0 && context_tokens > 0) {
+            uint32_t blocks = plan.candidateBlocks(est.prompt_tokens, est.output_tokens, candidates);
+            est.kv_bytes = (uint64_t)blocks * plan.block_bytes;
+            too_large = too_large || blocks > plan.blocks_per_slot;
+        }
+        if (too_large) {
+            est.decision = AdmissionDecision::REJECT_TOO_LARGE;
+            return est;
+        }
+
+        if (pending.size() >= policy.max_queued) {
+            // Roughly one queued task's worth of time frees an entry
+            est.decision = AdmissionDecision::DEFER_QUEUE_FULL;
+            est.retry_after_ms = (uint32_t)(est.queue_wait_ms / (pending.size() + 1));
+        } else if (policy.max_queue_wait_ms > 0 && est.queue_wait_ms > policy.max_queue_wait_ms) {
+            est.decision = AdmissionDecision::DEFER_OVER_SLO;
+            est.retry_after_ms = (uint32_t)(est.queue_wait_ms - policy.max_queue_wait_ms);
+        }
+
+        if (!est.admitted() && est.retry_after_ms < MIN_RETRY_MS) {
+            est.retry_after_ms = MIN_RETRY_MS;
+        }
+        return est;
+    }
+
+public:
+    AdmissionController() : context_tokens(0), pending_ms(0), running(false), running_ms(0),
+                            time_scale(1.0), output_ratio(1.0), admitted(0),
+                            deferred_full(0), deferred_slo(0), rejected(0),
+                            calibrations(0), max_admitted_wait_ms(0) {}
+
+    void configure(const ModelShape& shape, const CapacityPlan& capacity,
+                   const AdmissionPolicy& p) {
+        std::lock_guard<std::mutex> lock(mutex);
+        model.setShape(shape);
+        plan = capacity;
+        context_tokens = capacity.context_tokens;
+        policy = p;
+    }
+
+    void setPerfParams(const AccelPerfParams& params) {
+        std::lock_guard<std::mutex> lock(mutex);
+        model.setParams(params);
+    }
+
+    // What admit() would decide now, without reserving anything
+    AdmissionEstimate estimate(uint32_t prompt_tokens, int max_tokens,
+                               uint32_t candidates = 0) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return estimateLocked(prompt_tokens, max_tokens, candidates);
+    }
+
+    // Counts an admitted task as queued work until start() or drop()
+    AdmissionEstimate admit(const Task& task, uint32_t prompt_tokens) {
+        std::lock_guard<std::mutex> lock(mutex);
+        AdmissionEstimate est = estimateLocked(prompt_tokens, task.max_tokens, task.candidates);
+
+        switch (est.decision) {
+            case AdmissionDecision::ADMIT: {
+                double raw = modelMs(est.prompt_tokens, est.output_tokens, task.candidates);
+                pending[task.id] = raw;
+                pending_ms += raw;
+                admitted++;
+                if (est.queue_wait_ms > max_admitted_wait_ms) {
+                    max_admitted_wait_ms = est.queue_wait_ms;
+                }
+                return est;
+            }
+            case AdmissionDecision::DEFER_QUEUE_FULL: deferred_full++; break;
+            case AdmissionDecision::DEFER_OVER_SLO:   deferred_slo++; break;
+            case AdmissionDecision::REJECT_TOO_LARGE: rejected++; break;
+        }
+
+        printf("[Admission] Task %d not admitted (%s): %u+%u tokens, %.1f MB KV, "
+               "wait %.0f ms, run %.0f ms, retry in %u ms\n",
+               task.id, decisionName(est.decision), est.prompt_tokens, est.output_tokens,
+               est.kv_bytes / (1024.0 * 1024.0), est.queue_wait_ms, est.run_ms,
+               est.retry_after_ms);
+        return est;
+    }
+
+    // Task left the queue without running (shutdown, push failed)
+    void drop(int task_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = pending.find(task_id);
+        if (it != pending.end()) {
+            pending_ms -= it->second;
+            pending.erase(it);
+        }
+        if (pending.empty()) pending_ms = 0;    // Shed float drift
+    }
+
+    void start(const Task& task, uint32_t prompt_tokens) {
+        std::lock_guard<std::mutex> lock(mutex);
+        double raw;
+        auto it = pending.find(task.id);
+        if (it != pending.end()) {
+            raw = it->second;
+            pending_ms -= raw;
+            pending.erase(it);
+        } else {
+            // Retry requeued by recovery, never admitted
+            uint32_t out = task.max_tokens > 0 ? (uint32_t)task.max_tokens : policy.default_max_tokens;
+            raw = modelMs(prompt_tokens, out, task.candidates);
+        }
+        if (pending.empty()) pending_ms = 0;
+
+        running = true;
+        running_ms = raw * time_scale;
+        running_since = std::chrono::steady_clock::now();
+    }
+
+    // Preempted: the rest of the task is queued work again, decode only
+    // (its context stays in KV)
+    void suspend(const Task& resumed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+
+        uint32_t requested = resumed.max_tokens > 0 ? (uint32_t)resumed.max_tokens
+                                                    : policy.default_max_tokens;
+        uint32_t remaining = requested > resumed.resume.generated
+                           ? requested - resumed.resume.generated : 1;
+        uint32_t expected = (uint32_t)(remaining * output_ratio + 0.5);
+        if (expected < 1) expected = 1;
+        uint32_t context = resumed.resume.position;
+        double raw = (model.runUs(context, expected) - model.prefillUs(context)) / 1000.0;
+
+        pending[resumed.id] = raw;
+        pending_ms += raw;
+    }
+
+    // Calibrate against the run that just ended; generated counts decode
+    // steps for a candidates task
+    void finish(const Task& task, uint32_t prompt_tokens, uint32_t generated) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+
+        double elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - running_since).count();
+        if (generated == 0 || task.resume.valid) {
+            // Cancelled or failed before output says nothing; a resumed
+            // run skipped the prefill the model charges for
+            return;
+        }
+
+        double raw = model.runUs(prompt_tokens, generated, task.candidates) / 1000.0;
+        if (raw > 0) {
+            double scale = elapsed / raw;
+            if (scale < 0.01) scale = 0.01;
+            if (scale > 1000.0) scale = 1000.0;
+            time_scale += CALIBRATION_ALPHA * (scale - time_scale);
+        }
+
+        uint32_t requested = task.max_tokens > 0 ? (uint32_t)task.max_tokens : policy.default_max_tokens;
+        double ratio = (double)generated / requested;
+        if (ratio > 1.0) ratio = 1.0;
+        output_ratio += CALIBRATION_ALPHA * (ratio - output_ratio);
+        calibrations++;
+    }
+
+    double queueWaitMs() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return waitMsLocked();
+    }
+
+    size_t queuedTasks() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending.size();
+    }
+
+    void printStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        printf("\n[Admission] Statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Wait SLO:          %u ms\n", policy.max_queue_wait_ms);
+        printf("Admitted:          %lu (max predicted wait %.0f ms)\n",
+               (unsigned long)admitted, max_admitted_wait_ms);
+        printf("Deferred:          %lu queue full, %lu over SLO\n",
+               (unsigned long)deferred_full, (unsigned long)deferred_slo);
+        printf("Rejected:          %lu too large for a %u-token slot\n",
+               (unsigned long)rejected, context_tokens);
+        printf("Calibration:       %.2fx model time, %.0f%% of max_tokens used (%lu runs)\n",
+               time_scale, output_ratio * 100.0, (unsigned long)calibrations);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // ADMISSION_CONTROL_HPP
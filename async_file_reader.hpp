@@ -0,0 +1,391 @@
+// async_file_reader.hpp
+// Deep-queue file reader for weight loading.
+// Uses io_uring when the kernel supports it, falls back to pread otherwise.
+
+#ifndef ASYNC_FILE_READER_HPP
+#define ASYNC_FILE_READER_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define ASYNC_READER_HAVE_IO_URING 1
+#else
+#define ASYNC_READER_HAVE_IO_URING 0
+#endif
+
+struct ReadCompletion {
+    uint64_t tag;           // Caller tag passed to submitRead()
+    ssize_t result;         // Bytes read, or -errno
+};
+
+class AsyncFileReader {
+public:
+    // O_DIRECT requires buffer, offset and length aligned to this
+    static const size_t DIRECT_ALIGN = 4096;
+
+private:
+    int fd;
+    bool direct;
+    bool use_uring;
+    unsigned queue_depth;
+    unsigned in_flight;
+    uint64_t file_size;
+
+    // pread fallback: reads complete at submit time
+    std::vector<ReadCompletion> completed;
+
+#if ASYNC_READER_HAVE_IO_URING
+    int ring_fd;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    unsigned to_submit;
+
+    // One slot per in-flight read; iovecs must live until completion
+    std::vector<iovec> slot_iov;
+    std::vector<uint64_t> slot_tag;
+    std::vector<unsigned> free_slots;
+
+    bool setupRing(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        int rfd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (rfd < 0) {
+            return false;
+        }
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            if (cq_ring_size > sq_ring_size) sq_ring_size = cq_ring_size;
+            cq_ring_size = sq_ring_size;
+        }
+
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) {
+            sq_ring = nullptr;
+            ::close(rfd);
+            return false;
+        }
+
+        if (single_mmap) {
+            cq_ring = sq_ring;
+        } else {
+            cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_CQ_RING);
+            if (cq_ring == MAP_FAILED) {
+                cq_ring = nullptr;
+                munmap(sq_ring, sq_ring_size);
+                sq_ring = nullptr;
+                ::close(rfd);
+                return false;
+            }
+        }
+
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqe_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQES);
+        if (sqe_map == MAP_FAILED) {
+            if (cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+            munmap(sq_ring, sq_ring_size);
+            sq_ring = cq_ring = nullptr;
+            ::close(rfd);
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqe_map);
+
+        uint8_t* sq = static_cast<uint8_t*>(sq_ring);
+        uint8_t* cq = static_cast<uint8_t*>(cq_ring);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        ring_fd = rfd;
+        if (params.sq_entries < queue_depth) {
+            queue_depth = params.sq_entries;
+        }
+
+        slot_iov.resize(queue_depth);
+        slot_tag.resize(queue_depth);
+        free_slots.clear();
+        for (unsigned i = 0; i < queue_depth; i++) {
+            free_slots.push_back(queue_depth - 1 - i);
+        }
+        to_submit = 0;
+        return true;
+    }
+
+    void teardownRing() {
+        if (sqes) munmap(sqes, sqes_size);
+        if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+        if (sq_ring) munmap(sq_ring, sq_ring_size);
+        if (ring_fd >= 0) ::close(ring_fd);
+        sqes = nullptr;
+        sq_ring = cq_ring = nullptr;
+        ring_fd = -1;
+    }
+
+    // Submit queued SQEs, optionally waiting for min_complete completions
+    bool enter(unsigned min_complete) {
+        unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        while (true) {
+            int ret = (int)syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                   min_complete, flags, nullptr, 0);
+            if (ret >= 0) {
+                to_submit -= (unsigned)ret < to_submit ? (unsigned)ret : to_submit;
+                return true;
+            }
+            if (errno != EINTR && errno != EAGAIN) {
+                perror("[AsyncReader] io_uring_enter");
+                return false;
+            }
+        }
+    }
+
+    int reapRing(ReadCompletion* out, int max) {
+        int n = 0;
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail && n < max) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            unsigned slot = (unsigned)cqe.user_data;
+            out[n].tag = slot_tag[slot];
+            out[n].result = cqe.res;
+            free_slots.push_back(slot);
+            in_flight--;
+            n++;
+            head++;
+        }
+
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return n;
+    }
+#endif
+
+    ssize_t preadFull(void* buf, size_t len, uint64_t offset) {
+        size_t done = 0;
+        uint8_t* dst = static_cast<uint8_t*>(buf);
+
+        while (done < len) {
+            ssize_t nb = ::pread(fd, dst + done, len - done, (off_t)(offset + done));
+            if (nb < 0) {
+                if (errno == EINTR) continue;
+                return -errno;
+            }
+            if (nb == 0) break;  // EOF
+            done += (size_t)nb;
+        }
+
+        return (ssize_t)done;
+    }
+
+public:
+    AsyncFileReader() : fd(-1), direct(false), use_uring(false),
+                        queue_depth(0), in_flight(0), file_size(0)
+#if ASYNC_READER_HAVE_IO_URING
+                        , ring_fd(-1), sq_ring(nullptr), cq_ring(nullptr),
+                        sq_ring_size(0), cq_ring_size(0),
+                        sqes(nullptr), sqes_size(0),
+                        sq_tail(nullptr), sq_mask(nullptr), sq_array(nullptr),
+                        cq_head(nullptr), cq_tail(nullptr), cq_mask(nullptr),
+                        cqes(nullptr), to_submit(0)
+#endif
+    {}
+
+    ~AsyncFileReader() {
+        close();
+    }
+
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    // Open file for queued reads. With try_direct, O_DIRECT is used when the
+    // filesystem accepts it; callers must then keep reads DIRECT_ALIGN aligned.
+    bool open(const std::string& path, unsigned depth, bool try_direct) {
+        close();
+
+        if (try_direct) {
+            fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+            direct = (fd >= 0);
+        }
+        if (fd < 0) {
+            fd = ::open(path.c_str(), O_RDONLY);
+        }
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close();
+            return false;
+        }
+        file_size = (uint64_t)st.st_size;
+
+        queue_depth = depth > 0 ? depth : 1;
+        in_flight = 0;
+        completed.clear();
+
+#if ASYNC_READER_HAVE_IO_URING
+        use_uring = setupRing(queue_depth);
+        if (!use_uring) {
+            printf("[AsyncReader] io_uring unavailable (%s), using pread\n",
+                   strerror(errno));
+        }
+#endif
+
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0) {
+            drain();
+        }
+#if ASYNC_READER_HAVE_IO_URING
+        teardownRing();
+#endif
+        use_uring = false;
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        direct = false;
+        in_flight = 0;
+        completed.clear();
+    }
+
+    // Queue a read. Returns false when the queue is full; reap with wait().
+    bool submitRead(void* buf, size_t len, uint64_t offset, uint64_t tag) {
+        if (fd < 0 || in_flight >= queue_depth) {
+            return false;
+        }
+
+#if ASYNC_READER_HAVE_IO_URING
+        if (use_uring) {
+            unsigned slot = free_slots.back();
+            free_slots.pop_back();
+
+            slot_iov[slot].iov_base = buf;
+            slot_iov[slot].iov_len = len;
+            slot_tag[slot] = tag;
+
+            unsigned tail = *sq_tail;
+            unsigned idx = tail & *sq_mask;
+            io_uring_sqe& sqe = sqes[idx];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READV;  // READV works on every io_uring kernel
+            sqe.fd = fd;
+            sqe.addr = (uint64_t)(uintptr_t)&slot_iov[slot];
+            sqe.len = 1;
+            sqe.off = offset;
+            sqe.user_data = slot;
+            sq_array[idx] = idx;
+            __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+            to_submit++;
+            in_flight++;
+            return true;
+        }
+#endif
+
+        ReadCompletion c;
+        c.tag = tag;
+        c.result = preadFull(buf, len, offset);
+        completed.push_back(c);
+        in_flight++;
+        return true;
+    }
+
+    // Push queued reads to the kernel without waiting
+    bool submit() {
+#if ASYNC_READER_HAVE_IO_URING
+        if (use_uring && to_submit > 0) {
+            return enter(0);
+        }
+#endif
+        return true;
+    }
+
+    // Collect up to max completions, blocking until at least min_complete
+    // are available. Returns the number collected, or -1 on error.
+    int wait(ReadCompletion* out, int max, unsigned min_complete) {
+        if (in_flight == 0 || max <= 0) {
+            return 0;
+        }
+        if (min_complete > in_flight) {
+            min_complete = in_flight;
+        }
+
+#if ASYNC_READER_HAVE_IO_URING
+        if (use_uring) {
+            int n = reapRing(out, max);
+            if ((unsigned)n >= min_complete && to_submit == 0) {
+                return n;
+            }
+            if (!enter(min_complete > (unsigned)n ? min_complete - n : 0)) {
+                return -1;
+            }
+            return n + reapRing(out + n, max - n);
+        }
+#endif
+
+        int n = 0;
+        while (!completed.empty() && n < max) {
+            out[n++] = completed.front();
+            completed.erase(completed.begin());
+            in_flight--;
+        }
+        return n;
+    }
+
+    // Wait for every outstanding read (buffers may be freed afterwards)
+    void drain() {
+        ReadCompletion scratch[32];
+        while (in_flight > 0) {
+            if (wait(scratch, 32, 1) < 0) {
+                break;
+            }
+        }
+    }
+
+    bool isOpen() const { return fd >= 0; }
+    bool isDirect() const { return direct; }
+    bool usingIoUring() const { return use_uring; }
+    unsigned getQueueDepth() const { return queue_depth; }
+    unsigned getInFlight() const { return in_flight; }
+    uint64_t getFileSize() const { return file_size; }
+};
+
+#endif // ASYNC_FILE_READER_HPP
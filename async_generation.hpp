@@ -0,0 +1,323 @@
+// async_generation.hpp
+// Coroutine API for generation (C++20). A serving layer can run thousands
+// of concurrent generations on one GenerationLoop thread:
+//
+//   AsyncTask serve(AsyncEngine& engine, std::string prompt) {
+//       TokenStream stream = engine.generate(prompt, GenerationParams());
+//       while (std::optional<uint32_t> token = co_await stream.next()) {
+//           ...
+//       }
+//   }
+//   loop.spawn(serve(engine, "hello"));
+//
+// A coroutine waiting on next() is suspended, not blocking a thread. The
+// engine thread delivers each token (driven by the accelerator's status /
+// done interrupts) through the task's TokenSink, which posts the waiting
+// coroutine back onto its loop.
+//
+// Compiles to nothing before C++20 so the rest of the engine keeps
+// building with -std=c++17.
+
+#ifndef ASYNC_GENERATION_HPP
+#define ASYNC_GENERATION_HPP
+
+#include "types.hpp"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#define ASYNC_GENERATION_AVAILABLE 1
+
+class GenerationLoop;
+
+// Fire-and-forget coroutine run on a GenerationLoop. The frame destroys
+// itself when the body finishes.
+class AsyncTask {
+public:
+    struct promise_type {
+        GenerationLoop* loop = nullptr;
+
+        AsyncTask get_return_object() {
+            return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    AsyncTask(AsyncTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    AsyncTask(const AsyncTask&) = delete;
+    AsyncTask& operator=(const AsyncTask&) = delete;
+
+    ~AsyncTask() {
+        if (handle) handle.destroy();   // Never spawned
+    }
+
+private:
+    friend class GenerationLoop;
+    explicit AsyncTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+    std::coroutine_handle<promise_type> release() {
+        std::coroutine_handle<promise_type> h = handle;
+        handle = nullptr;
+        return h;
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Single-threaded executor. post() may be called from any thread; the
+// coroutines themselves only ever run on the thread inside run().
+class GenerationLoop {
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::coroutine_handle<>> ready;
+    bool stopping;
+    std::atomic<uint64_t> live_tasks;
+    std::atomic<uint64_t> resumes;
+
+public:
+    GenerationLoop() : stopping(false), live_tasks(0), resumes(0) {}
+
+    GenerationLoop(const GenerationLoop&) = delete;
+    GenerationLoop& operator=(const GenerationLoop&) = delete;
+
+    void spawn(AsyncTask task) {
+        std::coroutine_handle<AsyncTask::promise_type> h = task.release();
+        h.promise().loop = this;
+        live_tasks.fetch_add(1, std::memory_order_relaxed);
+        post(h);
+    }
+
+    void post(std::coroutine_handle<> h) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(h);
+        }
+        cv.notify_one();
+    }
+
+    // Resume everything currently ready, waiting up to timeout_ms for
+    // the first one. Returns the number of coroutines resumed.
+    size_t runOnce(int timeout_ms) {
+        std::deque<std::coroutine_handle<>> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                        [&] { return stopping || !ready.empty(); });
+            batch.swap(ready);
+        }
+        for (std::coroutine_handle<> h : batch) {
+            h.resume();
+        }
+        resumes.fetch_add(batch.size(), std::memory_order_relaxed);
+        return batch.size();
+    }
+
+    // Run until stop(), or until every spawned task has finished when
+    // until_idle is set
+    void run(bool until_idle = false) {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping) break;
+            }
+            if (until_idle && live_tasks.load(std::memory_order_acquire) == 0) {
+                break;
+            }
+            runOnce(100);
+        }
+        
+        // Resume anything posted before stop() (e.g. shutdown finishes)
+        runOnce(0);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+    }
+
+    void taskFinished() { live_tasks.fetch_sub(1, std::memory_order_acq_rel); }
+
+    uint64_t getLiveTasks() const { return live_tasks.load(); }
+    uint64_t getResumeCount() const { return resumes.load(); }
+};
+
+inline void AsyncTask::promise_type::FinalAwaiter::await_suspend(
+        std::coroutine_handle<promise_type> h) noexcept {
+    GenerationLoop* loop = h.promise().loop;
+    h.destroy();
+    if (loop) loop->taskFinished();
+}
+
+// Engine-side sink feeding one TokenStream. Tokens are buffered so the
+// engine never waits for the consumer.
+class TokenChannel : public TokenSink {
+private:
+    GenerationLoop& loop;
+    mutable std::mutex mutex;
+    std::deque<uint32_t> tokens;
+    bool finished;
+    FinishReason reason;
+    std::coroutine_handle<> waiter;
+    std::atomic<bool> cancelled;
+
+    void wake(std::unique_lock<std::mutex>& lock) {
+        std::coroutine_handle<> h = waiter;
+        waiter = nullptr;
+        lock.unlock();
+        if (h) loop.post(h);
+    }
+
+public:
+    explicit TokenChannel(GenerationLoop& l)
+        : loop(l), finished(false), reason(FinishReason::EOS), cancelled(false) {}
+
+    void onToken(uint32_t token) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        tokens.push_back(token);
+        wake(lock);
+    }
+
+    void onFinish(FinishReason r) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished = true;
+        reason = r;
+        wake(lock);
+    }
+
+    bool isCancelled() const override { return cancelled.load(std::memory_order_acquire); }
+    void cancel() { cancelled.store(true, std::memory_order_release); }
+
+    // Consumer side (loop thread)
+    bool readyLocked() const { return !tokens.empty() || finished; }
+
+    bool ready() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return readyLocked();
+    }
+
+    // False if a token arrived meanwhile (resume immediately)
+    bool park(std::coroutine_handle<> h) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (readyLocked()) return false;
+        waiter = h;
+        return true;
+    }
+
+    std::optional<uint32_t> take() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tokens.empty()) return std::nullopt;
+        uint32_t token = tokens.front();
+        tokens.pop_front();
+        return token;
+    }
+
+    bool isFinished() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return finished;
+    }
+
+    FinishReason finishReason() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return reason;
+    }
+};
+
+// Consumer handle for one generation. Dropping it before the end
+// cancels the task.
+class TokenStream {
+private:
+    std::shared_ptr<TokenChannel> channel;
+
+public:
+    struct NextToken {
+        TokenChannel* channel;
+
+        bool await_ready() const { return channel->ready(); }
+        bool await_suspend(std::coroutine_handle<> h) { return channel->park(h); }
+        std::optional<uint32_t> await_resume() { return channel->take(); }
+    };
+
+    explicit TokenStream(std::shared_ptr<TokenChannel> c) : channel(std::move(c)) {}
+    TokenStream(TokenStream&&) = default;
+    TokenStream& operator=(TokenStream&&) = default;
+
+    ~TokenStream() {
+        if (channel && !channel->isFinished()) {
+            channel->cancel();
+        }
+    }
+
+    // Next token, or nullopt once the generation has finished
+    NextToken next() { return NextToken{channel.get()}; }
+
+    FinishReason finishReason() const { return channel->finishReason(); }
+    void cancel() { channel->cancel(); }
+};
+
+struct GenerationParams {
+    int max_tokens;         // 0 = engine default
+    std::string tenant;     // Fair-share group; empty = default
+
+    GenerationParams() : max_tokens(0) {}
+};
+
+// Async front end to the engine's task queue. submit assigns the task id
+// and queues it; it returns false when admission control turns the task
+// away, which finishes the stream with REJECTED.
+class AsyncEngine {
+private:
+    GenerationLoop& loop;
+    std::function<bool(Task&)> submit;
+
+public:
+    AsyncEngine(GenerationLoop& l, std::function<bool(Task&)> submit_fn)
+        : loop(l), submit(std::move(submit_fn)) {}
+
+    TokenStream generate(const std::string& prompt, const GenerationParams& params) {
+        std::shared_ptr<TokenChannel> channel = std::make_shared<TokenChannel>(loop);
+
+        Task task;
+        task.type = TaskType::GENERATE;
+        task.prompt = prompt;
+        task.max_tokens = params.max_tokens;
+        task.tenant = params.tenant;
+        task.sink = channel;
+
+        if (!submit(task)) {
+            channel->onFinish(FinishReason::REJECTED);
+        }
+        return TokenStream(channel);
+    }
+
+    GenerationLoop& getLoop() { return loop; }
+};
+
+#endif // __cpp_impl_coroutine
+
+#endif // ASYNC_GENERATION_HPP
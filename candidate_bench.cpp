@@ -0,0 +1,131 @@
+// candidate_bench.cpp
+// n outputs per prompt (candidate_search.hpp): n separate tasks, each
+// with its own prefill and KV, against one prefill and a batched decode
+// over shared blocks. For each prompt length and n prints:
+//
+//   time      modeled run time of n tasks back to back and of one
+//             candidates run
+//   KV        blocks held: n full sequences, the planner's bound for the
+//             candidates run, and the peak a beam search actually reached
+//   host      per-step cost of beam search and sampling on the engine
+//             thread (re-rank, fork, block tables)
+//
+// Checks that the beam never needs more blocks than the planner admits
+// for and finishes with n ranked outputs.
+//
+// Build: g++ -std=c++17 -O2 candidate_bench.cpp -o candidate_bench -pthread
+
+#include "candidate_search.hpp"
+#include "capacity_planner.hpp"
+#include "perf_model.hpp"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+static const uint32_t OUTPUT_TOKENS = 64;
+static const uint32_t BLOCK_TOKENS = CapacityPlanner::KV_BLOCK_TOKENS;
+// One KV slot at max_seq_len 2048; every case below fits it
+static const uint32_t SLOT_BLOCKS = 2048 / BLOCK_TOKENS;
+
+// Top-k per row that never ends: letters that follow from the row's last
+// token, sampled by a per-row hash
+static void makeStep(const std::vector<uint32_t>& inputs, uint32_t step,
+                     std::vector<CandidateRow>& rows) {
+    rows.resize(inputs.size());
+    for (uint32_t r = 0; r < rows.size(); r++) {
+        CandidateRow& row = rows[r];
+        row = CandidateRow();
+        uint32_t prev = inputs[r] == EOS_TOKEN ? 0 : inputs[r];
+        for (uint32_t j = 0; j < LM_HEAD_TOP_K; j++) {
+            float jitter = (float)((prev * 31 + step * 17 + j * 13 + r * 7) % 10) * 0.05f;
+            row.top.top.push_back(LogitCandidate{97 + (prev * 7 + step * 3 + 3 * j) % 26,
+                                                 8.0f - 0.6f * j + jitter});
+        }
+        row.top.max_logit = row.top.top[0].logit;
+        row.top.sum_exp = 4.0;
+        uint32_t pick = ((r + 1) * 2654435761u ^ step * 40503u) % LM_HEAD_TOP_K;
+        row.sampled = row.top.top[pick].token;
+        row.sampled_logit = row.top.top[pick].logit;
+    }
+}
+
+struct HostRun {
+    double ns_per_step;
+    uint32_t peak_blocks;
+    uint64_t copies;
+    size_t outputs;
+};
+
+static HostRun runHost(CandidateMode mode, uint32_t n, uint32_t prompt) {
+    CandidateGroup group;
+    group.init(mode, n, prompt, OUTPUT_TOKENS, 0, SLOT_BLOCKS, BLOCK_TOKENS);
+    std::vector<uint32_t> inputs(n, EOS_TOKEN);
+    inputs[0] = 'a';
+    std::vector<CandidateRow> rows;
+    std::vector<uint32_t> tables;
+    double ns = 0;
+    bool more = true;
+    while (more) {
+        makeStep(inputs, group.steps(), rows);
+        auto start = std::chrono::steady_clock::now();
+        more = group.step(rows);
+        group.tables(tables);
+        ns += std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        inputs = group.inputs();
+    }
+    HostRun run;
+    run.ns_per_step = group.steps() ? ns / group.steps() : 0.0;
+    run.peak_blocks = group.peakBlocks();
+    run.copies = group.getBlockCopies();
+    run.outputs = group.ranked().size();
+    return run;
+}
+
+int main() {
+    const uint32_t prompts[] = {128, 512, 1024};
+    const uint32_t widths[] = {4, 8, 16};
+
+    ModelShape shape;
+    shape.num_layers = 12;
+    shape.hidden_size = 768;
+    shape.num_heads = 12;
+    shape.vocab_size = 32000;
+    shape.max_seq_len = 2048;
+    shape.intermediate_size = 3072;
+    PerfModel perf;
+    perf.setShape(shape);
+
+    CapacityPlan plan;
+    plan.block_tokens = BLOCK_TOKENS;
+    plan.blocks_per_slot = SLOT_BLOCKS;
+
+    printf("[Bench] %u output tokens, %u-token KV blocks\n", OUTPUT_TOKENS, BLOCK_TOKENS);
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("%6s %3s %11s %11s %6s %9s %7s %9s %7s %10s %10s %6s\n", "Prompt", "n", "separate",
+           "shared", "gain", "KV separ", "bound", "beam peak", "copies", "beam step",
+           "samp step", "check");
+
+    bool all_ok = true;
+    for (uint32_t prompt : prompts) {
+        for (uint32_t n : widths) {
+            double separate_ms = n * perf.runUs(prompt, OUTPUT_TOKENS) / 1000.0;
+            double shared_ms = perf.runUs(prompt, OUTPUT_TOKENS, n) / 1000.0;
+            uint32_t separate_blocks = n * ((prompt + OUTPUT_TOKENS + BLOCK_TOKENS - 1) / BLOCK_TOKENS);
+            uint32_t bound = plan.candidateBlocks(prompt, OUTPUT_TOKENS, n);
+
+            HostRun beam = runHost(CandidateMode::BEAM, n, prompt);
+            HostRun sample = runHost(CandidateMode::SAMPLE, n, prompt);
+            bool ok = beam.peak_blocks <= bound && sample.peak_blocks <= bound &&
+                      beam.outputs == n && sample.outputs == n;
+            all_ok = all_ok && ok;
+
+            printf("%6u %3u %8.1f ms %8.1f ms %5.1fx %9u %7u %9u %7lu %7.0f ns %7.0f ns %6s\n",
+                   prompt, n, separate_ms, shared_ms, shared_ms > 0 ? separate_ms / shared_ms : 0.0,
+                   separate_blocks, bound, beam.peak_blocks, (unsigned long)beam.copies,
+                   beam.ns_per_step, sample.ns_per_step, ok ? "ok" : "FAIL");
+        }
+    }
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,568 @@
+// candidate_search.hpp
+// Several outputs per prompt, n independent samples or a beam search of
+// width n, from a single prefill. The prompt goes through the kernel once
+// into row 0; the candidates then decode as one batched run
+// (CONFIG_FLAG_CANDIDATES), each row addressing KV through its own row of
+// a block table (CONFIG_FLAG_KV_BLOCK_TABLE) inside the task's KV slot.
+//
+// Blocks are reference counted. A fork copies the parent's table row, so
+// the prompt and any common prefix are stored once. A block is copied
+// only when a row is about to write into one it shares: that is the
+// partial last block, never a full one. The copies go to the kernel with
+// the step's tables and are done before the step.
+//
+// Per step the host turns each row's sample or top-k into the next
+// inputs: samples just append, beams are re-ranked by cumulative log
+// probability, dead beams free their rows and new ones fork from their
+// parents. Engine thread only.
+
+#ifndef CANDIDATE_SEARCH_HPP
+#define CANDIDATE_SEARCH_HPP
+
+#include "types.hpp"
+#include "lm_head_topk.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Rows the kernel decodes together (ENGINE_MAX_CANDIDATES in the C API)
+const uint32_t MAX_CANDIDATES = 16;
+
+inline const char* candidateModeName(CandidateMode mode) {
+    return mode == CandidateMode::BEAM ? "beam" : "sample";
+}
+
+// One row of a step's output
+struct CandidateRow {
+    uint32_t sampled;           // The kernel's own sample from the row
+    float sampled_logit;
+    LogitTopK top;              // Best LM_HEAD_TOP_K, normalizer over the vocabulary
+};
+
+// Step output in the output buffer, 32-bit words:
+//   [0]              row count
+// then per row:
+//   [0]              sampled token
+//   [1]              its logit (FP32 bits)
+//   [2]              candidate count n (<= LM_HEAD_TOP_K)
+//   [3]              max logit (FP32 bits)
+//   [4]              sum of exp(logit - max) (FP32 bits)
+//   [5 .. 2k + 4]    token, logit (FP32 bits) pairs, descending
+inline size_t candidateRowWords() {
+    return 5 + 2 * LM_HEAD_TOP_K;
+}
+
+inline size_t candidateStepWords(uint32_t rows) {
+    return 1 + rows * candidateRowWords();
+}
+
+inline void packCandidateStep(const std::vector<CandidateRow>& rows, uint32_t* words) {
+    words[0] = (uint32_t)rows.size();
+    for (size_t r = 0; r < rows.size(); r++) {
+        const CandidateRow& row = rows[r];
+        uint32_t* w = words + 1 + r * candidateRowWords();
+        uint32_t n = (uint32_t)std::min<size_t>(row.top.top.size(), LM_HEAD_TOP_K);
+        float sum = (float)row.top.sum_exp;
+        w[0] = row.sampled;
+        memcpy(&w[1], &row.sampled_logit, 4);
+        w[2] = n;
+        memcpy(&w[3], &row.top.max_logit, 4);
+        memcpy(&w[4], &sum, 4);
+        for (uint32_t i = 0; i < LM_HEAD_TOP_K; i++) {
+            LogitCandidate c = i < n ? row.top.top[i] : LogitCandidate{0, -INFINITY};
+            w[5 + 2 * i] = c.token;
+            memcpy(&w[6 + 2 * i], &c.logit, 4);
+        }
+    }
+}
+
+inline bool unpackCandidateStep(const uint32_t* words, size_t n_words,
+                                std::vector<CandidateRow>& rows) {
+    if (n_words < 1 || words[0] > MAX_CANDIDATES || n_words < candidateStepWords(words[0])) {
+        return false;
+    }
+    rows.resize(words[0]);
+    for (size_t r = 0; r < rows.size(); r++) {
+        CandidateRow& row = rows[r];
+        const uint32_t* w = words + 1 + r * candidateRowWords();
+        if (w[2] > LM_HEAD_TOP_K) {
+            return false;
+        }
+        float sum;
+        row.sampled = w[0];
+        memcpy(&row.sampled_logit, &w[1], 4);
+        row.top = LogitTopK();
+        memcpy(&row.top.max_logit, &w[3], 4);
+        memcpy(&sum, &w[4], 4);
+        row.top.sum_exp = sum;
+        for (uint32_t i = 0; i < w[2]; i++) {
+            LogitCandidate c;
+            c.token = w[5 + 2 * i];
+            memcpy(&c.logit, &w[6 + 2 * i], 4);
+            row.top.top.push_back(c);
+        }
+    }
+    return true;
+}
+
+// Block table in the input region, 32-bit words:
+//   [r * stride + b]     row r's block b, index from kv_cache_addr
+//   [rows * stride]      copy count c
+//   [.. + 1 ..]          c (source, destination) block pairs
+inline size_t kvTableWords(uint32_t rows, uint32_t stride) {
+    return (size_t)rows * stride + 1 + 2 * rows;
+}
+
+// Reference-counted KV blocks [first, first + count). The lowest free
+// block is handed out first so a run stays at the front of its slot.
+class KvBlockPool {
+private:
+    uint32_t first;
+    std::vector<uint32_t> refs;
+    std::vector<uint32_t> free_blocks;      // Descending; back() is lowest
+    uint32_t used;
+    uint32_t peak_used;
+
+public:
+    KvBlockPool() : first(0), used(0), peak_used(0) {}
+
+    void init(uint32_t first_block, uint32_t count) {
+        first = first_block;
+        refs.assign(count, 0);
+        free_blocks.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            free_blocks[i] = first_block + count - 1 - i;
+        }
+        used = 0;
+        peak_used = 0;
+    }
+
+    bool alloc(uint32_t& block) {
+        if (free_blocks.empty()) {
+            return false;
+        }
+        block = free_blocks.back();
+        free_blocks.pop_back();
+        refs[block - first] = 1;
+        used++;
+        if (used > peak_used) peak_used = used;
+        return true;
+    }
+
+    void retain(uint32_t block) {
+        refs[block - first]++;
+    }
+
+    void release(uint32_t block) {
+        if (--refs[block - first] > 0) {
+            return;
+        }
+        used--;
+        // Keep the stack descending so the lowest block goes out next
+        auto at = std::lower_bound(free_blocks.begin(), free_blocks.end(), block,
+                                   [](uint32_t a, uint32_t b) { return a > b; });
+        free_blocks.insert(at, block);
+    }
+
+    bool shared(uint32_t block) const { return refs[block - first] > 1; }
+    uint32_t usedBlocks() const { return used; }
+    uint32_t peak() const { return peak_used; }
+};
+
+// One candidates task: the rows, their blocks and what has finished.
+// Every live row holds the same number of positions (written), so all
+// rows write the same table column each step.
+class CandidateGroup {
+private:
+    struct Row {
+        bool live;
+        std::vector<uint32_t> blocks;
+        std::vector<uint32_t> tokens;
+        double logprob;
+
+        Row() : live(false), logprob(0) {}
+    };
+
+    // Beam expansion: token after row's text with the total log prob
+    struct Expansion {
+        uint32_t row;
+        uint32_t token;
+        double logprob;
+    };
+
+    CandidateMode mode;
+    uint32_t width;
+    uint32_t prompt_tokens;
+    uint32_t max_tokens;
+    uint32_t block_tokens;
+    uint32_t stride;
+
+    KvBlockPool pool;
+    std::vector<Row> rows;
+    std::vector<CandidateOutput> finished;
+    std::vector<std::pair<uint32_t, uint32_t>> copies;     // This step's
+    std::vector<uint32_t> next_inputs;
+
+    uint32_t written;           // KV positions per live row
+    uint32_t step_count;
+    uint32_t generated_tokens;  // Over all rows
+    uint64_t forks;
+    uint64_t block_copies;
+
+    void finishRow(uint32_t r, FinishReason reason) {
+        Row& row = rows[r];
+        CandidateOutput out;
+        out.tokens = row.tokens;
+        out.logprob = row.logprob;
+        out.finish = reason;
+        finished.push_back(out);
+        dropRow(r);
+    }
+
+    void dropRow(uint32_t r) {
+        Row& row = rows[r];
+        for (uint32_t b : row.blocks) {
+            pool.release(b);
+        }
+        row = Row();
+    }
+
+    void forkRow(uint32_t parent, uint32_t child) {
+        rows[child] = rows[parent];
+        for (uint32_t b : rows[child].blocks) {
+            pool.retain(b);
+        }
+        forks++;
+    }
+
+    // Room for the position the row's input is written to: a fresh block
+    // at a block boundary, otherwise a private copy of a shared tail
+    bool ensureBlock(Row& row) {
+        uint32_t block;
+        if (written % block_tokens == 0) {
+            if (!pool.alloc(block)) {
+                return false;
+            }
+            row.blocks.push_back(block);
+            return true;
+        }
+        uint32_t tail = row.blocks.back();
+        if (!pool.shared(tail)) {
+            return true;
+        }
+        if (!pool.alloc(block)) {
+            return false;
+        }
+        copies.push_back(std::make_pair(tail, block));
+        block_copies++;
+        pool.release(tail);
+        row.blocks.back() = block;
+        return true;
+    }
+
+    void sampleStep(const std::vector<CandidateRow>& out) {
+        if (step_count == 0) {
+            for (uint32_t r = 1; r < width && r < out.size(); r++) {
+                forkRow(0, r);
+            }
+        }
+        for (uint32_t r = 0; r < width && r < out.size(); r++) {
+            Row& row = rows[r];
+            if (!row.live) {
+                continue;
+            }
+            const CandidateRow& o = out[r];
+            double lp = o.top.empty() ? 0.0 : o.sampled_logit - o.top.logSumExp();
+            row.logprob += lp;
+            if (o.sampled == EOS_TOKEN) {
+                finishRow(r, FinishReason::EOS);
+                continue;
+            }
+            row.tokens.push_back(o.sampled);
+            generated_tokens++;
+            if (row.tokens.size() >= max_tokens) {
+                finishRow(r, FinishReason::MAX_TOKENS);
+            }
+        }
+    }
+
+    void beamStep(const std::vector<CandidateRow>& out) {
+        std::vector<Expansion> expansions;
+        for (uint32_t r = 0; r < width && r < out.size(); r++) {
+            if (!rows[r].live) {
+                continue;
+            }
+            const LogitTopK& top = out[r].top;
+            for (const LogitCandidate& c : top.top) {
+                expansions.push_back(Expansion{r, c.token, rows[r].logprob + top.logProb(c)});
+            }
+        }
+        std::stable_sort(expansions.begin(), expansions.end(),
+                         [](const Expansion& a, const Expansion& b) { return a.logprob > b.logprob; });
+
+        // An EOS among the best width expansions is a finished hypothesis;
+        // the best width others carry on
+        std::vector<Expansion> kept;
+        for (size_t i = 0; i < expansions.size() && kept.size() < width; i++) {
+            const Expansion& e = expansions[i];
+            if (e.token != EOS_TOKEN) {
+                kept.push_back(e);
+            } else if (i < width) {
+                CandidateOutput done;
+                done.tokens = rows[e.row].tokens;
+                done.logprob = e.logprob;
+                done.finish = FinishReason::EOS;
+                finished.push_back(done);
+            }
+        }
+
+        // First child stays in its parent's row; parents with none free
+        // theirs before the others fork
+        std::vector<uint32_t> children(width, 0);
+        for (const Expansion& e : kept) {
+            children[e.row]++;
+        }
+        for (uint32_t r = 0; r < width; r++) {
+            if (rows[r].live && children[r] == 0) {
+                dropRow(r);
+            }
+        }
+        std::vector<Row> parents(rows);
+        std::vector<bool> placed(width, false);
+        for (const Expansion& e : kept) {
+            uint32_t dst = e.row;
+            if (placed[e.row]) {
+                dst = 0;
+                while (dst < width && (rows[dst].live || children[dst] > 0)) {
+                    dst++;
+                }
+                if (dst == width) {
+                    continue;
+                }
+                rows[dst] = parents[e.row];
+                for (uint32_t b : rows[dst].blocks) {
+                    pool.retain(b);
+                }
+                forks++;
+            }
+            placed[e.row] = true;
+            Row& row = rows[dst];
+            row.live = true;
+            row.tokens.push_back(e.token);
+            row.logprob = e.logprob;
+            generated_tokens++;
+        }
+
+        if (finished.size() >= width) {
+            for (uint32_t r = 0; r < width; r++) {
+                if (rows[r].live) dropRow(r);
+            }
+            return;
+        }
+        if (!kept.empty() && rows[kept[0].row].tokens.size() >= max_tokens) {
+            for (uint32_t r = 0; r < width; r++) {
+                if (rows[r].live) finishRow(r, FinishReason::MAX_TOKENS);
+            }
+        }
+    }
+
+public:
+    CandidateGroup() : mode(CandidateMode::SAMPLE), width(0), prompt_tokens(0), max_tokens(0),
+                       block_tokens(0), stride(0), written(0), step_count(0),
+                       generated_tokens(0), forks(0), block_copies(0) {}
+
+    // n candidates of up to max_out tokens in blocks [first_block,
+    // first_block + slot_blocks). The prompt is written by the prefill
+    // into row 0. False if the prompt doesn't fit.
+    bool init(CandidateMode m, uint32_t n, uint32_t prompt_len, uint32_t max_out,
+              uint32_t first_block, uint32_t slot_blocks, uint32_t tokens_per_block) {
+        mode = m;
+        width = n < MAX_CANDIDATES ? n : MAX_CANDIDATES;
+        prompt_tokens = prompt_len;
+        max_tokens = max_out > 0 ? max_out : 1;
+        block_tokens = tokens_per_block;
+        stride = slot_blocks;
+        written = prompt_len;
+        step_count = 0;
+        generated_tokens = 0;
+        forks = 0;
+        block_copies = 0;
+        finished.clear();
+        copies.clear();
+        rows.assign(width, Row());
+        pool.init(first_block, slot_blocks);
+
+        if (width == 0 || block_tokens == 0) {
+            return false;
+        }
+        Row& first = rows[0];
+        first.live = true;
+        for (uint32_t p = 0; p < prompt_len; p += block_tokens) {
+            uint32_t block;
+            if (!pool.alloc(block)) {
+                return false;
+            }
+            first.blocks.push_back(block);
+        }
+        return true;
+    }
+
+    // Apply one step's output. Fills the next inputs and copies; false
+    // once every candidate has finished (inputs are then all EOS).
+    bool step(const std::vector<CandidateRow>& out) {
+        copies.clear();
+        if (mode == CandidateMode::BEAM) {
+            beamStep(out);
+        } else {
+            sampleStep(out);
+        }
+        step_count++;
+
+        next_inputs.assign(width, EOS_TOKEN);
+        bool any = false;
+        for (uint32_t r = 0; r < width; r++) {
+            Row& row = rows[r];
+            if (!row.live) {
+                continue;
+            }
+            if (!ensureBlock(row)) {
+                printf("[Candidates] Out of KV blocks at position %u\n", written);
+                finishRow(r, FinishReason::MAX_TOKENS);
+                continue;
+            }
+            next_inputs[r] = row.tokens.back();
+            any = true;
+        }
+        written++;
+        return any;
+    }
+
+    // Run ended early: live rows count as cut off
+    void stop() {
+        for (uint32_t r = 0; r < width; r++) {
+            if (rows[r].live) finishRow(r, FinishReason::MAX_TOKENS);
+        }
+        next_inputs.assign(width, EOS_TOKEN);
+    }
+
+    // Input word r: row r's token, EOS for idle rows
+    const std::vector<uint32_t>& inputs() const { return next_inputs; }
+
+    // Table words for the next step (kvTableWords(width, stride))
+    void tables(std::vector<uint32_t>& words) const {
+        words.assign(kvTableWords(width, stride), 0);
+        for (uint32_t r = 0; r < width; r++) {
+            const std::vector<uint32_t>& blocks = rows[r].blocks;
+            for (size_t b = 0; b < blocks.size() && b < stride; b++) {
+                words[r * stride + b] = blocks[b];
+            }
+        }
+        uint32_t* tail = &words[(size_t)width * stride];
+        tail[0] = (uint32_t)copies.size();
+        for (size_t i = 0; i < copies.size() && i < width; i++) {
+            tail[1 + 2 * i] = copies[i].first;
+            tail[2 + 2 * i] = copies[i].second;
+        }
+    }
+
+    // Best first by log prob per token (EOS counts as one), at most width
+    std::vector<CandidateOutput> ranked() const {
+        std::vector<CandidateOutput> out(finished);
+        auto score = [](const CandidateOutput& c) {
+            size_t len = c.tokens.size() + (c.finish == FinishReason::EOS ? 1 : 0);
+            return len ? c.logprob / len : c.logprob;
+        };
+        std::stable_sort(out.begin(), out.end(),
+                         [&](const CandidateOutput& a, const CandidateOutput& b) {
+                             return score(a) > score(b);
+                         });
+        if (out.size() > width) {
+            out.resize(width);
+        }
+        return out;
+    }
+
+    CandidateMode getMode() const { return mode; }
+    uint32_t getWidth() const { return width; }
+    uint32_t getPromptTokens() const { return prompt_tokens; }
+    uint32_t steps() const { return step_count; }
+    uint32_t generated() const { return generated_tokens; }
+    uint32_t liveRows() const {
+        uint32_t n = 0;
+        for (const Row& row : rows) n += row.live ? 1 : 0;
+        return n;
+    }
+    uint64_t getForks() const { return forks; }
+    uint64_t getBlockCopies() const { return block_copies; }
+    uint32_t peakBlocks() const { return pool.peak(); }
+
+    // What the same candidates would hold as separate sequences
+    uint32_t unsharedBlocks() const {
+        uint32_t longest = 0;
+        for (const CandidateOutput& c : finished) {
+            longest = std::max<uint32_t>(longest, (uint32_t)c.tokens.size());
+        }
+        return width * ((prompt_tokens + longest + block_tokens - 1) / block_tokens);
+    }
+};
+
+struct CandidateStats {
+    uint64_t runs;
+    uint64_t candidates;
+    uint64_t steps;
+    uint64_t tokens;
+    uint64_t prefill_tokens_saved;
+    double prefill_us_saved;        // Perf model, prefills not repeated per candidate
+    uint64_t forks;
+    uint64_t block_copies;
+    uint64_t peak_blocks;           // Sum over runs
+    uint64_t unshared_blocks;
+    double ns_total;                // Host work per step
+    double ns_max;
+
+    CandidateStats() : runs(0), candidates(0), steps(0), tokens(0), prefill_tokens_saved(0),
+                       prefill_us_saved(0), forks(0), block_copies(0), peak_blocks(0),
+                       unshared_blocks(0), ns_total(0), ns_max(0) {}
+
+    void step(double ns) {
+        steps++;
+        ns_total += ns;
+        if (ns > ns_max) ns_max = ns;
+    }
+
+    void finished(const CandidateGroup& group, double prefill_us) {
+        runs++;
+        candidates += group.getWidth();
+        tokens += group.generated();
+        prefill_tokens_saved += (uint64_t)(group.getWidth() - 1) * group.getPromptTokens();
+        prefill_us_saved += (group.getWidth() - 1) * prefill_us;
+        forks += group.getForks();
+        block_copies += group.getBlockCopies();
+        peak_blocks += group.peakBlocks();
+        unshared_blocks += group.unsharedBlocks();
+    }
+
+    void printStats() const {
+        printf("\n[Candidates] Beam search and parallel sampling:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Runs:              %lu (%lu candidates)\n",
+               (unsigned long)runs, (unsigned long)candidates);
+        printf("Steps:             %lu (%lu tokens over all rows)\n",
+               (unsigned long)steps, (unsigned long)tokens);
+        printf("Prefill saved:     %lu tokens, %.1f ms modelled\n",
+               (unsigned long)prefill_tokens_saved, prefill_us_saved / 1000.0);
+        printf("Forks:             %lu (%lu partial blocks copied)\n",
+               (unsigned long)forks, (unsigned long)block_copies);
+        printf("KV blocks:         %lu peak vs %lu unshared\n",
+               (unsigned long)peak_blocks, (unsigned long)unshared_blocks);
+        printf("Host per step:     %.0f ns mean, %.0f ns max\n",
+               steps ? ns_total / steps : 0.0, ns_max);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // CANDIDATE_SEARCH_HPP
@@ -0,0 +1,135 @@
+// capacity_planner.hpp
+// Decides at startup how many concurrent sequences (batch slots) and how
+// much context fit in the KV cache region for the model about to be
+// loaded, and checks the weight image against its region.
+//
+// The KV region is carved into fixed-size blocks of KV_BLOCK_TOKENS
+// positions (K and V for every layer). Each slot reserves enough blocks
+// for its full context, laid out contiguously so the kernel still sees
+// one linear KV buffer per sequence.
+
+#ifndef CAPACITY_PLANNER_HPP
+#define CAPACITY_PLANNER_HPP
+
+#include "perf_model.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+struct CapacityPlan {
+    bool weights_fit;
+    size_t weight_bytes;            // Estimated DDR image
+    size_t weight_region;
+    size_t kv_region;
+
+    uint64_t kv_bytes_per_token;
+    uint32_t block_tokens;
+    uint64_t block_bytes;
+    uint32_t total_blocks;
+
+    uint32_t context_tokens;        // Per slot, multiple of block_tokens
+    uint32_t blocks_per_slot;
+    uint32_t batch_slots;
+    uint64_t slot_bytes;
+    bool context_reduced;           // Model max_seq_len did not fit
+
+    CapacityPlan() : weights_fit(false), weight_bytes(0), weight_region(0),
+                     kv_region(0), kv_bytes_per_token(0), block_tokens(0),
+                     block_bytes(0), total_blocks(0), context_tokens(0),
+                     blocks_per_slot(0), batch_slots(0), slot_bytes(0),
+                     context_reduced(false) {}
+
+    bool valid() const { return weights_fit && batch_slots > 0; }
+
+    // KV base of a slot, relative to the start of the KV region
+    uint64_t slotOffset(uint32_t slot) const {
+        return (uint64_t)slot * slot_bytes;
+    }
+
+    // Blocks n candidates (candidate_search.hpp) can hold at once: the
+    // prompt's full blocks are shared, each candidate owns the rest
+    uint32_t candidateBlocks(uint32_t prompt_tokens, uint32_t output_tokens, uint32_t n) const {
+        if (block_tokens == 0) {
+            return 0;
+        }
+        uint32_t own = (prompt_tokens % block_tokens + output_tokens + block_tokens - 1) / block_tokens;
+        return prompt_tokens / block_tokens + n * own;
+    }
+};
+
+class CapacityPlanner {
+public:
+    static const uint32_t KV_BLOCK_TOKENS = 16;
+
+    // requested_context: 0 = the model's max_seq_len. max_slots: 0 = as
+    // many as the KV region holds. The kernel takes each run's KV base
+    // from config_in, so it sets no slot limit of its own.
+    static CapacityPlan plan(const ModelShape& shape, size_t weight_bytes,
+                             size_t weight_region, size_t kv_region,
+                             uint32_t requested_context = 0, uint32_t max_slots = 0) {
+        CapacityPlan p;
+        p.weight_bytes = weight_bytes;
+        p.weight_region = weight_region;
+        p.kv_region = kv_region;
+        p.weights_fit = weight_bytes <= weight_region;
+
+        PerfModel model;
+        model.setShape(shape);
+        p.kv_bytes_per_token = model.kvBytesPerToken();
+        p.block_tokens = KV_BLOCK_TOKENS;
+        p.block_bytes = p.kv_bytes_per_token * KV_BLOCK_TOKENS;
+
+        if (p.block_bytes == 0) {
+            return p;
+        }
+        p.total_blocks = (uint32_t)(kv_region / p.block_bytes);
+
+        uint32_t context = shape.max_seq_len;
+        if (requested_context > 0 && requested_context < context) {
+            context = requested_context;
+        }
+        uint32_t blocks = (context + KV_BLOCK_TOKENS - 1) / KV_BLOCK_TOKENS;
+
+        // Shrink the context until at least one slot fits
+        if (blocks > p.total_blocks) {
+            blocks = p.total_blocks;
+            p.context_reduced = true;
+        }
+        if (blocks == 0) {
+            return p;
+        }
+
+        p.blocks_per_slot = blocks;
+        p.context_tokens = blocks * KV_BLOCK_TOKENS;
+        if (!p.context_reduced && p.context_tokens > context) {
+            p.context_tokens = context;     // Don't exceed the model's limit
+        }
+        p.slot_bytes = (uint64_t)blocks * p.block_bytes;
+
+        uint32_t slots = p.total_blocks / blocks;
+        p.batch_slots = (max_slots > 0 && slots > max_slots) ? max_slots : slots;
+        return p;
+    }
+
+    static void print(const CapacityPlan& p) {
+        printf("\n[Capacity] Memory plan:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Weights:           %.1f MB of %.1f MB region%s\n",
+               p.weight_bytes / (1024.0 * 1024.0), p.weight_region / (1024.0 * 1024.0),
+               p.weights_fit ? "" : "  ** DOES NOT FIT **");
+        printf("KV per token:      %lu bytes\n", (unsigned long)p.kv_bytes_per_token);
+        printf("KV blocks:         %u x %u tokens (%.1f KB each) in %.1f MB\n",
+               p.total_blocks, p.block_tokens, p.block_bytes / 1024.0,
+               p.kv_region / (1024.0 * 1024.0));
+        printf("Context per slot:  %u tokens (%u blocks)%s\n",
+               p.context_tokens, p.blocks_per_slot,
+               p.context_reduced ? "  ** reduced to fit KV region **" : "");
+        printf("Batch slots:       %u\n", p.batch_slots);
+        uint64_t used = (uint64_t)p.batch_slots * p.slot_bytes;
+        printf("KV used:           %.1f MB (%.1f MB spare)\n",
+               used / (1024.0 * 1024.0), (p.kv_region - used) / (1024.0 * 1024.0));
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // CAPACITY_PLANNER_HPP
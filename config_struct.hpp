@@ -4,6 +4,38 @@
 #include <cstdint>
 #include <cstring>
 
+// ConfigIn::task_type
+const uint32_t TASK_TYPE_GENERATE = 0;     // Prefill prompt_length tokens, then decode
+const uint32_t TASK_TYPE_RESUME = 1;       // KV already holds prompt_length positions;
+                                            // decode from the one input token
+const uint32_t TASK_TYPE_CONTINUE = 2;     // KV already holds kv_prefix_length positions;
+                                            // prefill prompt_length tokens after them,
+                                            // then decode (session_store.hpp)
+
+// ConfigIn::flags
+const uint32_t CONFIG_FLAG_HOST_EMBED = 0x1;   // input_buffer_addr holds prompt_length FP16
+                                                // rows (token + position embedding) instead
+                                                // of token ids; the kernel skips its lookup
+const uint32_t CONFIG_FLAG_SPLIT_LM_HEAD = 0x2; // Kernel scores lm_head rows [0, lm_head_rows)
+                                                // only and writes its top-k, logsumexp and the
+                                                // final hidden state to the output buffer; the
+                                                // host scores the rest (lm_head_topk.hpp)
+const uint32_t CONFIG_FLAG_TOKEN_MASK = 0x4;    // Sample only tokens whose bit is set in the
+                                                // vocab_size + 1 bit mask at token_mask_addr
+                                                // (last bit = EOS); the host rewrites it
+                                                // before each step's lm_head
+const uint32_t CONFIG_FLAG_KV_BLOCK_TABLE = 0x8; // Sequences address KV through a block table
+                                                // at kv_block_table_addr: row r's position p
+                                                // is in block table[r * stride + p / block
+                                                // tokens] of kv_cache_addr. The table is
+                                                // followed by block copies to do first
+const uint32_t CONFIG_FLAG_CANDIDATES = 0x10;   // batch_size rows decode together from one
+                                                // prefill into row 0. Each step reads row r's
+                                                // input token from input word r (EOS = row
+                                                // idle, all idle ends the run) and writes
+                                                // every row's sample and top-k to the output
+                                                // buffer (candidate_search.hpp)
+
 // ConfigIn: 1216 bits total = 38 x 32-bit words
 // todo logical structure here based on what HLS expects
 struct ConfigIn {
@@ -31,9 +63,16 @@ struct ConfigIn {
     uint32_t task_id;               // bits 480-511
     uint32_t task_type;             // bits 512-543
     uint32_t flags;                 // bits 544-575
+    uint32_t sample_offset;         // bits 576-607, sampler steps already taken
+    uint32_t lm_head_rows;          // bits 608-639, with CONFIG_FLAG_SPLIT_LM_HEAD
+    uint64_t token_mask_addr;       // bits 640-703, with CONFIG_FLAG_TOKEN_MASK
+    uint64_t kv_block_table_addr;   // bits 704-767, with CONFIG_FLAG_KV_BLOCK_TABLE
+    uint32_t kv_block_tokens;       // bits 768-799, positions per KV block
+    uint32_t kv_block_table_stride; // bits 800-831, table entries per row
+    uint32_t kv_prefix_length;      // bits 832-863, with TASK_TYPE_CONTINUE
     
     // Reserved/padding to reach 1216 bits
-    uint32_t reserved[20];          // bits 576-1215 (640 bits)
+    uint32_t reserved[11];          // bits 864-1215 (352 bits)
     
     ConfigIn() {
         memset(this, 0, sizeof(ConfigIn));
@@ -59,6 +98,8 @@ struct ConfigIn {
     }
 };
 
+static_assert(sizeof(ConfigIn) == 38 * sizeof(uint32_t), "config_in must stay 1216 bits");
+
 // StatusOut: 128 bits = 4 x 32-bit words
 struct StatusOut {
     //  todo adjust based on actual HLS design
@@ -82,8 +123,11 @@ struct StatusOut {
     }
     
     // Pack to words (for simulation)
-    void pack_to_words() {
-        // Helper for simulation
+    void pack_to_words(uint32_t words[4]) const {
+        words[0] = current_token;
+        words[1] = tokens_generated;
+        words[2] = error_code;
+        words[3] = flags;
     }
 };
 
@@ -0,0 +1,1225 @@
+// constrained_decoding.hpp
+// Grammar-constrained generation. A regex, or a JSON schema lowered to
+// one, is compiled once into a byte-level DFA and then into a token-level
+// automaton over the tokenizer vocabulary: for every DFA state, the
+// bitmask of tokens whose text keeps the match alive. Bit vocab_size of
+// each mask is end of sequence, set in accepting states. Identical masks
+// are stored once.
+//
+// Per token the engine only advances the state over the sampled token's
+// bytes and hands the next state's mask to the kernel
+// (CONFIG_FLAG_TOKEN_MASK) and to the host lm_head shards, which clear
+// disallowed logits with the vector mask in cpu_kernels.hpp before top-k.
+//
+// Regex subset, always anchored at both ends: literals, ., [...] and
+// [^...] with ranges, \d \w \s and their negations, \n \r \t \xHH and
+// escaped metacharacters, ( ) and (?: ), |, * + ?, {n} {n,} {n,m}.
+//
+// JSON schema subset (output is compact JSON): type string (minLength,
+// maxLength, pattern), integer, number, boolean, null, array (items,
+// minItems, maxItems), object (every property in schema order), enum,
+// const, anyOf / oneOf. $ref is not supported.
+//
+// Compiled constraints are immutable and shared between tasks through
+// ConstraintCache.
+
+#ifndef CONSTRAINED_DECODING_HPP
+#define CONSTRAINED_DECODING_HPP
+
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ConstraintType {
+    REGEX,
+    JSON_SCHEMA
+};
+
+inline const char* constraintTypeName(ConstraintType type) {
+    return type == ConstraintType::REGEX ? "regex" : "json-schema";
+}
+
+typedef std::bitset<256> ByteSet;
+
+// Regex syntax tree
+struct RegexNode {
+    enum Kind { EMPTY, BYTES, CONCAT, ALT, REPEAT };
+    static const uint32_t UNBOUNDED = 0xFFFFFFFF;
+
+    Kind kind;
+    ByteSet bytes;                      // BYTES
+    std::vector<RegexNode> children;    // CONCAT, ALT; REPEAT has one
+    uint32_t min;
+    uint32_t max;
+
+    explicit RegexNode(Kind k = EMPTY) : kind(k), min(0), max(0) {}
+};
+
+class RegexParser {
+public:
+    // Bounded repeats are expanded; larger counts are rejected
+    static const uint32_t MAX_REPEAT = 256;
+
+    static bool parse(const std::string& pattern, RegexNode& root, std::string& error) {
+        RegexParser p(pattern);
+        if (!p.parseAlt(root, 0)) {
+            error = p.error;
+            return false;
+        }
+        if (p.pos != pattern.size()) {
+            error = "unbalanced ')' at offset " + std::to_string(p.pos);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static const int MAX_DEPTH = 64;
+
+    const std::string& s;
+    size_t pos;
+    std::string error;
+
+    explicit RegexParser(const std::string& pattern) : s(pattern), pos(0) {}
+
+    bool fail(const std::string& what) {
+        error = what + " at offset " + std::to_string(pos);
+        return false;
+    }
+
+    bool atEnd() const { return pos >= s.size(); }
+
+    static ByteSet range(uint8_t lo, uint8_t hi) {
+        ByteSet set;
+        for (uint32_t c = lo; c <= hi; c++) set.set(c);
+        return set;
+    }
+
+    static ByteSet wordBytes() {
+        ByteSet set = range('a', 'z') | range('A', 'Z') | range('0', '9');
+        set.set('_');
+        return set;
+    }
+
+    static ByteSet spaceBytes() {
+        ByteSet set;
+        for (char c : std::string(" \t\n\r\f\v")) set.set((uint8_t)c);
+        return set;
+    }
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // After a backslash; class escapes yield a set, the rest one byte
+    bool parseEscape(ByteSet& set) {
+        if (atEnd()) {
+            return fail("trailing backslash");
+        }
+        char c = s[pos++];
+        switch (c) {
+            case 'd': set = range('0', '9'); return true;
+            case 'D': set = ~range('0', '9'); return true;
+            case 'w': set = wordBytes(); return true;
+            case 'W': set = ~wordBytes(); return true;
+            case 's': set = spaceBytes(); return true;
+            case 'S': set = ~spaceBytes(); return true;
+            case 'n': set.reset(); set.set('\n'); return true;
+            case 'r': set.reset(); set.set('\r'); return true;
+            case 't': set.reset(); set.set('\t'); return true;
+            case 'f': set.reset(); set.set('\f'); return true;
+            case 'v': set.reset(); set.set('\v'); return true;
+            case 'x': {
+                if (pos + 2 > s.size() || hexValue(s[pos]) < 0 || hexValue(s[pos + 1]) < 0) {
+                    return fail("bad \\x escape");
+                }
+                set.reset();
+                set.set((uint8_t)(hexValue(s[pos]) * 16 + hexValue(s[pos + 1])));
+                pos += 2;
+                return true;
+            }
+            default:
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+                    return fail(std::string("unsupported escape \\") + c);
+                }
+                set.reset();
+                set.set((uint8_t)c);
+                return true;
+        }
+    }
+
+    bool parseClass(ByteSet& set) {
+        bool negate = !atEnd() && s[pos] == '^';
+        if (negate) pos++;
+        set.reset();
+        bool first = true;
+        while (!atEnd() && (s[pos] != ']' || first)) {
+            first = false;
+            ByteSet item;
+            bool single = true;
+            uint8_t lo = (uint8_t)s[pos];
+            if (s[pos++] == '\\') {
+                if (!parseEscape(item)) return false;
+                single = item.count() == 1;
+                if (single) {
+                    for (uint32_t c = 0; c < 256; c++) {
+                        if (item.test(c)) lo = (uint8_t)c;
+                    }
+                }
+            } else {
+                item.set(lo);
+            }
+
+            // a-z; a '-' before ']' is literal
+            if (single && pos + 1 < s.size() && s[pos] == '-' && s[pos + 1] != ']') {
+                pos++;
+                uint8_t hi = (uint8_t)s[pos];
+                if (s[pos++] == '\\') {
+                    ByteSet end;
+                    if (!parseEscape(end)) return false;
+                    if (end.count() != 1) return fail("class escape as range end");
+                    for (uint32_t c = 0; c < 256; c++) {
+                        if (end.test(c)) hi = (uint8_t)c;
+                    }
+                }
+                if (hi < lo) return fail("reversed range in class");
+                item = range(lo, hi);
+            }
+            set |= item;
+        }
+        if (atEnd()) {
+            return fail("unterminated [");
+        }
+        pos++;  // ']'
+        if (negate) set = ~set;
+        return true;
+    }
+
+    bool parseCount(uint32_t& value) {
+        if (atEnd() || s[pos] < '0' || s[pos] > '9') {
+            return fail("expected repeat count");
+        }
+        uint64_t v = 0;
+        while (!atEnd() && s[pos] >= '0' && s[pos] <= '9') {
+            v = v * 10 + (uint32_t)(s[pos++] - '0');
+            if (v > MAX_REPEAT) return fail("repeat count over " + std::to_string(MAX_REPEAT));
+        }
+        value = (uint32_t)v;
+        return true;
+    }
+
+    bool parseAtom(RegexNode& node, int depth) {
+        char c = s[pos++];
+        switch (c) {
+            case '(': {
+                if (s.compare(pos, 2, "?:") == 0) pos += 2;
+                if (!parseAlt(node, depth + 1)) return false;
+                if (atEnd() || s[pos] != ')') return fail("unterminated (");
+                pos++;
+                return true;
+            }
+            case '[':
+                node = RegexNode(RegexNode::BYTES);
+                return parseClass(node.bytes);
+            case '.':
+                node = RegexNode(RegexNode::BYTES);
+                node.bytes.set();
+                node.bytes.reset('\n');
+                return true;
+            case '\\':
+                node = RegexNode(RegexNode::BYTES);
+                return parseEscape(node.bytes);
+            case '^':
+            case '$':
+                return fail("anchors are implicit");
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                return fail(std::string("nothing to repeat before '") + c + "'");
+            default:
+                node = RegexNode(RegexNode::BYTES);
+                node.bytes.set((uint8_t)c);
+                return true;
+        }
+    }
+
+    bool parseRepeat(RegexNode& node, int depth) {
+        RegexNode atom;
+        if (!parseAtom(atom, depth)) return false;
+
+        while (!atEnd() && (s[pos] == '*' || s[pos] == '+' || s[pos] == '?' || s[pos] == '{')) {
+            uint32_t lo = 0, hi = RegexNode::UNBOUNDED;
+            char q = s[pos++];
+            if (q == '+') {
+                lo = 1;
+            } else if (q == '?') {
+                hi = 1;
+            } else if (q == '{') {
+                if (!parseCount(lo)) return false;
+                hi = lo;
+                if (!atEnd() && s[pos] == ',') {
+                    pos++;
+                    hi = RegexNode::UNBOUNDED;
+                    if (!atEnd() && s[pos] != '}' && !parseCount(hi)) return false;
+                }
+                if (atEnd() || s[pos] != '}') return fail("unterminated {");
+                pos++;
+                if (hi < lo) return fail("repeat max below min");
+            }
+            RegexNode rep(RegexNode::REPEAT);
+            rep.min = lo;
+            rep.max = hi;
+            rep.children.push_back(std::move(atom));
+            atom = std::move(rep);
+        }
+        node = std::move(atom);
+        return true;
+    }
+
+    bool parseConcat(RegexNode& node, int depth) {
+        node = RegexNode(RegexNode::CONCAT);
+        while (!atEnd() && s[pos] != '|' && s[pos] != ')') {
+            RegexNode item;
+            if (!parseRepeat(item, depth)) return false;
+            node.children.push_back(std::move(item));
+        }
+        return true;
+    }
+
+    bool parseAlt(RegexNode& node, int depth) {
+        if (depth > MAX_DEPTH) {
+            return fail("nesting too deep");
+        }
+        RegexNode first;
+        if (!parseConcat(first, depth)) return false;
+        if (atEnd() || s[pos] != '|') {
+            node = std::move(first);
+            return true;
+        }
+        node = RegexNode(RegexNode::ALT);
+        node.children.push_back(std::move(first));
+        while (!atEnd() && s[pos] == '|') {
+            pos++;
+            RegexNode branch;
+            if (!parseConcat(branch, depth)) return false;
+            node.children.push_back(std::move(branch));
+        }
+        return true;
+    }
+};
+
+// Byte-level DFA over the full match. Transitions into states that can
+// no longer reach an accepting state are DEAD.
+class ByteDfa {
+public:
+    static constexpr int32_t DEAD = -1;
+    static const uint32_t MAX_STATES = 4096;
+
+    std::vector<int32_t> next;      // state * 256 + byte
+    std::vector<bool> accepting;
+    uint32_t start;
+
+    ByteDfa() : start(0) {}
+
+    uint32_t numStates() const { return (uint32_t)accepting.size(); }
+
+    int32_t step(uint32_t state, uint8_t byte) const { return next[(size_t)state * 256 + byte]; }
+
+    // Thompson NFA, then subset construction and pruning of dead states
+    bool build(const RegexNode& root, std::string& error) {
+        Nfa nfa;
+        Nfa::Fragment f = nfa.add(root);
+        uint32_t accept = f.end;
+
+        std::map<std::vector<uint32_t>, uint32_t> ids;
+        std::vector<std::vector<uint32_t>> sets;
+        next.clear();
+        accepting.clear();
+
+        std::vector<uint32_t> first = nfa.closure(std::vector<uint32_t>(1, f.start));
+        ids[first] = 0;
+        sets.push_back(first);
+
+        for (uint32_t d = 0; d < sets.size(); d++) {
+            accepting.push_back(std::binary_search(sets[d].begin(), sets[d].end(), accept));
+            next.resize(sets.size() * 256, DEAD);
+
+            // Group bytes by the NFA states they lead to
+            std::map<std::vector<uint32_t>, std::vector<uint32_t>> targets;
+            for (uint32_t b = 0; b < 256; b++) {
+                std::vector<uint32_t> moved;
+                for (uint32_t n : sets[d]) {
+                    if (nfa.states[n].on.test(b)) moved.push_back(nfa.states[n].out);
+                }
+                if (!moved.empty()) {
+                    targets[nfa.closure(moved)].push_back(b);
+                }
+            }
+            for (auto& t : targets) {
+                auto it = ids.find(t.first);
+                uint32_t id;
+                if (it == ids.end()) {
+                    if (sets.size() >= MAX_STATES) {
+                        error = "grammar needs over " + std::to_string(MAX_STATES) + " DFA states";
+                        return false;
+                    }
+                    id = (uint32_t)sets.size();
+                    ids[t.first] = id;
+                    sets.push_back(t.first);
+                    next.resize(sets.size() * 256, DEAD);
+                } else {
+                    id = it->second;
+                }
+                for (uint32_t b : t.second) {
+                    next[(size_t)d * 256 + b] = (int32_t)id;
+                }
+            }
+        }
+        start = 0;
+        return prune(error);
+    }
+
+private:
+    struct Nfa {
+        struct State {
+            ByteSet on;                 // Bytes that move to out
+            uint32_t out;
+            std::vector<uint32_t> eps;
+        };
+        struct Fragment {
+            uint32_t start;
+            uint32_t end;               // Epsilon-only, nothing leaves it yet
+        };
+
+        std::vector<State> states;
+
+        uint32_t state() {
+            states.push_back(State());
+            states.back().out = 0;
+            return (uint32_t)states.size() - 1;
+        }
+
+        void link(uint32_t from, uint32_t to) { states[from].eps.push_back(to); }
+
+        Fragment add(const RegexNode& node) {
+            switch (node.kind) {
+                case RegexNode::BYTES: {
+                    uint32_t s = state();
+                    uint32_t e = state();
+                    states[s].on = node.bytes;
+                    states[s].out = e;
+                    return Fragment{s, e};
+                }
+                case RegexNode::CONCAT: {
+                    uint32_t s = state();
+                    Fragment f{s, s};
+                    for (const RegexNode& c : node.children) {
+                        Fragment g = add(c);
+                        link(f.end, g.start);
+                        f.end = g.end;
+                    }
+                    return f;
+                }
+                case RegexNode::ALT: {
+                    uint32_t s = state();
+                    uint32_t e = state();
+                    for (const RegexNode& c : node.children) {
+                        Fragment g = add(c);
+                        link(s, g.start);
+                        link(g.end, e);
+                    }
+                    return Fragment{s, e};
+                }
+                case RegexNode::REPEAT: {
+                    const RegexNode& child = node.children[0];
+                    uint32_t s = state();
+                    Fragment f{s, s};
+                    for (uint32_t i = 0; i < node.min; i++) {
+                        Fragment g = add(child);
+                        link(f.end, g.start);
+                        f.end = g.end;
+                    }
+                    uint32_t e = state();
+                    if (node.max == RegexNode::UNBOUNDED) {
+                        Fragment g = add(child);
+                        link(f.end, g.start);
+                        link(f.end, e);
+                        link(g.end, f.end);
+                    } else {
+                        // Each optional copy may skip straight to the end
+                        for (uint32_t i = node.min; i < node.max; i++) {
+                            Fragment g = add(child);
+                            link(f.end, g.start);
+                            link(f.end, e);
+                            f.end = g.end;
+                        }
+                        link(f.end, e);
+                    }
+                    f.end = e;
+                    return f;
+                }
+                default: {
+                    uint32_t s = state();
+                    return Fragment{s, s};
+                }
+            }
+        }
+
+        // Sorted epsilon closure
+        std::vector<uint32_t> closure(const std::vector<uint32_t>& from) const {
+            std::vector<bool> seen(states.size(), false);
+            std::vector<uint32_t> stack(from);
+            std::vector<uint32_t> out;
+            while (!stack.empty()) {
+                uint32_t n = stack.back();
+                stack.pop_back();
+                if (seen[n]) continue;
+                seen[n] = true;
+                out.push_back(n);
+                for (uint32_t e : states[n].eps) stack.push_back(e);
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        }
+    };
+
+    bool prune(std::string& error) {
+        uint32_t n = numStates();
+        std::vector<bool> live(accepting);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (uint32_t d = 0; d < n; d++) {
+                if (live[d]) continue;
+                for (uint32_t b = 0; b < 256 && !live[d]; b++) {
+                    int32_t t = next[(size_t)d * 256 + b];
+                    if (t != DEAD && live[t]) {
+                        live[d] = true;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        if (!live[start]) {
+            error = "grammar matches nothing";
+            return false;
+        }
+        for (int32_t& t : next) {
+            if (t != DEAD && !live[t]) t = DEAD;
+        }
+        return true;
+    }
+};
+
+// Minimal JSON reader for schemas; objects keep their key order
+struct JsonValue {
+    enum Kind { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    Kind kind;
+    bool boolean;
+    double number;
+    std::string text;                   // STRING decoded; NUMBER as written
+    std::vector<JsonValue> items;       // ARRAY, and OBJECT values
+    std::vector<std::string> keys;      // OBJECT
+
+    JsonValue() : kind(NUL), boolean(false), number(0) {}
+
+    const JsonValue* get(const std::string& key) const {
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == key) return &items[i];
+        }
+        return nullptr;
+    }
+
+    static bool parse(const std::string& text, JsonValue& out, std::string& error) {
+        size_t pos = 0;
+        if (!parseValue(text, pos, out, error, 0)) {
+            return false;
+        }
+        skipSpace(text, pos);
+        if (pos != text.size()) {
+            error = "trailing characters after JSON at offset " + std::to_string(pos);
+            return false;
+        }
+        return true;
+    }
+
+    // Compact JSON text of this value
+    std::string serialize() const {
+        switch (kind) {
+            case NUL:    return "null";
+            case BOOL:   return boolean ? "true" : "false";
+            case NUMBER: return text;
+            case STRING: return quote(text);
+            case ARRAY: {
+                std::string out = "[";
+                for (size_t i = 0; i < items.size(); i++) {
+                    if (i) out += ",";
+                    out += items[i].serialize();
+                }
+                return out + "]";
+            }
+            case OBJECT: {
+                std::string out = "{";
+                for (size_t i = 0; i < items.size(); i++) {
+                    if (i) out += ",";
+                    out += quote(keys[i]) + ":" + items[i].serialize();
+                }
+                return out + "}";
+            }
+        }
+        return "null";
+    }
+
+    static std::string quote(const std::string& s) {
+        std::string out = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if ((uint8_t)c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)(uint8_t)c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+
+private:
+    static const int MAX_DEPTH = 64;
+
+    static void skipSpace(const std::string& s, size_t& pos) {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    static bool fail(std::string& error, const char* what, size_t pos) {
+        error = std::string(what) + " at offset " + std::to_string(pos);
+        return false;
+    }
+
+    static bool parseString(const std::string& s, size_t& pos, std::string& out, std::string& error) {
+        pos++;  // '"'
+        out.clear();
+        while (pos < s.size() && s[pos] != '"') {
+            char c = s[pos++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= s.size()) break;
+            char e = s[pos++];
+            switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    // Only the ASCII range; the tokenizer has no other characters
+                    if (pos + 4 > s.size()) return fail(error, "bad \\u escape", pos);
+                    uint32_t v = (uint32_t)strtoul(s.substr(pos, 4).c_str(), nullptr, 16);
+                    if (v > 0x7F) return fail(error, "non-ASCII \\u escape", pos);
+                    out += (char)v;
+                    pos += 4;
+                    break;
+                }
+                default: out += e; break;
+            }
+        }
+        if (pos >= s.size()) {
+            return fail(error, "unterminated string", pos);
+        }
+        pos++;
+        return true;
+    }
+
+    static bool parseValue(const std::string& s, size_t& pos, JsonValue& out, std::string& error,
+                           int depth) {
+        if (depth > MAX_DEPTH) {
+            return fail(error, "JSON nesting too deep", pos);
+        }
+        skipSpace(s, pos);
+        if (pos >= s.size()) {
+            return fail(error, "unexpected end of JSON", pos);
+        }
+        out = JsonValue();
+        char c = s[pos];
+        if (c == '{' || c == '[') {
+            bool object = c == '{';
+            out.kind = object ? OBJECT : ARRAY;
+            pos++;
+            skipSpace(s, pos);
+            if (pos < s.size() && s[pos] == (object ? '}' : ']')) {
+                pos++;
+                return true;
+            }
+            while (true) {
+                if (object) {
+                    skipSpace(s, pos);
+                    if (pos >= s.size() || s[pos] != '"') return fail(error, "expected key", pos);
+                    std::string key;
+                    if (!parseString(s, pos, key, error)) return false;
+                    skipSpace(s, pos);
+                    if (pos >= s.size() || s[pos] != ':') return fail(error, "expected ':'", pos);
+                    pos++;
+                    out.keys.push_back(key);
+                }
+                JsonValue item;
+                if (!parseValue(s, pos, item, error, depth + 1)) return false;
+                out.items.push_back(std::move(item));
+                skipSpace(s, pos);
+                if (pos < s.size() && s[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                if (pos < s.size() && s[pos] == (object ? '}' : ']')) {
+                    pos++;
+                    return true;
+                }
+                return fail(error, object ? "expected ',' or '}'" : "expected ',' or ']'", pos);
+            }
+        }
+        if (c == '"') {
+            out.kind = STRING;
+            return parseString(s, pos, out.text, error);
+        }
+        if (s.compare(pos, 4, "true") == 0 || s.compare(pos, 5, "false") == 0) {
+            out.kind = BOOL;
+            out.boolean = s[pos] == 't';
+            pos += out.boolean ? 4 : 5;
+            return true;
+        }
+        if (s.compare(pos, 4, "null") == 0) {
+            pos += 4;
+            return true;
+        }
+        size_t begin = pos;
+        while (pos < s.size() && (strchr("+-.eE", s[pos]) || (s[pos] >= '0' && s[pos] <= '9'))) {
+            pos++;
+        }
+        if (pos == begin) {
+            return fail(error, "unexpected character", pos);
+        }
+        out.kind = NUMBER;
+        out.text = s.substr(begin, pos - begin);
+        out.number = strtod(out.text.c_str(), nullptr);
+        return true;
+    }
+};
+
+// Lowers the JSON schema subset above to an anchored regex
+class JsonSchemaRegex {
+public:
+    static bool build(const std::string& schema_text, std::string& regex, std::string& error) {
+        JsonValue schema;
+        if (!JsonValue::parse(schema_text, schema, error)) {
+            error = "schema: " + error;
+            return false;
+        }
+        regex.clear();
+        return schemaRegex(schema, regex, error, 0);
+    }
+
+    // Matches exactly text
+    static std::string literal(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            uint8_t b = (uint8_t)c;
+            if (b < 0x20 || b >= 0x7F) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\x%02x", (unsigned)b);
+                out += buf;
+            } else {
+                if (strchr("\\.^$|?*+()[]{}", c)) out += '\\';
+                out += c;
+            }
+        }
+        return out;
+    }
+
+private:
+    static const int MAX_DEPTH = 32;
+
+    // One character of a JSON string body
+    static std::string stringChar() {
+        return "(?:[^\"\\\\\\x00-\\x1f]|\\\\[\"\\\\/bfnrt])";
+    }
+
+    static bool count(const JsonValue& schema, const char* key, uint32_t& value) {
+        const JsonValue* v = schema.get(key);
+        if (!v || v->kind != JsonValue::NUMBER || v->number < 0) {
+            return false;
+        }
+        value = v->number > RegexParser::MAX_REPEAT ? RegexParser::MAX_REPEAT + 1 : (uint32_t)v->number;
+        return true;
+    }
+
+    static std::string repeat(uint32_t lo, uint32_t hi, bool bounded) {
+        if (!bounded) {
+            return lo == 0 ? "*" : "{" + std::to_string(lo) + ",}";
+        }
+        return "{" + std::to_string(lo) + "," + std::to_string(hi) + "}";
+    }
+
+    static bool alternatives(const JsonValue& list, std::string& out, std::string& error, int depth) {
+        if (list.kind != JsonValue::ARRAY || list.items.empty()) {
+            error = "anyOf/oneOf needs a non-empty array";
+            return false;
+        }
+        out += "(?:";
+        for (size_t i = 0; i < list.items.size(); i++) {
+            if (i) out += "|";
+            if (!schemaRegex(list.items[i], out, error, depth + 1)) return false;
+        }
+        out += ")";
+        return true;
+    }
+
+    static bool typeRegex(const JsonValue& schema, const std::string& type, std::string& out,
+                          std::string& error, int depth) {
+        if (type == "null") {
+            out += "null";
+        } else if (type == "boolean") {
+            out += "(?:true|false)";
+        } else if (type == "integer") {
+            out += "-?(?:0|[1-9][0-9]*)";
+        } else if (type == "number") {
+            out += "-?(?:0|[1-9][0-9]*)(?:\\.[0-9]+)?(?:[eE][+-]?[0-9]+)?";
+        } else if (type == "string") {
+            const JsonValue* pattern = schema.get("pattern");
+            if (pattern && pattern->kind == JsonValue::STRING) {
+                // Matched against the raw string body; anchors are implicit
+                std::string p = pattern->text;
+                if (!p.empty() && p[0] == '^') p.erase(0, 1);
+                if (!p.empty() && p.back() == '$' && (p.size() < 2 || p[p.size() - 2] != '\\')) {
+                    p.pop_back();
+                }
+                out += "\"(?:" + p + ")\"";
+                return true;
+            }
+            uint32_t lo = 0, hi = 0;
+            count(schema, "minLength", lo);
+            bool bounded = count(schema, "maxLength", hi);
+            if (lo > RegexParser::MAX_REPEAT || (bounded && (hi > RegexParser::MAX_REPEAT || hi < lo))) {
+                error = "string length bounds out of range";
+                return false;
+            }
+            out += "\"" + stringChar() + repeat(lo, hi, bounded) + "\"";
+        } else if (type == "array") {
+            const JsonValue* items = schema.get("items");
+            if (!items || items->kind != JsonValue::OBJECT) {
+                error = "array schema needs an items schema";
+                return false;
+            }
+            std::string item;
+            if (!schemaRegex(*items, item, error, depth + 1)) return false;
+            uint32_t lo = 0, hi = 0;
+            count(schema, "minItems", lo);
+            bool bounded = count(schema, "maxItems", hi);
+            if (lo > RegexParser::MAX_REPEAT || (bounded && (hi > RegexParser::MAX_REPEAT || hi < lo))) {
+                error = "array length bounds out of range";
+                return false;
+            }
+            out += "\\[";
+            if (!bounded || hi > 0) {
+                // First item, then comma-separated rest
+                std::string rest = "(?:," + item + ")" +
+                                   repeat(lo > 0 ? lo - 1 : 0, hi > 0 ? hi - 1 : 0, bounded);
+                out += lo == 0 ? "(?:" + item + rest + ")?" : item + rest;
+            }
+            out += "\\]";
+        } else if (type == "object") {
+            const JsonValue* props = schema.get("properties");
+            if (!props || props->kind != JsonValue::OBJECT) {
+                error = "object schema needs properties";
+                return false;
+            }
+            out += "\\{";
+            for (size_t i = 0; i < props->keys.size(); i++) {
+                if (i) out += ",";
+                out += literal(JsonValue::quote(props->keys[i])) + ":";
+                if (!schemaRegex(props->items[i], out, error, depth + 1)) return false;
+            }
+            out += "\\}";
+        } else {
+            error = "unsupported type \"" + type + "\"";
+            return false;
+        }
+        return true;
+    }
+
+    static bool schemaRegex(const JsonValue& schema, std::string& out, std::string& error, int depth) {
+        if (depth > MAX_DEPTH) {
+            error = "schema nesting too deep";
+            return false;
+        }
+        if (schema.kind != JsonValue::OBJECT) {
+            error = "schema must be an object";
+            return false;
+        }
+        if (schema.get("$ref")) {
+            error = "$ref is not supported";
+            return false;
+        }
+        if (const JsonValue* c = schema.get("const")) {
+            out += literal(c->serialize());
+            return true;
+        }
+        if (const JsonValue* e = schema.get("enum")) {
+            if (e->kind != JsonValue::ARRAY || e->items.empty()) {
+                error = "enum needs a non-empty array";
+                return false;
+            }
+            out += "(?:";
+            for (size_t i = 0; i < e->items.size(); i++) {
+                if (i) out += "|";
+                out += literal(e->items[i].serialize());
+            }
+            out += ")";
+            return true;
+        }
+        if (const JsonValue* any = schema.get("anyOf")) {
+            return alternatives(*any, out, error, depth);
+        }
+        if (const JsonValue* one = schema.get("oneOf")) {
+            return alternatives(*one, out, error, depth);
+        }
+
+        const JsonValue* type = schema.get("type");
+        if (!type) {
+            if (schema.get("properties")) return typeRegex(schema, "object", out, error, depth);
+            if (schema.get("items")) return typeRegex(schema, "array", out, error, depth);
+            error = "schema without type";
+            return false;
+        }
+        if (type->kind == JsonValue::STRING) {
+            return typeRegex(schema, type->text, out, error, depth);
+        }
+        if (type->kind == JsonValue::ARRAY && !type->items.empty()) {
+            out += "(?:";
+            for (size_t i = 0; i < type->items.size(); i++) {
+                if (i) out += "|";
+                if (type->items[i].kind != JsonValue::STRING ||
+                    !typeRegex(schema, type->items[i].text, out, error, depth)) {
+                    if (error.empty()) error = "bad type list";
+                    return false;
+                }
+            }
+            out += ")";
+            return true;
+        }
+        error = "bad type";
+        return false;
+    }
+};
+
+// Text of every token id as the detokenizer emits it, in a byte trie
+// so one walk per DFA state covers tokens that share prefixes. Tokens
+// with no text are never allowed.
+class TokenVocabulary {
+public:
+    struct TrieNode {
+        std::vector<std::pair<uint8_t, uint32_t>> children;
+        std::vector<uint32_t> tokens;   // Ending here
+    };
+
+    explicit TokenVocabulary(const std::vector<std::string>& token_pieces)
+        : pieces(token_pieces), trie(1) {
+        for (uint32_t t = 0; t < pieces.size(); t++) {
+            if (pieces[t].empty()) continue;
+            uint32_t node = 0;
+            for (char c : pieces[t]) {
+                uint32_t child = 0;
+                for (auto& edge : trie[node].children) {
+                    if (edge.first == (uint8_t)c) child = edge.second;
+                }
+                if (child == 0) {
+                    child = (uint32_t)trie.size();
+                    trie[node].children.push_back(std::make_pair((uint8_t)c, child));
+                    trie.push_back(TrieNode());
+                }
+                node = child;
+            }
+            trie[node].tokens.push_back(t);
+        }
+    }
+
+    uint32_t size() const { return (uint32_t)pieces.size(); }
+    const std::string& piece(uint32_t token) const { return pieces[token]; }
+    const std::vector<TrieNode>& nodes() const { return trie; }
+
+private:
+    std::vector<std::string> pieces;
+    std::vector<TrieNode> trie;
+};
+
+// Compiled grammar: DFA plus one token mask per state. Immutable.
+class TokenConstraint {
+public:
+    static constexpr uint32_t DEAD = 0xFFFFFFFF;
+
+    // Null with error set if the grammar is malformed or too large
+    static std::shared_ptr<const TokenConstraint> compile(
+            ConstraintType type, const std::string& spec,
+            std::shared_ptr<const TokenVocabulary> vocabulary, std::string& error) {
+        auto start = std::chrono::steady_clock::now();
+
+        std::string regex = spec;
+        if (type == ConstraintType::JSON_SCHEMA && !JsonSchemaRegex::build(spec, regex, error)) {
+            return nullptr;
+        }
+        RegexNode root;
+        if (!RegexParser::parse(regex, root, error)) {
+            return nullptr;
+        }
+        std::shared_ptr<TokenConstraint> c(new TokenConstraint(type, spec, vocabulary));
+        if (!c->dfa.build(root, error)) {
+            return nullptr;
+        }
+        c->buildMasks();
+        c->compile_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        return c;
+    }
+
+    // Words per mask: vocab bits plus the end-of-sequence bit
+    static uint32_t maskWordsFor(uint32_t vocab_size) { return vocab_size / 64 + 1; }
+
+    ConstraintType getType() const { return type; }
+    const std::string& getSpec() const { return spec; }
+    std::string key() const { return std::string(constraintTypeName(type)) + ":" + spec; }
+
+    uint32_t start() const { return dfa.start; }
+    uint32_t vocabSize() const { return vocab; }
+    uint32_t maskWords() const { return words; }
+    uint32_t numStates() const { return dfa.numStates(); }
+    uint32_t numMasks() const { return (uint32_t)(masks.size() / words); }
+    double compileMs() const { return compile_ms; }
+
+    size_t memoryBytes() const {
+        return masks.size() * 8 + dfa.next.size() * 4 + state_mask.size() * 4;
+    }
+
+    const uint64_t* mask(uint32_t state) const {
+        return &masks[(size_t)state_mask[state] * words];
+    }
+
+    bool allowed(uint32_t state, uint32_t token) const {
+        return token < vocab && ((mask(state)[token >> 6] >> (token & 63)) & 1);
+    }
+
+    bool accepting(uint32_t state) const { return dfa.accepting[state]; }
+
+    // Accepting and nothing can follow: the output is finished
+    bool complete(uint32_t state) const { return state_complete[state]; }
+
+    // State after token's text, DEAD if the token isn't allowed
+    uint32_t advance(uint32_t state, uint32_t token) const {
+        if (!allowed(state, token)) {
+            return DEAD;
+        }
+        int32_t s = (int32_t)state;
+        for (char c : vocabulary->piece(token)) {
+            s = dfa.step((uint32_t)s, (uint8_t)c);
+        }
+        return (uint32_t)s;
+    }
+
+private:
+    ConstraintType type;
+    std::string spec;
+    std::shared_ptr<const TokenVocabulary> vocabulary;
+    ByteDfa dfa;
+    uint32_t vocab;
+    uint32_t words;
+    std::vector<uint64_t> masks;        // Distinct masks, words each
+    std::vector<uint32_t> state_mask;   // DFA state -> mask index
+    std::vector<bool> state_complete;
+    double compile_ms;
+
+    TokenConstraint(ConstraintType t, const std::string& s,
+                    std::shared_ptr<const TokenVocabulary> v)
+        : type(t), spec(s), vocabulary(v), vocab(v->size()), words(maskWordsFor(v->size())),
+          compile_ms(0) {}
+
+    // Depth-first over the trie from each state, cutting subtrees at DEAD
+    void buildMasks() {
+        const std::vector<TokenVocabulary::TrieNode>& trie = vocabulary->nodes();
+        std::map<std::vector<uint64_t>, uint32_t> distinct;
+        std::vector<uint64_t> bits(words);
+        std::vector<std::pair<uint32_t, int32_t>> stack;
+
+        state_mask.resize(numStates());
+        state_complete.resize(numStates());
+        for (uint32_t s = 0; s < numStates(); s++) {
+            std::fill(bits.begin(), bits.end(), 0);
+            bool any = false;
+            stack.assign(1, std::make_pair(0u, (int32_t)s));
+            while (!stack.empty()) {
+                uint32_t node = stack.back().first;
+                int32_t at = stack.back().second;
+                stack.pop_back();
+                for (uint32_t t : trie[node].tokens) {
+                    bits[t >> 6] |= 1ull << (t & 63);
+                    any = true;
+                }
+                for (const auto& edge : trie[node].children) {
+                    int32_t to = dfa.step((uint32_t)at, edge.first);
+                    if (to != ByteDfa::DEAD) stack.push_back(std::make_pair(edge.second, to));
+                }
+            }
+            if (dfa.accepting[s]) {
+                bits[vocab >> 6] |= 1ull << (vocab & 63);
+            }
+            state_complete[s] = dfa.accepting[s] && !any;
+
+            auto it = distinct.find(bits);
+            if (it == distinct.end()) {
+                uint32_t index = (uint32_t)(masks.size() / words);
+                distinct[bits] = index;
+                masks.insert(masks.end(), bits.begin(), bits.end());
+                state_mask[s] = index;
+            } else {
+                state_mask[s] = it->second;
+            }
+        }
+    }
+};
+
+// Compiled constraints by grammar, shared by every task that uses the
+// same one. Any thread; compiles run outside the lock.
+class ConstraintCache {
+private:
+    static const size_t DEFAULT_CAPACITY = 32;
+
+    mutable std::mutex mutex;
+    std::shared_ptr<const TokenVocabulary> vocabulary;
+    std::list<std::shared_ptr<const TokenConstraint>> lru;    // Most recent first
+    size_t capacity;
+
+    uint64_t hits;
+    uint64_t compiles;
+    uint64_t failures;
+    double compile_ms_total;
+    double compile_ms_max;
+
+public:
+    ConstraintCache() : capacity(DEFAULT_CAPACITY), hits(0), compiles(0), failures(0),
+                        compile_ms_total(0), compile_ms_max(0) {}
+
+    void setVocabulary(std::shared_ptr<const TokenVocabulary> vocab) {
+        std::lock_guard<std::mutex> lock(mutex);
+        vocabulary = vocab;
+        lru.clear();
+    }
+
+    bool ready() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return vocabulary != nullptr;
+    }
+
+    std::shared_ptr<const TokenConstraint> get(ConstraintType type, const std::string& spec,
+                                               std::string& error) {
+        std::shared_ptr<const TokenVocabulary> vocab;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto it = lru.begin(); it != lru.end(); ++it) {
+                if ((*it)->getType() == type && (*it)->getSpec() == spec) {
+                    std::shared_ptr<const TokenConstraint> found = *it;
+                    lru.splice(lru.begin(), lru, it);
+                    hits++;
+                    return found;
+                }
+            }
+            vocab = vocabulary;
+        }
+        if (!vocab) {
+            error = "no vocabulary loaded";
+            return nullptr;
+        }
+
+        std::shared_ptr<const TokenConstraint> compiled =
+            TokenConstraint::compile(type, spec, vocab, error);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!compiled) {
+            failures++;
+            return nullptr;
+        }
+        compiles++;
+        compile_ms_total += compiled->compileMs();
+        if (compiled->compileMs() > compile_ms_max) compile_ms_max = compiled->compileMs();
+        printf("[Constraint] Compiled %s: %u states, %u distinct masks, %.1f KB in %.1f ms\n",
+               constraintTypeName(type), compiled->numStates(), compiled->numMasks(),
+               compiled->memoryBytes() / 1024.0, compiled->compileMs());
+
+        lru.push_front(compiled);
+        if (lru.size() > capacity) {
+            lru.pop_back();
+        }
+        return compiled;
+    }
+
+    void printStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = 0;
+        for (const auto& c : lru) bytes += c->memoryBytes();
+        printf("Grammars:          %lu compiled (%lu rejected), %lu reused, %zu cached (%.1f KB)\n",
+               (unsigned long)compiles, (unsigned long)failures, (unsigned long)hits,
+               lru.size(), bytes / 1024.0);
+        printf("Compile time:      %.1f ms mean, %.1f ms max\n",
+               compiles ? compile_ms_total / compiles : 0.0, compile_ms_max);
+    }
+};
+
+// Engine-thread counters for constrained runs
+struct ConstraintStats {
+    uint64_t runs;
+    uint64_t tokens;
+    uint64_t completed;         // Ended because the grammar allowed nothing more
+    uint64_t violations;        // Kernel returned a token outside the mask
+    double ns_total;            // Advance + mask hand-off per token
+    double ns_max;
+
+    ConstraintStats() : runs(0), tokens(0), completed(0), violations(0), ns_total(0), ns_max(0) {}
+
+    void token(double ns) {
+        tokens++;
+        ns_total += ns;
+        if (ns > ns_max) ns_max = ns;
+    }
+
+    void printStats(const ConstraintCache& cache) const {
+        printf("\n[Constraint] Constrained decoding statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        cache.printStats();
+        printf("Runs:              %lu (%lu completed by the grammar)\n",
+               (unsigned long)runs, (unsigned long)completed);
+        printf("Tokens:            %lu (%lu outside the mask)\n",
+               (unsigned long)tokens, (unsigned long)violations);
+        printf("Per-token cost:    %.0f ns mean, %.0f ns max\n",
+               tokens ? ns_total / tokens : 0.0, ns_max);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // CONSTRAINED_DECODING_HPP
@@ -0,0 +1,221 @@
+// constraint_bench.cpp
+// Constrained decoding (constrained_decoding.hpp) over a synthetic
+// vocabulary of single characters plus multi-character pieces. For each
+// grammar and vocabulary size prints:
+//
+//   compile   DFA states, distinct masks, memory and one-off compile time
+//   step      per-token cost in the engine loop: advance the state over
+//             the sampled token and copy the next mask to the kernel's slot
+//   mask      clearing disallowed logits over the whole vocabulary on the
+//             host, scalar and vector, for a split or host-only lm_head
+//
+// Every generated string is checked against std::regex, and the vector
+// mask against the scalar one.
+//
+// Build: g++ -std=c++17 -O2 constraint_bench.cpp -o constraint_bench -pthread
+
+#include "constrained_decoding.hpp"
+#include "cpu_kernels.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <regex>
+#include <vector>
+
+static const int WALKS = 64;
+static const int MAX_WALK_TOKENS = 64;
+static const int REPEATS = 5;
+
+// Keeps the timed mask copies from being optimized away
+static volatile uint64_t mask_sink;
+
+struct BenchGrammar {
+    const char* name;
+    ConstraintType type;
+    const char* spec;
+    const char* check;      // std::regex for the output, null = spec
+};
+
+// Ids below 128 are characters as in the engine's tokenizer; the rest
+// are 2-6 character pieces over a JSON-ish alphabet
+static std::vector<std::string> makePieces(uint32_t vocab) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 \":,{}[]-_.";
+    std::vector<std::string> pieces(vocab);
+    uint32_t seed = 42;
+    for (uint32_t t = 0; t < vocab; t++) {
+        if (t < 128) {
+            pieces[t] = std::string(1, (char)t);
+            continue;
+        }
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t len = 2 + (seed >> 24) % 5;
+        for (uint32_t i = 0; i < len; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            pieces[t] += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+        }
+    }
+    return pieces;
+}
+
+// Random token sequences through the grammar; each ends where the
+// grammar may stop
+static std::vector<std::vector<uint32_t>> makeWalks(const TokenConstraint& c,
+                                                    const TokenVocabulary& vocab,
+                                                    std::vector<std::string>& texts) {
+    std::vector<std::vector<uint32_t>> walks;
+    std::vector<uint32_t> allowed;
+    uint32_t seed = 7;
+    for (int w = 0; w < WALKS; w++) {
+        std::vector<uint32_t> walk;
+        std::string text;
+        uint32_t state = c.start();
+        for (int i = 0; i < MAX_WALK_TOKENS && !c.complete(state); i++) {
+            seed = seed * 1664525u + 1013904223u;
+            if (c.accepting(state) && (seed >> 28) < 3) break;
+            allowed.clear();
+            for (uint32_t t = 0; t < c.vocabSize(); t++) {
+                if (c.allowed(state, t)) allowed.push_back(t);
+            }
+            uint32_t t = allowed[(seed >> 8) % allowed.size()];
+            walk.push_back(t);
+            text += vocab.piece(t);
+            state = c.advance(state, t);
+        }
+        if (c.accepting(state)) {
+            walks.push_back(walk);
+            texts.push_back(text);
+        }
+    }
+    return walks;
+}
+
+template <typename Fn>
+static double bestOf(Fn fn) {
+    double best = 1e30;
+    for (int r = 0; r < REPEATS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+        if (us < best) best = us;
+    }
+    return best;
+}
+
+int main() {
+    const BenchGrammar grammars[] = {
+        {"phone", ConstraintType::REGEX, "\\(?[0-9]{3}\\)? ?[0-9]{3}-[0-9]{4}", nullptr},
+        {"words", ConstraintType::REGEX, "[a-z]+( [a-z]+){0,15}\\.", nullptr},
+        {"json", ConstraintType::JSON_SCHEMA,
+         "{\"type\":\"object\",\"properties\":{"
+         "\"name\":{\"type\":\"string\",\"maxLength\":24},"
+         "\"age\":{\"type\":\"integer\"},"
+         "\"tags\":{\"type\":\"array\",\"items\":{\"enum\":[\"a\",\"b\",\"c\"]},\"maxItems\":4},"
+         "\"score\":{\"type\":\"number\"},"
+         "\"active\":{\"type\":\"boolean\"}}}",
+         "\\{\"name\":\"[^\"\\\\]{0,24}\",\"age\":-?(0|[1-9][0-9]*),"
+         "\"tags\":\\[(\"[abc]\"(,\"[abc]\"){0,3})?\\],"
+         "\"score\":-?(0|[1-9][0-9]*)(\\.[0-9]+)?([eE][+-]?[0-9]+)?,"
+         "\"active\":(true|false)\\}"},
+    };
+    const uint32_t vocabs[] = {32000, 128256};
+
+    CpuIsa isa = detectCpuIsa();
+    MaskLogitsFn vector_mask = maskLogitsKernel(isa);
+    bool all_ok = true;
+
+    for (uint32_t vocab_size : vocabs) {
+        auto vocab = std::make_shared<TokenVocabulary>(makePieces(vocab_size));
+        std::vector<float> logits(vocab_size), scalar_out(vocab_size), vector_out(vocab_size);
+        std::vector<uint64_t> slot(TokenConstraint::maskWordsFor(vocab_size));
+
+        printf("\n[Bench] Vocab %u, %s mask kernel (best of %d)\n", vocab_size,
+               cpuIsaName(isa), REPEATS);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("%-7s %7s %6s %9s %10s %10s %11s %11s %7s\n", "Grammar", "states", "masks",
+               "memory", "compile", "step", "mask scal", "mask vec", "check");
+
+        for (const BenchGrammar& g : grammars) {
+            std::string error;
+            std::shared_ptr<const TokenConstraint> c =
+                TokenConstraint::compile(g.type, g.spec, vocab, error);
+            if (!c) {
+                printf("%-7s compile failed: %s\n", g.name, error.c_str());
+                all_ok = false;
+                continue;
+            }
+
+            std::vector<std::string> texts;
+            std::vector<std::vector<uint32_t>> walks = makeWalks(*c, *vocab, texts);
+            size_t tokens = 0;
+            for (const auto& w : walks) tokens += w.size();
+
+            std::regex check(g.check ? g.check : g.spec);
+            bool ok = !walks.empty();
+            for (const std::string& text : texts) {
+                ok = ok && std::regex_match(text, check);
+            }
+
+            // What runGeneration does per token, minus the kernel
+            const uint64_t* loaded = nullptr;
+            double step_us = bestOf([&] {
+                for (const auto& w : walks) {
+                    uint32_t state = c->start();
+                    for (uint32_t t : w) {
+                        state = c->advance(state, t);
+                        if (c->complete(state)) break;
+                        const uint64_t* m = c->mask(state);
+                        if (m != loaded) {
+                            memcpy(slot.data(), m, slot.size() * sizeof(uint64_t));
+                            loaded = m;
+                        }
+                        mask_sink = slot[0];
+                    }
+                }
+            });
+
+            // Host mask over every logit, at the states the walks visit
+            std::vector<const uint64_t*> masks;
+            for (const auto& w : walks) {
+                uint32_t state = c->start();
+                masks.push_back(c->mask(state));
+                for (size_t i = 0; i + 1 < w.size(); i++) {
+                    state = c->advance(state, w[i]);
+                    masks.push_back(c->mask(state));
+                }
+            }
+            for (uint32_t i = 0; i < vocab_size; i++) {
+                logits[i] = (float)((i * 37) % 101) * 0.1f;
+            }
+            // Masking is idempotent, so repeats need no fresh copy
+            auto maskAll = [&](MaskLogitsFn fn, std::vector<float>& out) {
+                memcpy(out.data(), logits.data(), vocab_size * sizeof(float));
+                return bestOf([&] {
+                    for (const uint64_t* m : masks) {
+                        fn(out.data(), m, 0, vocab_size);
+                    }
+                });
+            };
+            double scalar_us = maskAll(maskLogitsScalar, scalar_out);
+            double vector_us = maskAll(vector_mask, vector_out);
+            for (const uint64_t* m : masks) {
+                memcpy(scalar_out.data(), logits.data(), vocab_size * sizeof(float));
+                memcpy(vector_out.data(), logits.data(), vocab_size * sizeof(float));
+                maskLogitsScalar(scalar_out.data(), m, 0, vocab_size);
+                vector_mask(vector_out.data(), m, 0, vocab_size);
+                ok = ok && memcmp(scalar_out.data(), vector_out.data(),
+                                  vocab_size * sizeof(float)) == 0;
+            }
+            all_ok = all_ok && ok;
+
+            printf("%-7s %7u %6u %6.0f KB %7.2f ms %7.0f ns %8.2f us %8.2f us %7s\n", g.name,
+                   c->numStates(), c->numMasks(), c->memoryBytes() / 1024.0, c->compileMs(),
+                   tokens ? step_us * 1000.0 / tokens : 0.0,
+                   scalar_us / masks.size(), vector_us / masks.size(),
+                   ok ? "ok" : "FAIL");
+        }
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    }
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,536 @@
+// cpu_kernels.hpp
+// Vector kernels for the host-side compute paths (embedding gather,
+// lm_head shards, constrained decoding masks). Each kernel has an AVX/F16C version picked at runtime
+// on x86, a NEON version on AArch64 and a scalar fallback; callers pick
+// one with detectCpuIsa() and keep a function pointer.
+//
+// Kernels whose length is the model's hidden size also come compiled for
+// common sizes (findShapeKernels): constant trip counts unroll with no
+// tail, and at large sizes the dot product scores several rows per pass
+// over x (shapeRowBlock). Callers pass the hidden size from the weight
+// header and get the specialization when the dispatch table has one, the
+// generic kernel otherwise. Both give the same bits.
+
+#ifndef CPU_KERNELS_HPP
+#define CPU_KERNELS_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_KERNELS_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CPU_KERNELS_NEON 1
+#endif
+
+enum class CpuIsa { SCALAR, F16C, NEON };
+
+inline CpuIsa detectCpuIsa() {
+#if defined(CPU_KERNELS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c")) {
+        return CpuIsa::F16C;
+    }
+#elif defined(CPU_KERNELS_NEON)
+    return CpuIsa::NEON;
+#endif
+    return CpuIsa::SCALAR;
+}
+
+inline const char* cpuIsaName(CpuIsa isa) {
+    switch (isa) {
+        case CpuIsa::F16C: return "F16C";
+        case CpuIsa::NEON: return "NEON";
+        default:           return "scalar";
+    }
+}
+
+// FP32 -> FP16, round to nearest even, subnormals kept. Matches
+// VCVTPS2PH / FCVTN so every path gives the same bits.
+inline uint16_t fp16FromFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t abs = bits & 0x7FFFFFFF;
+
+    if (abs >= 0x7F800000) {
+        // Inf stays inf; NaN keeps its top payload bits and is quieted
+        return (uint16_t)(sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 | ((abs >> 13) & 0x3FF) : 0));
+    }
+    if (abs >= 0x477FF000) {
+        return (uint16_t)(sign | 0x7C00);    // Rounds past 65504
+    }
+    if (abs < 0x38800000) {
+        // Below the smallest normal: value = m * 2^-24
+        if (abs < 0x33000000) {
+            return (uint16_t)sign;
+        }
+        uint32_t exp = abs >> 23;
+        uint32_t mant = (abs & 0x7FFFFF) | 0x800000;
+        uint32_t shift = 126 - exp;
+        uint32_t m = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (m & 1))) m++;
+        return (uint16_t)(sign | m);
+    }
+    uint32_t r = abs - 0x38000000;          // Rebias exponent 127 -> 15
+    r = (r + 0xFFF + ((r >> 13) & 1)) >> 13;
+    return (uint16_t)(sign | r);
+}
+
+// FP16 -> FP32, exact (subnormals included, unlike fp16_to_float which
+// mirrors the weight file's flush-to-zero encoder)
+inline float fp16ToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+
+    if (exp == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Normalize the subnormal
+            int shift = 0;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                shift++;
+            }
+            bits = sign | ((uint32_t)(113 - shift) << 23) | ((mantissa & 0x3FF) << 13);
+        }
+    } else if (exp == 31) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exp + 112) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// dst[i] = fp16(a[i] + b[i])
+typedef void (*AddRowFp16Fn)(const float* a, const float* b, uint16_t* dst, size_t n);
+
+// sum over i of fp16 w[i] * x[i]
+typedef float (*DotFp16Fn)(const uint16_t* w, const float* x, size_t n);
+
+// out[r] = dot(w + r * n, x, n) for rows consecutive rows of w
+typedef void (*DotRowsFp16Fn)(const uint16_t* w, const float* x, size_t n, size_t rows,
+                              float* out);
+
+// logits[i] = -inf where bit first_bit + i of mask is clear
+typedef void (*MaskLogitsFn)(float* logits, const uint64_t* mask, uint32_t first_bit, size_t n);
+
+inline void addRowFp16Scalar(const float* a, const float* b, uint16_t* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = fp16FromFloat(a[i] + b[i]);
+    }
+}
+
+inline float dotFp16Scalar(const uint16_t* w, const float* x, size_t n) {
+    float acc[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            acc[j] += fp16ToFloat(w[i + j]) * x[i + j];
+        }
+    }
+    float sum = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    for (; i < n; i++) {
+        sum += fp16ToFloat(w[i]) * x[i];
+    }
+    return sum;
+}
+
+// Bits of mask from first_bit + i on, at most 64 and not past n; span
+// is set to how many logits the word covers
+inline uint64_t maskWordAt(const uint64_t* mask, uint32_t first_bit, size_t i, size_t n,
+                           size_t& span) {
+    uint32_t bit = first_bit + (uint32_t)i;
+    uint32_t shift = bit & 63;
+    span = 64 - shift;
+    if (span > n - i) span = n - i;
+    uint64_t word = mask[bit >> 6] >> shift;
+    return span < 64 ? word & ((1ull << span) - 1) : word;
+}
+
+inline void maskLogitsScalar(float* logits, const uint64_t* mask, uint32_t first_bit, size_t n) {
+    for (size_t i = 0; i < n; ) {
+        size_t span;
+        uint64_t word = maskWordAt(mask, first_bit, i, n, span);
+        for (size_t j = 0; j < span; j++) {
+            if (!((word >> j) & 1)) logits[i + j] = -INFINITY;
+        }
+        i += span;
+    }
+}
+
+#ifdef CPU_KERNELS_X86
+// Lane select for each byte of mask bits: all ones where the bit is set
+inline const float (*maskLaneTable())[8] {
+    alignas(32) static float table[256][8];
+    static bool built = [] {
+        for (uint32_t b = 0; b < 256; b++) {
+            for (uint32_t j = 0; j < 8; j++) {
+                uint32_t bits = ((b >> j) & 1) ? 0xFFFFFFFFu : 0;
+                memcpy(&table[b][j], &bits, 4);
+            }
+        }
+        return true;
+    }();
+    (void)built;
+    return table;
+}
+
+// Whole words allowed or masked are a skip or a fill; mixed words select
+// eight lanes per mask byte with and/or, which is far cheaper than blendv
+// on some parts
+__attribute__((target("avx,f16c")))
+inline void maskLogitsF16C(float* logits, const uint64_t* mask, uint32_t first_bit, size_t n) {
+    const float (*lanes)[8] = maskLaneTable();
+    const __m256 neg_inf = _mm256_set1_ps(-INFINITY);
+    for (size_t i = 0; i < n; ) {
+        size_t span;
+        uint64_t word = maskWordAt(mask, first_bit, i, n, span);
+        if (span < 64) {
+            maskLogitsScalar(logits + i, mask, first_bit + (uint32_t)i, span);
+        } else if (word == 0) {
+            for (size_t j = 0; j < 64; j += 8) {
+                _mm256_storeu_ps(logits + i + j, neg_inf);
+            }
+        } else if (word != ~0ull) {
+            for (size_t j = 0; j < 64; j += 8) {
+                __m256 sel = _mm256_load_ps(lanes[(word >> j) & 0xFF]);
+                __m256 v = _mm256_loadu_ps(logits + i + j);
+                _mm256_storeu_ps(logits + i + j, _mm256_or_ps(_mm256_and_ps(sel, v),
+                                                              _mm256_andnot_ps(sel, neg_inf)));
+            }
+        }
+        i += span;
+    }
+}
+
+__attribute__((target("avx,f16c")))
+inline void addRowFp16F16C(const float* a, const float* b, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 s0 = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 s1 = _mm256_add_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(s0, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storeu_si128((__m128i*)(dst + i + 8), _mm256_cvtps_ph(s1, _MM_FROUND_TO_NEAREST_INT));
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 s = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(s, _MM_FROUND_TO_NEAREST_INT));
+    }
+    addRowFp16Scalar(a + i, b + i, dst + i, n - i);
+}
+
+// Horizontal sum of two accumulators, in a fixed order
+__attribute__((target("avx,f16c")))
+inline float hsumF16C(__m256 acc0, __m256 acc1) {
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+// Two accumulators to hide add latency; no FMA so F16C-only parts qualify
+__attribute__((target("avx,f16c")))
+inline float dotFp16F16C(const uint16_t* w, const float* x, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 w0 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(w + i)));
+        __m256 w1 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(w + i + 8)));
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(w0, _mm256_loadu_ps(x + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(w1, _mm256_loadu_ps(x + i + 8)));
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 w0 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(w + i)));
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(w0, _mm256_loadu_ps(x + i)));
+    }
+    float sum = hsumF16C(acc0, acc1);
+    for (; i < n; i++) {
+        sum += fp16ToFloat(w[i]) * x[i];
+    }
+    return sum;
+}
+
+// Fixed-length versions (N a multiple of 16; n is ignored). Same
+// accumulation order as the generic kernels above.
+template <size_t N>
+__attribute__((target("avx,f16c")))
+inline void addRowFp16F16CFixed(const float* a, const float* b, uint16_t* dst, size_t) {
+    for (size_t i = 0; i < N; i += 8) {
+        __m256 s = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(s, _MM_FROUND_TO_NEAREST_INT));
+    }
+}
+
+template <size_t N>
+__attribute__((target("avx,f16c")))
+inline float dotFp16F16CFixed(const uint16_t* w, const float* x, size_t) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (size_t i = 0; i < N; i += 16) {
+        __m256 w0 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(w + i)));
+        __m256 w1 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(w + i + 8)));
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(w0, _mm256_loadu_ps(x + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(w1, _mm256_loadu_ps(x + i + 8)));
+    }
+    return hsumF16C(acc0, acc1);
+}
+
+// ROWS rows share each load of x, two accumulators per row
+template <size_t N, size_t ROWS>
+__attribute__((target("avx,f16c")))
+inline void dotRowsFp16F16CFixed(const uint16_t* w, const float* x, size_t, size_t rows,
+                                 float* out) {
+    size_t r = 0;
+    for (; r + ROWS <= rows; r += ROWS) {
+        __m256 lo[ROWS], hi[ROWS];
+        for (size_t k = 0; k < ROWS; k++) {
+            lo[k] = _mm256_setzero_ps();
+            hi[k] = _mm256_setzero_ps();
+        }
+        for (size_t i = 0; i < N; i += 16) {
+            __m256 xl = _mm256_loadu_ps(x + i);
+            __m256 xh = _mm256_loadu_ps(x + i + 8);
+            for (size_t k = 0; k < ROWS; k++) {
+                const uint16_t* row = w + (r + k) * N + i;
+                __m256 w0 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)row));
+                __m256 w1 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(row + 8)));
+                lo[k] = _mm256_add_ps(lo[k], _mm256_mul_ps(w0, xl));
+                hi[k] = _mm256_add_ps(hi[k], _mm256_mul_ps(w1, xh));
+            }
+        }
+        for (size_t k = 0; k < ROWS; k++) {
+            out[r + k] = hsumF16C(lo[k], hi[k]);
+        }
+    }
+    for (; r < rows; r++) {
+        out[r] = dotFp16F16CFixed<N>(w + r * N, x, N);
+    }
+}
+#endif
+
+#ifdef CPU_KERNELS_NEON
+inline void maskLogitsNeon(float* logits, const uint64_t* mask, uint32_t first_bit, size_t n) {
+    const float32x4_t neg_inf = vdupq_n_f32(-INFINITY);
+    const uint32_t lane_bits[4] = {1, 2, 4, 8};
+    const uint32x4_t bits = vld1q_u32(lane_bits);
+    for (size_t i = 0; i < n; ) {
+        size_t span;
+        uint64_t word = maskWordAt(mask, first_bit, i, n, span);
+        if (span < 64) {
+            maskLogitsScalar(logits + i, mask, first_bit + (uint32_t)i, span);
+        } else if (word == 0) {
+            for (size_t j = 0; j < 64; j += 4) {
+                vst1q_f32(logits + i + j, neg_inf);
+            }
+        } else if (word != ~0ull) {
+            for (size_t j = 0; j < 64; j += 4) {
+                uint32x4_t sel = vtstq_u32(vdupq_n_u32((uint32_t)(word >> j) & 0xF), bits);
+                vst1q_f32(logits + i + j, vbslq_f32(sel, vld1q_f32(logits + i + j), neg_inf));
+            }
+        }
+        i += span;
+    }
+}
+
+inline void addRowFp16Neon(const float* a, const float* b, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t s0 = vaddq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        float32x4_t s1 = vaddq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        float16x8_t h = vcvt_high_f16_f32(vcvt_f16_f32(s0), s1);
+        vst1q_u16(dst + i, vreinterpretq_u16_f16(h));
+    }
+    addRowFp16Scalar(a + i, b + i, dst + i, n - i);
+}
+
+inline float dotFp16Neon(const uint16_t* w, const float* x, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float16x8_t h = vreinterpretq_f16_u16(vld1q_u16(w + i));
+        acc0 = vfmaq_f32(acc0, vcvt_f32_f16(vget_low_f16(h)), vld1q_f32(x + i));
+        acc1 = vfmaq_f32(acc1, vcvt_high_f32_f16(h), vld1q_f32(x + i + 4));
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; i++) {
+        sum += fp16ToFloat(w[i]) * x[i];
+    }
+    return sum;
+}
+
+// Fixed-length versions (N a multiple of 8; n is ignored)
+template <size_t N>
+inline void addRowFp16NeonFixed(const float* a, const float* b, uint16_t* dst, size_t) {
+    for (size_t i = 0; i < N; i += 8) {
+        float32x4_t s0 = vaddq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        float32x4_t s1 = vaddq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        float16x8_t h = vcvt_high_f16_f32(vcvt_f16_f32(s0), s1);
+        vst1q_u16(dst + i, vreinterpretq_u16_f16(h));
+    }
+}
+
+template <size_t N>
+inline float dotFp16NeonFixed(const uint16_t* w, const float* x, size_t) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (size_t i = 0; i < N; i += 8) {
+        float16x8_t h = vreinterpretq_f16_u16(vld1q_u16(w + i));
+        acc0 = vfmaq_f32(acc0, vcvt_f32_f16(vget_low_f16(h)), vld1q_f32(x + i));
+        acc1 = vfmaq_f32(acc1, vcvt_high_f32_f16(h), vld1q_f32(x + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(acc0, acc1));
+}
+
+template <size_t N, size_t ROWS>
+inline void dotRowsFp16NeonFixed(const uint16_t* w, const float* x, size_t, size_t rows,
+                                 float* out) {
+    size_t r = 0;
+    for (; r + ROWS <= rows; r += ROWS) {
+        float32x4_t lo[ROWS], hi[ROWS];
+        for (size_t k = 0; k < ROWS; k++) {
+            lo[k] = vdupq_n_f32(0.0f);
+            hi[k] = vdupq_n_f32(0.0f);
+        }
+        for (size_t i = 0; i < N; i += 8) {
+            float32x4_t xl = vld1q_f32(x + i);
+            float32x4_t xh = vld1q_f32(x + i + 4);
+            for (size_t k = 0; k < ROWS; k++) {
+                float16x8_t h = vreinterpretq_f16_u16(vld1q_u16(w + (r + k) * N + i));
+                lo[k] = vfmaq_f32(lo[k], vcvt_f32_f16(vget_low_f16(h)), xl);
+                hi[k] = vfmaq_f32(hi[k], vcvt_high_f32_f16(h), xh);
+            }
+        }
+        for (size_t k = 0; k < ROWS; k++) {
+            out[r + k] = vaddvq_f32(vaddq_f32(lo[k], hi[k]));
+        }
+    }
+    for (; r < rows; r++) {
+        out[r] = dotFp16NeonFixed<N>(w + r * N, x, N);
+    }
+}
+#endif
+
+// Any length: one dot product per row
+template <DotFp16Fn Dot>
+inline void dotRowsFp16(const uint16_t* w, const float* x, size_t n, size_t rows, float* out) {
+    for (size_t r = 0; r < rows; r++) {
+        out[r] = Dot(w + r * n, x, n);
+    }
+}
+
+// Rows per pass of the fixed dot_rows kernels. Interleaving rows only
+// pays once a row is long enough to stream on its own; below 2048 the
+// extra streams cost more than the shared loads of x save.
+constexpr size_t shapeRowBlock(size_t n) {
+    return n >= 2048 ? 8 : 1;
+}
+
+// Row lengths with compiled kernels; hidden sizes of common models
+struct ShapeKernels {
+    size_t n;
+    AddRowFp16Fn add_row;
+    DotFp16Fn dot;
+    DotRowsFp16Fn dot_rows;
+};
+
+// Dispatch table entry for n, or null (scalar, or a length without one)
+inline const ShapeKernels* findShapeKernels(CpuIsa isa, size_t n) {
+#if defined(CPU_KERNELS_X86) || defined(CPU_KERNELS_NEON)
+#if defined(CPU_KERNELS_X86)
+#define SHAPE_KERNEL(N) {N, addRowFp16F16CFixed<N>, dotFp16F16CFixed<N>, dotRowsFp16F16CFixed<N, shapeRowBlock(N)>}
+    const CpuIsa table_isa = CpuIsa::F16C;
+#else
+#define SHAPE_KERNEL(N) {N, addRowFp16NeonFixed<N>, dotFp16NeonFixed<N>, dotRowsFp16NeonFixed<N, shapeRowBlock(N)>}
+    const CpuIsa table_isa = CpuIsa::NEON;
+#endif
+    static const ShapeKernels table[] = {
+        SHAPE_KERNEL(512), SHAPE_KERNEL(768), SHAPE_KERNEL(1024), SHAPE_KERNEL(2048),
+        SHAPE_KERNEL(4096), SHAPE_KERNEL(5120), SHAPE_KERNEL(8192)
+    };
+#undef SHAPE_KERNEL
+    if (isa == table_isa) {
+        for (const ShapeKernels& k : table) {
+            if (k.n == n) {
+                return &k;
+            }
+        }
+    }
+#endif
+    (void)isa;
+    (void)n;
+    return nullptr;
+}
+
+inline AddRowFp16Fn addRowFp16Kernel(CpuIsa isa) {
+#if defined(CPU_KERNELS_X86)
+    if (isa == CpuIsa::F16C) return addRowFp16F16C;
+#elif defined(CPU_KERNELS_NEON)
+    if (isa == CpuIsa::NEON) return addRowFp16Neon;
+#endif
+    (void)isa;
+    return addRowFp16Scalar;
+}
+
+inline DotFp16Fn dotFp16Kernel(CpuIsa isa) {
+#if defined(CPU_KERNELS_X86)
+    if (isa == CpuIsa::F16C) return dotFp16F16C;
+#elif defined(CPU_KERNELS_NEON)
+    if (isa == CpuIsa::NEON) return dotFp16Neon;
+#endif
+    (void)isa;
+    return dotFp16Scalar;
+}
+
+inline DotRowsFp16Fn dotRowsFp16Kernel(CpuIsa isa) {
+#if defined(CPU_KERNELS_X86)
+    if (isa == CpuIsa::F16C) return dotRowsFp16<dotFp16F16C>;
+#elif defined(CPU_KERNELS_NEON)
+    if (isa == CpuIsa::NEON) return dotRowsFp16<dotFp16Neon>;
+#endif
+    (void)isa;
+    return dotRowsFp16<dotFp16Scalar>;
+}
+
+// For rows of length n: the specialization when there is one
+inline AddRowFp16Fn addRowFp16Kernel(CpuIsa isa, size_t n) {
+    const ShapeKernels* k = findShapeKernels(isa, n);
+    return k ? k->add_row : addRowFp16Kernel(isa);
+}
+
+inline DotFp16Fn dotFp16Kernel(CpuIsa isa, size_t n) {
+    const ShapeKernels* k = findShapeKernels(isa, n);
+    return k ? k->dot : dotFp16Kernel(isa);
+}
+
+inline DotRowsFp16Fn dotRowsFp16Kernel(CpuIsa isa, size_t n) {
+    const ShapeKernels* k = findShapeKernels(isa, n);
+    return k ? k->dot_rows : dotRowsFp16Kernel(isa);
+}
+
+inline MaskLogitsFn maskLogitsKernel(CpuIsa isa) {
+#if defined(CPU_KERNELS_X86)
+    if (isa == CpuIsa::F16C) return maskLogitsF16C;
+#elif defined(CPU_KERNELS_NEON)
+    if (isa == CpuIsa::NEON) return maskLogitsNeon;
+#endif
+    (void)isa;
+    return maskLogitsScalar;
+}
+
+#endif // CPU_KERNELS_HPP
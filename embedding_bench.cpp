@@ -0,0 +1,128 @@
+// embedding_bench.cpp
+// Host-side embedding gather (embedding_gather.hpp) against the kernel's
+// own lookup. For each model shape and prompt length prints:
+//
+//   gather    host time to write the prompt's FP16 rows, scalar and vector
+//   prefill   modeled prefill with kernel lookup and with host embedding
+//   decode    one decode step, the window the gather hides in while the
+//             previous run is still generating
+//
+// Rows from the vector path are checked bit for bit against the scalar one.
+//
+// Build: g++ -std=c++17 -O2 embedding_bench.cpp -o embedding_bench -pthread
+
+#include "embedding_gather.hpp"
+#include "perf_model.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const int REPEATS = 5;
+
+struct BenchShape {
+    const char* name;
+    ModelShape shape;
+};
+
+static ModelShape makeShape(uint32_t layers, uint32_t hidden, uint32_t heads,
+                            uint32_t vocab, uint32_t seq) {
+    ModelShape s;
+    s.num_layers = layers;
+    s.hidden_size = hidden;
+    s.num_heads = heads;
+    s.vocab_size = vocab;
+    s.max_seq_len = seq;
+    s.intermediate_size = 4 * hidden;
+    return s;
+}
+
+template <typename Fn>
+static double bestOf(Fn fn) {
+    double best = 1e30;
+    for (int r = 0; r < REPEATS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+        if (us < best) best = us;
+    }
+    return best;
+}
+
+int main() {
+    const BenchShape shapes[] = {
+        {"small", makeShape(6, 512, 8, 32000, 1024)},
+        {"base", makeShape(12, 768, 12, 32000, 2048)},
+    };
+    const uint32_t prompts[] = {16, 128, 512, 2048};
+
+    bool identical = true;
+
+    for (const BenchShape& bench : shapes) {
+        const ModelShape& shape = bench.shape;
+
+        std::vector<float> token_table((size_t)shape.vocab_size * shape.hidden_size);
+        std::vector<float> position_table((size_t)shape.max_seq_len * shape.hidden_size);
+        uint32_t seed = 12345;
+        for (float& v : token_table) {
+            seed = seed * 1664525u + 1013904223u;
+            v = ((int32_t)(seed >> 8) - (1 << 23)) * (1.0f / (1 << 25));
+        }
+        for (size_t i = 0; i < position_table.size(); i++) {
+            position_table[i] = (float)((i * 37) % 2001) * 1e-4f - 0.1f;
+        }
+
+        // Best kernel for this CPU, and the fallback for comparison
+        EmbeddingGather vector_gather;
+        vector_gather.init(token_table.data(), token_table.size(), position_table.data(),
+                           position_table.size(), shape.hidden_size);
+        EmbeddingGather scalar_gather;
+        scalar_gather.init(token_table.data(), token_table.size(), position_table.data(),
+                           position_table.size(), shape.hidden_size);
+        scalar_gather.forceIsa(CpuIsa::SCALAR);
+
+        PerfModel perf;
+        perf.setShape(shape);
+
+        printf("\n[Bench] %s: %u layers, hidden %u, vocab %u (best of %d)\n", bench.name,
+               shape.num_layers, shape.hidden_size, shape.vocab_size, REPEATS);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("%-7s %11s %11s %11s %13s %13s %8s %11s\n", "Prompt", "scalar",
+               vector_gather.kernelName(), "GB/s", "prefill kern", "prefill host", "saved", "decode");
+
+        for (uint32_t n : prompts) {
+            if (n > shape.max_seq_len) {
+                break;
+            }
+            std::vector<uint32_t> tokens(n);
+            for (uint32_t i = 0; i < n; i++) {
+                tokens[i] = (i * 7919u + 17) % shape.vocab_size;
+            }
+            std::vector<uint16_t> scalar_rows((size_t)n * shape.hidden_size);
+            std::vector<uint16_t> vector_rows((size_t)n * shape.hidden_size);
+
+            double scalar_us = bestOf([&] {
+                scalar_gather.gather(tokens.data(), n, 0, scalar_rows.data());
+            });
+            double vector_us = bestOf([&] {
+                vector_gather.gather(tokens.data(), n, 0, vector_rows.data());
+            });
+            if (memcmp(scalar_rows.data(), vector_rows.data(),
+                       scalar_rows.size() * sizeof(uint16_t)) != 0) {
+                identical = false;
+            }
+
+            double kern_us = perf.prefillUs(n, false);
+            double host_us = perf.prefillUs(n, true);
+            double gbps = (double)n * vector_gather.rowBytes() / (vector_us * 1000.0);
+            printf("%-7u %8.1f us %8.1f us %11.2f %10.1f us %10.1f us %7.2f%% %8.1f us\n",
+                   n, scalar_us, vector_us, gbps, kern_us, host_us,
+                   100.0 * (kern_us - host_us) / kern_us, perf.decodeUs(n));
+        }
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    }
+
+    printf("\n[Bench] Vector and scalar rows: %s\n", identical ? "bit-identical" : "MISMATCH");
+    return identical ? 0 : 1;
+}
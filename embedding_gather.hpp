@@ -0,0 +1,153 @@
+// embedding_gather.hpp
+// Host-side embedding lookup for prefill. Instead of handing the kernel
+// token ids (one random token_embeddings row and one position row per
+// token, fetched from DDR before layer 0 can start), the host writes
+// token + position embedding for the whole prompt as contiguous FP16
+// rows into the input buffer while the previous run is still decoding.
+// The kernel then streams the rows in one burst and spends its DDR
+// bandwidth on layer weights. Selected per run by CONFIG_FLAG_HOST_EMBED.
+//
+// Rows are summed in FP32 and rounded to FP16 once (round to nearest
+// even). The vector paths (F16C on x86, NEON on AArch64) and the scalar
+// fallback produce identical bits.
+//
+// Engine thread only; long prompts are split across the shared pool.
+
+#ifndef EMBEDDING_GATHER_HPP
+#define EMBEDDING_GATHER_HPP
+
+#include "cpu_kernels.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+class EmbeddingGather {
+private:
+    // Prompts up to this many rows are gathered on the engine thread
+    static const size_t PARALLEL_ROWS = 256;
+    static const size_t ROW_GRAIN = 64;
+
+    const float* token_table;
+    const float* position_table;
+    uint32_t vocab;
+    uint32_t positions;
+    uint32_t hidden;
+    CpuIsa isa;
+    AddRowFp16Fn row_fn;
+
+    uint64_t runs;
+    uint64_t rows;
+    uint64_t fallbacks;         // Prompts handed to the kernel as token ids
+    double us_total;
+    double us_max;
+
+    void gatherRange(const uint32_t* tokens, size_t lo, size_t hi, uint32_t start_pos,
+                     uint16_t* dst) const {
+        for (size_t i = lo; i < hi; i++) {
+            row_fn(token_table + (size_t)tokens[i] * hidden,
+                   position_table + (size_t)(start_pos + i) * hidden,
+                   dst + i * hidden, hidden);
+        }
+    }
+
+public:
+    EmbeddingGather() : token_table(nullptr), position_table(nullptr), vocab(0),
+                        positions(0), hidden(0), isa(CpuIsa::SCALAR),
+                        row_fn(addRowFp16Scalar), runs(0), rows(0), fallbacks(0),
+                        us_total(0), us_max(0) {}
+
+    // Tables (counts in floats) stay owned by the caller (ModelWeights)
+    // and must outlive this
+    bool init(const float* token_embeddings, size_t token_count,
+              const float* position_embeddings, size_t position_count, uint32_t hidden_size) {
+        if (hidden_size == 0 || token_count < hidden_size || position_count < hidden_size) {
+            printf("[Embed] No embedding tables, kernel looks up token ids\n");
+            return false;
+        }
+        token_table = token_embeddings;
+        position_table = position_embeddings;
+        hidden = hidden_size;
+        vocab = (uint32_t)(token_count / hidden_size);
+        positions = (uint32_t)(position_count / hidden_size);
+        isa = detectCpuIsa();
+        row_fn = addRowFp16Kernel(isa, hidden);
+
+        printf("[Embed] Host embedding gather: vocab %u, %u positions, hidden %u, %s kernel%s\n",
+               vocab, positions, hidden, kernelName(),
+               findShapeKernels(isa, hidden) ? " for this hidden size" : "");
+        return true;
+    }
+
+    // Benchmarks compare the vector path against the fallback
+    bool forceIsa(CpuIsa k) {
+        if (k != CpuIsa::SCALAR && k != detectCpuIsa()) {
+            return false;
+        }
+        isa = k;
+        row_fn = addRowFp16Kernel(isa, hidden);
+        return true;
+    }
+
+    bool ready() const { return hidden > 0; }
+    uint32_t hiddenSize() const { return hidden; }
+    uint32_t rowBytes() const { return hidden * 2; }
+    CpuIsa getIsa() const { return isa; }
+    const char* kernelName() const { return cpuIsaName(isa); }
+
+    // dst[i] = token_embeddings[tokens[i]] + position_embeddings[start_pos + i]
+    // as FP16, count rows of hidden_size. False (dst untouched) if a token
+    // or position is outside the tables; the run falls back to token ids.
+    bool gather(const uint32_t* tokens, size_t count, uint32_t start_pos, uint16_t* dst) {
+        if (!ready() || (uint64_t)start_pos + count > positions) {
+            fallbacks++;
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (tokens[i] >= vocab) {
+                fallbacks++;
+                return false;
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (count > PARALLEL_ROWS) {
+            sharedThreadPool().parallel_for(0, count, ROW_GRAIN, [&](size_t lo, size_t hi) {
+                gatherRange(tokens, lo, hi, start_pos, dst);
+            });
+        } else {
+            gatherRange(tokens, 0, count, start_pos, dst);
+        }
+        double us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+
+        runs++;
+        rows += count;
+        us_total += us;
+        if (us > us_max) us_max = us;
+        return true;
+    }
+
+    // Prompt longer than the input buffer holds
+    void skipped() { fallbacks++; }
+
+    void printStats() const {
+        printf("\n[Embed] Host gather statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Kernel:            %s, hidden %u\n", kernelName(), hidden);
+        printf("Prompts gathered:  %lu (%lu sent as token ids)\n",
+               (unsigned long)runs, (unsigned long)fallbacks);
+        printf("Rows written:      %lu (%.2f MB)\n", (unsigned long)rows,
+               rows * (double)rowBytes() / (1024.0 * 1024.0));
+        printf("Gather time:       %.1f us mean, %.1f us max\n",
+               runs ? us_total / runs : 0.0, us_max);
+        if (us_total > 0) {
+            printf("Throughput:        %.2f GB/s written\n",
+                   rows * (double)rowBytes() / (us_total * 1000.0));
+        }
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // EMBEDDING_GATHER_HPP
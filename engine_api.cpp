@@ -0,0 +1,452 @@
+// engine_api.cpp
+// C ABI over InferenceEngine (see engine_api.h). Each request gets an
+// ApiRequest sink that either forwards tokens to the caller's callback
+// or buffers them for engine_poll_tokens. Candidates requests hand their
+// ranked outputs to the caller in one call at the finish.
+
+#include "engine_api.h"
+#include "inference_engine.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+static_assert(ENGINE_MAX_CANDIDATES == MAX_CANDIDATES, "engine_api.h candidate limit");
+
+namespace {
+
+int finishCode(FinishReason reason) {
+    switch (reason) {
+        case FinishReason::EOS:        return ENGINE_FINISH_EOS;
+        case FinishReason::MAX_TOKENS: return ENGINE_FINISH_MAX_TOKENS;
+        case FinishReason::CANCELLED:  return ENGINE_FINISH_CANCELLED;
+        case FinishReason::FAILED:     return ENGINE_FINISH_FAILED;
+        case FinishReason::SHUTDOWN:   return ENGINE_FINISH_SHUTDOWN;
+        case FinishReason::REJECTED:   return ENGINE_FINISH_REJECTED;
+    }
+    return ENGINE_FINISH_FAILED;
+}
+
+int submitStatus(const AdmissionEstimate& est) {
+    switch (est.decision) {
+        case AdmissionDecision::ADMIT:            return ENGINE_OK;
+        case AdmissionDecision::DEFER_QUEUE_FULL: return ENGINE_ERR_QUEUE_FULL;
+        case AdmissionDecision::DEFER_OVER_SLO:   return ENGINE_ERR_OVERLOADED;
+        case AdmissionDecision::REJECT_TOO_LARGE: return ENGINE_ERR_TOO_LARGE;
+    }
+    return ENGINE_ERR_QUEUE_FULL;
+}
+
+class ApiRequest;
+
+}  // namespace
+
+struct engine {
+    // Declared before core so it outlives the engine and IRQ threads
+    RegisterRecorder recorder;
+    InferenceEngine core;
+
+    // Live requests; guards submit against an immediate finish
+    std::mutex mutex;
+    std::unordered_map<int64_t, std::shared_ptr<ApiRequest>> requests;
+
+    engine(const EngineOptions& options, const char* record_path)
+        : core(traced(options, record_path)) {}
+
+    EngineOptions traced(EngineOptions options, const char* record_path) {
+        if (record_path && recorder.open(record_path)) {
+            options.recorder = &recorder;
+        }
+        return options;
+    }
+
+    void release(int64_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.erase(id);
+    }
+
+    std::shared_ptr<ApiRequest> find(int64_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = requests.find(id);
+        return it == requests.end() ? nullptr : it->second;
+    }
+};
+
+namespace {
+
+class ApiRequest : public TokenSink {
+private:
+    engine* owner;
+    int64_t id;
+    engine_token_callback callback;     // Null = polling
+    engine_candidates_callback candidates_callback;
+    void* user_data;
+    std::vector<CandidateOutput> ranked;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<uint32_t> tokens;
+    int finish;
+    std::atomic<bool> cancelled;
+
+public:
+    ApiRequest(engine* e, int64_t request_id, engine_token_callback cb, void* user)
+        : owner(e), id(request_id), callback(cb), candidates_callback(nullptr),
+          user_data(user), finish(ENGINE_FINISH_NONE), cancelled(false) {}
+
+    ApiRequest(engine* e, int64_t request_id, engine_candidates_callback cb, void* user)
+        : owner(e), id(request_id), callback(nullptr), candidates_callback(cb),
+          user_data(user), finish(ENGINE_FINISH_NONE), cancelled(false) {}
+
+    bool polled() const { return callback == nullptr && candidates_callback == nullptr; }
+
+    void onCandidates(const std::vector<CandidateOutput>& outputs) override {
+        ranked = outputs;
+    }
+
+    void onToken(uint32_t token) override {
+        if (callback) {
+            callback(user_data, id, token, ENGINE_FINISH_NONE);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tokens.push_back(token);
+        }
+        cv.notify_one();
+    }
+
+    void onFinish(FinishReason reason) override {
+        if (candidates_callback) {
+            std::vector<engine_candidate_t> out(ranked.size());
+            for (size_t i = 0; i < ranked.size(); i++) {
+                out[i].tokens = ranked[i].tokens.data();
+                out[i].token_count = (uint32_t)ranked[i].tokens.size();
+                out[i].logprob = ranked[i].logprob;
+                out[i].finish_reason = finishCode(ranked[i].finish);
+            }
+            candidates_callback(user_data, id, out.data(), (uint32_t)out.size(),
+                                finishCode(reason));
+            owner->release(id);
+            return;
+        }
+        if (callback) {
+            callback(user_data, id, 0, finishCode(reason));
+            owner->release(id);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finish = finishCode(reason);
+        }
+        cv.notify_one();
+    }
+
+    bool isCancelled() const override { return cancelled.load(std::memory_order_acquire); }
+    void cancel() { cancelled.store(true, std::memory_order_release); }
+
+    // Returns the count copied. finish_reason is set only once the
+    // request has finished and every token has been taken.
+    size_t take(uint32_t* out, size_t capacity, int timeout_ms, int* finish_reason) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (timeout_ms > 0) {
+            cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] {
+                return !tokens.empty() || finish != ENGINE_FINISH_NONE;
+            });
+        }
+
+        size_t n = 0;
+        while (n < capacity && !tokens.empty()) {
+            out[n++] = tokens.front();
+            tokens.pop_front();
+        }
+        *finish_reason = tokens.empty() ? finish : ENGINE_FINISH_NONE;
+        return n;
+    }
+};
+
+}  // namespace
+
+extern "C" {
+
+uint32_t engine_api_version(void) {
+    return ENGINE_API_VERSION;
+}
+
+const char* engine_status_string(int status) {
+    switch (status) {
+        case ENGINE_OK:             return "ok";
+        case ENGINE_ERR_INVALID:    return "invalid argument";
+        case ENGINE_ERR_INIT:       return "engine initialization failed";
+        case ENGINE_ERR_QUEUE_FULL: return "task queue full";
+        case ENGINE_ERR_NOT_FOUND:  return "unknown request";
+        case ENGINE_ERR_MODE:       return "request uses callback delivery";
+        case ENGINE_ERR_OVERLOADED: return "queue wait over SLO, retry later";
+        case ENGINE_ERR_TOO_LARGE:  return "request exceeds KV slot";
+    }
+    return "unknown status";
+}
+
+void engine_config_init(engine_config_t* config) {
+    if (!config) return;
+    config->struct_size = sizeof(engine_config_t);
+    config->model_path = nullptr;
+    config->record_path = nullptr;
+    config->weight_region_bytes = 0;
+    config->kv_region_bytes = 0;
+    config->context_tokens = 0;
+    config->max_queue_wait_ms = 0;
+    config->cache_memory_bytes = 0;
+    config->cache_dir = nullptr;
+    config->cache_disk_bytes = 0;
+    config->host_embed_bytes = 0;
+    config->host_lm_head_fraction = 0.0;
+    config->session_memory_bytes = 0;
+    config->session_snapshot_path = nullptr;
+    config->share_weights = 0;
+    config->shared_weights_dir = nullptr;
+    config->stall_window_ms = 0;
+}
+
+engine_t* engine_create(const engine_config_t* config) {
+    // Older callers pass a shorter struct; fields they lack keep defaults
+    engine_config_t cfg;
+    engine_config_init(&cfg);
+    if (config) {
+        if (config->struct_size < offsetof(engine_config_t, max_queue_wait_ms) ||
+            config->struct_size > sizeof(engine_config_t)) {
+            printf("[API] engine_config_t size %u not supported (expected %zu)\n",
+                   config->struct_size, sizeof(engine_config_t));
+            return nullptr;
+        }
+        memcpy(&cfg, config, config->struct_size);
+    }
+    config = &cfg;
+
+    EngineOptions options;
+    if (config->model_path) options.model_file = config->model_path;
+    if (config->weight_region_bytes) options.weight_region = config->weight_region_bytes;
+    if (config->kv_region_bytes) options.kv_region = config->kv_region_bytes;
+    options.requested_context = config->context_tokens;
+    if (config->max_queue_wait_ms) options.admission.max_queue_wait_ms = config->max_queue_wait_ms;
+    options.host_embed_bytes = config->host_embed_bytes;
+    options.host_lm_head_fraction = config->host_lm_head_fraction;
+    if (config->cache_memory_bytes) {
+        options.cache.enabled = true;
+        options.cache.memory_bytes = config->cache_memory_bytes;
+        if (config->cache_dir) options.cache.disk_dir = config->cache_dir;
+        if (config->cache_disk_bytes) options.cache.disk_bytes = config->cache_disk_bytes;
+    }
+    if (config->session_memory_bytes) {
+        options.sessions.enabled = true;
+        options.sessions.memory_bytes = config->session_memory_bytes;
+        if (config->session_snapshot_path) {
+            options.sessions.snapshot_path = config->session_snapshot_path;
+        }
+    }
+    options.shared_weights.enabled = config->share_weights != 0;
+    if (config->shared_weights_dir) options.shared_weights.dir = config->shared_weights_dir;
+    if (config->stall_window_ms) options.stall_window_ms = config->stall_window_ms;
+
+    engine* e = new engine(options, config->record_path);
+
+    if (!e->core.init() || !e->core.start()) {
+        delete e;
+        return nullptr;
+    }
+    return e;
+}
+
+// One output streamed to callback or buffered for polling
+static int64_t submitText(engine_t* e, const char* tenant, const char* prompt, int max_tokens,
+                          const std::shared_ptr<const TokenConstraint>& constraint,
+                          const char* session, engine_token_callback callback,
+                          void* user_data) {
+    // The id must be in the sink before the engine thread can see the task
+    int id = e->core.reserveTaskId();
+    std::shared_ptr<ApiRequest> request =
+        std::make_shared<ApiRequest>(e, id, callback, user_data);
+
+    Task task(id, TaskType::GENERATE, prompt);
+    task.max_tokens = max_tokens;
+    task.tenant = tenant ? tenant : "";
+    task.sink = request;
+    task.constraint = constraint;
+    task.session = session;
+
+    // Held across submit so a finish can't release the id before it's added
+    std::lock_guard<std::mutex> lock(e->mutex);
+    AdmissionEstimate est;
+    if (!e->core.submit(task, &est)) {
+        return submitStatus(est);
+    }
+    e->requests[id] = request;
+    return id;
+}
+
+int64_t engine_submit(engine_t* e, const char* prompt, int max_tokens,
+                      engine_token_callback callback, void* user_data) {
+    return engine_submit_as(e, nullptr, prompt, max_tokens, callback, user_data);
+}
+
+int64_t engine_submit_as(engine_t* e, const char* tenant, const char* prompt,
+                         int max_tokens, engine_token_callback callback, void* user_data) {
+    return engine_submit_constrained(e, tenant, prompt, max_tokens, 0, nullptr,
+                                     callback, user_data);
+}
+
+int64_t engine_submit_constrained(engine_t* e, const char* tenant, const char* prompt,
+                                  int max_tokens, int constraint_type, const char* constraint,
+                                  engine_token_callback callback, void* user_data) {
+    if (!e || !prompt || max_tokens < 0) {
+        return ENGINE_ERR_INVALID;
+    }
+
+    std::shared_ptr<const TokenConstraint> compiled;
+    if (constraint_type != 0) {
+        if (!constraint || (constraint_type != ENGINE_CONSTRAINT_REGEX &&
+                            constraint_type != ENGINE_CONSTRAINT_JSON_SCHEMA)) {
+            return ENGINE_ERR_INVALID;
+        }
+        compiled = e->core.compileConstraint(constraint_type == ENGINE_CONSTRAINT_REGEX
+                                                 ? ConstraintType::REGEX
+                                                 : ConstraintType::JSON_SCHEMA,
+                                             constraint);
+        if (!compiled) {
+            return ENGINE_ERR_INVALID;
+        }
+    }
+    return submitText(e, tenant, prompt, max_tokens, compiled, "", callback, user_data);
+}
+
+int64_t engine_submit_session(engine_t* e, const char* tenant, const char* session,
+                              const char* prompt, int max_tokens,
+                              engine_token_callback callback, void* user_data) {
+    if (!e || !session || !*session || !prompt || max_tokens < 0) {
+        return ENGINE_ERR_INVALID;
+    }
+    return submitText(e, tenant, prompt, max_tokens, nullptr, session, callback, user_data);
+}
+
+int64_t engine_submit_candidates(engine_t* e, const char* tenant, const char* prompt,
+                                 int max_tokens, uint32_t n, int mode,
+                                 engine_candidates_callback callback, void* user_data) {
+    if (!e || !prompt || max_tokens < 0 || !callback || n == 0 || n > MAX_CANDIDATES ||
+        (mode != ENGINE_CANDIDATES_SAMPLE && mode != ENGINE_CANDIDATES_BEAM)) {
+        return ENGINE_ERR_INVALID;
+    }
+
+    int id = e->core.reserveTaskId();
+    std::shared_ptr<ApiRequest> request =
+        std::make_shared<ApiRequest>(e, id, callback, user_data);
+
+    Task task(id, TaskType::GENERATE, prompt);
+    task.max_tokens = max_tokens;
+    task.tenant = tenant ? tenant : "";
+    task.sink = request;
+    task.candidates = n;
+    task.candidate_mode = mode == ENGINE_CANDIDATES_BEAM ? CandidateMode::BEAM
+                                                         : CandidateMode::SAMPLE;
+
+    std::lock_guard<std::mutex> lock(e->mutex);
+    AdmissionEstimate est;
+    if (!e->core.submit(task, &est)) {
+        return submitStatus(est);
+    }
+    e->requests[id] = request;
+    return id;
+}
+
+int engine_configure_tenant(engine_t* e, const char* tenant, uint32_t weight,
+                            uint32_t max_inflight, double tokens_per_sec) {
+    if (!e || !tenant || tokens_per_sec < 0) {
+        return ENGINE_ERR_INVALID;
+    }
+    TenantConfig config = e->core.getTenantConfig(tenant);
+    config.weight = weight > 0 ? weight : 1;
+    config.max_inflight = max_inflight;
+    config.tokens_per_sec = tokens_per_sec;
+    e->core.configureTenant(tenant, config);
+    return ENGINE_OK;
+}
+
+int engine_set_tenant_priority(engine_t* e, const char* tenant, int priority) {
+    if (!e || !tenant) {
+        return ENGINE_ERR_INVALID;
+    }
+    TenantConfig config = e->core.getTenantConfig(tenant);
+    config.priority = priority;
+    e->core.configureTenant(tenant, config);
+    return ENGINE_OK;
+}
+
+int engine_poll_tokens(engine_t* e, int64_t request_id, uint32_t* tokens,
+                       size_t capacity, int timeout_ms, int* finish_reason) {
+    if (!e || !finish_reason || (!tokens && capacity > 0)) {
+        return ENGINE_ERR_INVALID;
+    }
+    *finish_reason = ENGINE_FINISH_NONE;
+
+    std::shared_ptr<ApiRequest> request = e->find(request_id);
+    if (!request) {
+        return ENGINE_ERR_NOT_FOUND;
+    }
+    if (!request->polled()) {
+        return ENGINE_ERR_MODE;
+    }
+
+    size_t n = request->take(tokens, capacity, timeout_ms, finish_reason);
+    if (*finish_reason != ENGINE_FINISH_NONE) {
+        e->release(request_id);
+    }
+    return (int)n;
+}
+
+int engine_estimate(engine_t* e, const char* prompt, int max_tokens,
+                    engine_estimate_t* estimate) {
+    if (!e || !prompt || !estimate || max_tokens < 0) {
+        return ENGINE_ERR_INVALID;
+    }
+    AdmissionEstimate est = e->core.estimate(prompt, max_tokens);
+    estimate->status = submitStatus(est);
+    estimate->prompt_tokens = est.prompt_tokens;
+    estimate->output_tokens = est.output_tokens;
+    estimate->kv_bytes = est.kv_bytes;
+    estimate->queue_wait_ms = (uint32_t)est.queue_wait_ms;
+    estimate->run_ms = (uint32_t)est.run_ms;
+    estimate->retry_after_ms = est.retry_after_ms;
+    return ENGINE_OK;
+}
+
+int engine_snapshot_sessions(engine_t* e) {
+    if (!e) {
+        return ENGINE_ERR_INVALID;
+    }
+    return e->core.sendCommand(CommandType::SNAPSHOT_SESSIONS) ? ENGINE_OK : ENGINE_ERR_QUEUE_FULL;
+}
+
+int engine_cancel(engine_t* e, int64_t request_id) {
+    if (!e) {
+        return ENGINE_ERR_INVALID;
+    }
+    std::shared_ptr<ApiRequest> request = e->find(request_id);
+    if (!request) {
+        return ENGINE_ERR_NOT_FOUND;
+    }
+    request->cancel();
+    return ENGINE_OK;
+}
+
+void engine_destroy(engine_t* e) {
+    if (!e) return;
+    e->core.shutdown();
+    e->recorder.close();
+    delete e;
+}
+
+}  // extern "C"
@@ -0,0 +1,235 @@
+/* engine_api.h
+ * Stable C ABI for embedding the inference engine in-process (Go via cgo,
+ * Python via ctypes/cffi, ...). Only plain C types cross this boundary;
+ * the engine itself is opaque.
+ *
+ * Build: g++ -std=c++17 -O2 -fPIC -shared -fvisibility=hidden \
+ *            engine_api.cpp -o libfpga_engine.so -pthread
+ *
+ *   engine_config_t cfg;
+ *   engine_config_init(&cfg);
+ *   engine_t* e = engine_create(&cfg);
+ *
+ *   // Polling: pass no callback, then drain with engine_poll_tokens
+ *   int64_t req = engine_submit(e, "hello", 32, NULL, NULL);
+ *   uint32_t buf[64];
+ *   int finish = ENGINE_FINISH_NONE;
+ *   while (finish == ENGINE_FINISH_NONE) {
+ *       int n = engine_poll_tokens(e, req, buf, 64, 100, &finish);
+ *       ...
+ *   }
+ *
+ *   engine_destroy(e);
+ *
+ * All functions are thread-safe. Request ids are never reused within one
+ * engine.
+ *
+ * engine_config_t only grows at the end; callers built against an older
+ * header pass their smaller struct_size and get defaults for the rest.
+ */
+
+#ifndef ENGINE_API_H
+#define ENGINE_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define ENGINE_API __attribute__((visibility("default")))
+#else
+#define ENGINE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped on any incompatible change to this header */
+#define ENGINE_API_VERSION 1
+
+typedef struct engine engine_t;
+
+/* Status codes; request ids are always > 0 */
+#define ENGINE_OK               0
+#define ENGINE_ERR_INVALID     -1   /* Null handle, bad argument or config */
+#define ENGINE_ERR_INIT        -2   /* Memory, weights or accelerator setup failed */
+#define ENGINE_ERR_QUEUE_FULL  -3   /* Retry later, see engine_estimate */
+#define ENGINE_ERR_NOT_FOUND   -4   /* Unknown or already released request */
+#define ENGINE_ERR_MODE        -5   /* Polling a request that has a callback */
+#define ENGINE_ERR_OVERLOADED  -6   /* Queue wait over the SLO; retry later */
+#define ENGINE_ERR_TOO_LARGE   -7   /* Prompt + max_tokens exceed a KV slot */
+
+/* Why a request ended */
+#define ENGINE_FINISH_NONE       0  /* Still running */
+#define ENGINE_FINISH_EOS        1
+#define ENGINE_FINISH_MAX_TOKENS 2
+#define ENGINE_FINISH_CANCELLED  3
+#define ENGINE_FINISH_FAILED     4  /* Accelerator error, retries exhausted */
+#define ENGINE_FINISH_SHUTDOWN   5
+#define ENGINE_FINISH_REJECTED   6  /* Not admitted by admission control */
+
+/* Output constraints for engine_submit_constrained */
+#define ENGINE_CONSTRAINT_REGEX       1 /* Anchored regex over the output text */
+#define ENGINE_CONSTRAINT_JSON_SCHEMA 2 /* JSON schema; output is compact JSON */
+
+/* Search modes for engine_submit_candidates */
+#define ENGINE_CANDIDATES_SAMPLE 1  /* n independent samples */
+#define ENGINE_CANDIDATES_BEAM   2  /* Beam search of width n */
+#define ENGINE_MAX_CANDIDATES    16
+
+typedef struct {
+    uint32_t struct_size;           /* sizeof(engine_config_t), set by engine_config_init */
+    const char* model_path;         /* NULL = "model.pt.bin" */
+    const char* record_path;        /* Register trace file, NULL = off */
+    uint64_t weight_region_bytes;   /* 0 = default (1GB) */
+    uint64_t kv_region_bytes;       /* 0 = default (512MB) */
+    uint32_t context_tokens;        /* 0 = model max_seq_len */
+    uint32_t max_queue_wait_ms;     /* Admission wait SLO, 0 = default (30s) */
+    uint64_t cache_memory_bytes;    /* Response cache for repeated requests, 0 = off */
+    const char* cache_dir;          /* Persistent cache tier, NULL = memory only */
+    uint64_t cache_disk_bytes;      /* 0 = default (1GB) */
+    uint64_t host_embed_bytes;      /* Host-side prompt embedding buffer, 0 = off
+                                       (the kernel looks up token ids) */
+    double host_lm_head_fraction;   /* Share of lm_head vocabulary rows scored on
+                                       the CPU (0 = off, 1 = all) */
+    uint64_t session_memory_bytes;  /* KV kept between session turns, 0 = off */
+    const char* session_snapshot_path; /* Session KV across restarts, NULL = none */
+    uint32_t share_weights;         /* Host weights in a shared segment keyed by the
+                                       model checksums: the first process publishes,
+                                       later ones attach read-only. 0 = off */
+    const char* shared_weights_dir; /* NULL = /dev/shm; a hugetlbfs mount for huge pages */
+    uint32_t stall_window_ms;       /* A run with no progress this long is retried as
+                                       hung (its first token also gets the modeled
+                                       prompt time), 0 = default (2s) */
+} engine_config_t;
+
+/* Admission control's view of a request, as if submitted now */
+typedef struct {
+    int status;                     /* What engine_submit would return: ENGINE_OK,
+                                       ENGINE_ERR_QUEUE_FULL, _OVERLOADED, _TOO_LARGE */
+    uint32_t prompt_tokens;
+    uint32_t output_tokens;         /* max_tokens or the engine default */
+    uint64_t kv_bytes;
+    uint32_t queue_wait_ms;         /* Predicted wait before it starts */
+    uint32_t run_ms;                /* Predicted run time */
+    uint32_t retry_after_ms;        /* When not ENGINE_OK; 0 = never fits */
+} engine_estimate_t;
+
+/* Callback delivery. Called on the engine thread once per token with
+ * finish_reason ENGINE_FINISH_NONE, then exactly once with token 0 and the
+ * finish reason. Must not block; it may call engine_submit/engine_cancel.
+ * The request is released after the final call. */
+typedef void (*engine_token_callback)(void* user_data, int64_t request_id,
+                                      uint32_t token, int finish_reason);
+
+/* One output of engine_submit_candidates */
+typedef struct {
+    const uint32_t* tokens;
+    uint32_t token_count;
+    double logprob;                 /* Sum over the tokens (and EOS if it ended there) */
+    int finish_reason;              /* ENGINE_FINISH_EOS or _MAX_TOKENS */
+} engine_candidate_t;
+
+/* Called once on the engine thread with the outputs best first (count 0
+ * if the request was cancelled, failed or shut down). The array and its
+ * tokens are only valid during the call. The request is released after. */
+typedef void (*engine_candidates_callback)(void* user_data, int64_t request_id,
+                                           const engine_candidate_t* candidates,
+                                           uint32_t count, int finish_reason);
+
+ENGINE_API uint32_t engine_api_version(void);
+ENGINE_API const char* engine_status_string(int status);
+
+ENGINE_API void engine_config_init(engine_config_t* config);
+
+/* Loads weights and starts the engine thread. NULL on failure; at most one
+ * engine per accelerator. config may be NULL for defaults. */
+ENGINE_API engine_t* engine_create(const engine_config_t* config);
+
+/* Queues a generation. max_tokens 0 = engine default. With callback NULL
+ * the tokens are buffered for engine_poll_tokens. Returns the request id,
+ * or a negative status; admission control turns work away with
+ * ENGINE_ERR_QUEUE_FULL / _OVERLOADED (retry later) or _TOO_LARGE. */
+ENGINE_API int64_t engine_submit(engine_t* engine, const char* prompt, int max_tokens,
+                                 engine_token_callback callback, void* user_data);
+
+/* engine_submit on behalf of a tenant (NULL = "default"). Tenants share
+ * the accelerator by weighted fair queuing on generated tokens. */
+ENGINE_API int64_t engine_submit_as(engine_t* engine, const char* tenant, const char* prompt,
+                                    int max_tokens, engine_token_callback callback,
+                                    void* user_data);
+
+/* engine_submit_as with the output held to a grammar: only tokens that
+ * keep the text a prefix of a match are sampled, and the request ends with
+ * ENGINE_FINISH_EOS once the match can't be extended. Each distinct
+ * grammar is compiled once and reused. Returns ENGINE_ERR_INVALID if the
+ * grammar doesn't compile (or is outside the supported subset, see
+ * constrained_decoding.hpp). */
+ENGINE_API int64_t engine_submit_constrained(engine_t* engine, const char* tenant,
+                                             const char* prompt, int max_tokens,
+                                             int constraint_type, const char* constraint,
+                                             engine_token_callback callback, void* user_data);
+
+/* n outputs (1..ENGINE_MAX_CANDIDATES) from one prefill of the prompt:
+ * independent samples or a beam search, as mode. The candidates decode
+ * together and share the prompt's KV blocks, so n outputs cost one prompt
+ * pass and a batched decode rather than n runs. Outputs are ranked by log
+ * probability per token and delivered once through callback (required).
+ * Candidates requests are never preempted or cached. */
+ENGINE_API int64_t engine_submit_candidates(engine_t* engine, const char* tenant,
+                                            const char* prompt, int max_tokens, uint32_t n,
+                                            int mode, engine_candidates_callback callback,
+                                            void* user_data);
+
+/* engine_submit_as as one turn of a conversation. The prompt is the whole
+ * conversation so far; when it extends the previous turn of the same
+ * session (its prompt and output), that turn's KV cache is put back and
+ * only the new text is prefilled. Needs session_memory_bytes. */
+ENGINE_API int64_t engine_submit_session(engine_t* engine, const char* tenant,
+                                         const char* session, const char* prompt,
+                                         int max_tokens, engine_token_callback callback,
+                                         void* user_data);
+
+/* Writes the kept session KV to session_snapshot_path once the current
+ * generation ends, for a later engine_create to restore. engine_destroy
+ * does the same. */
+ENGINE_API int engine_snapshot_sessions(engine_t* engine);
+
+/* Sets a tenant's weight (>= 1), concurrency cap and generated-token rate
+ * limit (0 = unlimited for either). Applies from the next task pickup;
+ * tenants never configured get weight 1 and no limits. */
+ENGINE_API int engine_configure_tenant(engine_t* engine, const char* tenant, uint32_t weight,
+                                       uint32_t max_inflight, double tokens_per_sec);
+
+/* Puts a tenant in a priority class (default 0). Higher classes are
+ * served first, and a running lower-class generation is suspended at a
+ * token boundary (its KV cache kept) and resumed once they're done. */
+ENGINE_API int engine_set_tenant_priority(engine_t* engine, const char* tenant, int priority);
+
+/* Copies up to capacity buffered tokens into tokens, waiting up to
+ * timeout_ms (0 = don't wait) for at least one token or the finish.
+ * *finish_reason is ENGINE_FINISH_NONE until the request has ended and
+ * every token has been returned; that call releases the request.
+ * Returns the number of tokens copied, or a negative status. */
+ENGINE_API int engine_poll_tokens(engine_t* engine, int64_t request_id,
+                                  uint32_t* tokens, size_t capacity,
+                                  int timeout_ms, int* finish_reason);
+
+/* Predicted cost and queue wait of a request, and whether it would be
+ * admitted. Also gives the retry hint after a rejected submit. */
+ENGINE_API int engine_estimate(engine_t* engine, const char* prompt, int max_tokens,
+                               engine_estimate_t* estimate);
+
+/* Stops a request at its next token boundary (or before it starts). It
+ * still finishes with ENGINE_FINISH_CANCELLED through its callback or poll. */
+ENGINE_API int engine_cancel(engine_t* engine, int64_t request_id);
+
+/* Finishes every outstanding request with ENGINE_FINISH_SHUTDOWN, stops
+ * the engine and frees it. Buffered tokens not yet polled are lost. */
+ENGINE_API void engine_destroy(engine_t* engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ENGINE_API_H */
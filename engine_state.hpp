@@ -0,0 +1,216 @@
+// engine_state.hpp
+// Lock-free engine state machine shared by the engine thread, UI,
+// metrics and interrupt callbacks.
+
+#ifndef ENGINE_STATE_HPP
+#define ENGINE_STATE_HPP
+
+#include "types.hpp"
+#include <cstdint>
+#include <atomic>
+#include <functional>
+
+// Called by whichever thread performed the transition
+using EngineStateObserver = std::function<void(EngineStatus from, EngineStatus to, int task_id)>;
+
+struct EngineSnapshot {
+    EngineStatus status;
+    int currentTaskId;      // -1 means null
+    bool cancelRequested;
+    bool resetRequested;
+    uint64_t transitions;
+};
+
+class EngineState {
+public:
+    static const int MAX_OBSERVERS = 8;
+
+private:
+    // Status and task id packed in one word so readers never see a
+    // status from one transition with the task id of another.
+    // [63:32] task id, [31:0] status
+    std::atomic<uint64_t> word;
+    std::atomic<bool> cancel_requested;
+    std::atomic<bool> reset_requested;
+    std::atomic<uint64_t> transition_count;
+
+    EngineStateObserver observers[MAX_OBSERVERS];
+    std::atomic<bool> observer_ready[MAX_OBSERVERS];
+    std::atomic<int> observer_slots;
+
+    static uint64_t pack(EngineStatus status, int task_id) {
+        return ((uint64_t)(uint32_t)task_id << 32) | (uint32_t)status;
+    }
+
+    static EngineStatus unpackStatus(uint64_t w) {
+        return (EngineStatus)(uint32_t)(w & 0xFFFFFFFF);
+    }
+
+    static int unpackTaskId(uint64_t w) {
+        return (int)(uint32_t)(w >> 32);
+    }
+
+    void notify(EngineStatus from, EngineStatus to, int task_id) {
+        int slots = observer_slots.load(std::memory_order_acquire);
+        if (slots > MAX_OBSERVERS) slots = MAX_OBSERVERS;
+
+        for (int i = 0; i < slots; i++) {
+            if (observer_ready[i].load(std::memory_order_acquire)) {
+                observers[i](from, to, task_id);
+            }
+        }
+    }
+
+public:
+    EngineState() : word(pack(EngineStatus::IDLE, -1)),
+                    cancel_requested(false),
+                    reset_requested(false),
+                    transition_count(0),
+                    observer_slots(0) {
+        for (int i = 0; i < MAX_OBSERVERS; i++) {
+            observer_ready[i].store(false);
+        }
+    }
+
+    EngineState(const EngineState&) = delete;
+    EngineState& operator=(const EngineState&) = delete;
+
+    //   IDLE        -> GENERATING | RESETTING | SHUTTING_DOWN
+    //   GENERATING  -> COMPLETING | RESETTING | SHUTTING_DOWN
+    //   COMPLETING  -> IDLE | SHUTTING_DOWN
+    //   RESETTING   -> IDLE | SHUTTING_DOWN
+    static bool isLegal(EngineStatus from, EngineStatus to) {
+        switch (from) {
+            case EngineStatus::IDLE:
+                return to == EngineStatus::GENERATING ||
+                       to == EngineStatus::RESETTING ||
+                       to == EngineStatus::SHUTTING_DOWN;
+            case EngineStatus::GENERATING:
+                return to == EngineStatus::COMPLETING ||
+                       to == EngineStatus::RESETTING ||
+                       to == EngineStatus::SHUTTING_DOWN;
+            case EngineStatus::COMPLETING:
+            case EngineStatus::RESETTING:
+                return to == EngineStatus::IDLE ||
+                       to == EngineStatus::SHUTTING_DOWN;
+            case EngineStatus::SHUTTING_DOWN:
+                return false;
+        }
+        return false;
+    }
+
+    static const char* statusName(EngineStatus status) {
+        switch (status) {
+            case EngineStatus::IDLE:          return "IDLE";
+            case EngineStatus::GENERATING:    return "GENERATING";
+            case EngineStatus::COMPLETING:    return "COMPLETING";
+            case EngineStatus::RESETTING:     return "RESETTING";
+            case EngineStatus::SHUTTING_DOWN: return "SHUTTING_DOWN";
+        }
+        return "UNKNOWN";
+    }
+
+    // Atomically move from -> to. Fails if the current status is not
+    // `from` (another thread got there first) or the edge is illegal.
+    // task_id is kept as-is when negative, except entering IDLE clears it.
+    bool transition(EngineStatus from, EngineStatus to, int task_id = -1) {
+        if (!isLegal(from, to)) {
+            return false;
+        }
+
+        uint64_t current = word.load(std::memory_order_acquire);
+        while (true) {
+            if (unpackStatus(current) != from) {
+                return false;
+            }
+
+            int next_id = task_id;
+            if (to == EngineStatus::IDLE) {
+                next_id = -1;
+            } else if (task_id < 0) {
+                next_id = unpackTaskId(current);
+            }
+
+            if (word.compare_exchange_weak(current, pack(to, next_id),
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+                transition_count.fetch_add(1, std::memory_order_relaxed);
+                notify(from, to, next_id);
+                return true;
+            }
+        }
+    }
+
+    // Enter SHUTTING_DOWN from any live state
+    bool requestShutdown() {
+        uint64_t current = word.load(std::memory_order_acquire);
+        while (true) {
+            EngineStatus from = unpackStatus(current);
+            if (from == EngineStatus::SHUTTING_DOWN) {
+                return false;
+            }
+            if (word.compare_exchange_weak(current,
+                                           pack(EngineStatus::SHUTTING_DOWN, unpackTaskId(current)),
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+                cancel_requested.store(true, std::memory_order_release);
+                transition_count.fetch_add(1, std::memory_order_relaxed);
+                notify(from, EngineStatus::SHUTTING_DOWN, unpackTaskId(current));
+                return true;
+            }
+        }
+    }
+
+    EngineStatus status() const {
+        return unpackStatus(word.load(std::memory_order_acquire));
+    }
+
+    int currentTaskId() const {
+        return unpackTaskId(word.load(std::memory_order_acquire));
+    }
+
+    EngineSnapshot snapshot() const {
+        uint64_t w = word.load(std::memory_order_acquire);
+        EngineSnapshot s;
+        s.status = unpackStatus(w);
+        s.currentTaskId = unpackTaskId(w);
+        s.cancelRequested = cancel_requested.load(std::memory_order_acquire);
+        s.resetRequested = reset_requested.load(std::memory_order_acquire);
+        s.transitions = transition_count.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // Requests may come from any thread; the engine consumes them at
+    // token boundaries.
+    void requestCancel() { cancel_requested.store(true, std::memory_order_release); }
+    void requestReset() {
+        reset_requested.store(true, std::memory_order_release);
+        cancel_requested.store(true, std::memory_order_release);
+    }
+
+    bool consumeCancel() { return cancel_requested.exchange(false, std::memory_order_acq_rel); }
+    bool consumeReset() { return reset_requested.exchange(false, std::memory_order_acq_rel); }
+
+    void clearRequests() {
+        cancel_requested.store(false, std::memory_order_release);
+        reset_requested.store(false, std::memory_order_release);
+    }
+
+    // Register before the engine starts, or from any thread at runtime;
+    // observers are never removed.
+    bool addObserver(EngineStateObserver cb) {
+        int slot = observer_slots.fetch_add(1, std::memory_order_acq_rel);
+        if (slot >= MAX_OBSERVERS) {
+            return false;
+        }
+        observers[slot] = cb;
+        observer_ready[slot].store(true, std::memory_order_release);
+        return true;
+    }
+
+    uint64_t getTransitionCount() const {
+        return transition_count.load(std::memory_order_relaxed);
+    }
+};
+
+#endif // ENGINE_STATE_HPP
@@ -0,0 +1,178 @@
+// error_recovery.hpp
+// Decodes StatusOut error codes and recovers the accelerator so a
+// faulting task is retried or failed while the rest of the queue runs.
+
+#ifndef ERROR_RECOVERY_HPP
+#define ERROR_RECOVERY_HPP
+
+#include "accelerator.hpp"
+#include "types.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+
+// StatusOut::error_code values
+// todo align with the HLS design once its error reporting is fixed
+enum class AccelError : uint32_t {
+    NONE            = 0,
+    DDR_TIMEOUT     = 1,    // AXI read/write did not complete
+    DMA_FAULT       = 2,    // AXI SLVERR/DECERR on a transfer
+    KV_OVERFLOW     = 3,    // Sequence ran past the KV cache region
+    INVALID_CONFIG  = 4,    // config_in rejected by the kernel
+    KV_CORRUPT      = 5,    // KV cache contents failed a sanity check
+    
+    // Host-side codes (never reported by the kernel)
+    HANG            = 0x100 // Watchdog: run stopped making progress
+};
+
+enum class RecoveryAction {
+    RETRY,          // Soft reset, requeue the task
+    FAIL_TASK,      // Soft reset, report the task as failed
+    FULL_RESET      // Reset including KV wipe, then requeue
+};
+
+struct ErrorInfo {
+    AccelError code;
+    const char* name;
+    RecoveryAction action;
+};
+
+inline ErrorInfo decodeAccelError(uint32_t code) {
+    switch ((AccelError)code) {
+        case AccelError::NONE:
+            return {AccelError::NONE, "NONE", RecoveryAction::RETRY};
+        case AccelError::DDR_TIMEOUT:
+            return {AccelError::DDR_TIMEOUT, "DDR_TIMEOUT", RecoveryAction::RETRY};
+        case AccelError::DMA_FAULT:
+            return {AccelError::DMA_FAULT, "DMA_FAULT", RecoveryAction::RETRY};
+        case AccelError::KV_OVERFLOW:
+            // Same task would overflow again
+            return {AccelError::KV_OVERFLOW, "KV_OVERFLOW", RecoveryAction::FAIL_TASK};
+        case AccelError::INVALID_CONFIG:
+            return {AccelError::INVALID_CONFIG, "INVALID_CONFIG", RecoveryAction::FAIL_TASK};
+        case AccelError::KV_CORRUPT:
+            return {AccelError::KV_CORRUPT, "KV_CORRUPT", RecoveryAction::FULL_RESET};
+        case AccelError::HANG:
+            return {AccelError::HANG, "HANG", RecoveryAction::RETRY};
+    }
+    return {(AccelError)code, "UNKNOWN", RecoveryAction::RETRY};
+}
+
+class ErrorRecovery {
+public:
+    static const int MAX_ATTEMPTS = 3;     // Runs per task before giving up
+
+    static const int NUM_TRACKED_CODES = 8;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Accelerator& accel;
+
+    // Statistics
+    uint64_t errors;
+    uint64_t errors_by_code[NUM_TRACKED_CODES];   // Last slot: other codes
+    uint64_t retries;
+    uint64_t failures;
+    uint64_t soft_resets;
+    uint64_t full_resets;
+    uint64_t reset_failures;
+    uint64_t recovery_us_total;
+    uint64_t recovery_us_max;
+
+    void countCode(uint32_t code) {
+        int slot = code < (uint32_t)(NUM_TRACKED_CODES - 1) ? (int)code : NUM_TRACKED_CODES - 1;
+        errors_by_code[slot]++;
+    }
+
+public:
+    explicit ErrorRecovery(Accelerator& accelerator)
+        : accel(accelerator), errors(0), retries(0), failures(0),
+          soft_resets(0), full_resets(0), reset_failures(0),
+          recovery_us_total(0), recovery_us_max(0) {
+        for (int i = 0; i < NUM_TRACKED_CODES; i++) {
+            errors_by_code[i] = 0;
+        }
+    }
+
+    // Recover from an error reported while running task. Returns RETRY
+    // when the caller should requeue the task, FAIL_TASK otherwise.
+    RecoveryAction handle(const Task& task, uint32_t error_code) {
+        Clock::time_point start = Clock::now();
+        ErrorInfo info = decodeAccelError(error_code);
+
+        errors++;
+        countCode(error_code);
+
+        printf("[Recovery] Task %d: %s (0x%08X), attempt %d\n",
+               task.id, info.name, error_code, task.attempts + 1);
+
+        if (info.action == RecoveryAction::FULL_RESET) {
+            full_resets++;
+            accel.reset();
+        } else {
+            soft_resets++;
+            if (!accel.softReset()) {
+                // Kernel wedged: escalate
+                reset_failures++;
+                full_resets++;
+                accel.reset();
+            }
+        }
+
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - start).count();
+        recovery_us_total += us;
+        if (us > recovery_us_max) recovery_us_max = us;
+
+        RecoveryAction result = info.action;
+        if (result == RecoveryAction::FULL_RESET) {
+            result = RecoveryAction::RETRY;
+        }
+        if (result == RecoveryAction::RETRY && task.attempts + 1 >= MAX_ATTEMPTS) {
+            result = RecoveryAction::FAIL_TASK;
+        }
+
+        if (result == RecoveryAction::RETRY) {
+            retries++;
+        } else {
+            failures++;
+        }
+
+        printf("[Recovery] Recovered in %lu us, task %d %s\n",
+               (unsigned long)us, task.id,
+               result == RecoveryAction::RETRY ? "requeued" : "failed");
+
+        return result;
+    }
+
+    uint64_t getErrorCount() const { return errors; }
+    uint64_t getRetryCount() const { return retries; }
+    uint64_t getFailureCount() const { return failures; }
+
+    double getMeanTimeToRecoveryUs() const {
+        return errors ? (double)recovery_us_total / errors : 0.0;
+    }
+
+    void printStats() {
+        printf("\n[Recovery] Error Statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Errors:            %lu\n", (unsigned long)errors);
+        for (int i = 0; i < NUM_TRACKED_CODES; i++) {
+            if (errors_by_code[i] == 0) continue;
+            const char* name = (i == NUM_TRACKED_CODES - 1)
+                ? "OTHER" : decodeAccelError(i).name;
+            printf("  %-16s %lu\n", name, (unsigned long)errors_by_code[i]);
+        }
+        printf("Tasks retried:     %lu\n", (unsigned long)retries);
+        printf("Tasks failed:      %lu\n", (unsigned long)failures);
+        printf("Soft resets:       %lu (%lu escalated)\n",
+               (unsigned long)soft_resets, (unsigned long)reset_failures);
+        printf("Full resets:       %lu\n", (unsigned long)full_resets);
+        printf("MTTR:              %.1f us (max %lu us)\n",
+               getMeanTimeToRecoveryUs(), (unsigned long)recovery_us_max);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // ERROR_RECOVERY_HPP
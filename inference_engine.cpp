@@ -1,177 +1,78 @@
 // inference_engine.cpp
-// Main inference engine implementation with weight loading
+// Interactive front end for the inference engine (inference_engine.hpp)
 
-#include "types.hpp"
-#include "queue.hpp"
-#include "accelerator.hpp"
-#include "weight_loader.hpp"
-#include "memory_manager.hpp"
+#include "inference_engine.hpp"
+#include "async_generation.hpp"
+#include "shm_transport.hpp"
 #include <iostream>
 #include <thread>
 #include <atomic>
-#include <chrono>
-#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
 
-//TODO global queue vs mutex 
-Queue<Task, 100> taskQueue;
-Queue<Command, 10> commandQueue;
-
-std::vector<uint32_t> tokenize(const std::string& text) {
-    std::vector<uint32_t> tokens;
-    for (char c : text) {
-        tokens.push_back((uint32_t)c);
-    }
-    return tokens;
-}
-
-std::string detokenize(uint32_t token) {
-    if (token < 128) {
-        return std::string(1, (char)token);
-    }
-    return "[T" + std::to_string(token) + "]";
-}
-
-void sendOutputToUI(const std::string& text) {
-    std::cout << text << std::flush;
-}
-
-void clearKvCache(Accelerator& accel) {
-    accel.reset();
-}
-
-void handleTopLevelCommand(const Command& cmd, EngineState& state, Accelerator& accel) {
-    switch (cmd.type) {
-        case CommandType::SHUTDOWN:
-            state.status = EngineStatus::SHUTTING_DOWN;
-            break;
-            
-        case CommandType::RESET:
-            clearKvCache(accel);
-            sendOutputToUI("\n[Memory cleared]\n");
-            break;
-            
-        case CommandType::STOP_CURRENT:
-            // Nothing to stop when idle
-            break;
+#ifdef ASYNC_GENERATION_AVAILABLE
+// /async: n concurrent generations driven by coroutines on one loop thread
+AsyncTask asyncGeneration(AsyncEngine& engine, std::string prompt, int index,
+                          std::shared_ptr<std::atomic<int>> remaining) {
+    TokenStream stream = engine.generate(prompt, GenerationParams());
+    
+    int tokens = 0;
+    while (std::optional<uint32_t> token = co_await stream.next()) {
+        tokens++;
     }
-}
-
-void runGeneration(const Task& task, EngineState& state, Accelerator& accel) {
-    state.cancelCurrent = false;
-    state.resetRequested = false;
-    
-    std::vector<uint32_t> promptTokens = tokenize(task.prompt);
-    
-    sendOutputToUI("\n[Generating] ");
-    
-    accel.startInference(task.id, promptTokens);
-    
-    int token_count = 0;
-    const int MAX_TOKENS = 50; // todo determine limit
     
-    while (token_count < MAX_TOKENS) {
-
-        Command cmd;
-        if (commandQueue.tryPop(cmd)) {
-            switch (cmd.type) {
-                case CommandType::SHUTDOWN:
-                    state.cancelCurrent = true;
-                    state.status = EngineStatus::SHUTTING_DOWN;
-                    sendOutputToUI("\n[Aborted: shutdown requested]\n");
-                    return;
-                    
-                case CommandType::RESET:
-                    state.cancelCurrent = true;
-                    state.resetRequested = true;
-                    break;
-                    
-                case CommandType::STOP_CURRENT:
-                    state.cancelCurrent = true;
-                    break;
-            }
-        }
-        
-        if (state.cancelCurrent) {
-            sendOutputToUI("\n[Aborted]\n");
-            
-            if (state.resetRequested) {
-                clearKvCache(accel);
-                sendOutputToUI("[Memory cleared]\n");
-                state.resetRequested = false;
-            }
-            return;
-        }
-        
-        uint32_t nextToken;
-        if (accel.getNextToken(nextToken)) {
-            if (nextToken == EOS_TOKEN) {
-                sendOutputToUI("\n[EOS]\n");
-                return;
-            }
-            
-            sendOutputToUI(detokenize(nextToken));
-            token_count++;
-        }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(50)); //todo tune processing time
+    std::cout << "\n[Async " << index << "] " << tokens << " tokens, finish "
+              << (int)stream.finishReason() << "\n";
+    if (remaining->fetch_sub(1) == 1) {
+        std::cout << "[Async] All generations finished\n";
     }
-    
-    sendOutputToUI("\n[Max tokens reached]\n");
 }
+#endif
 
-void inferenceEngineThread() {
-    EngineState state;
-    Accelerator accel;
-    
-    //todo determine correct mem address
-    uint64_t input_addr = 0x10000000;
-    uint64_t output_addr = 0x20000000;
-    uint64_t kv_cache_addr = 0x30000000;
-    accel.configure(input_addr, output_addr, kv_cache_addr, 128, 2048);
-    
-    std::cout << "[Engine] Inference engine started\n";
-    
-    while (state.status != EngineStatus::SHUTTING_DOWN) {
-        if (state.status == EngineStatus::IDLE) {
-
-            Command cmd;
-            if (commandQueue.tryPop(cmd)) {
-                handleTopLevelCommand(cmd, state, accel);
-                continue;
-            }
-            
-            Task task;
-            if (taskQueue.tryPop(task)) {
-                state.currentTaskId = task.id;
-                state.status = EngineStatus::GENERATING;
-                
-                runGeneration(task, state, accel);
-                
-                if (state.status == EngineStatus::GENERATING) {
-                    state.status = EngineStatus::IDLE;
-                    state.currentTaskId = -1;
-                }
-            } else {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+int main(int argc, char** argv) {
+    RegisterRecorder recorder;
+    EngineOptions options;
+    bool serve_shm = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) {
+            if (recorder.open(argv[++i])) {
+                options.recorder = &recorder;
             }
-        } else if (state.status == EngineStatus::GENERATING) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        } else if (arg == "--shm") {
+            serve_shm = true;
+        } else if (arg == "--host-embed") {
+            options.host_embed_bytes = 8 * 1024 * 1024;
+        } else if (arg == "--host-lm-head" && i + 1 < argc) {
+            options.host_lm_head_fraction = atof(argv[++i]);
+        } else if (arg == "--cache") {
+            options.cache.enabled = true;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            options.cache.enabled = true;
+            options.cache.disk_dir = argv[++i];
+        } else if (arg == "--sessions" && i + 1 < argc) {
+            options.sessions.enabled = true;
+            options.sessions.snapshot_path = argv[++i];
+        } else if (arg == "--stall-window-ms" && i + 1 < argc) {
+            options.stall_window_ms = (uint32_t)atoi(argv[++i]);
+        } else if (arg == "--share-weights") {
+            options.shared_weights.enabled = true;
+        } else if (arg == "--share-weights-dir" && i + 1 < argc) {
+            options.shared_weights.enabled = true;
+            options.shared_weights.dir = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--record trace.bin] [--shm] [--host-embed]\n"
+                      << "       [--host-lm-head FRACTION] [--cache] [--cache-dir DIR]\n"
+                      << "       [--sessions SNAPSHOT] [--share-weights] [--share-weights-dir DIR]\n"
+                      << "       [--stall-window-ms MS]\n";
+            return 1;
         }
     }
     
-    clearKvCache(accel);
-    std::cout << "[Engine] Shutdown complete\n";
-}
-
-bool pushTask(const Task& task) {
-    if (taskQueue.full()) {
-        std::cout << "[Warning] Task queue full, dropping request\n";
-        return false;
-    }
-    return taskQueue.push(task);
-}
-
-int main() {
     std::cout << "=================================================\n";
     std::cout << "FPGA Inference Engine - with Weight Loading\n";
     std::cout << "=================================================\n";
@@ -179,76 +80,51 @@ int main() {
     std::cout << "  /quit   - Shutdown engine\n";
     std::cout << "  /stop   - Stop current generation\n";
     std::cout << "  /reset  - Clear KV cache\n";
+    std::cout << "  /status - Show engine state\n";
+    std::cout << "  /tenants - Show per-tenant scheduling\n";
+    std::cout << "  /regex <pattern> <text> - Generate output matching pattern\n";
+    std::cout << "  /json <schema.json> <text> - Generate JSON matching a schema file\n";
+    std::cout << "  /sample <n> <text> - Generate n samples from one prefill\n";
+    std::cout << "  /beam <n> <text> - Beam search of width n\n";
+    std::cout << "  /session <id> <text> - Conversation turn; text is the whole history\n";
+    std::cout << "  /snapshot - Write session KV to the snapshot file\n";
+#ifdef ASYNC_GENERATION_AVAILABLE
+    std::cout << "  /async <n> <text> - Run n concurrent coroutine generations\n";
+#endif
     std::cout << "  <text>  - Generate response\n";
     std::cout << "=================================================\n\n";
     
-    std::cout << "Phase 1: Memory Initialization\n";
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
-    
-    MemoryManager memory;
-    if (!memory.init()) {
-        std::cerr << "Failed to initialize memory manager\n";
-        return 1;
-    }
-    
-    size_t weight_size = 1024 * 1024 * 1024;  // 1GB for weights
-    size_t kv_cache_size = 512 * 1024 * 1024;  // 512MB for KV cache
-    size_t input_size = 16 * 1024;   // 16KB input buffer
-    size_t output_size = 16 * 1024;  // 16KB output buffer
-    
-    if (!memory.allocateWeights(weight_size)) {
-        std::cerr << "Failed to allocate weight memory\n";
+    InferenceEngine engine(options);
+    if (!engine.init() || !engine.start()) {
         return 1;
     }
     
-    if (!memory.allocateKVCache(kv_cache_size)) {
-        std::cerr << "Failed to allocate KV cache\n";
-        return 1;
-    }
-    
-    if (!memory.allocateIOBuffers(input_size, output_size)) {
-        std::cerr << "Failed to allocate I/O buffers\n";
-        return 1;
-    }
-    
-    memory.printMemoryMap();
-    
-    std::cout << "Phase 2: Weight Loading\n";
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
-    
-    WeightLoader weightLoader;
-    
-    const char* model_file = "model.pt.bin";
-    
-    if (!weightLoader.loadFromBinary(model_file)) {
-        std::cout << "\nNo model weights found. To load weights:\n";
-        std::cout << "  1. Get INT4 quantized PyTorch model (model.pt)\n";
-        std::cout << "  2. Run: python convert_weights.py model.pt model.pt.bin\n";
-        std::cout << "  3. Place model.pt.bin in current directory\n";
-        std::cout << "\nContinuing without weights (simulation mode)...\n\n";
-    } else {
-        if (!weightLoader.allocateDDR(
-                memory.getWeightsPhysAddr(),
-                memory.getWeightsVirtAddr(),
-                memory.getWeightsSize())) {
-            std::cerr << "Failed to allocate DDR for weights\n";
-            return 1;
+    // --shm: serve out-of-process clients instead of stdin
+    if (serve_shm) {
+        ShmServer server;
+        bool created = server.create(
+            [&engine](Task& task) { return engine.submit(task); },
+            [&engine](CommandType type) { engine.sendCommand(type); });
+        server.setWaitEstimate([&engine] { return (uint32_t)engine.getQueueWaitMs(); });
+        if (created) {
+            std::cout << "\nServing shared-memory clients at " << server.path() << "\n";
+            server.run();
         }
-        
-        if (!weightLoader.copyToDDR()) {
-            std::cerr << "Failed to copy weights to DDR\n";
-            return 1;
-        }
-        
-        std::cout << "Weights loaded successfully!\n\n";
+        engine.shutdown();      // Finishes pending sinks while server is alive
+        server.printStats();
+        recorder.close();
+        std::cout << "\n[Main] Application shutdown\n";
+        return created ? 0 : 1;
     }
     
-    std::cout << "Phase 3: Accelerator Configuration\n";
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
+#ifdef ASYNC_GENERATION_AVAILABLE
+    GenerationLoop generationLoop;
+    AsyncEngine asyncEngine(generationLoop, [&engine](Task& task) {
+        return engine.submit(task);
+    });
+    std::thread loopThread([&generationLoop] { generationLoop.run(); });
+#endif
     
-    std::thread engineThread(inferenceEngineThread);
-    
-    int nextTaskId = 1;
     std::string userInput;
     
     std::cout << "\nSystem ready for inference!\n";
@@ -262,21 +138,109 @@ int main() {
         }
         
         if (userInput == "/quit") {
-            commandQueue.push(Command(CommandType::SHUTDOWN));
             break;
         } else if (userInput == "/stop") {
-            commandQueue.push(Command(CommandType::STOP_CURRENT));
+            engine.sendCommand(CommandType::STOP_CURRENT);
         } else if (userInput == "/reset") {
-            commandQueue.push(Command(CommandType::RESET));
+            engine.sendCommand(CommandType::RESET);
+        } else if (userInput == "/status") {
+            EngineSnapshot snap = engine.snapshot();
+            std::cout << "[Engine] " << EngineState::statusName(snap.status)
+                      << ", task " << snap.currentTaskId
+                      << ", transitions " << snap.transitions
+                      << ", stalls " << engine.getStallCount()
+                      << ", queued " << engine.getQueuedTasks()
+                      << " (~" << (int)engine.getQueueWaitMs() << " ms wait)\n";
+        } else if (userInput == "/tenants") {
+            engine.printTenantStats();
+#ifdef ASYNC_GENERATION_AVAILABLE
+        } else if (userInput.compare(0, 7, "/async ") == 0) {
+            // /async <n> <prompt>
+            size_t space = userInput.find(' ', 7);
+            int n = atoi(userInput.c_str() + 7);
+            std::string prompt = space == std::string::npos ? "" : userInput.substr(space + 1);
+            if (n <= 0 || prompt.empty()) {
+                std::cout << "Usage: /async <n> <prompt>\n";
+                continue;
+            }
+            auto remaining = std::make_shared<std::atomic<int>>(n);
+            for (int i = 0; i < n; i++) {
+                generationLoop.spawn(asyncGeneration(asyncEngine, prompt, i, remaining));
+            }
+#endif
+        } else if (userInput.compare(0, 7, "/regex ") == 0 ||
+                   userInput.compare(0, 6, "/json ") == 0) {
+            // /regex <pattern> <prompt>, /json <schema file> <prompt>
+            bool regex = userInput[1] == 'r';
+            size_t begin = regex ? 7 : 6;
+            size_t space = userInput.find(' ', begin);
+            std::string arg = userInput.substr(begin, space == std::string::npos ? std::string::npos
+                                                                                  : space - begin);
+            std::string prompt = space == std::string::npos ? "" : userInput.substr(space + 1);
+            if (arg.empty() || prompt.empty()) {
+                std::cout << (regex ? "Usage: /regex <pattern> <prompt>\n"
+                                    : "Usage: /json <schema.json> <prompt>\n");
+                continue;
+            }
+            std::string spec = arg;
+            if (!regex) {
+                std::ifstream file(arg);
+                if (!file) {
+                    std::cout << "Cannot read " << arg << "\n";
+                    continue;
+                }
+                std::stringstream text;
+                text << file.rdbuf();
+                spec = text.str();
+            }
+            Task task(0, TaskType::GENERATE, prompt);
+            task.constraint = engine.compileConstraint(
+                regex ? ConstraintType::REGEX : ConstraintType::JSON_SCHEMA, spec);
+            if (task.constraint) {
+                engine.submit(task);
+            }
+        } else if (userInput.compare(0, 8, "/sample ") == 0 ||
+                   userInput.compare(0, 6, "/beam ") == 0) {
+            // /sample <n> <prompt>, /beam <n> <prompt>
+            bool beam = userInput[1] == 'b';
+            size_t begin = beam ? 6 : 8;
+            size_t space = userInput.find(' ', begin);
+            int n = atoi(userInput.c_str() + begin);
+            std::string prompt = space == std::string::npos ? "" : userInput.substr(space + 1);
+            if (n <= 0 || n > (int)MAX_CANDIDATES || prompt.empty()) {
+                std::cout << (beam ? "Usage: /beam <n> <prompt>" : "Usage: /sample <n> <prompt>")
+                          << ", n up to " << MAX_CANDIDATES << "\n";
+                continue;
+            }
+            Task task(0, TaskType::GENERATE, prompt);
+            task.candidates = (uint32_t)n;
+            task.candidate_mode = beam ? CandidateMode::BEAM : CandidateMode::SAMPLE;
+            engine.submit(task);
+        } else if (userInput.compare(0, 9, "/session ") == 0) {
+            // /session <id> <conversation so far>
+            size_t space = userInput.find(' ', 9);
+            std::string prompt = space == std::string::npos ? "" : userInput.substr(space + 1);
+            if (space == 9 || prompt.empty()) {
+                std::cout << "Usage: /session <id> <prompt>\n";
+                continue;
+            }
+            Task task(0, TaskType::GENERATE, prompt);
+            task.session = userInput.substr(9, space - 9);
+            engine.submit(task);
+        } else if (userInput == "/snapshot") {
+            engine.sendCommand(CommandType::SNAPSHOT_SESSIONS);
         } else {
-            Task task(nextTaskId++, TaskType::GENERATE, userInput);
-            pushTask(task);
+            Task task(0, TaskType::GENERATE, userInput);
+            engine.submit(task);
         }
     }
     
-    engineThread.join();
-    
-    memory.cleanup();
+    engine.shutdown();
+#ifdef ASYNC_GENERATION_AVAILABLE
+    generationLoop.stop();
+    loopThread.join();
+#endif
+    recorder.close();
     
     std::cout << "\n[Main] Application shutdown\n";
     return 0;
@@ -0,0 +1,1472 @@
+// inference_engine.hpp
+// The inference engine as an embeddable object: owns the DDR regions,
+// loaded weights, task and command queues, state machine and the engine
+// thread. The CLI (inference_engine.cpp) and the C API (engine_api.cpp)
+// are both thin front ends over this class.
+//
+//   InferenceEngine engine(options);
+//   if (!engine.init() || !engine.start()) ...
+//   engine.submit(task);            // any thread
+//   engine.shutdown();              // drains, joins, frees DDR
+//
+// One engine drives one accelerator; on hardware only one instance per
+// process can own the UIO device and DDR regions.
+
+#ifndef INFERENCE_ENGINE_HPP
+#define INFERENCE_ENGINE_HPP
+
+#include "types.hpp"
+#include "engine_state.hpp"
+#include "queue.hpp"
+#include "accelerator.hpp"
+#include "task_pipeline.hpp"
+#include "error_recovery.hpp"
+#include "run_watchdog.hpp"
+#include "weight_loader.hpp"
+#include "weight_share.hpp"
+#include "interrupt_handler.hpp"
+#include "register_trace.hpp"
+#include "perf_model.hpp"
+#include "capacity_planner.hpp"
+#include "admission_control.hpp"
+#include "tenant_scheduler.hpp"
+#include "preemption.hpp"
+#include "response_cache.hpp"
+#include "session_store.hpp"
+#include "embedding_gather.hpp"
+#include "lm_head_topk.hpp"
+#include "constrained_decoding.hpp"
+#include "candidate_search.hpp"
+#include "memory_manager.hpp"
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+inline std::vector<uint32_t> tokenize(const std::string& text) {
+    std::vector<uint32_t> tokens;
+    for (char c : text) {
+        tokens.push_back((uint32_t)c);
+    }
+    return tokens;
+}
+
+inline std::string detokenize(uint32_t token) {
+    if (token < 128) {
+        return std::string(1, (char)token);
+    }
+    return "[T" + std::to_string(token) + "]";
+}
+
+// Token texts for constrained decoding: ids below 128 are characters,
+// the rest have no text and are never allowed
+inline std::vector<std::string> tokenizerPieces(uint32_t vocab_size) {
+    std::vector<std::string> pieces(vocab_size);
+    for (uint32_t t = 0; t < vocab_size && t < 128; t++) {
+        pieces[t] = std::string(1, (char)t);
+    }
+    return pieces;
+}
+
+struct EngineOptions {
+    std::string model_file;
+    size_t weight_region;           // DDR reserved for the weight image
+    size_t kv_region;               // DDR reserved for KV slots
+    size_t input_buffer;
+    size_t output_buffer;
+    size_t host_embed_bytes;        // Input region for host-gathered embeddings, 0 = off
+    double host_lm_head_fraction;   // Share of lm_head rows scored on the CPU, 0 = off
+    uint32_t requested_context;     // 0 = model max_seq_len
+    uint32_t max_kv_slots;          // 0 = as many as kv_region holds
+    std::string uio_device;         // REAL_HARDWARE only
+    RegisterRecorder* recorder;     // Null = register tracing off
+    AdmissionPolicy admission;
+    PreemptionPolicy preemption;
+    ResponseCacheOptions cache;
+    SessionOptions sessions;
+    SharedWeightOptions shared_weights;
+    uint32_t stall_window_ms;       // A run with no status progress this long is hung
+
+    EngineOptions() : model_file("model.pt.bin"),
+                      weight_region(1024 * 1024 * 1024),     // 1GB for weights
+                      kv_region(512 * 1024 * 1024),          // 512MB for KV cache
+                      input_buffer(16 * 1024),
+                      output_buffer(16 * 1024),
+                      host_embed_bytes(0),
+                      host_lm_head_fraction(0.0),
+                      requested_context(0),
+                      max_kv_slots(0),
+                      uio_device("/dev/uio0"),
+                      recorder(nullptr),
+                      stall_window_ms(2000) {}
+};
+
+class InferenceEngine {
+public:
+    static const int DEFAULT_MAX_TOKENS = 50;   // todo determine limit
+    static const size_t TASK_QUEUE_SIZE = 100;
+
+private:
+    EngineOptions options;
+
+    // Producers are any front-end thread; the engine thread consumes.
+    // Tasks wait in per-tenant queues and are picked by fair share.
+    mutable std::mutex queue_mutex;
+    TenantScheduler scheduler;
+    Queue<Command, 10> command_queue;
+    std::atomic<int> next_task_id;
+
+    // Shared with front ends, metrics and interrupt callbacks
+    EngineState engine_state;
+
+    // Set by the ERROR interrupt; engine re-reads status at the next token
+    std::atomic<bool> accel_error_pending;
+
+    // ap_done arrives once per launched run, in launch order, and can land
+    // after the next run was started back to back. Interrupts are matched
+    // to runs by count; only the current run's completes it. A reset
+    // aborts runs without ap_done, so it settles the count.
+    std::atomic<uint64_t> runs_launched;    // Written by the engine thread
+    std::atomic<uint64_t> runs_done;        // Counted by the interrupt thread
+    std::atomic<uint64_t> run_current;      // Launch number being decoded, 0 = none
+
+    // Simulation: error code to raise at the next token boundary, 0 = none
+    std::atomic<uint32_t> sim_error_pending;
+
+    // Engine thread only: tokens of the running task's output produced so
+    // far, counting earlier runs it was suspended or retried from
+    uint32_t output_position;
+
+    RunWatchdog run_watchdog;
+
+    // Shape of the loaded model (or a stand-in in simulation mode); sent
+    // to the kernel in config_in and used by the timing model
+    ModelShape model_shape;
+
+    // Batch slots and per-slot context chosen at init
+    CapacityPlan capacity_plan;
+
+    AdmissionController admission;
+
+    // Engine thread only: KV slots held by suspended tasks, and the slot
+    // the staged task will run in
+    KvSlotPool kv_slots;
+    PreemptionStats preemption_stats;
+    uint32_t staged_kv_slot;
+
+    // Engine thread only: blocks and rows of a staged candidates task
+    CandidateGroup staged_group;
+    CandidateStats candidate_stats;
+
+    // Engine thread only: session KV between turns. A staged turn whose
+    // context was put back in its slot continues after kv_prefix
+    // positions, written under kv_epoch; the slot of the run in progress
+    // (-1 between runs) is never the one written.
+    SessionStore sessions;
+    uint32_t staged_kv_prefix;
+    uint32_t staged_kv_epoch;
+    int active_kv_slot;
+    bool snapshot_requested;
+
+    // Cache hits skip the queue and are streamed to their sinks by the
+    // replay thread, so they never wait behind a running generation
+    struct CacheReplay {
+        Task task;
+        std::shared_ptr<const CachedResponse> response;
+    };
+    ResponseCache response_cache;
+    std::mutex replay_mutex;
+    std::condition_variable replay_cv;
+    std::deque<CacheReplay> replay_queue;
+    std::thread replay_thread;
+    bool replay_running;
+
+    MemoryManager memory;
+    SharedWeights shared_weights;   // Outlives the views weight_loader holds
+    WeightLoader weight_loader;
+    EmbeddingGather embedding_gather;
+
+    // Split lm_head: host rows, and the kernel's hidden state per token
+    ShardedLmHead lm_head_shards;
+    std::vector<float> lm_head_hidden;
+
+    // Grammars are compiled by front ends; masks are applied here
+    ConstraintCache constraints;
+    ConstraintStats constraint_stats;
+#ifdef REAL_HARDWARE
+    InterruptHandler irq;
+#endif
+
+    std::thread engine_thread;
+    bool initialized;
+    bool memory_ready;
+
+    bool popTask(Task& task) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return scheduler.pop(task);
+    }
+
+    // Ignores caps and rate limits; shutdown only
+    bool drainTask(Task& task) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return scheduler.drain(task);
+    }
+
+    void completeTask(const Task& task, uint32_t generated) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        scheduler.complete(task, generated);
+    }
+
+    // Pop and stage the next task: fresh tasks in a free KV slot,
+    // suspended ones in their own. Suspended tasks whose KV was wiped
+    // by a reset can't resume and are finished here.
+    bool stageNext(TaskPipeline& pipeline, Accelerator& accel) {
+        kv_slots.sync(accel.getKvEpoch());
+        staged_kv_prefix = 0;
+
+        Task next;
+        while (popTask(next)) {
+            if (next.resume.valid && next.resume.kv_epoch != accel.getKvEpoch()) {
+                sendTaskOutput(next, "\n[Aborted: context cleared while preempted]\n");
+                preemption_stats.discard(next);
+                admission.drop(next.id);
+                completeTask(next, 0);
+                finishTask(next, FinishReason::CANCELLED);
+                continue;
+            }
+
+            staged_kv_slot = next.resume.valid ? next.resume.kv_slot : kv_slots.freeSlot();
+            if (next.candidates > 0) {
+                // Candidates share the blocks of one slot; the prefill
+                // fills row 0's
+                std::vector<uint32_t> prompt = tokenize(next.prompt);
+                uint32_t max_out = next.max_tokens > 0 ? (uint32_t)next.max_tokens
+                                                       : DEFAULT_MAX_TOKENS;
+                uint32_t slot_blocks = capacity_plan.blocks_per_slot;
+                if (!staged_group.init(next.candidate_mode, next.candidates,
+                                       (uint32_t)prompt.size(), max_out,
+                                       staged_kv_slot * slot_blocks, slot_blocks,
+                                       capacity_plan.block_tokens)) {
+                    sendTaskOutput(next, "\n[Failed: prompt too large for a KV slot]\n");
+                    admission.drop(next.id);
+                    completeTask(next, 0);
+                    finishTask(next, FinishReason::FAILED);
+                    continue;
+                }
+                std::vector<uint32_t> tables;
+                staged_group.tables(tables);
+                pipeline.stage(next, prompt, staged_kv_slot, &tables);
+                return true;
+            }
+            if (next.resume.valid) {
+                pipeline.stage(next, std::vector<uint32_t>(), staged_kv_slot);
+                return true;
+            }
+            std::vector<uint32_t> prompt = tokenize(next.prompt);
+            staged_kv_prefix = restoreSession(next, prompt, accel);
+            pipeline.stage(next, staged_kv_prefix > 0
+                               ? std::vector<uint32_t>(prompt.begin() + staged_kv_prefix, prompt.end())
+                               : prompt,
+                           staged_kv_slot, nullptr, staged_kv_prefix);
+            return true;
+        }
+        return false;
+    }
+
+    // A session turn extending the stored context: its KV goes back into
+    // a free slot other than the running one, which becomes the staged
+    // slot. Returns the positions restored (0 = prefill the whole prompt).
+    uint32_t restoreSession(const Task& task, const std::vector<uint32_t>& prompt,
+                            Accelerator& accel) {
+        SessionView view;
+        if (task.session.empty() || task.candidates > 0 ||
+            !sessions.lookup(task.session, prompt, view)) {
+            return 0;
+        }
+        uint32_t slot;
+        if (!kv_slots.freeSlotBesides(active_kv_slot, slot)) {
+            sessions.noSlot();
+            return 0;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        accel.writeKv(slot, view.kv, view.positions);
+        sessions.restored(view, std::chrono::duration<double, std::micro>(
+                              std::chrono::steady_clock::now() - start).count(),
+                          accel.getPerfModel().prefillUs(view.positions));
+        staged_kv_slot = slot;
+        staged_kv_epoch = accel.getKvEpoch();
+        printf("[Session] Task %d continues session %s after %u tokens%s\n", task.id,
+               task.session.c_str(), view.positions, view.from_snapshot ? " (from snapshot)" : "");
+        return view.positions;
+    }
+
+    // Before the slot can be reused: a session turn's context and its KV
+    // are kept for the next turn
+    void saveSession(const Task& task, uint32_t kv_slot, Accelerator& accel) {
+        if (task.session.empty() || !sessions.enabled()) {
+            return;
+        }
+        sessions.finish(task, tokenize(task.prompt), [&](uint32_t positions, uint8_t* dst) {
+            return accel.readKv(kv_slot, positions, dst);
+        });
+    }
+
+    // Queued or staged work in a higher class than the running task
+    bool higherPriorityWaiting(const Task& task, const TaskPipeline& pipeline) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        int running = scheduler.priorityOf(task);
+        if (pipeline.hasStaged() && scheduler.priorityOf(pipeline.stagedTask()) > running) {
+            return true;
+        }
+        return scheduler.waitingAbove(running);
+    }
+
+    // Checked at each token boundary once the run has produced
+    // min_tokens; no_slot_counted keeps starvation counted once per run.
+    // Candidates tasks run to the end: their rows can't be resumed from
+    // a single last token.
+    bool shouldPreempt(const Task& task, int token_count, int token_limit,
+                       const TaskPipeline& pipeline, bool& no_slot_counted) {
+        const PreemptionPolicy& policy = options.preemption;
+        if (task.candidates > 0) {
+            return false;
+        }
+        if (!policy.enabled || token_count < 1 || token_count < (int)policy.min_tokens ||
+            token_limit - token_count <= (int)policy.min_remaining) {
+            return false;
+        }
+        if (!higherPriorityWaiting(task, pipeline)) {
+            return false;
+        }
+        // This run's slot gets pinned; the preempting task needs another
+        if (kv_slots.freeCount() < 2) {
+            if (!no_slot_counted) {
+                preemption_stats.noSlot();
+                no_slot_counted = true;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // Stop the run, pin its KV and requeue it with its resume state. A
+    // staged task goes back to its queue so the scheduler picks what
+    // runs next. False if the kernel couldn't be stopped.
+    bool suspendTask(const Task& task, int token_count, uint32_t last_token,
+                     uint32_t constraint_state, uint32_t kv_slot, Accelerator& accel,
+                     TaskPipeline& pipeline) {
+        auto start = std::chrono::steady_clock::now();
+
+        if (!accel.suspendRun()) {
+            preemption_stats.suspendFailed();
+            return false;
+        }
+        run_watchdog.disarm();
+
+        Task resumed = task;
+        ResumeState& r = resumed.resume;
+        if (r.valid) {
+            r.position += token_count;
+        } else {
+            r.position = (uint32_t)tokenize(task.prompt).size() + token_count - 1;
+        }
+        r.valid = true;
+        r.kv_slot = kv_slot;
+        r.kv_epoch = accel.getKvEpoch();
+        r.generated += token_count;
+        r.last_token = last_token;
+        r.constraint_state = constraint_state;
+        r.preemptions++;
+        kv_slots.pin(kv_slot);
+
+        Task displaced;
+        bool had_staged = pipeline.drop(displaced);
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (had_staged) {
+                scheduler.unstage(displaced);
+            }
+            scheduler.suspend(task, resumed, (uint32_t)token_count);
+        }
+        admission.suspend(resumed);
+
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        preemption_stats.suspended(resumed, us, kv_slots.pinnedCount());
+
+        printf("[Engine] Preempted task %d after %u tokens (position %u, KV slot %u)\n",
+               task.id, r.generated, r.position, kv_slot);
+        sendTaskOutput(task, "\n[Preempted]\n");
+        engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+        return true;
+    }
+
+    bool popCommand(Command& cmd) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return command_queue.tryPop(cmd);
+    }
+
+    void sendOutputToUI(const std::string& text) {
+        std::cout << text << std::flush;
+    }
+
+    // Task-scoped output: tasks with a sink report through it instead
+    void sendTaskOutput(const Task& task, const std::string& text) {
+        if (!task.sink) {
+            sendOutputToUI(text);
+        }
+    }
+
+    void finishTask(const Task& task, FinishReason reason) {
+        response_cache.finish(task, tokenize(task.prompt), reason);
+        sessions.discard(task.id);
+        if (task.sink) {
+            task.sink->onFinish(reason);
+        }
+    }
+
+    // After begin() or finishRun(): the pipeline may have issued AP_START
+    void noteLaunches(const TaskPipeline& pipeline, bool begun) {
+        runs_launched = pipeline.getLaunches();
+        if (begun) {
+            run_current = pipeline.getLaunches();
+            // Launched back to back and already done before it began here
+            if (runs_done.load() >= run_current.load()) {
+                engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+            }
+        }
+    }
+
+    // Runs aborted by a reset raise no ap_done
+    void settleRuns() {
+        runs_done = runs_launched.load();
+    }
+
+    void clearKvCache(Accelerator& accel) {
+        accel.reset();
+        settleRuns();
+    }
+
+    void handleTopLevelCommand(const Command& cmd, Accelerator& accel) {
+        switch (cmd.type) {
+            case CommandType::SHUTDOWN:
+                engine_state.requestShutdown();
+                break;
+
+            case CommandType::RESET:
+                if (engine_state.transition(EngineStatus::IDLE, EngineStatus::RESETTING)) {
+                    clearKvCache(accel);
+                    sendOutputToUI("\n[Memory cleared]\n");
+                    engine_state.transition(EngineStatus::RESETTING, EngineStatus::IDLE);
+                }
+                break;
+
+            case CommandType::STOP_CURRENT:
+                // Nothing to stop when idle
+                break;
+
+            case CommandType::SNAPSHOT_SESSIONS:
+                sessions.snapshot();
+                break;
+        }
+    }
+
+    // Reset the accelerator and requeue or fail the task
+    void recoverTask(const Task& task, uint32_t error_code, ErrorRecovery& recovery) {
+        run_watchdog.disarm();
+
+        RecoveryAction action = recovery.handle(task, error_code);
+        settleRuns();
+
+        if (action == RecoveryAction::RETRY) {
+            Task retry = task;
+            retry.attempts++;
+            retry.resume = ResumeState();   // Restarts from the prompt
+            retry.delivered = std::max(task.delivered, output_position);
+            response_cache.discard(task.id);
+            sessions.discard(task.id);
+            sendTaskOutput(task, "\n[Accelerator error, retrying]\n");
+            if (!pushTask(retry)) {
+                sendTaskOutput(task, "[Failed: queue full]\n");
+                finishTask(task, FinishReason::FAILED);
+            }
+        } else {
+            sendTaskOutput(task, "\n[Failed: accelerator error " +
+                           std::string(decodeAccelError(error_code).name) + "]\n");
+            finishTask(task, FinishReason::FAILED);
+        }
+
+        engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+    }
+
+    // The first token waits for the prompt pass: allow its modeled time
+    // on top of the stall window
+    uint32_t firstTokenWindowMs(const Accelerator& accel) const {
+        return options.stall_window_ms + (uint32_t)(accel.firstTokenUs() / 1000.0);
+    }
+
+    // Returns true if the run must stop
+    bool handleAccelError(const Task& task, Accelerator& accel, ErrorRecovery& recovery) {
+        uint32_t injected = sim_error_pending.exchange(0);
+        if (injected) {
+            accel.simInjectError(injected);
+        }
+        if (accel_error_pending.exchange(false)) {
+            accel.getStatus();
+        }
+
+        if (accel.lastStatusHasError()) {
+            recoverTask(task, accel.lastErrorCode(), recovery);
+            return true;
+        }
+
+        if (run_watchdog.check(accel.lastStatus())) {
+            recoverTask(task, (uint32_t)AccelError::HANG, recovery);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Commands and cancellation at a token boundary. True if the run
+    // ended here: the task was finished as shutdown or cancelled.
+    bool runInterrupted(const Task& task, Accelerator& accel) {
+        Command cmd;
+        if (popCommand(cmd)) {
+            switch (cmd.type) {
+                case CommandType::SHUTDOWN:
+                    engine_state.requestShutdown();
+                    break;
+
+                case CommandType::RESET:
+                    engine_state.requestReset();
+                    break;
+
+                case CommandType::STOP_CURRENT:
+                    engine_state.requestCancel();
+                    break;
+
+                case CommandType::SNAPSHOT_SESSIONS:
+                    // Written once this run ends, not behind its tokens
+                    snapshot_requested = true;
+                    break;
+            }
+        }
+
+        if (engine_state.status() == EngineStatus::SHUTTING_DOWN) {
+            sendTaskOutput(task, "\n[Aborted: shutdown requested]\n");
+            finishTask(task, FinishReason::SHUTDOWN);
+            return true;
+        }
+
+        bool sink_cancelled = task.sink && task.sink->isCancelled();
+        if (engine_state.consumeCancel() || sink_cancelled) {
+            sendTaskOutput(task, "\n[Aborted]\n");
+            finishTask(task, FinishReason::CANCELLED);
+
+            if (engine_state.consumeReset() &&
+                engine_state.transition(EngineStatus::GENERATING, EngineStatus::RESETTING)) {
+                clearKvCache(accel);
+                sendOutputToUI("[Memory cleared]\n");
+                engine_state.transition(EngineStatus::RESETTING, EngineStatus::IDLE);
+                return true;
+            }
+            engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+            return true;
+        }
+        return false;
+    }
+
+    // task must already be staged in the pipeline, in KV slot kv_slot.
+    // Returns the number of tokens generated; suspended is set if the
+    // task was preempted and requeued rather than finished.
+    int runGeneration(const Task& task, Accelerator& accel, TaskPipeline& pipeline,
+                       ErrorRecovery& recovery, uint32_t kv_slot, bool& suspended) {
+        engine_state.clearRequests();
+
+        sendTaskOutput(task, "\n[Generating] ");
+
+        pipeline.begin();
+        noteLaunches(pipeline, true);
+        run_watchdog.arm(task.id, accel.lastStatus(), firstTokenWindowMs(accel));
+
+        int token_count = 0;
+        int token_limit = task.max_tokens > 0 ? task.max_tokens : DEFAULT_MAX_TOKENS;
+        if (task.resume.valid) {
+            token_limit -= (int)task.resume.generated;
+        }
+        uint32_t last_token = 0;
+        bool no_slot_counted = false;
+        suspended = false;
+        output_position = task.resume.valid ? task.resume.generated : 0;
+
+        const TokenConstraint* constraint = task.constraint.get();
+        uint32_t constraint_state = 0;
+        if (constraint) {
+            constraint_state = task.resume.valid ? task.resume.constraint_state : constraint->start();
+            constraint_stats.runs++;
+        }
+
+        while (token_count < token_limit) {
+
+            // Prepare the next task while this one decodes
+            if (!pipeline.hasStaged()) {
+                stageNext(pipeline, accel);
+            }
+            pipeline.service();
+
+            if (runInterrupted(task, accel)) {
+                return token_count;
+            }
+
+            if (shouldPreempt(task, token_count, token_limit, pipeline, no_slot_counted) &&
+                suspendTask(task, token_count, last_token, constraint_state, kv_slot, accel,
+                            pipeline)) {
+                suspended = true;
+                return token_count;
+            }
+
+            uint32_t nextToken = 0;
+            bool gotToken = accel.getNextToken(nextToken);
+
+            if (handleAccelError(task, accel, recovery)) {
+                return token_count;
+            }
+
+            if (gotToken) {
+                if (nextToken == EOS_TOKEN) {
+                    saveSession(task, kv_slot, accel);
+                    pipeline.finishRun();
+                    noteLaunches(pipeline, false);
+                    sendTaskOutput(task, "\n[EOS]\n");
+                    finishTask(task, FinishReason::EOS);
+                    engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+                    return token_count;
+                }
+                if (lm_head_shards.ready()) {
+                    nextToken = completeLogits(accel, nextToken,
+                                               constraint ? constraint->mask(constraint_state) : nullptr);
+                }
+
+                if (constraint && !constraint->allowed(constraint_state, nextToken)) {
+                    constraint_stats.violations++;
+                    sendTaskOutput(task, "\n[Failed: token outside the grammar]\n");
+                    finishTask(task, FinishReason::FAILED);
+                    engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+                    return token_count;
+                }
+
+                // A retry regenerates what an earlier attempt already sent
+                if (output_position++ >= task.delivered) {
+                    if (task.sink) {
+                        task.sink->onToken(nextToken);
+                    } else {
+                        sendOutputToUI(detokenize(nextToken));
+                    }
+                }
+                response_cache.record(task.id, nextToken);
+                sessions.record(task, nextToken);
+                last_token = nextToken;
+                token_count++;
+
+                // Next step samples under the state after this token
+                if (constraint) {
+                    auto start = std::chrono::steady_clock::now();
+                    constraint_state = constraint->advance(constraint_state, nextToken);
+                    bool complete = constraint->complete(constraint_state);
+                    if (!complete) {
+                        accel.setTokenMask(constraint->mask(constraint_state));
+                    }
+                    constraint_stats.token(std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start).count());
+
+                    if (complete) {
+                        constraint_stats.completed++;
+                        saveSession(task, kv_slot, accel);
+                        sendTaskOutput(task, "\n[Grammar complete]\n");
+                        finishTask(task, FinishReason::EOS);
+                        engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+                        return token_count;
+                    }
+                }
+            } else if (engine_state.status() == EngineStatus::COMPLETING) {
+                // AP_DONE interrupt finished the run and no tokens are left
+                saveSession(task, kv_slot, accel);
+                pipeline.finishRun();
+                noteLaunches(pipeline, false);
+                sendTaskOutput(task, "\n[Done]\n");
+                finishTask(task, FinishReason::EOS);
+                return token_count;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(50)); //todo tune processing time
+        }
+
+        saveSession(task, kv_slot, accel);
+        sendTaskOutput(task, "\n[Max tokens reached]\n");
+        finishTask(task, FinishReason::MAX_TOKENS);
+        engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+        return token_count;
+    }
+
+    // Ranked outputs to the sink, or one line each on the console. The
+    // task ended with EOS if any candidate did.
+    void finishCandidates(const Task& task, const CandidateGroup& group, Accelerator& accel) {
+        std::vector<CandidateOutput> ranked = group.ranked();
+        candidate_stats.finished(group, accel.getPerfModel().prefillUs(group.getPromptTokens()));
+
+        FinishReason reason = FinishReason::MAX_TOKENS;
+        for (const CandidateOutput& c : ranked) {
+            if (c.finish == FinishReason::EOS) reason = FinishReason::EOS;
+        }
+        if (task.sink) {
+            task.sink->onCandidates(ranked);
+        } else {
+            for (size_t i = 0; i < ranked.size(); i++) {
+                char head[64];
+                snprintf(head, sizeof(head), "\n#%zu (logprob %.2f%s) ", i + 1, ranked[i].logprob,
+                         ranked[i].finish == FinishReason::EOS ? "" : ", cut off");
+                std::string text = head;
+                for (uint32_t token : ranked[i].tokens) {
+                    text += detokenize(token);
+                }
+                sendOutputToUI(text);
+            }
+        }
+        sendTaskOutput(task, "\n[Done]\n");
+        finishTask(task, reason);
+    }
+
+    // A candidates task, staged like runGeneration's. Each step the
+    // kernel's rows go through group and the next inputs and block
+    // tables go back, until every candidate has finished. Outputs are
+    // delivered at the end, not streamed. Returns the decode steps run.
+    int runCandidates(const Task& task, Accelerator& accel, TaskPipeline& pipeline,
+                      ErrorRecovery& recovery, CandidateGroup& group) {
+        engine_state.clearRequests();
+
+        sendTaskOutput(task, "\n[Generating " + std::to_string(group.getWidth()) + " " +
+                             candidateModeName(group.getMode()) + " candidates] ");
+
+        pipeline.begin();
+        noteLaunches(pipeline, true);
+        run_watchdog.arm(task.id, accel.lastStatus(), firstTokenWindowMs(accel));
+        output_position = 0;   // Outputs are only sent once the group finishes
+
+        std::vector<CandidateRow> rows;
+        std::vector<uint32_t> tables;
+        while (true) {
+            if (!pipeline.hasStaged()) {
+                stageNext(pipeline, accel);
+            }
+            pipeline.service();
+
+            if (runInterrupted(task, accel)) {
+                return (int)group.steps();
+            }
+
+            bool gotStep = accel.readCandidateStep(rows);
+
+            if (handleAccelError(task, accel, recovery)) {
+                return (int)group.steps();
+            }
+
+            if (gotStep) {
+                auto start = std::chrono::steady_clock::now();
+                bool more = group.step(rows);
+                group.tables(tables);
+                accel.feedbackCandidates(group.inputs(), tables);
+                candidate_stats.step(std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start).count());
+
+                if (!more) {
+                    pipeline.finishRun();
+                    noteLaunches(pipeline, false);
+                    finishCandidates(task, group, accel);
+                    engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+                    return (int)group.steps();
+                }
+            } else if (engine_state.status() == EngineStatus::COMPLETING) {
+                // AP_DONE before every row finished: keep what there is
+                pipeline.finishRun();
+                noteLaunches(pipeline, false);
+                group.stop();
+                finishCandidates(task, group, accel);
+                return (int)group.steps();
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(50)); //todo tune processing time
+        }
+    }
+
+    void engineThreadMain() {
+        Accelerator accel;
+        accel.setRecorder(options.recorder);
+        accel.setModelConfig(model_shape);
+
+        //todo determine correct mem address
+        uint64_t input_addr = 0x10000000;
+        uint64_t output_addr = 0x20000000;
+        uint64_t kv_cache_addr = 0x30000000;
+        accel.configure(input_addr, output_addr, kv_cache_addr, 128, capacity_plan.context_tokens);
+        accel.configureKvSlots(capacity_plan.slot_bytes);
+        if (lm_head_shards.ready()) {
+            accel.configureLmHeadSplit(lm_head_shards.firstRow(), model_shape.hidden_size);
+        }
+        // In input region order: each one's buffers sit after the last's
+        if (embedding_gather.ready()) {
+            accel.configureHostEmbedding(hostEmbedTokens(), embedding_gather.rowBytes(),
+                                         &embedding_gather);
+        }
+        accel.configureTokenMasks(model_shape.vocab_size);
+        accel.configureKvTables(capacity_plan.block_tokens, capacity_plan.blocks_per_slot);
+        kv_slots.init(capacity_plan.batch_slots, accel.getKvEpoch());
+
+        accel.getPerfModel().printSummary();
+
+        TaskPipeline pipeline(accel);
+        ErrorRecovery recovery(accel);
+
+        std::cout << "[Engine] Inference engine started\n";
+
+        while (engine_state.status() != EngineStatus::SHUTTING_DOWN) {
+            Command cmd;
+            if (popCommand(cmd)) {
+                handleTopLevelCommand(cmd, accel);
+                continue;
+            }
+
+            if (snapshot_requested) {
+                snapshot_requested = false;
+                sessions.snapshot();
+            }
+
+            // Normally the next task was staged during the previous run
+            if (!pipeline.hasStaged() && !stageNext(pipeline, accel)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+
+            Task task = pipeline.stagedTask();
+            uint32_t kv_slot = staged_kv_slot;
+            if (staged_kv_prefix > 0 && staged_kv_epoch != accel.getKvEpoch()) {
+                // A reset wiped the restored context: prefill all of it
+                Task dropped;
+                pipeline.drop(dropped);
+                pipeline.stage(task, tokenize(task.prompt), kv_slot);
+            }
+            staged_kv_prefix = 0;
+            CandidateGroup group;
+            if (task.candidates > 0) {
+                group = staged_group;
+            }
+            if (!engine_state.transition(EngineStatus::IDLE, EngineStatus::GENERATING, task.id)) {
+                continue;  // Shutdown raced with pickup
+            }
+
+            active_kv_slot = (int)kv_slot;
+            if (task.resume.valid) {
+                // Running again: its slot is no longer set aside
+                kv_slots.unpin(task.resume.kv_slot);
+                preemption_stats.resumed(task, accel.getPerfModel().prefillUs(task.resume.position));
+            }
+
+            uint32_t prompt_tokens = (uint32_t)tokenize(task.prompt).size();
+            admission.start(task, prompt_tokens);
+            bool suspended = false;
+            int generated;
+            if (task.candidates > 0) {
+                // Calibrated per step; charged to the tenant per token
+                generated = runCandidates(task, accel, pipeline, recovery, group);
+                admission.finish(task, prompt_tokens, (uint32_t)generated);
+                completeTask(task, group.generated());
+            } else {
+                generated = runGeneration(task, accel, pipeline, recovery, kv_slot, suspended);
+                if (!suspended) {
+                    admission.finish(task, prompt_tokens, (uint32_t)generated);
+                    completeTask(task, (uint32_t)generated);
+                }
+            }
+            pipeline.abandonRun();  // No-op after finishRun()
+            run_watchdog.disarm();
+            active_kv_slot = -1;
+            run_current = 0;
+
+            engine_state.transition(EngineStatus::COMPLETING, EngineStatus::IDLE);
+        }
+
+        Task dropped;
+        if (pipeline.drop(dropped)) {
+            std::cout << "[Engine] Dropped staged task " << dropped.id << "\n";
+            admission.drop(dropped.id);
+            finishTask(dropped, FinishReason::SHUTDOWN);
+        }
+        while (drainTask(dropped)) {
+            admission.drop(dropped.id);
+            finishTask(dropped, FinishReason::SHUTDOWN);
+        }
+        pipeline.printStats();
+        recovery.printStats();
+        run_watchdog.printStats();
+        admission.printStats();
+        preemption_stats.printStats(kv_slots, options.preemption);
+        if (embedding_gather.ready()) {
+            embedding_gather.printStats();
+        }
+        if (lm_head_shards.ready()) {
+            lm_head_shards.printStats(accel.getPerfModel().decodeUs(capacity_plan.context_tokens / 2));
+        }
+        if (candidate_stats.runs > 0) {
+            candidate_stats.printStats();
+        }
+        if (constraint_stats.runs > 0) {
+            constraint_stats.printStats(constraints);
+            printf("Mask uploads:      %lu (%lu already in place)\n\n",
+                   (unsigned long)accel.getMaskWrites(), (unsigned long)accel.getMaskReuses());
+        }
+        printTenantStats();
+        if (sessions.persistent()) {
+            sessions.snapshot();
+        }
+        sessions.printStats();
+
+        clearKvCache(accel);
+        std::cout << "[Engine] Shutdown complete\n";
+    }
+
+    void replayThreadMain() {
+        std::unique_lock<std::mutex> lock(replay_mutex);
+        while (true) {
+            replay_cv.wait(lock, [this] { return !replay_queue.empty() || !replay_running; });
+            if (replay_queue.empty()) {
+                return;     // Stopped and drained
+            }
+            CacheReplay replay = replay_queue.front();
+            replay_queue.pop_front();
+            lock.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+            const Task& task = replay.task;
+            FinishReason reason = replay.response->finish;
+
+            sendTaskOutput(task, "\n[Cached] ");
+            for (uint32_t token : replay.response->tokens) {
+                if (task.sink && task.sink->isCancelled()) {
+                    reason = FinishReason::CANCELLED;
+                    break;
+                }
+                if (task.sink) {
+                    task.sink->onToken(token);
+                } else {
+                    sendOutputToUI(detokenize(token));
+                }
+            }
+            sendTaskOutput(task, reason == FinishReason::CANCELLED ? "\n[Aborted]\n" : "\n[Done]\n");
+            if (task.sink) {
+                task.sink->onFinish(reason);
+            }
+
+            response_cache.replayed(std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count());
+            lock.lock();
+        }
+    }
+
+    // Queues a hit for replay; false once the replay thread has stopped
+    bool replayCached(const Task& task, std::shared_ptr<const CachedResponse> response) {
+        {
+            std::lock_guard<std::mutex> lock(replay_mutex);
+            if (!replay_running) {
+                return false;
+            }
+            CacheReplay replay;
+            replay.task = task;
+            replay.response = response;
+            replay_queue.push_back(replay);
+        }
+        replay_cv.notify_one();
+        return true;
+    }
+
+    // Weights identify the model by their checksums; without a weight
+    // file only the shape is known
+    uint64_t modelHash(bool& from_checksums) const {
+        uint64_t hash = weight_loader.getWeights().checksum_hash;
+        from_checksums = hash != 0;
+        if (!from_checksums) {
+            const uint32_t shape[] = {model_shape.num_layers, model_shape.hidden_size,
+                                      model_shape.num_heads, model_shape.vocab_size,
+                                      model_shape.max_seq_len, model_shape.intermediate_size};
+            hash = 0xcbf29ce484222325ull;
+            for (uint32_t word : shape) {
+                hash = (hash ^ word) * 0x100000001b3ull;
+            }
+        }
+        return hash;
+    }
+
+    void setupCache() {
+        if (!options.cache.enabled) {
+            return;
+        }
+        bool from_checksums;
+        uint64_t hash = modelHash(from_checksums);
+        response_cache.open(options.cache, hash, from_checksums, DEFAULT_MAX_TOKENS);
+    }
+
+    // A snapshot is only restored into the same weights and KV geometry
+    void setupSessions() {
+        if (!options.sessions.enabled) {
+            return;
+        }
+        bool from_checksums;
+        uint64_t hash = modelHash(from_checksums);
+        sessions.open(options.sessions, hash, from_checksums, capacity_plan.kv_bytes_per_token,
+                      capacity_plan.context_tokens);
+    }
+
+    bool setupMemory() {
+        std::cout << "Phase 1: Memory Initialization\n";
+        std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
+
+        if (!memory.init()) {
+            std::cerr << "Failed to initialize memory manager\n";
+            return false;
+        }
+        memory_ready = true;
+
+        if (!memory.allocateWeights(options.weight_region)) {
+            std::cerr << "Failed to allocate weight memory\n";
+            return false;
+        }
+
+        if (!memory.allocateKVCache(options.kv_region)) {
+            std::cerr << "Failed to allocate KV cache\n";
+            return false;
+        }
+
+        if (!memory.allocateIOBuffers(options.input_buffer + options.host_embed_bytes +
+                                          Accelerator::TOKEN_MASK_REGION_BYTES +
+                                          Accelerator::KV_TABLE_REGION_BYTES,
+                                      options.output_buffer)) {
+            std::cerr << "Failed to allocate I/O buffers\n";
+            return false;
+        }
+
+        memory.printMemoryMap();
+        return true;
+    }
+
+    bool planCapacity() {
+        std::cout << "Phase 2: Capacity Planning\n";
+        std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
+
+        // Size KV slots from the header before spending time on the full load
+        WeightFileHeader header;
+        bool have_header = WeightLoader::readHeader(options.model_file, header);
+        if (have_header) {
+            model_shape.num_layers = header.num_layers;
+            model_shape.hidden_size = header.hidden_size;
+            model_shape.num_heads = header.num_heads;
+            model_shape.vocab_size = header.vocab_size;
+            model_shape.max_seq_len = header.max_seq_len;
+            model_shape.intermediate_size = header.intermediate_size;
+        } else {
+            // todo replace with the target model's shape
+            model_shape.num_layers = 12;
+            model_shape.hidden_size = 768;
+            model_shape.num_heads = 12;
+            model_shape.vocab_size = 32000;
+            model_shape.max_seq_len = 2048;
+            model_shape.intermediate_size = 3072;
+
+            header = WeightFileHeader();
+            header.num_layers = model_shape.num_layers;
+            header.hidden_size = model_shape.hidden_size;
+            header.num_heads = model_shape.num_heads;
+            header.vocab_size = model_shape.vocab_size;
+            header.max_seq_len = model_shape.max_seq_len;
+            header.intermediate_size = model_shape.intermediate_size;
+            std::cout << "[Capacity] No model header, planning for simulation model\n";
+        }
+
+        capacity_plan = CapacityPlanner::plan(model_shape, WeightLoader::estimateDDRSize(header),
+                                              options.weight_region, options.kv_region,
+                                              options.requested_context, options.max_kv_slots);
+        CapacityPlanner::print(capacity_plan);
+
+        if (!capacity_plan.valid()) {
+            std::cerr << "Model does not fit in the configured DDR regions\n";
+            return false;
+        }
+        model_shape.max_seq_len = capacity_plan.context_tokens;
+
+        AdmissionPolicy policy = options.admission;
+        policy.default_max_tokens = DEFAULT_MAX_TOKENS;
+        policy.max_queued = TASK_QUEUE_SIZE;
+        admission.configure(model_shape, capacity_plan, policy);
+        return true;
+    }
+
+    bool loadWeights() {
+        std::cout << "Phase 3: Weight Loading\n";
+        std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
+
+        if (!loadHostWeights()) {
+            std::cout << "\nNo model weights found. To load weights:\n";
+            std::cout << "  1. Get INT4 quantized PyTorch model (model.pt)\n";
+            std::cout << "  2. Run: python convert_weights.py model.pt model.pt.bin\n";
+            std::cout << "  3. Place model.pt.bin in current directory\n";
+            std::cout << "\nContinuing without weights (simulation mode)...\n\n";
+            return true;
+        }
+
+        if (!weight_loader.allocateDDR(
+                memory.getWeightsPhysAddr(),
+                memory.getWeightsVirtAddr(),
+                memory.getWeightsSize())) {
+            std::cerr << "Failed to allocate DDR for weights\n";
+            return false;
+        }
+
+        if (!weight_loader.copyToDDR()) {
+            std::cerr << "Failed to copy weights to DDR\n";
+            return false;
+        }
+
+        std::cout << "Weights loaded successfully!\n\n";
+        return true;
+    }
+
+    // From another process's shared segment when there is one; otherwise
+    // from the file, then shared for the next process
+    bool loadHostWeights() {
+        uint64_t hash = 0;
+        bool shareable = options.shared_weights.enabled &&
+                         WeightLoader::readChecksumHash(options.model_file, hash);
+        if (shareable &&
+            shared_weights.attach(options.shared_weights, hash, weight_loader.getMutableWeights())) {
+            weight_loader.setLoaded();
+            return true;
+        }
+        if (!weight_loader.loadFromBinary(options.model_file)) {
+            return false;
+        }
+        if (options.shared_weights.enabled) {
+            shared_weights.publish(options.shared_weights, weight_loader.getMutableWeights());
+        }
+        return true;
+    }
+
+    // Needs the FP32 tables, so only with a weight file
+    void setupEmbedding() {
+        if (options.host_embed_bytes == 0) {
+            return;
+        }
+        const ModelWeights& weights = weight_loader.getWeights();
+        FloatWeights tokens = weights.floats(weights.token_embeddings);
+        FloatWeights positions = weights.floats(weights.position_embeddings);
+        embedding_gather.init(tokens.data(), tokens.size(), positions.data(), positions.size(),
+                              weights.hidden_size);
+    }
+
+    // The top rows of the vocabulary go to the host; the kernel keeps
+    // the rest
+    void setupLmHead() {
+        if (options.host_lm_head_fraction <= 0.0) {
+            return;
+        }
+        const ModelWeights& weights = weight_loader.getWeights();
+        // WTNT files carry no lm_head: it is tied to the token embeddings
+        FloatWeights table = weights.floats(weights.lm_head.count ? weights.lm_head
+                                                                  : weights.token_embeddings);
+        double fraction = options.host_lm_head_fraction < 1.0 ? options.host_lm_head_fraction : 1.0;
+        uint32_t vocab = weights.hidden_size ? (uint32_t)(table.size() / weights.hidden_size) : 0;
+        uint32_t host_rows = (uint32_t)(vocab * fraction + 0.5);
+        lm_head_shards.init(table.data(), table.size(), weights.hidden_size, vocab - host_rows);
+    }
+
+    // Split lm_head: merge the kernel's candidates with the host shards'.
+    // The winner is fed back as the next step's input. A constrained
+    // run's mask was applied by the kernel to its rows and is applied to
+    // the host's here.
+    uint32_t completeLogits(Accelerator& accel, uint32_t kernel_token,
+                            const uint64_t* mask = nullptr) {
+        LogitTopK kernel_part;
+        if (!accel.readLmHeadPartial(kernel_part, lm_head_hidden)) {
+            return kernel_token;
+        }
+        LogitTopK merged = lm_head_shards.topK(lm_head_hidden.data(), LM_HEAD_TOP_K, mask);
+        merged.merge(kernel_part, LM_HEAD_TOP_K);
+        if (merged.top.empty()) {
+            return kernel_token;
+        }
+
+        uint32_t token = merged.top[0].token;
+        lm_head_shards.decided(token);
+        if (token != kernel_token) {
+            accel.feedbackToken(token);
+        }
+        return token;
+    }
+
+    // Grammars compile against the tokenizer's vocabulary; without room
+    // for the masks every task runs unconstrained
+    void setupConstraints() {
+        if (!Accelerator::tokenMasksFit(model_shape.vocab_size)) {
+            printf("[Constraint] Vocabulary of %u too large for token masks, constraints off\n",
+                   model_shape.vocab_size);
+            return;
+        }
+        constraints.setVocabulary(
+            std::make_shared<TokenVocabulary>(tokenizerPieces(model_shape.vocab_size)));
+    }
+
+    // Largest prompt whose rows fit in half the host embedding region
+    uint32_t hostEmbedTokens() const {
+        if (!embedding_gather.ready()) {
+            return 0;
+        }
+        uint64_t rows = options.host_embed_bytes / 2 / embedding_gather.rowBytes();
+        if (rows > capacity_plan.context_tokens) rows = capacity_plan.context_tokens;
+        if (rows > 0xFFFF) rows = 0xFFFF;
+        return (uint32_t)rows;
+    }
+
+    void setupInterrupts() {
+        std::cout << "Phase 4: Accelerator Configuration\n";
+        std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n";
+
+#ifdef REAL_HARDWARE
+        irq.setRecorder(options.recorder);
+        irq.onDone([this](InterruptType) {
+            uint64_t run = runs_done.fetch_add(1) + 1;
+            if (run > runs_launched.load()) {
+                runs_done = runs_launched.load();   // Raced a reset
+            } else if (run == run_current.load()) {
+                engine_state.transition(EngineStatus::GENERATING, EngineStatus::COMPLETING);
+            }
+        });
+        irq.onError([this](InterruptType) {
+            accel_error_pending.store(true);
+        });
+        if (irq.init(options.uio_device.c_str())) {
+            irq.start();
+        }
+#endif
+    }
+
+public:
+    explicit InferenceEngine(const EngineOptions& opts = EngineOptions())
+        : options(opts), scheduler(TASK_QUEUE_SIZE, DEFAULT_MAX_TOKENS),
+          next_task_id(1), accel_error_pending(false), runs_launched(0), runs_done(0),
+          run_current(0), sim_error_pending(0), output_position(0),
+          run_watchdog(options.stall_window_ms), staged_kv_slot(0), staged_kv_prefix(0),
+          staged_kv_epoch(0), active_kv_slot(-1), snapshot_requested(false), replay_running(false),
+          initialized(false), memory_ready(false) {}
+
+    ~InferenceEngine() {
+        shutdown();
+    }
+
+    InferenceEngine(const InferenceEngine&) = delete;
+    InferenceEngine& operator=(const InferenceEngine&) = delete;
+
+    // Memory, capacity planning, weight load and interrupts. False leaves
+    // the engine unusable; the destructor still releases what was taken.
+    bool init() {
+        if (initialized) {
+            return true;
+        }
+        if (!setupMemory() || !planCapacity() || !loadWeights()) {
+            return false;
+        }
+        setupCache();
+        setupSessions();
+        setupEmbedding();
+        setupLmHead();
+        setupConstraints();
+        setupInterrupts();
+        initialized = true;
+        return true;
+    }
+
+    bool start() {
+        if (!initialized || engine_thread.joinable()) {
+            return false;
+        }
+        engine_thread = std::thread(&InferenceEngine::engineThreadMain, this);
+        if (response_cache.enabled()) {
+            replay_running = true;
+            replay_thread = std::thread(&InferenceEngine::replayThreadMain, this);
+        }
+        return true;
+    }
+
+    // Finishes every pending task with SHUTDOWN, joins the engine thread
+    // and releases the DDR regions. Safe to call more than once.
+    void shutdown() {
+        if (engine_thread.joinable()) {
+            sendCommand(CommandType::SHUTDOWN);
+            engine_thread.join();
+        }
+        if (replay_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(replay_mutex);
+                replay_running = false;
+            }
+            replay_cv.notify_one();
+            replay_thread.join();
+            response_cache.printStats();
+        }
+#ifdef REAL_HARDWARE
+        irq.stop();
+#endif
+        if (memory_ready) {
+            memory.cleanup();
+            memory_ready = false;
+        }
+        initialized = false;
+    }
+
+    bool pushTask(const Task& task) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (scheduler.full()) {
+            std::cout << "[Warning] Task queue full, dropping request\n";
+            return false;
+        }
+        if (!scheduler.push(task)) {
+            std::cout << "[Warning] Tenant " << task.tenant << " queue limit, dropping request\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Weight, caps and rate limit for a tenant; takes effect at the next
+    // pickup. Unknown tenants get TenantConfig() on first submit.
+    void configureTenant(const std::string& name, const TenantConfig& config) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        scheduler.configure(name, config);
+    }
+
+    TenantConfig getTenantConfig(const std::string& name) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return scheduler.config(name);
+    }
+
+    void printTenantStats() const {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        scheduler.printStats();
+    }
+
+    // For front ends that must know the id before the task can run
+    int reserveTaskId() {
+        return next_task_id.fetch_add(1);
+    }
+
+    // New request from any front end: assign an id (unless reserved),
+    // answer it from the response cache or run admission control and
+    // queue it. When false, task.retry_after_ms says when to try again
+    // (0 = the task can never be admitted) and result, if given, holds
+    // the decision.
+    bool submit(Task& task, AdmissionEstimate* result = nullptr) {
+        if (task.id <= 0) {
+            task.id = reserveTaskId();
+        }
+
+        std::vector<uint32_t> prompt = tokenize(task.prompt);
+        if (task.candidates > 0 && (task.candidates > MAX_CANDIDATES || !candidatesAvailable())) {
+            printf("[Candidates] Task %d: %u candidates not supported\n", task.id, task.candidates);
+            task.retry_after_ms = 0;
+            if (result) {
+                *result = AdmissionEstimate();
+                result->decision = AdmissionDecision::REJECT_TOO_LARGE;
+                result->prompt_tokens = (uint32_t)prompt.size();
+            }
+            return false;
+        }
+        std::shared_ptr<const CachedResponse> cached = response_cache.lookup(task, prompt);
+        if (cached && replayCached(task, cached)) {
+            task.retry_after_ms = 0;
+            if (result) {
+                *result = AdmissionEstimate();
+                result->prompt_tokens = (uint32_t)prompt.size();
+                result->output_tokens = (uint32_t)cached->tokens.size();
+            }
+            return true;
+        }
+
+        AdmissionEstimate est = admission.admit(task, (uint32_t)prompt.size());
+        if (est.admitted() && !pushTask(task)) {
+            admission.drop(task.id);
+            est.decision = AdmissionDecision::DEFER_QUEUE_FULL;
+            est.retry_after_ms = AdmissionController::MIN_RETRY_MS;
+        }
+
+        task.retry_after_ms = est.retry_after_ms;
+        if (result) {
+            *result = est;
+        }
+        return est.admitted();
+    }
+
+    // Compiled grammar for task.constraint, shared with earlier tasks
+    // that used the same one. Null with error set if it doesn't compile.
+    std::shared_ptr<const TokenConstraint> compileConstraint(ConstraintType type,
+                                                             const std::string& spec,
+                                                             std::string* error = nullptr) {
+        std::string message = "constrained decoding unavailable";
+        std::shared_ptr<const TokenConstraint> c;
+        if (constraints.ready()) {
+            message.clear();
+            c = constraints.get(type, spec, message);
+        }
+        if (!c) {
+            printf("[Constraint] Rejected %s: %s\n", constraintTypeName(type), message.c_str());
+        }
+        if (error) {
+            *error = message;
+        }
+        return c;
+    }
+
+    // Admission decision and queue wait a task would see right now
+    AdmissionEstimate estimate(const std::string& prompt, int max_tokens,
+                               uint32_t candidates = 0) const {
+        return admission.estimate((uint32_t)tokenize(prompt).size(), max_tokens, candidates);
+    }
+
+    // Simulation: the running task sees accelerator error error_code at
+    // its next token boundary, as if the kernel had reported it
+    void simInjectError(uint32_t error_code) {
+        sim_error_pending = error_code;
+    }
+
+    // Candidates tasks need a block table per row in the input region
+    bool candidatesAvailable() const {
+        return capacity_plan.block_tokens > 0 &&
+               Accelerator::kvTablesFit(capacity_plan.blocks_per_slot);
+    }
+
+    bool sendCommand(CommandType type) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return command_queue.push(Command(type));
+    }
+
+    bool isRunning() const { return engine_thread.joinable(); }
+    EngineSnapshot snapshot() const { return engine_state.snapshot(); }
+    EngineState& getState() { return engine_state; }
+    uint64_t getStallCount() const { return run_watchdog.getStallCount(); }
+    double getQueueWaitMs() const { return admission.queueWaitMs(); }
+    size_t getQueuedTasks() const { return admission.queuedTasks(); }
+    const ModelShape& getModelShape() const { return model_shape; }
+    const CapacityPlan& getCapacityPlan() const { return capacity_plan; }
+};
+
+#endif // INFERENCE_ENGINE_HPP
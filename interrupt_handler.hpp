@@ -12,6 +12,7 @@
 #include <functional>
 #include <poll.h>
 #include "xaccelerator_hw.h"
+#include "register_trace.hpp"
 
 // Interrupt types
 enum class InterruptType {
@@ -33,6 +34,9 @@ private:
     
     volatile uint32_t* reg_base;
     
+    RegisterRecorder* recorder;
+    RegisterReplay* replay;
+    
     // Callbacks
     InterruptCallback on_done_callback;
     InterruptCallback on_ready_callback;
@@ -71,14 +75,7 @@ private:
                 ssize_t nb = read(uio_fd, &irq_count, sizeof(irq_count));
                 
                 if (nb == sizeof(irq_count)) {
-                    total_interrupts++;
-                    
-                    uint32_t isr = readISR();
-                
-                    handleInterrupt(isr);
-                    
-                    clearISR(isr);
-                    
+                    serviceInterrupt();
                 } else {
                     printf("[IRQ] Read error: %zd\n", nb);
                 }
@@ -90,6 +87,20 @@ private:
     
 
     uint32_t readISR() {
+        if (replay) {
+            uint32_t isr = replay->read(RegSource::IRQ, XACCELERATOR_CTRL_ADDR_ISR);
+            if (recorder) recorder->read(RegSource::IRQ, RegScope::IRQ_SERVICE, XACCELERATOR_CTRL_ADDR_ISR, isr);
+            return isr;
+        }
+        
+        uint32_t isr = readISRRaw();
+        if (recorder) {
+            recorder->read(RegSource::IRQ, RegScope::IRQ_SERVICE, XACCELERATOR_CTRL_ADDR_ISR, isr);
+        }
+        return isr;
+    }
+    
+    uint32_t readISRRaw() {
         #ifdef REAL_HARDWARE
         if (reg_base) {
             return reg_base[XACCELERATOR_CTRL_ADDR_ISR / 4];
@@ -105,6 +116,14 @@ private:
     }
     
     void clearISR(uint32_t mask) {
+        if (recorder) {
+            recorder->write(RegSource::IRQ, RegScope::IRQ_SERVICE, XACCELERATOR_CTRL_ADDR_ISR, mask);
+        }
+        if (replay) {
+            replay->write(RegSource::IRQ, XACCELERATOR_CTRL_ADDR_ISR, mask);
+            return;
+        }
+        
         #ifdef REAL_HARDWARE
         if (reg_base) {
             // Write-1-to-clear
@@ -151,7 +170,7 @@ private:
 
 public:
     InterruptHandler() : uio_fd(-1), enabled(false), running(false),
-                         reg_base(nullptr),
+                         reg_base(nullptr), recorder(nullptr), replay(nullptr),
                          total_interrupts(0), done_count(0),
                          ready_count(0), token_count(0), error_count(0) {}
     
@@ -185,6 +204,7 @@ public:
         }
         
         #else
+        (void)uio_device;
         printf("[IRQ] Running in simulation mode (no real UIO)\n");
         uio_fd = 0;  // Fake fd for simulation
         #endif
@@ -239,6 +259,24 @@ public:
         enabled = false;
     }
     
+    // Read, dispatch and acknowledge one interrupt
+    void serviceInterrupt() {
+        if (recorder) {
+            recorder->call(RegSource::IRQ, RegScope::IRQ_SERVICE);
+        }
+        
+        total_interrupts++;
+        
+        uint32_t isr = readISR();
+        
+        handleInterrupt(isr);
+        
+        clearISR(isr);
+    }
+    
+    void setRecorder(RegisterRecorder* rec) { recorder = rec; }
+    void setReplay(RegisterReplay* rep) { replay = rep; }
+    
     void onDone(InterruptCallback cb) { on_done_callback = cb; }
     void onReady(InterruptCallback cb) { on_ready_callback = cb; }
     void onToken(InterruptCallback cb) { on_token_callback = cb; }
@@ -268,6 +306,8 @@ public:
             uint32_t ier = reg_base[XACCELERATOR_CTRL_ADDR_IER / 4];
             reg_base[XACCELERATOR_CTRL_ADDR_IER / 4] = ier | mask;
         }
+        #else
+        (void)mask;
         #endif
     }
     
@@ -278,6 +318,8 @@ public:
             uint32_t ier = reg_base[XACCELERATOR_CTRL_ADDR_IER / 4];
             reg_base[XACCELERATOR_CTRL_ADDR_IER / 4] = ier & ~mask;
         }
+        #else
+        (void)mask;
         #endif
     }
     
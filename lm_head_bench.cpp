@@ -0,0 +1,135 @@
+// lm_head_bench.cpp
+// Host-side sharded lm_head (lm_head_topk.hpp) across vocabulary sizes.
+// For each vocab prints:
+//
+//   host      time to score every row and reduce to the top k, scalar on
+//             one shard and vector on the pool, and the bandwidth it reads
+//   kernel    modeled decode step with the full lm_head, with none, and
+//             with the split where host and kernel time are equal
+//
+// The sharded top-k and logsumexp are checked against a full double
+// precision softmax over every logit.
+//
+// Build: g++ -std=c++17 -O2 lm_head_bench.cpp -o lm_head_bench -pthread
+
+#include "lm_head_topk.hpp"
+#include "perf_model.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static const int REPEATS = 5;
+static const uint32_t HIDDEN = 768;
+static const uint32_t CONTEXT = 512;
+
+template <typename Fn>
+static double bestOf(Fn fn) {
+    double best = 1e30;
+    for (int r = 0; r < REPEATS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+        if (us < best) best = us;
+    }
+    return best;
+}
+
+static std::vector<uint16_t> makeTable(uint32_t vocab) {
+    std::vector<uint16_t> table((size_t)vocab * HIDDEN);
+    uint32_t seed = vocab;
+    for (uint16_t& w : table) {
+        seed = seed * 1664525u + 1013904223u;
+        w = fp16FromFloat(((int32_t)(seed >> 8) - (1 << 23)) * (0.05f / (1 << 23)));
+    }
+    return table;
+}
+
+// Top-1 and logsumexp from every logit, in double
+static bool matchesReference(const std::vector<uint16_t>& table, uint32_t vocab,
+                             const std::vector<float>& x, const LogitTopK& got) {
+    std::vector<double> logits(vocab);
+    double m = -INFINITY;
+    uint32_t best = 0;
+    for (uint32_t r = 0; r < vocab; r++) {
+        double sum = 0;
+        for (uint32_t i = 0; i < HIDDEN; i++) {
+            sum += (double)fp16ToFloat(table[(size_t)r * HIDDEN + i]) * x[i];
+        }
+        logits[r] = sum;
+        if (sum > m) {
+            m = sum;
+            best = r;
+        }
+    }
+    double s = 0;
+    for (double v : logits) s += std::exp(v - m);
+    double lse = m + std::log(s);
+
+    return !got.top.empty() && got.top[0].token == best &&
+           std::fabs(got.logSumExp() - lse) < 1e-3;
+}
+
+int main() {
+    const uint32_t vocabs[] = {32000, 50257, 128256, 256000};
+
+    ModelShape shape;
+    shape.num_layers = 12;
+    shape.hidden_size = HIDDEN;
+    shape.num_heads = 12;
+    shape.max_seq_len = 2048;
+    shape.intermediate_size = 4 * HIDDEN;
+
+    std::vector<float> x(HIDDEN);
+    for (uint32_t i = 0; i < HIDDEN; i++) {
+        x[i] = (float)((i * 37) % 101) * 0.02f - 1.0f;
+    }
+
+    printf("[Bench] lm_head top-%u, hidden %u, decode at context %u (%u pool workers, best of %d)\n",
+           LM_HEAD_TOP_K, HIDDEN, CONTEXT, sharedThreadPool().getWorkerCount(), REPEATS);
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("%-7s %8s %11s %11s %7s %12s %12s %16s %6s\n", "Vocab", "lm_head", "scalar",
+           "sharded", "GB/s", "kernel all", "kernel none", "balanced split", "check");
+
+    bool all_ok = true;
+    for (uint32_t vocab : vocabs) {
+        std::vector<uint16_t> table = makeTable(vocab);
+
+        ShardedLmHead scalar;
+        scalar.initFp16(table, vocab, HIDDEN, 0, vocab);
+        scalar.forceIsa(CpuIsa::SCALAR);
+        ShardedLmHead sharded;
+        sharded.initFp16(table, vocab, HIDDEN, 0);
+
+        LogitTopK result;
+        double scalar_us = bestOf([&] { result = scalar.topK(x.data(), LM_HEAD_TOP_K); });
+        double sharded_us = bestOf([&] { result = sharded.topK(x.data(), LM_HEAD_TOP_K); });
+        bool ok = matchesReference(table, vocab, x, result);
+        all_ok = all_ok && ok;
+
+        shape.vocab_size = vocab;
+        PerfModel perf;
+        perf.setShape(shape);
+        double kernel_all = perf.decodeUs(CONTEXT);
+        perf.setLmHeadSplit(0);
+        double kernel_none = perf.decodeUs(CONTEXT);
+
+        // Host time scales with its rows; find where it meets the kernel's
+        double lo = 0.0, hi = 1.0;
+        for (int i = 0; i < 30; i++) {
+            double f = (lo + hi) / 2;
+            perf.setLmHeadSplit((uint32_t)(vocab * (1.0 - f)));
+            if (f * sharded_us < perf.decodeUs(CONTEXT)) lo = f; else hi = f;
+        }
+        perf.setLmHeadSplit((uint32_t)(vocab * (1.0 - lo)));
+        double split_us = perf.decodeUs(CONTEXT);
+
+        printf("%-7u %5.0f MB %8.1f us %8.1f us %7.2f %9.1f us %9.1f us %5.1f%% %6.1f us %6s\n",
+               vocab, table.size() * 2 / (1024.0 * 1024.0), scalar_us, sharded_us,
+               sharded.bytesPerToken() / (sharded_us * 1000.0), kernel_all, kernel_none,
+               lo * 100.0, split_us, ok ? "ok" : "FAIL");
+    }
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,353 @@
+// lm_head_topk.hpp
+// Vocabulary-sharded lm_head on the host. The lm_head is the largest
+// single tensor the kernel streams per token for big vocabularies. With
+// CONFIG_FLAG_SPLIT_LM_HEAD the kernel scores only the first
+// lm_head_rows rows and reports its best candidates, the max logit and
+// the sum of exp over them; the host scores the remaining rows against
+// the final hidden state in parallel shards.
+//
+// Each shard (kernel or host) reduces to a LogitTopK: top-k candidates
+// plus a logsumexp normalizer. Partials of disjoint slices merge into the
+// partial of their union, so only O(shards * k) values are reduced, not
+// vocab logits, and the merged candidates' probabilities stay exact.
+//
+// lm_head_rows 0 leaves the whole lm_head to the host; the kernel skips
+// it entirely.
+//
+// Constrained decoding passes a token mask (constrained_decoding.hpp):
+// rows whose bit is clear are neither scored nor counted in the
+// normalizer, on either side of the split.
+
+#ifndef LM_HEAD_TOPK_HPP
+#define LM_HEAD_TOPK_HPP
+
+#include "cpu_kernels.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Candidates the kernel reports for its rows
+const uint32_t LM_HEAD_TOP_K = 8;
+
+struct LogitCandidate {
+    uint32_t token;
+    float logit;
+};
+
+// Top-k and softmax normalizer of a slice of the vocabulary
+struct LogitTopK {
+    std::vector<LogitCandidate> top;    // Descending logit
+    float max_logit;
+    double sum_exp;                     // Sum of exp(logit - max_logit) over the slice
+
+    LogitTopK() : max_logit(-INFINITY), sum_exp(0) {}
+
+    bool empty() const { return sum_exp <= 0; }
+    double logSumExp() const { return max_logit + std::log(sum_exp); }
+    double logProb(const LogitCandidate& c) const { return c.logit - logSumExp(); }
+
+    // Partial of logits[i] for tokens first_token + i; -inf logits are
+    // masked out
+    static LogitTopK fromLogits(const float* logits, uint32_t first_token, size_t n, uint32_t k) {
+        LogitTopK part;
+        if (n == 0) {
+            return part;
+        }
+        float m = logits[0];
+        for (size_t i = 1; i < n; i++) {
+            if (logits[i] > m) m = logits[i];
+        }
+        if (m == -INFINITY) {
+            return part;
+        }
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += std::exp(logits[i] - m);
+        }
+        part.max_logit = m;
+        part.sum_exp = sum;
+
+        // Insertion into a short sorted list; most logits fail the threshold
+        std::vector<LogitCandidate>& top = part.top;
+        top.reserve(k + 1);
+        for (size_t i = 0; i < n && k > 0; i++) {
+            float v = logits[i];
+            if (v == -INFINITY || (top.size() == k && v <= top.back().logit)) {
+                continue;
+            }
+            size_t pos = top.size();
+            while (pos > 0 && top[pos - 1].logit < v) pos--;
+            top.insert(top.begin() + pos, LogitCandidate{first_token + (uint32_t)i, v});
+            if (top.size() > k) top.pop_back();
+        }
+        return part;
+    }
+
+    void merge(const LogitTopK& other, uint32_t k) {
+        if (other.empty()) {
+            return;
+        }
+        if (empty()) {
+            *this = other;
+            if (top.size() > k) top.resize(k);
+            return;
+        }
+        float m = std::max(max_logit, other.max_logit);
+        sum_exp = sum_exp * std::exp((double)max_logit - m) +
+                  other.sum_exp * std::exp((double)other.max_logit - m);
+        max_logit = m;
+
+        std::vector<LogitCandidate> merged;
+        merged.reserve(k);
+        size_t a = 0, b = 0;
+        while (merged.size() < k && (a < top.size() || b < other.top.size())) {
+            if (b >= other.top.size() ||
+                (a < top.size() && top[a].logit >= other.top[b].logit)) {
+                merged.push_back(top[a++]);
+            } else {
+                merged.push_back(other.top[b++]);
+            }
+        }
+        top.swap(merged);
+    }
+};
+
+// Kernel partial in the output buffer, 32-bit words:
+//   [0]              candidate count n (<= LM_HEAD_TOP_K)
+//   [1 .. 2k]        token, logit (FP32 bits) pairs, descending
+//   [2k + 1]         max logit over the kernel's rows (FP32 bits)
+//   [2k + 2]         sum of exp(logit - max) (FP32 bits)
+//   [2k + 3 ..]      final hidden state, FP16, two per word
+inline size_t lmHeadPartialWords(uint32_t hidden) {
+    return 2 * LM_HEAD_TOP_K + 3 + (hidden + 1) / 2;
+}
+
+inline void packLmHeadPartial(const LogitTopK& part, const float* hidden_state,
+                              uint32_t hidden, uint32_t* words) {
+    uint32_t n = (uint32_t)std::min<size_t>(part.top.size(), LM_HEAD_TOP_K);
+    words[0] = n;
+    for (uint32_t i = 0; i < LM_HEAD_TOP_K; i++) {
+        LogitCandidate c = i < n ? part.top[i] : LogitCandidate{0, -INFINITY};
+        words[1 + 2 * i] = c.token;
+        memcpy(&words[2 + 2 * i], &c.logit, 4);
+    }
+    float sum = (float)part.sum_exp;
+    memcpy(&words[2 * LM_HEAD_TOP_K + 1], &part.max_logit, 4);
+    memcpy(&words[2 * LM_HEAD_TOP_K + 2], &sum, 4);
+
+    uint32_t* h = words + 2 * LM_HEAD_TOP_K + 3;
+    for (uint32_t i = 0; i < hidden; i += 2) {
+        uint32_t lo = fp16FromFloat(hidden_state[i]);
+        uint32_t hi = i + 1 < hidden ? fp16FromFloat(hidden_state[i + 1]) : 0;
+        h[i / 2] = lo | (hi << 16);
+    }
+}
+
+inline bool unpackLmHeadPartial(const uint32_t* words, size_t n_words, uint32_t hidden,
+                                LogitTopK& part, std::vector<float>& hidden_state) {
+    if (n_words < lmHeadPartialWords(hidden) || words[0] > LM_HEAD_TOP_K) {
+        return false;
+    }
+    part = LogitTopK();
+    for (uint32_t i = 0; i < words[0]; i++) {
+        LogitCandidate c;
+        c.token = words[1 + 2 * i];
+        memcpy(&c.logit, &words[2 + 2 * i], 4);
+        part.top.push_back(c);
+    }
+    float sum;
+    memcpy(&part.max_logit, &words[2 * LM_HEAD_TOP_K + 1], 4);
+    memcpy(&sum, &words[2 * LM_HEAD_TOP_K + 2], 4);
+    part.sum_exp = sum;
+
+    hidden_state.resize(hidden);
+    const uint32_t* h = words + 2 * LM_HEAD_TOP_K + 3;
+    for (uint32_t i = 0; i < hidden; i++) {
+        hidden_state[i] = fp16ToFloat((uint16_t)(h[i / 2] >> (16 * (i & 1))));
+    }
+    return true;
+}
+
+// Host rows [first_row, vocab) of the lm_head as FP16, scored in shards
+// on the shared pool. Engine thread only.
+class ShardedLmHead {
+private:
+    static const uint32_t MIN_SHARD_ROWS = 1024;
+
+    std::vector<uint16_t> table;        // FP16, (vocab - first_row) x hidden
+    uint32_t hidden;
+    uint32_t vocab;
+    uint32_t first_row;
+    uint32_t shard_rows;
+    CpuIsa isa;
+    DotFp16Fn dot;                      // Masked rows, one at a time
+    DotRowsFp16Fn dot_rows;             // Unmasked shards
+    MaskLogitsFn mask_logits;
+
+    std::vector<LogitTopK> shard_out;
+
+    uint64_t tokens;
+    uint64_t masked_tokens;             // Scored under a token mask
+    uint64_t host_wins;                 // Merged winner came from a host row
+    double us_total;
+    double us_max;
+
+    uint32_t hostRows() const { return vocab - first_row; }
+
+    // Masked rows skip their dot product, one mask word at a time; the
+    // vector mask then sets their logits to -inf
+    void scoreShard(uint32_t shard, const float* x, uint32_t k, const uint64_t* mask) {
+        uint32_t lo = shard * shard_rows;
+        uint32_t hi = std::min(lo + shard_rows, hostRows());
+        thread_local std::vector<float> logits;
+        logits.resize(hi - lo);
+        if (!mask) {
+            dot_rows(&table[(size_t)lo * hidden], x, hidden, hi - lo, logits.data());
+        } else {
+            for (size_t i = 0; i < hi - lo; ) {
+                size_t span;
+                uint64_t word = maskWordAt(mask, first_row + lo, i, hi - lo, span);
+                for (; word; word &= word - 1) {
+                    size_t r = lo + i + __builtin_ctzll(word);
+                    logits[r - lo] = dot(&table[r * hidden], x, hidden);
+                }
+                i += span;
+            }
+            mask_logits(logits.data(), mask, first_row + lo, hi - lo);
+        }
+        shard_out[shard] = LogitTopK::fromLogits(logits.data(), first_row + lo, hi - lo, k);
+    }
+
+public:
+    ShardedLmHead() : hidden(0), vocab(0), first_row(0), shard_rows(0),
+                      isa(CpuIsa::SCALAR), dot(dotFp16Scalar),
+                      dot_rows(dotRowsFp16<dotFp16Scalar>), mask_logits(maskLogitsScalar),
+                      tokens(0), masked_tokens(0), host_wins(0), us_total(0), us_max(0) {}
+
+    // Takes rows [first, vocab) of an FP16 table already laid out row-major.
+    // rows_per_shard 0 = about two shards per pool worker.
+    bool initFp16(std::vector<uint16_t> rows, uint32_t vocab_size, uint32_t hidden_size,
+                  uint32_t first, uint32_t rows_per_shard = 0) {
+        if (hidden_size == 0 || first >= vocab_size ||
+            rows.size() != (size_t)(vocab_size - first) * hidden_size) {
+            printf("[LmHead] No lm_head rows for the host\n");
+            return false;
+        }
+        table.swap(rows);
+        hidden = hidden_size;
+        vocab = vocab_size;
+        first_row = first;
+
+        if (rows_per_shard == 0) {
+            uint32_t shards = 2 * (sharedThreadPool().getWorkerCount() + 1);
+            rows_per_shard = (hostRows() + shards - 1) / shards;
+            if (rows_per_shard < MIN_SHARD_ROWS) rows_per_shard = MIN_SHARD_ROWS;
+        }
+        shard_rows = rows_per_shard;
+        shard_out.assign(numShards(), LogitTopK());
+        isa = detectCpuIsa();
+        dot = dotFp16Kernel(isa, hidden);
+        dot_rows = dotRowsFp16Kernel(isa, hidden);
+        mask_logits = maskLogitsKernel(isa);
+
+        printf("[LmHead] Host scores rows %u-%u of %u (%.2f MB FP16) in %u shards, %s kernel%s\n",
+               first_row, vocab - 1, vocab, table.size() * 2 / (1024.0 * 1024.0),
+               numShards(), cpuIsaName(isa), specialized() ? " for this hidden size" : "");
+        return true;
+    }
+
+    // From the FP32 lm_head in ModelWeights (vocab x hidden, count floats)
+    bool init(const float* lm_head, size_t count, uint32_t hidden_size, uint32_t first,
+              uint32_t rows_per_shard = 0) {
+        if (hidden_size == 0 || count < hidden_size) {
+            printf("[LmHead] No lm_head loaded, kernel scores the full vocabulary\n");
+            return false;
+        }
+        uint32_t vocab_size = (uint32_t)(count / hidden_size);
+        if (first >= vocab_size) {
+            return initFp16(std::vector<uint16_t>(), vocab_size, hidden_size, first);
+        }
+        std::vector<uint16_t> rows((size_t)(vocab_size - first) * hidden_size);
+        const float* src = lm_head + (size_t)first * hidden_size;
+        sharedThreadPool().parallel_for(0, rows.size(), 64 * 1024, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                rows[i] = fp16FromFloat(src[i]);
+            }
+        });
+        return initFp16(std::move(rows), vocab_size, hidden_size, first, rows_per_shard);
+    }
+
+    bool forceIsa(CpuIsa k) {
+        if (k != CpuIsa::SCALAR && k != detectCpuIsa()) {
+            return false;
+        }
+        isa = k;
+        dot = dotFp16Kernel(isa, hidden);
+        dot_rows = dotRowsFp16Kernel(isa, hidden);
+        mask_logits = maskLogitsKernel(isa);
+        return true;
+    }
+
+    bool ready() const { return hidden > 0; }
+    bool specialized() const { return findShapeKernels(isa, hidden) != nullptr; }
+    uint32_t firstRow() const { return first_row; }
+    uint32_t vocabSize() const { return vocab; }
+    uint32_t numShards() const { return shard_rows ? (hostRows() + shard_rows - 1) / shard_rows : 0; }
+    uint64_t bytesPerToken() const { return (uint64_t)table.size() * 2; }
+    const char* kernelName() const { return cpuIsaName(isa); }
+
+    // Top k over the host rows for one hidden state (hidden floats). With
+    // a mask (one bit per vocabulary token) only tokens whose bit is set
+    // are scored.
+    LogitTopK topK(const float* hidden_state, uint32_t k, const uint64_t* mask = nullptr) {
+        auto start = std::chrono::steady_clock::now();
+
+        sharedThreadPool().parallel_for(0, numShards(), 1, [&](size_t lo, size_t hi) {
+            for (size_t s = lo; s < hi; s++) {
+                scoreShard((uint32_t)s, hidden_state, k, mask);
+            }
+        });
+        LogitTopK result;
+        for (const LogitTopK& part : shard_out) {
+            result.merge(part, k);
+        }
+
+        double us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+        tokens++;
+        if (mask) masked_tokens++;
+        us_total += us;
+        if (us > us_max) us_max = us;
+        return result;
+    }
+
+    // Engine reports which side the merged winner came from
+    void decided(uint32_t token) {
+        if (token >= first_row) host_wins++;
+    }
+
+    void printStats(double kernel_step_us) const {
+        printf("\n[LmHead] Host shard statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Host rows:         %u of %u in %u shards (%s kernel)\n",
+               hostRows(), vocab, numShards(), kernelName());
+        printf("Tokens scored:     %lu (%lu won by a host row, %lu masked)\n",
+               (unsigned long)tokens, (unsigned long)host_wins, (unsigned long)masked_tokens);
+        printf("Host time:         %.1f us mean, %.1f us max per token\n",
+               tokens ? us_total / tokens : 0.0, us_max);
+        if (us_total > 0) {
+            printf("Throughput:        %.2f GB/s of lm_head\n",
+                   tokens * (double)bytesPerToken() / (us_total * 1000.0));
+        }
+        printf("Kernel step:       %.1f us modeled%s\n", kernel_step_us,
+               tokens && us_total / tokens > kernel_step_us ? " (host is the bottleneck)" : "");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // LM_HEAD_TOPK_HPP
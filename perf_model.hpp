@@ -0,0 +1,274 @@
+// perf_model.hpp
+// Roofline-style timing model of the accelerator. Predicts prefill and
+// per-token decode time from the model shape in ConfigIn, DDR bandwidth
+// and clock rate, so scheduling and capacity questions can be answered
+// without the board. The simulator paces its tokens with it.
+//
+// Per decode step the kernel streams every INT4 layer weight and the
+// FP16 lm_head from DDR once, reads the KV cache of each sequence in the
+// batch and appends one K/V row per layer. Time is the larger of memory
+// and compute time plus fixed per-layer/per-step overhead.
+//
+// Before layer 0 the kernel needs the input embeddings: one token row and
+// one position row per input token, gathered from DDR row by row. With
+// host-side embedding (CONFIG_FLAG_HOST_EMBED) the prompt's rows arrive
+// pre-summed in the input buffer and are read as one burst.
+//
+// With a split lm_head (CONFIG_FLAG_SPLIT_LM_HEAD) the kernel streams and
+// scores only its share of the vocabulary rows; the host does the rest.
+
+#ifndef PERF_MODEL_HPP
+#define PERF_MODEL_HPP
+
+#include "config_struct.hpp"
+#include <cstdint>
+#include <cstdio>
+
+// Hardware parameters
+// todo calibrate against the board once timing counters are exposed
+struct AccelPerfParams {
+    double clock_mhz;
+    double ddr_gbps;                // Peak DDR bandwidth, GB/s
+    double ddr_efficiency;          // Achieved fraction of peak on long bursts
+    uint32_t macs_per_cycle;        // INT4 x FP16 MAC lanes
+    uint32_t layer_overhead_cycles; // Pipeline fill/drain per layer
+    uint32_t step_overhead_cycles;  // Handshake, sampling, status write per step
+    uint32_t kv_bytes;              // Bytes per KV element (FP16)
+    uint32_t embed_row_cycles;      // Address/latency cost of one embedding row fetch
+
+    AccelPerfParams() : clock_mhz(300.0), ddr_gbps(19.2), ddr_efficiency(0.6),
+                        macs_per_cycle(1024), layer_overhead_cycles(2000),
+                        step_overhead_cycles(5000), kv_bytes(2), embed_row_cycles(64) {}
+};
+
+// Shape of the loaded model (what ConfigIn carries, plus the FFN width
+// which it does not)
+struct ModelShape {
+    uint32_t num_layers;
+    uint32_t hidden_size;
+    uint32_t num_heads;
+    uint32_t vocab_size;
+    uint32_t max_seq_len;
+    uint32_t intermediate_size;     // 0 = 4 * hidden_size
+    uint32_t batch_size;
+
+    ModelShape() : num_layers(0), hidden_size(0), num_heads(0), vocab_size(0),
+                   max_seq_len(0), intermediate_size(0), batch_size(1) {}
+
+    bool valid() const { return num_layers > 0 && hidden_size > 0; }
+
+    uint32_t ffnSize() const {
+        return intermediate_size ? intermediate_size : 4 * hidden_size;
+    }
+};
+
+// Cost of one prefill or decode step
+struct StepCost {
+    uint64_t weight_bytes;
+    uint64_t kv_read_bytes;
+    uint64_t kv_write_bytes;
+    uint64_t macs;
+    uint64_t embed_bytes;           // Input embeddings read before layer 0
+    double embed_us;
+    double memory_us;
+    double compute_us;
+    double overhead_us;
+    double total_us;
+    bool memory_bound;
+};
+
+class PerfModel {
+private:
+    AccelPerfParams params;
+    ModelShape shape;
+    bool lm_head_split;
+    uint32_t lm_head_rows;          // Kernel's rows when split
+
+    double bytesPerUs() const {
+        // 1 GB/s = 1000 bytes/us
+        return params.ddr_gbps * params.ddr_efficiency * 1000.0;
+    }
+
+    double cyclesToUs(double cycles) const {
+        return cycles / params.clock_mhz;
+    }
+
+    StepCost finish(StepCost cost) const {
+        cost.memory_us = (cost.weight_bytes + cost.kv_read_bytes + cost.kv_write_bytes) / bytesPerUs();
+        cost.compute_us = cyclesToUs((double)cost.macs / params.macs_per_cycle);
+        cost.overhead_us = cyclesToUs((double)shape.num_layers * params.layer_overhead_cycles +
+                                      params.step_overhead_cycles);
+        cost.memory_bound = cost.memory_us >= cost.compute_us;
+        cost.total_us = (cost.memory_bound ? cost.memory_us : cost.compute_us) +
+                        cost.overhead_us + cost.embed_us;
+        return cost;
+    }
+
+    // Layer 0 can't start until its inputs are in: kernel lookup fetches
+    // a token and a position row per input, host embedding streams one
+    // pre-summed row per input
+    void embedInputs(StepCost& cost, uint64_t inputs, bool host_embed) const {
+        uint64_t row_bytes = (uint64_t)shape.hidden_size * 2;
+        if (host_embed) {
+            cost.embed_bytes = inputs * row_bytes;
+            cost.embed_us = cost.embed_bytes / bytesPerUs();
+        } else {
+            cost.embed_bytes = 2 * inputs * row_bytes;
+            cost.embed_us = cost.embed_bytes / bytesPerUs() +
+                            cyclesToUs(2.0 * inputs * params.embed_row_cycles);
+        }
+    }
+
+public:
+    PerfModel() : lm_head_split(false), lm_head_rows(0) {}
+
+    void setParams(const AccelPerfParams& p) { params = p; }
+    const AccelPerfParams& getParams() const { return params; }
+
+    void setShape(const ModelShape& s) { shape = s; }
+    const ModelShape& getShape() const { return shape; }
+
+    // Take the shape from a packed config; FFN width is kept
+    void setConfig(const ConfigIn& config) {
+        shape.num_layers = config.num_layers;
+        shape.hidden_size = config.hidden_size;
+        shape.num_heads = config.num_heads;
+        shape.vocab_size = config.vocab_size;
+        shape.max_seq_len = config.sequence_length;
+        shape.batch_size = config.batch_size ? config.batch_size : 1;
+        lm_head_split = (config.flags & CONFIG_FLAG_SPLIT_LM_HEAD) != 0;
+        lm_head_rows = config.lm_head_rows;
+    }
+
+    // Kernel scores rows [0, rows) of the lm_head; the host the rest
+    void setLmHeadSplit(uint32_t rows) {
+        lm_head_split = true;
+        lm_head_rows = rows;
+    }
+
+    uint32_t kernelLmHeadRows() const {
+        return lm_head_split && lm_head_rows < shape.vocab_size ? lm_head_rows : shape.vocab_size;
+    }
+
+    bool valid() const { return shape.valid(); }
+
+    // INT4 weights of all layers plus the kernel's FP16 lm_head rows
+    uint64_t weightBytes() const {
+        uint64_t h = shape.hidden_size;
+        uint64_t per_layer = 4 * h * h + 2 * h * shape.ffnSize();
+        return shape.num_layers * per_layer / 2 + (uint64_t)kernelLmHeadRows() * h * 2;
+    }
+
+    // K and V, all layers, one position
+    uint64_t kvBytesPerToken() const {
+        return 2ull * shape.num_layers * shape.hidden_size * params.kv_bytes;
+    }
+
+    uint64_t kvBytesPerSequence() const {
+        return kvBytesPerToken() * shape.max_seq_len;
+    }
+
+    uint64_t macsPerToken(uint32_t context) const {
+        uint64_t h = shape.hidden_size;
+        uint64_t dense = shape.num_layers * (4 * h * h + 2 * h * shape.ffnSize());
+        uint64_t attention = 2ull * shape.num_layers * h * context;  // QK^T and AV
+        return dense + attention + (uint64_t)kernelLmHeadRows() * h;
+    }
+
+    // One decode step for the whole batch; context = tokens already in
+    // the KV cache of each sequence. batch 0 = the shape's.
+    StepCost decodeStep(uint32_t context, uint32_t batch = 0) const {
+        StepCost cost = StepCost();
+        if (batch == 0) batch = shape.batch_size ? shape.batch_size : 1;
+        cost.weight_bytes = weightBytes();
+        cost.kv_read_bytes = kvBytesPerToken() * context * batch;
+        cost.kv_write_bytes = kvBytesPerToken() * batch;
+        cost.macs = macsPerToken(context) * batch;
+        embedInputs(cost, batch, false);
+        return finish(cost);
+    }
+
+    // Prompt pass: weights streamed once, compute scales with the prompt.
+    // Attention reads K/V of earlier prompt positions from on-chip tiles.
+    StepCost prefill(uint32_t prompt_len, bool host_embed = false) const {
+        StepCost cost = StepCost();
+        uint32_t batch = shape.batch_size ? shape.batch_size : 1;
+        cost.weight_bytes = weightBytes();
+        cost.kv_write_bytes = kvBytesPerToken() * prompt_len * batch;
+        uint64_t macs = 0;
+        for (uint32_t pos = 0; pos < prompt_len; pos++) {
+            macs += macsPerToken(pos);
+        }
+        cost.macs = macs * batch;
+        embedInputs(cost, (uint64_t)prompt_len * batch, host_embed);
+        return finish(cost);
+    }
+
+    double prefillUs(uint32_t prompt_len, bool host_embed = false) const {
+        return valid() ? prefill(prompt_len, host_embed).total_us : 0.0;
+    }
+
+    double decodeUs(uint32_t context, uint32_t batch = 0) const {
+        return valid() ? decodeStep(context, batch).total_us : 0.0;
+    }
+
+    // Whole run: prompt pass followed by gen_tokens decode steps of batch
+    // sequences (candidate search: one prefill, then a batched decode)
+    double runUs(uint32_t prompt_len, uint32_t gen_tokens, uint32_t batch = 0) const {
+        if (!valid()) {
+            return 0.0;
+        }
+        double us = prefillUs(prompt_len);
+        for (uint32_t i = 0; i < gen_tokens; i++) {
+            us += decodeUs(prompt_len + i, batch);
+        }
+        return us;
+    }
+
+    // Aggregate tokens/s over the batch at a given context length
+    double tokensPerSecond(uint32_t context) const {
+        double us = decodeUs(context);
+        uint32_t batch = shape.batch_size ? shape.batch_size : 1;
+        return us > 0.0 ? batch * 1e6 / us : 0.0;
+    }
+
+    void printSummary() const {
+        printf("\n[PerfModel] Accelerator timing model:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        if (!valid()) {
+            printf("No model shape configured\n");
+            printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+            return;
+        }
+        printf("Model:             %u layers, hidden %u, ffn %u, vocab %u, batch %u\n",
+               shape.num_layers, shape.hidden_size, shape.ffnSize(),
+               shape.vocab_size, shape.batch_size);
+        printf("Hardware:          %.0f MHz, %.1f GB/s x %.0f%%, %u MACs/cycle\n",
+               params.clock_mhz, params.ddr_gbps, params.ddr_efficiency * 100.0,
+               params.macs_per_cycle);
+        printf("Weights/step:      %.2f MB\n", weightBytes() / (1024.0 * 1024.0));
+        if (kernelLmHeadRows() < shape.vocab_size) {
+            printf("lm_head split:     kernel %u rows, host %u of %u\n",
+                   kernelLmHeadRows(), shape.vocab_size - kernelLmHeadRows(), shape.vocab_size);
+        }
+        printf("KV per token:      %lu bytes (%.2f MB per sequence)\n",
+               (unsigned long)kvBytesPerToken(), kvBytesPerSequence() / (1024.0 * 1024.0));
+
+        uint32_t prompt = shape.max_seq_len < 128 ? shape.max_seq_len : 128;
+        StepCost p = prefill(prompt);
+        printf("Prefill %4u:      %.1f us (%s-bound), %.1f us with host embedding\n",
+               prompt, p.total_us, p.memory_bound ? "memory" : "compute",
+               prefill(prompt, true).total_us);
+
+        const uint32_t contexts[] = {1, 128, 512, 2048};
+        for (uint32_t ctx : contexts) {
+            if (ctx > shape.max_seq_len && ctx != 1) break;
+            StepCost d = decodeStep(ctx);
+            printf("Decode @%4u:      %.1f us/step, %.1f tok/s (%s-bound)\n", ctx,
+                   d.total_us, tokensPerSecond(ctx), d.memory_bound ? "memory" : "compute");
+        }
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // PERF_MODEL_HPP
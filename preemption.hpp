@@ -0,0 +1,180 @@
+// preemption.hpp
+// Suspending a running generation at a token boundary so a higher
+// priority tenant's task can run, then resuming it later from its KV
+// cache instead of re-running the prompt.
+//
+// Each run decodes in its own KV slot (CapacityPlan batch slots). A
+// suspended task keeps its slot pinned and goes back to the front of its
+// tenant's queue with a ResumeState: slot, position, tokens generated
+// and the last sampled token. The resume run is launched with
+// TASK_TYPE_RESUME, feeding that token at the saved position with the
+// sampler offset restored.
+//
+// Engine thread only; no locking.
+
+#ifndef PREEMPTION_HPP
+#define PREEMPTION_HPP
+
+#include "types.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+struct PreemptionPolicy {
+    bool enabled;
+    uint32_t min_tokens;        // Run keeps at least this many before it can be preempted
+    uint32_t min_remaining;     // Not worth suspending this close to max_tokens
+
+    PreemptionPolicy() : enabled(true), min_tokens(4), min_remaining(4) {}
+};
+
+// KV slots pinned by suspended tasks. Unpinned slots are shared by
+// whatever runs next; runs are sequential, so only a suspended run needs
+// its slot left alone.
+class KvSlotPool {
+private:
+    std::vector<bool> pinned;
+    uint32_t pinned_count;
+    uint32_t epoch;             // Accelerator KV epoch the pins belong to
+
+public:
+    KvSlotPool() : pinned_count(0), epoch(0) {}
+
+    void init(uint32_t slots, uint32_t kv_epoch) {
+        pinned.assign(slots > 0 ? slots : 1, false);
+        pinned_count = 0;
+        epoch = kv_epoch;
+    }
+
+    // A reset wiped every slot; nothing suspended survives it
+    void sync(uint32_t kv_epoch) {
+        if (kv_epoch != epoch) {
+            pinned.assign(pinned.size(), false);
+            pinned_count = 0;
+            epoch = kv_epoch;
+        }
+    }
+
+    // Lowest unpinned slot; there is always one while pins < slots
+    uint32_t freeSlot() const {
+        for (uint32_t i = 0; i < pinned.size(); i++) {
+            if (!pinned[i]) return i;
+        }
+        return 0;
+    }
+
+    // Lowest unpinned slot other than busy (the running one, -1 = none),
+    // for KV written before the run in busy ends. False if there is none.
+    bool freeSlotBesides(int busy, uint32_t& slot) const {
+        for (uint32_t i = 0; i < pinned.size(); i++) {
+            if (!pinned[i] && (int)i != busy) {
+                slot = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void pin(uint32_t slot) {
+        if (slot < pinned.size() && !pinned[slot]) {
+            pinned[slot] = true;
+            pinned_count++;
+        }
+    }
+
+    void unpin(uint32_t slot) {
+        if (slot < pinned.size() && pinned[slot]) {
+            pinned[slot] = false;
+            pinned_count--;
+        }
+    }
+
+    uint32_t slots() const { return (uint32_t)pinned.size(); }
+    uint32_t pinnedCount() const { return pinned_count; }
+    uint32_t freeCount() const { return slots() - pinned_count; }
+};
+
+class PreemptionStats {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    std::unordered_map<int, Clock::time_point> suspended_at;
+
+    uint64_t preemptions;
+    uint64_t suspend_failures;      // Kernel didn't go idle; run continued
+    uint64_t no_slot;               // Runs that couldn't be preempted: KV slots pinned
+    uint64_t suspend_us_total;
+    uint64_t suspend_us_max;
+
+    uint64_t resumes;
+    uint64_t discarded;             // KV reset while suspended
+    uint64_t prefill_tokens_skipped;
+    double prefill_us_skipped;      // Perf model time for those tokens
+    double suspended_ms_total;
+    double suspended_ms_max;
+    uint32_t max_suspended;
+
+public:
+    PreemptionStats() : preemptions(0), suspend_failures(0), no_slot(0),
+                        suspend_us_total(0), suspend_us_max(0), resumes(0),
+                        discarded(0), prefill_tokens_skipped(0), prefill_us_skipped(0),
+                        suspended_ms_total(0), suspended_ms_max(0), max_suspended(0) {}
+
+    void suspended(const Task& task, uint64_t suspend_us, uint32_t now_suspended) {
+        preemptions++;
+        suspend_us_total += suspend_us;
+        if (suspend_us > suspend_us_max) suspend_us_max = suspend_us;
+        if (now_suspended > max_suspended) max_suspended = now_suspended;
+        suspended_at[task.id] = Clock::now();
+    }
+
+    void suspendFailed() { suspend_failures++; }
+    void noSlot() { no_slot++; }
+
+    // prefill_us: what re-running the saved context would have cost
+    void resumed(const Task& task, double prefill_us) {
+        resumes++;
+        prefill_tokens_skipped += task.resume.position;
+        prefill_us_skipped += prefill_us;
+
+        auto it = suspended_at.find(task.id);
+        if (it != suspended_at.end()) {
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - it->second).count();
+            suspended_ms_total += ms;
+            if (ms > suspended_ms_max) suspended_ms_max = ms;
+            suspended_at.erase(it);
+        }
+    }
+
+    void discard(const Task& task) {
+        discarded++;
+        suspended_at.erase(task.id);
+    }
+
+    void printStats(const KvSlotPool& slots, const PreemptionPolicy& policy) const {
+        printf("\n[Preemption] Statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        if (!policy.enabled || slots.slots() < 2) {
+            printf("Disabled:          %s\n", policy.enabled ? "one KV slot" : "by policy");
+        }
+        printf("Preemptions:       %lu (%lu suspend failures, %lu held by pinned KV)\n",
+               (unsigned long)preemptions, (unsigned long)suspend_failures,
+               (unsigned long)no_slot);
+        printf("Suspend latency:   %.1f us mean, %lu us max\n",
+               preemptions ? (double)suspend_us_total / preemptions : 0.0,
+               (unsigned long)suspend_us_max);
+        printf("Resumes:           %lu (%lu lost to KV reset)\n",
+               (unsigned long)resumes, (unsigned long)discarded);
+        printf("Prefill skipped:   %lu tokens (%.1f ms modeled)\n",
+               (unsigned long)prefill_tokens_skipped, prefill_us_skipped / 1000.0);
+        printf("Time suspended:    %.0f ms mean, %.0f ms max\n",
+               resumes ? suspended_ms_total / resumes : 0.0, suspended_ms_max);
+        printf("KV slots pinned:   %u of %u now, %u max\n",
+               slots.pinnedCount(), slots.slots(), max_suspended);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // PREEMPTION_HPP
@@ -0,0 +1,401 @@
+// register_replay.cpp
+// Offline analysis of a register trace recorded with
+// `inference_engine --record trace.bin`.
+//
+// Pass 1 summarizes the trace: register traffic per operation and per
+// register, reads/writes per generated token, inter-token latency.
+// Pass 2 re-drives Accelerator / InterruptHandler with the recorded reads
+// served back, so host-side changes can be checked against an old trace
+// (any write that differs from the recording counts as a divergence).
+//
+// Build: g++ -std=c++17 -O2 register_replay.cpp -o register_replay -pthread
+
+#include "register_trace.hpp"
+#include "accelerator.hpp"
+#include "interrupt_handler.hpp"
+#include "config_struct.hpp"
+#include "xaccelerator_hw.h"
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+
+struct ScopeStats {
+    uint64_t calls;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t time_us;       // Recorded time spent inside the operation
+};
+
+static const char* registerName(uint32_t offset) {
+    static char buf[32];
+    if (offset == XACCELERATOR_CTRL_ADDR_AP_CTRL) return "AP_CTRL";
+    if (offset == XACCELERATOR_CTRL_ADDR_GIE) return "GIE";
+    if (offset == XACCELERATOR_CTRL_ADDR_IER) return "IER";
+    if (offset == XACCELERATOR_CTRL_ADDR_ISR) return "ISR";
+    if (offset == XACCELERATOR_STATUS_OUT_CTRL) return "STATUS_OUT_CTRL";
+    if (offset == XACCELERATOR_IRQ_CLEAR_IN) return "IRQ_CLEAR_IN";
+    if (offset == XACCELERATOR_SUSPEND_IN) return "SUSPEND_IN";
+    if (offset >= XACCELERATOR_CONFIG_IN_BASE &&
+        offset < XACCELERATOR_CONFIG_IN_OFFSET(XACCELERATOR_CONFIG_IN_WORDS)) {
+        snprintf(buf, sizeof(buf), "CONFIG_IN[%u]",
+                 (offset - XACCELERATOR_CONFIG_IN_BASE) / 4);
+        return buf;
+    }
+    if (offset >= XACCELERATOR_STATUS_OUT_BASE &&
+        offset < XACCELERATOR_STATUS_OUT_OFFSET(XACCELERATOR_STATUS_OUT_WORDS)) {
+        snprintf(buf, sizeof(buf), "STATUS_OUT[%u]",
+                 (offset - XACCELERATOR_STATUS_OUT_BASE) / 4);
+        return buf;
+    }
+    snprintf(buf, sizeof(buf), "0x%03X", offset);
+    return buf;
+}
+
+static void analyze(const std::vector<RegTraceRecord>& records) {
+    ScopeStats scopes[(int)RegScope::NUM_SCOPES];
+    memset(scopes, 0, sizeof(scopes));
+
+    std::map<uint32_t, uint64_t> reg_reads;
+    std::map<uint32_t, uint64_t> reg_writes;
+
+    uint64_t total_us = 0;
+    uint64_t tokens = 0;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t last_token_us = 0;
+    std::vector<uint64_t> token_gaps;
+
+    for (const RegTraceRecord& r : records) {
+        total_us += r.delta_us;
+
+        int s = r.scope < (uint8_t)RegScope::NUM_SCOPES ? r.scope : 0;
+        // Time since the previous record belongs to the operation that
+        // was running when this one was logged
+        if (r.op() != RegOp::CALL) {
+            scopes[s].time_us += r.delta_us;
+        }
+
+        switch (r.op()) {
+            case RegOp::READ:
+                reads++;
+                scopes[s].reads++;
+                reg_reads[r.offset]++;
+                break;
+            case RegOp::WRITE:
+                writes++;
+                scopes[s].writes++;
+                reg_writes[r.offset]++;
+                break;
+            case RegOp::CALL:
+                scopes[s].calls++;
+                break;
+            case RegOp::TOKEN:
+                if (tokens > 0) {
+                    token_gaps.push_back(total_us - last_token_us);
+                }
+                last_token_us = total_us;
+                tokens++;
+                break;
+        }
+    }
+
+    printf("\n[Replay] Trace summary:\n");
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("Records:           %zu\n", records.size());
+    printf("Duration:          %.3f s\n", total_us / 1e6);
+    printf("Register reads:    %lu\n", (unsigned long)reads);
+    printf("Register writes:   %lu\n", (unsigned long)writes);
+    printf("Tokens:            %lu\n", (unsigned long)tokens);
+    if (tokens > 0) {
+        printf("Reads/token:       %.1f\n", (double)reads / tokens);
+        printf("Writes/token:      %.1f\n", (double)writes / tokens);
+    }
+    if (!token_gaps.empty()) {
+        std::sort(token_gaps.begin(), token_gaps.end());
+        uint64_t sum = 0;
+        for (uint64_t g : token_gaps) sum += g;
+        printf("Inter-token:       mean %.1f us, p50 %lu us, p99 %lu us, max %lu us\n",
+               (double)sum / token_gaps.size(),
+               (unsigned long)token_gaps[token_gaps.size() / 2],
+               (unsigned long)token_gaps[token_gaps.size() * 99 / 100],
+               (unsigned long)token_gaps.back());
+    }
+
+    printf("\n%-16s %8s %10s %10s %12s\n", "Operation", "Calls", "Reads", "Writes", "Time (us)");
+    for (int s = 0; s < (int)RegScope::NUM_SCOPES; s++) {
+        const ScopeStats& st = scopes[s];
+        if (st.calls == 0 && st.reads == 0 && st.writes == 0) continue;
+        printf("%-16s %8lu %10lu %10lu %12lu\n", regScopeName((RegScope)s),
+               (unsigned long)st.calls, (unsigned long)st.reads,
+               (unsigned long)st.writes, (unsigned long)st.time_us);
+    }
+
+    printf("\n%-16s %10s %10s\n", "Register", "Reads", "Writes");
+    std::map<uint32_t, bool> offsets;
+    for (auto& kv : reg_reads) offsets[kv.first] = true;
+    for (auto& kv : reg_writes) offsets[kv.first] = true;
+    for (auto& kv : offsets) {
+        printf("%-16s %10lu %10lu\n", registerName(kv.first),
+               (unsigned long)reg_reads[kv.first], (unsigned long)reg_writes[kv.first]);
+    }
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+}
+
+// Rebuild configure() arguments from the config_in writes that follow
+// the CONFIGURE marker
+static bool configureArgs(const std::vector<RegTraceRecord>& records, size_t idx,
+                          ConfigIn& config) {
+    uint32_t words[XACCELERATOR_CONFIG_IN_WORDS];
+    int found = 0;
+    for (size_t i = idx + 1; i < records.size() && found < XACCELERATOR_CONFIG_IN_WORDS; i++) {
+        const RegTraceRecord& r = records[i];
+        if (r.source() != RegSource::ACCEL || r.op() != RegOp::WRITE) continue;
+        if (r.offset != XACCELERATOR_CONFIG_IN_OFFSET(found)) return false;
+        words[found++] = r.value;
+    }
+    if (found != XACCELERATOR_CONFIG_IN_WORDS) {
+        return false;
+    }
+    config.unpack(words);
+    return true;
+}
+
+// Re-issue every recorded call against the replay backend
+static bool redrive(RegisterReplay& replay, bool verbose) {
+    const std::vector<RegTraceRecord>& records = replay.getRecords();
+
+    Accelerator accel;
+    InterruptHandler irq;
+    accel.setReplay(&replay);
+    irq.setReplay(&replay);
+
+    // The driver paths log every call; keep the report readable
+    int saved_stdout = -1;
+    if (!verbose) {
+        fflush(stdout);
+        saved_stdout = dup(STDOUT_FILENO);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        ::close(devnull);
+    }
+
+    uint64_t calls = 0;
+    uint64_t skipped = 0;
+    uint64_t tokens = 0;
+    uint64_t token_mismatches = 0;
+    uint32_t token = 0;
+    uint32_t kv_slot = 0;
+    uint32_t sample_offset = 0;
+
+    // Mask contents never reach registers; only whether a stage had one
+    std::vector<uint64_t> mask;
+    bool masked = false;
+    uint32_t candidate_rows = 0;
+    std::vector<CandidateRow> candidate_step;
+    uint32_t kv_prefix = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const RegTraceRecord& r = records[i];
+
+        if (r.op() == RegOp::TOKEN) {
+            // Recorded token must match what getNextToken returned. The
+            // simulator makes tokens up after the status read, so only
+            // hardware traces can be checked.
+            tokens++;
+#ifdef REAL_HARDWARE
+            if (r.value != token) token_mismatches++;
+#endif
+            continue;
+        }
+        if (r.op() != RegOp::CALL) {
+            continue;
+        }
+
+        calls++;
+        replay.seek(r.source(), i + 1);
+
+        switch ((RegScope)r.scope) {
+            case RegScope::CONFIGURE: {
+                ConfigIn config;
+                if (!configureArgs(records, i, config)) {
+                    skipped++;
+                    break;
+                }
+                // The shape rides in config_in; setModelConfig() records
+                // no call of its own
+                ModelShape shape;
+                shape.num_layers = config.num_layers;
+                shape.hidden_size = config.hidden_size;
+                shape.num_heads = config.num_heads;
+                shape.vocab_size = config.vocab_size;
+                shape.max_seq_len = config.sequence_length;
+                shape.batch_size = config.batch_size;
+                accel.setModelConfig(shape);
+                accel.configure(config.input_buffer_addr, config.output_buffer_addr,
+                                config.kv_cache_addr, config.stride, config.max_tokens);
+                break;
+            }
+            case RegScope::TASK_CONFIG:
+                accel.setTaskConfig((int)r.value, r.offset);
+                break;
+            case RegScope::KV_SLOTS:
+                accel.configureKvSlots(((uint64_t)r.offset << 32) | r.value);
+                break;
+            case RegScope::HOST_EMBED:
+                // No tables here: assumes every prompt that fit was gathered
+                accel.configureHostEmbedding(r.offset, r.value);
+                break;
+            case RegScope::LM_HEAD_SPLIT:
+                accel.configureLmHeadSplit(r.value, r.offset);
+                break;
+            case RegScope::TOKEN_MASKS:
+                accel.configureTokenMasks(r.value);
+                mask.assign(TokenConstraint::maskWordsFor(r.value), ~0ull);
+                break;
+            case RegScope::TOKEN_MASK:
+                // Precedes KV_SLOT
+                masked = true;
+                break;
+            case RegScope::KV_TABLES:
+                accel.configureKvTables(r.offset, r.value);
+                break;
+            case RegScope::CANDIDATES:
+                // Precedes KV_SLOT
+                candidate_rows = r.offset;
+                break;
+            case RegScope::KV_PREFIX:
+                // Precedes KV_SLOT; the restored KV is memory, not registers
+                kv_prefix = r.value;
+                break;
+            case RegScope::KV_SLOT:
+                // Precedes STAGE / STAGE_RESUME
+                kv_slot = r.offset;
+                sample_offset = r.value;
+                break;
+            case RegScope::STAGE: {
+                // Token values never reach registers; only the length matters
+                std::vector<uint32_t> prompt(r.offset, 0);
+                if (candidate_rows > 0) {
+                    // Block tables are memory, not registers
+                    std::vector<uint32_t> tables(kvTableWords(candidate_rows,
+                                                              accel.getKvTableStride()), 0);
+                    accel.stageCandidates((int)r.value, prompt, kv_slot, candidate_rows, tables);
+                } else if (kv_prefix > 0) {
+                    accel.stageContinue((int)r.value, prompt, kv_slot, kv_prefix,
+                                        masked ? mask.data() : nullptr);
+                } else {
+                    accel.stageTask((int)r.value, prompt, kv_slot, masked ? mask.data() : nullptr);
+                }
+                masked = false;
+                candidate_rows = 0;
+                kv_prefix = 0;
+                break;
+            }
+            case RegScope::STAGE_RESUME: {
+                ResumeState state;
+                state.kv_slot = kv_slot;
+                state.position = r.offset;
+                state.generated = sample_offset;
+                accel.stageResume((int)r.value, state, masked ? mask.data() : nullptr);
+                masked = false;
+                break;
+            }
+            case RegScope::SUSPEND:
+                accel.suspendRun();
+                break;
+            case RegScope::LAUNCH:
+                accel.launchStaged();
+                break;
+            case RegScope::STATUS:
+                if (r.offset == 0) {
+                    accel.getNextToken(token);
+                } else {
+                    accel.getStatus();
+                }
+                break;
+            case RegScope::CANDIDATE_STEP:
+                accel.readCandidateStep(candidate_step);
+                break;
+            case RegScope::CONTROL:
+                accel.serviceControl();
+                break;
+            case RegScope::SOFT_RESET:
+                accel.softReset();
+                break;
+            case RegScope::RESET:
+                accel.reset();
+                break;
+            case RegScope::IRQ_SERVICE:
+                irq.serviceInterrupt();
+                break;
+            default:
+                skipped++;
+                break;
+        }
+    }
+
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    if (!verbose) {
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        ::close(saved_stdout);
+    }
+
+    printf("\n[Replay] Re-drive:\n");
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("Calls replayed:    %lu (%lu skipped)\n", (unsigned long)calls, (unsigned long)skipped);
+    printf("Reads served:      %lu\n", (unsigned long)replay.getServedReads());
+    printf("Writes matched:    %lu\n", (unsigned long)replay.getCheckedWrites());
+#ifdef REAL_HARDWARE
+    printf("Tokens:            %lu (%lu mismatched)\n",
+           (unsigned long)tokens, (unsigned long)token_mismatches);
+#else
+    printf("Tokens:            %lu (not checked in simulation)\n", (unsigned long)tokens);
+#endif
+    printf("Divergences:       %lu\n", (unsigned long)replay.getDivergences());
+    printf("Host time:         %lu us\n", (unsigned long)us);
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+
+    return replay.getDivergences() == 0 && token_mismatches == 0 && skipped == 0;
+}
+
+int main(int argc, char** argv) {
+    std::string path;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--verbose") {
+            verbose = true;
+        } else if (path.empty()) {
+            path = arg;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+
+    if (path.empty()) {
+        fprintf(stderr, "Usage: %s [--verbose] trace.bin\n", argv[0]);
+        return 1;
+    }
+
+    RegisterReplay replay;
+    if (!replay.load(path)) {
+        return 1;
+    }
+
+    analyze(replay.getRecords());
+
+    return redrive(replay, verbose) ? 0 : 2;
+}
@@ -0,0 +1,323 @@
+// register_trace.hpp
+// Compact binary log of MMIO traffic, and a replay source that feeds the
+// recorded read values back to Accelerator / InterruptHandler.
+//
+// File layout:
+//   RegTraceHeader
+//   RegTraceRecord[]   (12 bytes each)
+//
+// Besides register reads and writes the trace holds CALL markers at the
+// entry of each Accelerator/InterruptHandler operation, so a replay can
+// re-issue the same calls in the same order, and TOKEN markers so traffic
+// can be attributed per generated token.
+
+#ifndef REGISTER_TRACE_HPP
+#define REGISTER_TRACE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+const uint32_t REG_TRACE_MAGIC = 0x43525452;  // "RTRC"
+const uint32_t REG_TRACE_VERSION = 1;
+
+enum class RegOp : uint8_t {
+    READ = 0,
+    WRITE = 1,
+    CALL = 2,       // offset = 16-bit arg, value = 32-bit arg
+    TOKEN = 3       // value = token
+};
+
+enum class RegSource : uint8_t {
+    ACCEL = 0,
+    IRQ = 1
+};
+
+// Operation that issued the access (CALL marker kind)
+enum class RegScope : uint8_t {
+    NONE = 0,
+    CONFIGURE,
+    TASK_CONFIG,
+    STAGE,          // offset = prompt length, value = task id
+    PRELOAD,
+    LAUNCH,
+    STATUS,         // getNextToken / getStatus
+    CONTROL,        // serviceControl
+    SOFT_RESET,
+    RESET,
+    IRQ_SERVICE,
+    KV_SLOTS,       // offset:value = 48-bit slot size
+    KV_SLOT,        // offset = slot for the next stage, value = sample offset
+    STAGE_RESUME,   // offset = KV position, value = task id
+    SUSPEND,
+    HOST_EMBED,     // offset = max prompt rows, value = row bytes
+    LM_HEAD_SPLIT,  // offset = hidden size, value = kernel lm_head rows
+    TOKEN_MASKS,    // value = vocab size
+    TOKEN_MASK,     // Next stage is constrained
+    KV_TABLES,      // offset = block tokens, value = table stride
+    CANDIDATES,     // offset = rows of the next stage
+    CANDIDATE_STEP, // readCandidateStep
+    KV_PREFIX,      // value = KV positions the next stage continues from
+    NUM_SCOPES
+};
+
+inline const char* regScopeName(RegScope scope) {
+    switch (scope) {
+        case RegScope::NONE:        return "none";
+        case RegScope::CONFIGURE:   return "configure";
+        case RegScope::TASK_CONFIG: return "setTaskConfig";
+        case RegScope::STAGE:       return "stageTask";
+        case RegScope::PRELOAD:     return "preloadStaged";
+        case RegScope::LAUNCH:      return "launchStaged";
+        case RegScope::STATUS:      return "readStatus";
+        case RegScope::CONTROL:     return "serviceControl";
+        case RegScope::SOFT_RESET:  return "softReset";
+        case RegScope::RESET:       return "reset";
+        case RegScope::IRQ_SERVICE: return "irqService";
+        case RegScope::KV_SLOTS:    return "configureKvSlots";
+        case RegScope::KV_SLOT:     return "kvSlot";
+        case RegScope::STAGE_RESUME: return "stageResume";
+        case RegScope::SUSPEND:     return "suspendRun";
+        case RegScope::HOST_EMBED:  return "configureHostEmbedding";
+        case RegScope::LM_HEAD_SPLIT: return "configureLmHeadSplit";
+        case RegScope::TOKEN_MASKS: return "configureTokenMasks";
+        case RegScope::TOKEN_MASK:  return "stageTokenMask";
+        case RegScope::KV_TABLES:   return "configureKvTables";
+        case RegScope::CANDIDATES:  return "stageCandidates";
+        case RegScope::CANDIDATE_STEP: return "readCandidateStep";
+        case RegScope::KV_PREFIX:   return "stageContinue";
+        default:                    return "?";
+    }
+}
+
+#pragma pack(push, 1)
+struct RegTraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start_unix_us;
+};
+
+struct RegTraceRecord {
+    uint32_t delta_us;      // Since previous record (saturating)
+    uint16_t offset;        // Register offset, or CALL arg
+    uint8_t op_source;      // [3:0] RegOp, [7:4] RegSource
+    uint8_t scope;          // RegScope active when recorded
+    uint32_t value;
+
+    RegOp op() const { return (RegOp)(op_source & 0x0F); }
+    RegSource source() const { return (RegSource)(op_source >> 4); }
+};
+#pragma pack(pop)
+
+static_assert(sizeof(RegTraceRecord) == 12, "trace record must stay 12 bytes");
+
+class RegisterRecorder {
+private:
+    static const size_t FLUSH_RECORDS = 4096;
+
+    FILE* file;
+    std::mutex mutex;
+    std::vector<RegTraceRecord> buffer;
+    std::chrono::steady_clock::time_point last;
+
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t tokens;
+
+    void flushLocked() {
+        if (file && !buffer.empty()) {
+            fwrite(buffer.data(), sizeof(RegTraceRecord), buffer.size(), file);
+        }
+        buffer.clear();
+    }
+
+    void append(RegOp op, RegSource source, RegScope scope,
+                uint16_t offset, uint32_t value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!file) return;
+
+        auto now = std::chrono::steady_clock::now();
+        uint64_t delta = std::chrono::duration_cast<std::chrono::microseconds>(
+            now - last).count();
+        last = now;
+
+        RegTraceRecord rec;
+        rec.delta_us = delta > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)delta;
+        rec.offset = offset;
+        rec.op_source = (uint8_t)((uint8_t)op | ((uint8_t)source << 4));
+        rec.scope = (uint8_t)scope;
+        rec.value = value;
+        buffer.push_back(rec);
+
+        if (op == RegOp::READ) reads++;
+        else if (op == RegOp::WRITE) writes++;
+        else if (op == RegOp::TOKEN) tokens++;
+
+        if (buffer.size() >= FLUSH_RECORDS) {
+            flushLocked();
+        }
+    }
+
+public:
+    RegisterRecorder() : file(nullptr), reads(0), writes(0), tokens(0) {}
+
+    ~RegisterRecorder() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            perror("[RegTrace] Failed to open trace file");
+            return false;
+        }
+
+        RegTraceHeader header;
+        header.magic = REG_TRACE_MAGIC;
+        header.version = REG_TRACE_VERSION;
+        header.start_unix_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        fwrite(&header, sizeof(header), 1, file);
+
+        last = std::chrono::steady_clock::now();
+        buffer.reserve(FLUSH_RECORDS);
+        printf("[RegTrace] Recording register traffic to %s\n", path.c_str());
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!file) return;
+
+        flushLocked();
+        fclose(file);
+        file = nullptr;
+        printf("[RegTrace] Recorded %lu reads, %lu writes, %lu tokens\n",
+               (unsigned long)reads, (unsigned long)writes, (unsigned long)tokens);
+    }
+
+    void read(RegSource source, RegScope scope, uint32_t offset, uint32_t value) {
+        append(RegOp::READ, source, scope, (uint16_t)offset, value);
+    }
+
+    void write(RegSource source, RegScope scope, uint32_t offset, uint32_t value) {
+        append(RegOp::WRITE, source, scope, (uint16_t)offset, value);
+    }
+
+    void call(RegSource source, RegScope scope, uint16_t arg16 = 0, uint32_t arg32 = 0) {
+        append(RegOp::CALL, source, scope, arg16, arg32);
+    }
+
+    void token(uint32_t value) {
+        append(RegOp::TOKEN, RegSource::ACCEL, RegScope::STATUS, 0, value);
+    }
+};
+
+// Serves recorded reads in order, per source, and checks that writes
+// match the recording. Divergences are counted rather than fatal so a
+// changed host build can be compared against an old trace.
+class RegisterReplay {
+private:
+    std::vector<RegTraceRecord> records;
+    size_t cursor[2];       // Per RegSource
+    uint64_t divergences;
+    uint64_t served_reads;
+    uint64_t checked_writes;
+
+    // Next READ/WRITE record of this source at or after the cursor
+    const RegTraceRecord* next(RegSource source) {
+        size_t& c = cursor[(int)source];
+        while (c < records.size()) {
+            const RegTraceRecord& r = records[c++];
+            if (r.source() != source) continue;
+            if (r.op() == RegOp::READ || r.op() == RegOp::WRITE) {
+                return &r;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    RegisterReplay() : divergences(0), served_reads(0), checked_writes(0) {
+        cursor[0] = cursor[1] = 0;
+    }
+
+    bool load(const std::string& path) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) {
+            perror("[RegTrace] Failed to open trace");
+            return false;
+        }
+
+        RegTraceHeader header;
+        if (fread(&header, sizeof(header), 1, f) != 1 ||
+            header.magic != REG_TRACE_MAGIC) {
+            printf("[RegTrace] Not a register trace: %s\n", path.c_str());
+            fclose(f);
+            return false;
+        }
+        if (header.version != REG_TRACE_VERSION) {
+            printf("[RegTrace] Unsupported trace version %u\n", header.version);
+            fclose(f);
+            return false;
+        }
+
+        records.clear();
+        RegTraceRecord chunk[1024];
+        size_t n;
+        while ((n = fread(chunk, sizeof(RegTraceRecord), 1024, f)) > 0) {
+            records.insert(records.end(), chunk, chunk + n);
+        }
+        fclose(f);
+
+        rewind();
+        printf("[RegTrace] Loaded %zu records from %s\n", records.size(), path.c_str());
+        return true;
+    }
+
+    void rewind() {
+        cursor[0] = cursor[1] = 0;
+        divergences = 0;
+        served_reads = 0;
+        checked_writes = 0;
+    }
+
+    uint32_t read(RegSource source, uint32_t offset) {
+        const RegTraceRecord* r = next(source);
+        if (!r || r->op() != RegOp::READ || r->offset != (uint16_t)offset) {
+            divergences++;
+            return 0;
+        }
+        served_reads++;
+        return r->value;
+    }
+
+    void write(RegSource source, uint32_t offset, uint32_t value) {
+        const RegTraceRecord* r = next(source);
+        if (!r || r->op() != RegOp::WRITE || r->offset != (uint16_t)offset ||
+            r->value != value) {
+            divergences++;
+            return;
+        }
+        checked_writes++;
+    }
+
+    // Move a source's cursor to a record index (used by the replay driver
+    // to resynchronize at CALL markers)
+    void seek(RegSource source, size_t index) {
+        cursor[(int)source] = index;
+    }
+
+    const std::vector<RegTraceRecord>& getRecords() const { return records; }
+    uint64_t getDivergences() const { return divergences; }
+    uint64_t getServedReads() const { return served_reads; }
+    uint64_t getCheckedWrites() const { return checked_writes; }
+};
+
+#endif // REGISTER_TRACE_HPP
@@ -0,0 +1,432 @@
+// response_cache.hpp
+// Token streams of finished generations, keyed by model, prompt tokens
+// and generation parameters, so a repeated request is answered without
+// the accelerator. Decoding is greedy, so a request that ran to EOS or
+// max_tokens produces the same stream every time. Candidates tasks
+// (sampled or beam, several outputs) are never cached.
+//
+//   memory   LRU bounded by memory_bytes
+//   disk     optional write-through directory, LRU bounded by disk_bytes,
+//            that survives restarts. Only used when the model hash comes
+//            from the WTNT checksums: a shape-only hash can't tell two
+//            sets of weights apart.
+//
+// Lookups come from submitting threads; recording and stores from the
+// engine thread.
+
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include "types.hpp"
+#include "constrained_decoding.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct ResponseCacheOptions {
+    bool enabled;
+    size_t memory_bytes;
+    std::string disk_dir;           // Empty = memory only
+    size_t disk_bytes;
+
+    ResponseCacheOptions() : enabled(false), memory_bytes(64 * 1024 * 1024),
+                             disk_bytes(1024 * 1024 * 1024) {}
+};
+
+struct CachedResponse {
+    std::vector<uint32_t> tokens;
+    FinishReason finish;            // EOS or MAX_TOKENS
+};
+
+class ResponseCache {
+public:
+    static const uint32_t FILE_MAGIC = 0x50535252;     // "RRSP"
+    static const uint32_t FILE_VERSION = 1;
+
+private:
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t key_bytes;
+        uint32_t finish;
+        uint32_t tokens;
+    };
+
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const CachedResponse> response;
+        size_t bytes;
+    };
+
+    struct DiskFile {
+        std::string name;
+        size_t bytes;
+    };
+
+    ResponseCacheOptions options;
+    uint64_t model_hash;
+    bool use_disk;
+    uint32_t default_max_tokens;
+
+    mutable std::mutex mutex;
+    std::list<Entry> lru;                   // Front = most recently used
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t memory_used;
+
+    std::list<DiskFile> disk_lru;
+    std::unordered_map<std::string, std::list<DiskFile>::iterator> disk_index;
+    size_t disk_used;
+
+    // Streams of runs in flight, by task id (engine thread only)
+    std::unordered_map<int, std::vector<uint32_t>> recording;
+
+    // Stats
+    uint64_t lookups;
+    uint64_t memory_hits;
+    uint64_t disk_hits;
+    uint64_t stores;
+    uint64_t not_stored;            // Cancelled, failed, shut down
+    uint64_t evictions;
+    uint64_t disk_evictions;
+    uint64_t disk_errors;
+    uint64_t tokens_served;
+    uint64_t replays;
+    double replay_us;
+
+    // model | max_tokens | prompt tokens [| grammar]
+    std::string makeKey(const Task& task, const std::vector<uint32_t>& prompt) const {
+        uint32_t max_tokens = task.max_tokens > 0 ? (uint32_t)task.max_tokens : default_max_tokens;
+        std::string key(sizeof(model_hash) + sizeof(max_tokens) + prompt.size() * 4, '\0');
+        char* p = &key[0];
+        memcpy(p, &model_hash, sizeof(model_hash));
+        memcpy(p + sizeof(model_hash), &max_tokens, sizeof(max_tokens));
+        if (!prompt.empty()) {
+            memcpy(p + sizeof(model_hash) + sizeof(max_tokens), prompt.data(), prompt.size() * 4);
+        }
+        if (task.constraint) {
+            key += task.constraint->key();
+        }
+        return key;
+    }
+
+    static std::string fileName(const std::string& key) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (char c : key) {
+            hash = (hash ^ (uint8_t)c) * 0x100000001b3ull;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.rsp", (unsigned long long)hash);
+        return name;
+    }
+
+    std::string pathOf(const std::string& name) const {
+        return options.disk_dir + "/" + name;
+    }
+
+    void insertLocked(const std::string& key, std::shared_ptr<const CachedResponse> response) {
+        size_t bytes = key.size() + response->tokens.size() * sizeof(uint32_t) + sizeof(Entry);
+        if (bytes > options.memory_bytes) {
+            return;
+        }
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            memory_used -= it->second->bytes;
+            lru.erase(it->second);
+            index.erase(it);
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.response = response;
+        entry.bytes = bytes;
+        lru.push_front(entry);
+        index[key] = lru.begin();
+        memory_used += bytes;
+
+        while (memory_used > options.memory_bytes && !lru.empty()) {
+            memory_used -= lru.back().bytes;
+            index.erase(lru.back().key);
+            lru.pop_back();
+            evictions++;
+        }
+    }
+
+    void touchDiskLocked(const std::string& name, size_t bytes) {
+        auto it = disk_index.find(name);
+        if (it != disk_index.end()) {
+            disk_used -= it->second->bytes;
+            disk_lru.erase(it->second);
+        }
+        DiskFile file;
+        file.name = name;
+        file.bytes = bytes;
+        disk_lru.push_front(file);
+        disk_index[name] = disk_lru.begin();
+        disk_used += bytes;
+
+        while (disk_used > options.disk_bytes && disk_lru.size() > 1) {
+            const DiskFile& victim = disk_lru.back();
+            unlink(pathOf(victim.name).c_str());
+            disk_used -= victim.bytes;
+            disk_index.erase(victim.name);
+            disk_lru.pop_back();
+            disk_evictions++;
+        }
+    }
+
+    // Write to a temp file and rename, so readers never see half a file
+    void writeFileLocked(const std::string& key, const CachedResponse& response) {
+        std::string name = fileName(key);
+        std::string tmp = pathOf(name + ".tmp");
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f) {
+            disk_errors++;
+            return;
+        }
+
+        FileHeader header;
+        header.magic = FILE_MAGIC;
+        header.version = FILE_VERSION;
+        header.key_bytes = (uint32_t)key.size();
+        header.finish = (uint32_t)response.finish;
+        header.tokens = (uint32_t)response.tokens.size();
+
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(key.data(), 1, key.size(), f) == key.size() &&
+                  fwrite(response.tokens.data(), sizeof(uint32_t), response.tokens.size(), f)
+                      == response.tokens.size();
+        ok = fclose(f) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), pathOf(name).c_str()) != 0) {
+            unlink(tmp.c_str());
+            disk_errors++;
+            return;
+        }
+        touchDiskLocked(name, sizeof(header) + key.size() + response.tokens.size() * sizeof(uint32_t));
+    }
+
+    // Null if absent, unreadable or a hash collision with another key
+    std::shared_ptr<const CachedResponse> readFileLocked(const std::string& key) {
+        std::string name = fileName(key);
+        if (disk_index.find(name) == disk_index.end()) {
+            return nullptr;
+        }
+
+        FILE* f = fopen(pathOf(name).c_str(), "rb");
+        if (!f) {
+            disk_errors++;
+            return nullptr;
+        }
+
+        std::shared_ptr<CachedResponse> response;
+        FileHeader header;
+        std::string stored;
+        if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == FILE_MAGIC &&
+            header.version == FILE_VERSION && header.key_bytes == key.size()) {
+            stored.resize(header.key_bytes);
+            if (fread(&stored[0], 1, stored.size(), f) == stored.size() && stored == key) {
+                response = std::make_shared<CachedResponse>();
+                response->finish = (FinishReason)header.finish;
+                response->tokens.resize(header.tokens);
+                if (fread(response->tokens.data(), sizeof(uint32_t), header.tokens, f) != header.tokens) {
+                    response.reset();
+                    disk_errors++;
+                }
+            }
+        }
+        fclose(f);
+
+        if (response) {
+            touchDiskLocked(name, sizeof(header) + key.size() + response->tokens.size() * sizeof(uint32_t));
+        }
+        return response;
+    }
+
+    // Index existing files, oldest first, so LRU order survives restarts
+    void scanDiskLocked() {
+        DIR* dir = opendir(options.disk_dir.c_str());
+        if (!dir) {
+            return;
+        }
+
+        struct Found {
+            std::string name;
+            size_t bytes;
+            time_t mtime;
+        };
+        std::vector<Found> found;
+        while (struct dirent* ent = readdir(dir)) {
+            std::string name = ent->d_name;
+            if (name.size() < 4 || name.compare(name.size() - 4, 4, ".rsp") != 0) {
+                continue;
+            }
+            struct stat st;
+            if (stat(pathOf(name).c_str(), &st) == 0) {
+                found.push_back({name, (size_t)st.st_size, st.st_mtime});
+            }
+        }
+        closedir(dir);
+
+        std::sort(found.begin(), found.end(),
+                  [](const Found& a, const Found& b) { return a.mtime < b.mtime; });
+        for (const Found& file : found) {
+            touchDiskLocked(file.name, file.bytes);
+        }
+    }
+
+public:
+    ResponseCache() : model_hash(0), use_disk(false), default_max_tokens(0), memory_used(0),
+                      disk_used(0), lookups(0), memory_hits(0), disk_hits(0), stores(0),
+                      not_stored(0), evictions(0), disk_evictions(0), disk_errors(0),
+                      tokens_served(0), replays(0), replay_us(0) {}
+
+    // model_hash identifies the weights; from_checksums says whether it
+    // covers their contents (required for the disk tier)
+    void open(const ResponseCacheOptions& opts, uint64_t hash, bool from_checksums,
+              uint32_t default_tokens) {
+        std::lock_guard<std::mutex> lock(mutex);
+        options = opts;
+        model_hash = hash;
+        default_max_tokens = default_tokens;
+        if (!options.enabled) {
+            return;
+        }
+
+        use_disk = !options.disk_dir.empty() && from_checksums;
+        if (!options.disk_dir.empty() && !from_checksums) {
+            printf("[Cache] No WTNT checksums to identify the model; disk cache off\n");
+        }
+        if (use_disk) {
+            mkdir(options.disk_dir.c_str(), 0755);
+            scanDiskLocked();
+        }
+        printf("[Cache] Response cache for model %016llx: %.1f MB memory%s%s\n",
+               (unsigned long long)model_hash, options.memory_bytes / (1024.0 * 1024.0),
+               use_disk ? ", disk " : "", use_disk ? options.disk_dir.c_str() : "");
+    }
+
+    bool enabled() const { return options.enabled; }
+
+    // The cached stream for a request identical to task, if any
+    std::shared_ptr<const CachedResponse> lookup(const Task& task,
+                                                 const std::vector<uint32_t>& prompt) {
+        if (!options.enabled || task.candidates > 0) {
+            return nullptr;
+        }
+        std::string key = makeKey(task, prompt);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        lookups++;
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            memory_hits++;
+            tokens_served += it->second->response->tokens.size();
+            return it->second->response;
+        }
+
+        if (use_disk) {
+            std::shared_ptr<const CachedResponse> response = readFileLocked(key);
+            if (response) {
+                insertLocked(key, response);
+                disk_hits++;
+                tokens_served += response->tokens.size();
+                return response;
+            }
+        }
+        return nullptr;
+    }
+
+    // Engine thread: a token the accelerator produced for task_id
+    void record(int task_id, uint32_t token) {
+        if (options.enabled) {
+            recording[task_id].push_back(token);
+        }
+    }
+
+    // Engine thread: the run restarts from the prompt (retry)
+    void discard(int task_id) {
+        recording.erase(task_id);
+    }
+
+    // Engine thread: task finished; its stream is stored if it ran to
+    // completion
+    void finish(const Task& task, const std::vector<uint32_t>& prompt, FinishReason reason) {
+        if (!options.enabled || task.candidates > 0) {
+            return;
+        }
+
+        auto it = recording.find(task.id);
+        if (reason != FinishReason::EOS && reason != FinishReason::MAX_TOKENS) {
+            if (it != recording.end()) {
+                recording.erase(it);
+                std::lock_guard<std::mutex> lock(mutex);
+                not_stored++;
+            }
+            return;
+        }
+
+        std::shared_ptr<CachedResponse> response = std::make_shared<CachedResponse>();
+        response->finish = reason;
+        if (it != recording.end()) {
+            response->tokens.swap(it->second);
+            recording.erase(it);
+        }
+
+        std::string key = makeKey(task, prompt);
+        std::lock_guard<std::mutex> lock(mutex);
+        insertLocked(key, response);
+        if (use_disk) {
+            writeFileLocked(key, *response);
+        }
+        stores++;
+    }
+
+    void replayed(double us) {
+        std::lock_guard<std::mutex> lock(mutex);
+        replays++;
+        replay_us += us;
+    }
+
+    void printStats() const {
+        if (!options.enabled) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t hits = memory_hits + disk_hits;
+
+        printf("\n[Cache] Response cache:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Lookups:           %lu, hit rate %.1f%% (%lu memory, %lu disk)\n",
+               (unsigned long)lookups, lookups ? 100.0 * hits / lookups : 0.0,
+               (unsigned long)memory_hits, (unsigned long)disk_hits);
+        printf("Stored:            %lu (%lu runs not cacheable)\n",
+               (unsigned long)stores, (unsigned long)not_stored);
+        printf("Memory:            %zu entries, %.1f of %.1f MB (%lu evicted)\n",
+               lru.size(), memory_used / (1024.0 * 1024.0),
+               options.memory_bytes / (1024.0 * 1024.0), (unsigned long)evictions);
+        if (use_disk) {
+            printf("Disk:              %zu files, %.1f of %.1f MB (%lu evicted, %lu errors)\n",
+                   disk_lru.size(), disk_used / (1024.0 * 1024.0),
+                   options.disk_bytes / (1024.0 * 1024.0), (unsigned long)disk_evictions,
+                   (unsigned long)disk_errors);
+        }
+        printf("Tokens served:     %lu in %lu replays (%.1f us mean replay)\n",
+               (unsigned long)tokens_served, (unsigned long)replays,
+               replays ? replay_us / replays : 0.0);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // RESPONSE_CACHE_HPP
@@ -0,0 +1,100 @@
+// retry_stream_test.cpp
+// A task whose run fails mid-stream is retried from its prompt
+// (InferenceEngine::recoverTask). The retry regenerates the tokens the
+// first attempt already streamed; its sink must see each of them once.
+//
+// Runs the simulated engine with no weight file: one task streams to the
+// end as the reference, then the same prompt runs again with an
+// accelerator error injected (InferenceEngine::simInjectError) after a
+// few tokens, once per error class (soft reset and full reset).
+//
+// Build: g++ -std=c++17 -O2 retry_stream_test.cpp -o retry_stream_test -pthread
+
+#include "inference_engine.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static const uint32_t INJECT_AFTER = 3;
+static const int TIMEOUT_S = 60;
+
+// Records the stream; injects the error once INJECT_AFTER tokens are in
+class RecordingSink : public TokenSink {
+public:
+    RecordingSink(InferenceEngine& engine, uint32_t error_code)
+        : engine(engine), error_code(error_code), finishes(0), reason(FinishReason::FAILED) {}
+
+    void onToken(uint32_t token) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        tokens.push_back(token);
+        if (error_code && tokens.size() == INJECT_AFTER) {
+            engine.simInjectError(error_code);
+        }
+    }
+
+    void onFinish(FinishReason r) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        finishes++;
+        reason = r;
+        done.notify_all();
+    }
+
+    bool wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        return done.wait_for(lock, std::chrono::seconds(TIMEOUT_S), [this] { return finishes > 0; });
+    }
+
+    InferenceEngine& engine;
+    uint32_t error_code;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<uint32_t> tokens;
+    int finishes;
+    FinishReason reason;
+};
+
+static std::shared_ptr<RecordingSink> run(InferenceEngine& engine, uint32_t error_code) {
+    auto sink = std::make_shared<RecordingSink>(engine, error_code);
+    Task task(0, TaskType::GENERATE, "retry stream test");
+    task.sink = sink;
+    if (!engine.submit(task) || !sink->wait()) {
+        return nullptr;
+    }
+    return sink;
+}
+
+int main() {
+    EngineOptions options;
+    options.model_file = "/nonexistent/model.bin";     // Simulation model
+    options.weight_region = 128 * 1024 * 1024;
+    options.kv_region = 64 * 1024 * 1024;
+
+    InferenceEngine engine(options);
+    if (!engine.init() || !engine.start()) {
+        printf("[Test] Engine failed to start\n");
+        return 1;
+    }
+
+    std::shared_ptr<RecordingSink> reference = run(engine, 0);
+    bool ok = reference && reference->tokens.size() > INJECT_AFTER;
+    printf("[Test] reference: %zu tokens %s\n", reference ? reference->tokens.size() : 0,
+           ok ? "ok" : "FAIL");
+
+    const AccelError errors[] = {AccelError::DDR_TIMEOUT, AccelError::KV_CORRUPT};
+    for (AccelError error : errors) {
+        std::shared_ptr<RecordingSink> sink = ok ? run(engine, (uint32_t)error) : nullptr;
+        bool same = sink && sink->tokens == reference->tokens && sink->finishes == 1 &&
+                    sink->reason == reference->reason;
+        printf("[Test] %s after %u tokens: %zu tokens, %d finish %s\n",
+               decodeAccelError((uint32_t)error).name, INJECT_AFTER,
+               sink ? sink->tokens.size() : 0, sink ? sink->finishes : 0, same ? "ok" : "FAIL");
+        ok = ok && same;
+    }
+
+    engine.shutdown();
+    printf("[Test] %s\n", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
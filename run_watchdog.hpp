@@ -0,0 +1,118 @@
+// run_watchdog.hpp
+// Declares an accelerator run hung when StatusOut stops advancing for
+// longer than the stall window, so one stuck run cannot block the queue.
+
+#ifndef RUN_WATCHDOG_HPP
+#define RUN_WATCHDOG_HPP
+
+#include "config_struct.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+
+class RunWatchdog {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    uint32_t stall_window_ms;
+
+    bool armed;
+    int task_id;
+    Clock::time_point last_progress;
+    uint32_t first_window_ms;       // Window until the run first progresses
+    bool progressed;
+
+    // Progress signature of the last status seen
+    uint32_t last_tokens;
+    uint32_t last_token;
+    uint32_t last_flags;
+
+    // Statistics (readable from other threads)
+    std::atomic<uint64_t> runs_watched;
+    std::atomic<uint64_t> stalls;
+    std::atomic<uint64_t> longest_quiet_ms;     // Longest gap that did not trip
+
+public:
+    explicit RunWatchdog(uint32_t stall_ms = 2000)
+        : stall_window_ms(stall_ms), armed(false), task_id(-1),
+          first_window_ms(stall_ms), progressed(false), last_tokens(0), last_token(0), last_flags(0),
+          runs_watched(0), stalls(0), longest_quiet_ms(0) {}
+
+    void setStallWindowMs(uint32_t ms) { stall_window_ms = ms; }
+    uint32_t getStallWindowMs() const { return stall_window_ms; }
+
+    // Start watching a run (call right after AP_START, with the status
+    // as of the launch so its flags and last token aren't taken for
+    // progress). The first token may take first_ms (its prompt pass) if
+    // that is longer than the stall window.
+    void arm(int id, const StatusOut& status, uint32_t first_ms = 0) {
+        armed = true;
+        task_id = id;
+        last_progress = Clock::now();
+        first_window_ms = first_ms > stall_window_ms ? first_ms : stall_window_ms;
+        progressed = false;
+        last_tokens = status.tokens_generated;
+        last_token = status.current_token;
+        last_flags = status.flags;
+        runs_watched++;
+    }
+
+    void disarm() {
+        armed = false;
+        task_id = -1;
+    }
+
+    // Feed the latest status. Any change in tokens_generated, the current
+    // token or the flags counts as progress. The first-token window holds
+    // until tokens_generated (counted from 0 each run) moves. Returns true
+    // once the run has been quiet for the whole window; the watchdog then
+    // disarms.
+    bool check(const StatusOut& status) {
+        if (!armed) {
+            return false;
+        }
+
+        Clock::time_point now = Clock::now();
+        uint64_t quiet_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - last_progress).count();
+
+        if (status.tokens_generated != last_tokens ||
+            status.current_token != last_token ||
+            status.flags != last_flags) {
+            if (quiet_ms > longest_quiet_ms) longest_quiet_ms = quiet_ms;
+            last_tokens = status.tokens_generated;
+            last_token = status.current_token;
+            last_flags = status.flags;
+            last_progress = now;
+            progressed = progressed || status.tokens_generated != 0;
+            return false;
+        }
+
+        if (quiet_ms < (progressed ? stall_window_ms : first_window_ms)) {
+            return false;
+        }
+
+        stalls++;
+        printf("[Watchdog] Task %d hung: no progress for %lu ms (%u tokens generated)\n",
+               task_id, (unsigned long)quiet_ms, last_tokens);
+        disarm();
+        return true;
+    }
+
+    uint64_t getRunsWatched() const { return runs_watched; }
+    uint64_t getStallCount() const { return stalls; }
+    uint64_t getLongestQuietMs() const { return longest_quiet_ms; }
+
+    void printStats() {
+        printf("\n[Watchdog] Statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Stall window:      %u ms\n", stall_window_ms);
+        printf("Runs watched:      %lu\n", (unsigned long)runs_watched.load());
+        printf("Stalls:            %lu\n", (unsigned long)stalls.load());
+        printf("Longest quiet gap: %lu ms\n", (unsigned long)longest_quiet_ms.load());
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // RUN_WATCHDOG_HPP
@@ -0,0 +1,496 @@
+// session_store.hpp
+// KV of conversation sessions, kept between turns and across restarts.
+// Clients re-send the whole conversation every turn. When a task names a
+// session whose stored context (earlier prompt plus reply) is a prefix
+// of its prompt, that context's KV is written back into the task's slot
+// and only the new tokens are prefilled (TASK_TYPE_CONTINUE).
+//
+//   memory    a session's KV is copied out of its slot when a turn ends
+//             at EOS or max_tokens; LRU bounded by memory_bytes
+//   snapshot  on shutdown or on demand every session goes to one file:
+//             header, per-session index (name and context tokens), then
+//             page-aligned KV. At startup the file is mapped and only the
+//             index is read; a session's KV pages are first touched when
+//             it is restored. The header carries the model hash and KV
+//             geometry, and a file for other weights is ignored. Only
+//             used when the hash comes from the WTNT checksums.
+//
+// Engine thread only; no locking.
+
+#ifndef SESSION_STORE_HPP
+#define SESSION_STORE_HPP
+
+#include "types.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct SessionOptions {
+    bool enabled;
+    size_t memory_bytes;
+    std::string snapshot_path;      // Empty = sessions end with the engine
+
+    SessionOptions() : enabled(false), memory_bytes(256 * 1024 * 1024) {}
+};
+
+// A stored context to write back into a KV slot
+struct SessionView {
+    uint32_t positions;             // KV entries, one per context token
+    const uint8_t* kv;              // positions x position bytes
+    bool from_snapshot;             // kv is in the mapped file
+
+    SessionView() : positions(0), kv(nullptr), from_snapshot(false) {}
+};
+
+class SessionStore {
+public:
+    static const uint32_t FILE_MAGIC = 0x4E53564B;     // "KVSN"
+    static const uint32_t FILE_VERSION = 1;
+    static const uint64_t KV_ALIGN = 4096;
+
+    // Copies a slot's first positions KV entries to dst; false if it can't
+    typedef std::function<bool(uint32_t positions, uint8_t* dst)> KvReader;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t model_hash;
+        uint64_t position_bytes;
+        uint32_t context_tokens;
+        uint32_t sessions;
+        uint64_t index_bytes;       // Index follows the header
+    };
+
+    // Followed by name_bytes of name and positions context tokens
+    struct FileEntry {
+        uint32_t name_bytes;
+        uint32_t positions;
+        uint64_t kv_offset;
+    };
+
+    struct Session {
+        std::vector<uint32_t> tokens;       // Context the KV holds
+        std::vector<uint8_t> kv;            // Empty unless held in memory
+        const uint8_t* mapped;              // Copy in the snapshot, or null
+        std::list<std::string>::iterator lru;
+
+        Session() : mapped(nullptr) {}
+    };
+
+    SessionOptions options;
+    uint64_t model_hash;
+    uint64_t position_bytes;
+    uint32_t context_tokens;
+    bool use_snapshot;
+
+    std::unordered_map<std::string, Session> sessions;
+    std::list<std::string> lru;             // Held in memory; front = most recent
+    size_t memory_used;
+
+    void* map_base;
+    size_t map_bytes;
+
+    // Tokens of session turns in flight, by task id
+    std::unordered_map<int, std::vector<uint32_t>> recording;
+
+    // Stats
+    uint64_t lookups;
+    uint64_t restores;
+    uint64_t snapshot_restores;
+    uint64_t diverged;              // Stored context not a prefix of the prompt
+    uint64_t no_slot;
+    uint64_t tokens_restored;
+    double prefill_us_skipped;
+    double restore_us;
+    uint64_t captures;
+    uint64_t capture_failures;
+    uint64_t too_large;
+    double capture_us;
+    uint64_t evictions;
+    uint64_t snapshots;
+    uint64_t snapshot_errors;
+    uint64_t snapshot_bytes;
+    double snapshot_ms;
+    uint32_t loaded;                // Sessions in the file found at startup
+
+    static uint64_t alignUp(uint64_t v) {
+        return (v + KV_ALIGN - 1) & ~(KV_ALIGN - 1);
+    }
+
+    uint64_t kvBytes(const Session& s) const {
+        return (uint64_t)s.tokens.size() * position_bytes;
+    }
+
+    void unmap() {
+        if (map_base) {
+            munmap(map_base, map_bytes);
+            map_base = nullptr;
+            map_bytes = 0;
+        }
+    }
+
+    // Drop a session's memory copy; it survives only if the snapshot has it
+    void releaseMemory(std::unordered_map<std::string, Session>::iterator it) {
+        Session& s = it->second;
+        if (s.kv.empty()) {
+            return;
+        }
+        memory_used -= s.kv.size();
+        lru.erase(s.lru);
+        std::vector<uint8_t>().swap(s.kv);
+        if (!s.mapped) {
+            sessions.erase(it);
+        }
+    }
+
+    // Map the snapshot and index its sessions. KV pages stay on disk.
+    bool mapSnapshot() {
+        int fd = ::open(options.snapshot_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FileHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void* base = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            printf("[Session] Cannot map %s\n", options.snapshot_path.c_str());
+            return false;
+        }
+        map_base = base;
+        map_bytes = (size_t)st.st_size;
+
+        const uint8_t* p = (const uint8_t*)base;
+        FileHeader header;
+        memcpy(&header, p, sizeof(header));
+        if (header.magic != FILE_MAGIC || header.version != FILE_VERSION) {
+            printf("[Session] %s is not a session snapshot; ignored\n", options.snapshot_path.c_str());
+            unmap();
+            return false;
+        }
+        if (header.model_hash != model_hash || header.position_bytes != position_bytes) {
+            printf("[Session] Snapshot is for model %016llx (%lu KV bytes per token), not %016llx; "
+                   "ignored\n", (unsigned long long)header.model_hash,
+                   (unsigned long)header.position_bytes, (unsigned long long)model_hash);
+            unmap();
+            return false;
+        }
+        if (sizeof(header) + header.index_bytes > map_bytes) {
+            printf("[Session] Snapshot index truncated; ignored\n");
+            unmap();
+            return false;
+        }
+
+        const uint8_t* q = p + sizeof(header);
+        const uint8_t* end = q + header.index_bytes;
+        for (uint32_t i = 0; i < header.sessions; i++) {
+            FileEntry entry;
+            if (q + sizeof(entry) > end) break;
+            memcpy(&entry, q, sizeof(entry));
+            q += sizeof(entry);
+            uint64_t tokens_bytes = (uint64_t)entry.positions * sizeof(uint32_t);
+            uint64_t kv_bytes = (uint64_t)entry.positions * position_bytes;
+            if (q + entry.name_bytes + tokens_bytes > end ||
+                entry.kv_offset + kv_bytes > map_bytes) {
+                printf("[Session] Snapshot entry %u out of bounds; rest ignored\n", i);
+                break;
+            }
+            std::string name((const char*)q, entry.name_bytes);
+            q += entry.name_bytes;
+            if (entry.positions == 0 || entry.positions > context_tokens) {
+                q += tokens_bytes;
+                continue;   // Longer than a slot holds now
+            }
+            Session& s = sessions[name];
+            s.tokens.resize(entry.positions);
+            memcpy(s.tokens.data(), q, tokens_bytes);
+            q += tokens_bytes;
+            s.mapped = p + entry.kv_offset;
+        }
+        return true;
+    }
+
+    void store(const std::string& name, std::vector<uint32_t>& tokens, std::vector<uint8_t>& kv) {
+        auto it = sessions.find(name);
+        if (it != sessions.end() && !it->second.kv.empty()) {
+            memory_used -= it->second.kv.size();
+            lru.erase(it->second.lru);
+        }
+        Session& s = sessions[name];
+        s.tokens.swap(tokens);
+        s.kv.swap(kv);
+        s.mapped = nullptr;         // The snapshot's context is older
+        lru.push_front(name);
+        s.lru = lru.begin();
+        memory_used += s.kv.size();
+
+        while (memory_used > options.memory_bytes && lru.size() > 1) {
+            releaseMemory(sessions.find(lru.back()));
+            evictions++;
+        }
+    }
+
+public:
+    SessionStore() : model_hash(0), position_bytes(0), context_tokens(0), use_snapshot(false),
+                     memory_used(0), map_base(nullptr), map_bytes(0), lookups(0), restores(0),
+                     snapshot_restores(0), diverged(0), no_slot(0), tokens_restored(0),
+                     prefill_us_skipped(0), restore_us(0), captures(0), capture_failures(0),
+                     too_large(0), capture_us(0), evictions(0), snapshots(0),
+                     snapshot_errors(0), snapshot_bytes(0), snapshot_ms(0), loaded(0) {}
+
+    ~SessionStore() {
+        unmap();
+    }
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    // model_hash identifies the weights; from_checksums says whether it
+    // covers their contents (required for snapshots). Sessions in an
+    // existing snapshot for the same model become restorable.
+    void open(const SessionOptions& opts, uint64_t hash, bool from_checksums,
+              uint64_t kv_position_bytes, uint32_t context) {
+        options = opts;
+        model_hash = hash;
+        position_bytes = kv_position_bytes;
+        context_tokens = context;
+        if (!options.enabled) {
+            return;
+        }
+
+        use_snapshot = !options.snapshot_path.empty() && from_checksums;
+        if (!options.snapshot_path.empty() && !from_checksums) {
+            printf("[Session] No WTNT checksums to identify the model; snapshots off\n");
+        }
+        if (use_snapshot && mapSnapshot()) {
+            loaded = (uint32_t)sessions.size();
+        }
+        printf("[Session] Session KV for model %016llx: %.1f MB memory%s%s, %u sessions restorable\n",
+               (unsigned long long)model_hash, options.memory_bytes / (1024.0 * 1024.0),
+               use_snapshot ? ", snapshot " : "", use_snapshot ? options.snapshot_path.c_str() : "",
+               loaded);
+    }
+
+    bool enabled() const { return options.enabled; }
+    bool persistent() const { return use_snapshot; }
+
+    // The session's stored context if it is a strict prefix of prompt
+    bool lookup(const std::string& name, const std::vector<uint32_t>& prompt, SessionView& view) {
+        if (!options.enabled || name.empty()) {
+            return false;
+        }
+        lookups++;
+        auto it = sessions.find(name);
+        if (it == sessions.end()) {
+            return false;
+        }
+        Session& s = it->second;
+        if (s.tokens.size() >= prompt.size() ||
+            memcmp(s.tokens.data(), prompt.data(), s.tokens.size() * sizeof(uint32_t)) != 0) {
+            diverged++;
+            return false;
+        }
+        view.positions = (uint32_t)s.tokens.size();
+        view.from_snapshot = s.kv.empty();
+        view.kv = s.kv.empty() ? s.mapped : s.kv.data();
+        if (!s.kv.empty()) {
+            lru.splice(lru.begin(), lru, s.lru);
+        }
+        return true;
+    }
+
+    // A looked-up context went back into a slot; prefill_us is what
+    // prefilling it would have cost
+    void restored(const SessionView& view, double us, double prefill_us) {
+        restores++;
+        snapshot_restores += view.from_snapshot ? 1 : 0;
+        tokens_restored += view.positions;
+        restore_us += us;
+        prefill_us_skipped += prefill_us;
+    }
+
+    // Every slot but the running one was pinned; prefilled in full instead
+    void noSlot() { no_slot++; }
+
+    void record(const Task& task, uint32_t token) {
+        if (options.enabled && !task.session.empty() && task.candidates == 0) {
+            recording[task.id].push_back(token);
+        }
+    }
+
+    // The run restarts from the prompt (retry) or ended without a context
+    // worth keeping
+    void discard(int task_id) {
+        recording.erase(task_id);
+    }
+
+    // The task's turn ended at EOS or max_tokens, its KV still in its
+    // slot: prompt + reply become the session's context. The last token
+    // was sampled but never fed back, so it has no KV entry.
+    void finish(const Task& task, const std::vector<uint32_t>& prompt, const KvReader& read) {
+        auto rec = recording.find(task.id);
+        std::vector<uint32_t> tokens = prompt;
+        if (rec != recording.end()) {
+            if (rec->second.size() > 1) {
+                tokens.insert(tokens.end(), rec->second.begin(), rec->second.end() - 1);
+            }
+            recording.erase(rec);
+        }
+        if (!options.enabled || task.session.empty() || task.candidates > 0 ||
+            tokens.empty() || tokens.size() > context_tokens) {
+            return;
+        }
+
+        uint64_t bytes = (uint64_t)tokens.size() * position_bytes;
+        if (bytes > options.memory_bytes) {
+            too_large++;
+            return;
+        }
+        auto start = Clock::now();
+        std::vector<uint8_t> kv(bytes);
+        if (!read((uint32_t)tokens.size(), kv.data())) {
+            capture_failures++;
+            return;
+        }
+        store(task.session, tokens, kv);
+        captures++;
+        capture_us += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    }
+
+    // Every session to snapshot_path (temp file, then rename). Their KV
+    // is then read from the new file and memory copies are released.
+    bool snapshot() {
+        if (!options.enabled || !use_snapshot) {
+            printf("[Session] No snapshot file configured\n");
+            return false;
+        }
+        auto start = Clock::now();
+
+        uint64_t index_bytes = 0;
+        for (const auto& kv : sessions) {
+            index_bytes += sizeof(FileEntry) + kv.first.size() +
+                           kv.second.tokens.size() * sizeof(uint32_t);
+        }
+        uint64_t offset = alignUp(sizeof(FileHeader) + index_bytes);
+
+        std::vector<uint8_t> index;
+        index.reserve(index_bytes);
+        std::vector<const uint8_t*> data;
+        std::vector<uint64_t> data_offsets;
+        for (const auto& kv : sessions) {
+            const Session& s = kv.second;
+            FileEntry entry;
+            entry.name_bytes = (uint32_t)kv.first.size();
+            entry.positions = (uint32_t)s.tokens.size();
+            entry.kv_offset = offset;
+            const uint8_t* e = (const uint8_t*)&entry;
+            index.insert(index.end(), e, e + sizeof(entry));
+            index.insert(index.end(), kv.first.begin(), kv.first.end());
+            const uint8_t* t = (const uint8_t*)s.tokens.data();
+            index.insert(index.end(), t, t + s.tokens.size() * sizeof(uint32_t));
+            data.push_back(s.kv.empty() ? s.mapped : s.kv.data());
+            data_offsets.push_back(offset);
+            offset = alignUp(offset + kvBytes(s));
+        }
+
+        FileHeader header;
+        header.magic = FILE_MAGIC;
+        header.version = FILE_VERSION;
+        header.model_hash = model_hash;
+        header.position_bytes = position_bytes;
+        header.context_tokens = context_tokens;
+        header.sessions = (uint32_t)sessions.size();
+        header.index_bytes = index_bytes;
+
+        std::string tmp = options.snapshot_path + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f) {
+            printf("[Session] Cannot write %s\n", tmp.c_str());
+            snapshot_errors++;
+            return false;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(index.data(), 1, index.size(), f) == index.size();
+        size_t i = 0;
+        for (auto it = sessions.begin(); ok && it != sessions.end(); ++it, ++i) {
+            uint64_t bytes = kvBytes(it->second);
+            ok = fseeko(f, (off_t)data_offsets[i], SEEK_SET) == 0 &&
+                 fwrite(data[i], 1, bytes, f) == bytes;
+        }
+        // Pad the last entry out so every KV range is inside the file
+        ok = ok && fseeko(f, (off_t)offset - 1, SEEK_SET) == 0 && fputc(0, f) != EOF;
+        ok = fclose(f) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), options.snapshot_path.c_str()) != 0) {
+            unlink(tmp.c_str());
+            printf("[Session] Writing snapshot %s failed\n", options.snapshot_path.c_str());
+            snapshot_errors++;
+            return false;
+        }
+
+        // Serve everything from the file just written
+        sessions.clear();
+        lru.clear();
+        memory_used = 0;
+        unmap();
+        mapSnapshot();
+
+        snapshots++;
+        snapshot_bytes = offset;
+        snapshot_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        printf("[Session] Snapshot of %zu sessions to %s (%.1f MB, %.1f ms)\n", sessions.size(),
+               options.snapshot_path.c_str(), offset / (1024.0 * 1024.0), snapshot_ms);
+        return true;
+    }
+
+    void printStats() const {
+        if (!options.enabled) {
+            return;
+        }
+        size_t on_disk = 0;
+        for (const auto& kv : sessions) {
+            on_disk += kv.second.mapped ? 1 : 0;
+        }
+
+        printf("\n[Session] Session KV:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Sessions:          %zu (%zu in memory, %.1f of %.1f MB; %zu in snapshot)\n",
+               sessions.size(), lru.size(), memory_used / (1024.0 * 1024.0),
+               options.memory_bytes / (1024.0 * 1024.0), on_disk);
+        printf("Lookups:           %lu, %lu restored (%lu from snapshot), %lu diverged, "
+               "%lu without a free slot\n",
+               (unsigned long)lookups, (unsigned long)restores, (unsigned long)snapshot_restores,
+               (unsigned long)diverged, (unsigned long)no_slot);
+        printf("Prefill skipped:   %lu tokens (%.1f ms modeled), %.1f us mean restore\n",
+               (unsigned long)tokens_restored, prefill_us_skipped / 1000.0,
+               restores ? restore_us / restores : 0.0);
+        printf("Turns kept:        %lu (%.1f us mean copy, %lu failed, %lu too large, %lu evicted)\n",
+               (unsigned long)captures, captures ? capture_us / captures : 0.0,
+               (unsigned long)capture_failures, (unsigned long)too_large,
+               (unsigned long)evictions);
+        if (use_snapshot) {
+            printf("Snapshots:         %lu written (%.1f MB, %.1f ms last; %lu failed), "
+                   "%u sessions loaded at start\n",
+                   (unsigned long)snapshots, snapshot_bytes / (1024.0 * 1024.0), snapshot_ms,
+                   (unsigned long)snapshot_errors, loaded);
+        }
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // SESSION_STORE_HPP
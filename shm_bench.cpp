@@ -0,0 +1,332 @@
+// shm_bench.cpp
+// Shared-memory transport vs Unix socket, between two processes.
+//
+//   latency     One request out, one response back (round trip), the
+//               shape of a cancel or a short generation
+//   throughput  One request, then a stream of single-token responses,
+//               each sent as soon as it is "produced"
+//
+// Both transports carry the same ShmRequest / ShmResponse records. The
+// shm side uses the rings and futex doorbells from shm_transport.hpp;
+// the socket side one write() per message over a socketpair.
+//
+//   shm_bench                     transport comparison (forks an echo server)
+//   shm_bench --engine PATH [n]   n generations against a running
+//                                 `inference_engine --shm`
+//
+// Build: g++ -std=c++17 -O2 shm_bench.cpp -o shm_bench -pthread
+
+#include "shm_transport.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+static const int LATENCY_ROUNDS = 20000;
+static const uint32_t STREAM_TOKENS = 1000000;
+static const char PROMPT[] = "The quick brown fox jumps over";
+
+typedef std::chrono::steady_clock Clock;
+
+static double usSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+struct BenchResult {
+    double p50_us;
+    double p99_us;
+    double tokens_per_sec;
+};
+
+static void percentiles(std::vector<double>& samples, BenchResult& result) {
+    std::sort(samples.begin(), samples.end());
+    result.p50_us = samples[samples.size() / 2];
+    result.p99_us = samples[samples.size() * 99 / 100];
+}
+
+// ---------------------------------------------------------------------------
+// Shared memory
+
+static void shmSend(ShmClientSlot& slot, uint32_t type, uint32_t id, int max_tokens) {
+    ShmRequest* req;
+    while (!(req = slot.requests.claim())) {
+        sched_yield();
+    }
+    req->type = type;
+    req->request_id = id;
+    req->max_tokens = max_tokens;
+    req->prompt_len = sizeof(PROMPT) - 1;
+    memcpy(req->prompt, PROMPT, req->prompt_len);
+    slot.requests.publish();
+}
+
+static void shmRespond(ShmClientSlot& slot, uint32_t id, uint32_t token, uint32_t finish) {
+    ShmResponse* resp;
+    while (!(resp = slot.responses.claim())) {
+        sched_yield();
+    }
+    resp->request_id = id;
+    resp->token = token;
+    resp->finish = finish;
+    resp->retry_after_ms = 0;
+    slot.responses.publish();
+}
+
+static ShmResponse shmReceive(ShmClientSlot& slot) {
+    ShmResponse* resp;
+    while (!(resp = slot.responses.front())) {
+        slot.responses.wait(1000);
+    }
+    ShmResponse out = *resp;
+    slot.responses.pop();
+    return out;
+}
+
+// Child: answer GENERATE with max_tokens responses, SHUTDOWN exits
+static void shmEchoServer(ShmClientSlot& slot) {
+    while (true) {
+        ShmRequest* req = slot.requests.front();
+        if (!req) {
+            slot.requests.wait(1000);
+            continue;
+        }
+        uint32_t type = req->type;
+        uint32_t id = req->request_id;
+        int tokens = req->max_tokens;
+        slot.requests.pop();
+
+        if (type == (uint32_t)ShmMsgType::SHUTDOWN) {
+            return;
+        }
+        for (int i = 0; i < tokens - 1; i++) {
+            shmRespond(slot, id, (uint32_t)i, 0);
+        }
+        shmRespond(slot, id, 0, shmFinishCode(FinishReason::MAX_TOKENS));
+    }
+}
+
+static BenchResult benchShm() {
+    void* addr = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    ShmRegion* region = new (addr) ShmRegion;
+    ShmClientSlot& slot = region->clients[0];
+
+    pid_t child = fork();
+    if (child == 0) {
+        shmEchoServer(slot);
+        _exit(0);
+    }
+
+    BenchResult result;
+    std::vector<double> samples;
+    samples.reserve(LATENCY_ROUNDS);
+    for (int i = 0; i < LATENCY_ROUNDS; i++) {
+        Clock::time_point start = Clock::now();
+        shmSend(slot, (uint32_t)ShmMsgType::GENERATE, (uint32_t)i, 1);
+        shmReceive(slot);
+        samples.push_back(usSince(start));
+    }
+    percentiles(samples, result);
+
+    Clock::time_point start = Clock::now();
+    shmSend(slot, (uint32_t)ShmMsgType::GENERATE, 0, (int)STREAM_TOKENS);
+    uint32_t received = 0;
+    while (true) {
+        ShmResponse resp = shmReceive(slot);
+        received++;
+        if (resp.finish) break;
+    }
+    result.tokens_per_sec = received / (usSince(start) / 1e6);
+
+    shmSend(slot, (uint32_t)ShmMsgType::SHUTDOWN, 0, 0);
+    waitpid(child, nullptr, 0);
+    munmap(addr, sizeof(ShmRegion));
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Unix socket
+
+static bool readFull(int fd, void* buf, size_t len) {
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool writeFull(int fd, const void* buf, size_t len) {
+    const char* p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static const size_t REQUEST_HEADER = offsetof(ShmRequest, prompt);
+
+static void socketSend(int fd, uint32_t type, uint32_t id, int max_tokens) {
+    ShmRequest req;
+    req.type = type;
+    req.request_id = id;
+    req.max_tokens = max_tokens;
+    req.prompt_len = sizeof(PROMPT) - 1;
+    memcpy(req.prompt, PROMPT, req.prompt_len);
+    writeFull(fd, &req, REQUEST_HEADER + req.prompt_len);
+}
+
+static void socketEchoServer(int fd) {
+    ShmRequest req;
+    while (readFull(fd, &req, REQUEST_HEADER) && readFull(fd, req.prompt, req.prompt_len)) {
+        if (req.type == (uint32_t)ShmMsgType::SHUTDOWN) {
+            return;
+        }
+        ShmResponse resp;
+        resp.request_id = req.request_id;
+        resp.retry_after_ms = 0;
+        for (int i = 0; i < req.max_tokens; i++) {
+            resp.token = (uint32_t)i;
+            resp.finish = i == req.max_tokens - 1 ? shmFinishCode(FinishReason::MAX_TOKENS) : 0;
+            writeFull(fd, &resp, sizeof(resp));
+        }
+    }
+}
+
+static BenchResult benchSocket() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        ::close(fds[0]);
+        socketEchoServer(fds[1]);
+        _exit(0);
+    }
+    ::close(fds[1]);
+    int fd = fds[0];
+
+    BenchResult result;
+    std::vector<double> samples;
+    samples.reserve(LATENCY_ROUNDS);
+    ShmResponse resp;
+    for (int i = 0; i < LATENCY_ROUNDS; i++) {
+        Clock::time_point start = Clock::now();
+        socketSend(fd, (uint32_t)ShmMsgType::GENERATE, (uint32_t)i, 1);
+        readFull(fd, &resp, sizeof(resp));
+        samples.push_back(usSince(start));
+    }
+    percentiles(samples, result);
+
+    // Client reads in bulk, as a real consumer of a byte stream would
+    Clock::time_point start = Clock::now();
+    socketSend(fd, (uint32_t)ShmMsgType::GENERATE, 0, (int)STREAM_TOKENS);
+    std::vector<ShmResponse> batch(256);
+    uint32_t received = 0;
+    size_t partial = 0;
+    bool done = false;
+    while (!done) {
+        char* base = reinterpret_cast<char*>(batch.data());
+        ssize_t n = read(fd, base + partial, batch.size() * sizeof(ShmResponse) - partial);
+        if (n <= 0) break;
+        partial += (size_t)n;
+        size_t whole = partial / sizeof(ShmResponse);
+        for (size_t i = 0; i < whole; i++) {
+            received++;
+            if (batch[i].finish) done = true;
+        }
+        partial -= whole * sizeof(ShmResponse);
+        memmove(base, base + whole * sizeof(ShmResponse), partial);
+    }
+    result.tokens_per_sec = received / (usSince(start) / 1e6);
+
+    socketSend(fd, (uint32_t)ShmMsgType::SHUTDOWN, 0, 0);
+    waitpid(child, nullptr, 0);
+    ::close(fd);
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Against a running engine
+
+static int benchEngine(const char* path, int requests) {
+    ShmClient client;
+    if (!client.attach(path)) {
+        return 1;
+    }
+    printf("[Bench] Attached to %s as client %u\n", path, client.getSlot());
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("%-8s %12s %10s %12s %8s\n", "Request", "first token", "tokens", "tokens/s", "finish");
+
+    for (int r = 0; r < requests; r++) {
+        Clock::time_point start = Clock::now();
+        uint32_t id = client.submit(PROMPT, 32);
+        if (id == 0) {
+            printf("[Bench] Request ring full\n");
+            return 1;
+        }
+
+        double first_us = 0;
+        uint32_t tokens = 0;
+        ShmResponse resp;
+        resp.finish = 0;
+        while (client.next(resp, 10000)) {
+            if (resp.request_id != id) continue;
+            if (resp.finish) break;
+            if (tokens++ == 0) first_us = usSince(start);
+        }
+        double total_s = usSince(start) / 1e6;
+        printf("%-8d %9.2f ms %10u %12.1f %8u\n", r, first_us / 1000.0, tokens,
+               tokens / total_s, resp.finish);
+    }
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    client.detach();
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "--engine") == 0 && argc > 2) {
+            return benchEngine(argv[2], argc > 3 ? atoi(argv[3]) : 3);
+        }
+        fprintf(stderr, "Usage: %s [--engine /proc/<pid>/fd/<n> [requests]]\n", argv[0]);
+        return 1;
+    }
+
+    printf("[Bench] Transport round trip and streaming (%d round trips, %u tokens)\n",
+           LATENCY_ROUNDS, STREAM_TOKENS);
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("%-14s %12s %12s %16s\n", "Transport", "RTT p50", "RTT p99", "tokens/s");
+
+    BenchResult shm = benchShm();
+    printf("%-14s %9.2f us %9.2f us %16.0f\n", "shm + futex", shm.p50_us, shm.p99_us,
+           shm.tokens_per_sec);
+
+    BenchResult sock = benchSocket();
+    printf("%-14s %9.2f us %9.2f us %16.0f\n", "unix socket", sock.p50_us, sock.p99_us,
+           sock.tokens_per_sec);
+
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("shm vs socket: %.1fx lower p50 RTT, %.1fx tokens/s\n",
+           sock.p50_us / shm.p50_us, shm.tokens_per_sec / sock.tokens_per_sec);
+    return 0;
+}
@@ -0,0 +1,737 @@
+// shm_transport.hpp
+// Zero-copy shared-memory transport for clients that cannot link the
+// engine. The server creates one memfd region holding a slot per client;
+// each slot has two single-producer/single-consumer rings:
+//
+//   requests   client -> server   ShmRequest (prompt written in place)
+//   responses  server -> client   ShmResponse (one token or a finish)
+//
+// Nothing is copied through the kernel: the client writes its prompt
+// straight into a ring slot and the server builds the Task from it;
+// tokens go back the same way. Doorbells are futexes on the ring words,
+// so an idle side sleeps in the kernel and is only woken when the other
+// side finds it parked.
+//
+// Clients find the region through /proc/<server pid>/fd/<memfd>, printed
+// by the server at startup:
+//
+//   ShmClient client;
+//   client.attach(path, "search-team");
+//   uint32_t id = client.submit("hello", 32);
+//   ShmResponse r;
+//   while (client.next(r, 1000) && !r.finish) { ... r.token ... }
+//
+// A request turned away by admission control finishes at once with
+// REJECTED and a retry_after_ms hint; queueWaitMs() predicts the wait
+// before submitting.
+//
+// Layout is fixed-size and versioned (SHM_VERSION); clients in other
+// languages map the same structs.
+
+#ifndef SHM_TRANSPORT_HPP
+#define SHM_TRANSPORT_HPP
+
+#include "types.hpp"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint32_t SHM_MAGIC = 0x54534D48;           // "HMST"
+static const uint32_t SHM_VERSION = 3;
+static const uint32_t SHM_MAX_CLIENTS = 16;
+static const uint32_t SHM_REQUEST_SLOTS = 64;
+static const uint32_t SHM_RESPONSE_SLOTS = 4096;
+static const uint32_t SHM_MAX_PROMPT = 2048;
+static const uint32_t SHM_TENANT_LEN = 32;
+static const uint32_t SHM_CLAIM_TIMEOUT_MS = 5000;     // CLAIMING with no pid after this is abandoned
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+              std::atomic<uint32_t>::is_always_lock_free,
+              "futex words must be plain lock-free 32-bit atomics");
+
+// Shared (not PRIVATE) futexes: the waiters live in different processes
+inline void shmFutexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+            timeout_ms >= 0 ? &ts : nullptr, nullptr, 0);
+}
+
+inline void shmFutexWake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX,
+            nullptr, nullptr, 0);
+}
+
+enum class ShmMsgType : uint32_t {
+    GENERATE = 1,
+    CANCEL,             // request_id = the generation to stop
+    STOP_CURRENT,
+    RESET,
+    SHUTDOWN
+};
+
+struct ShmRequest {
+    uint32_t type;              // ShmMsgType
+    uint32_t request_id;        // Chosen by the client, echoed in responses
+    int32_t max_tokens;         // 0 = engine default
+    uint32_t prompt_len;
+    char prompt[SHM_MAX_PROMPT];
+};
+
+struct ShmResponse {
+    uint32_t request_id;
+    uint32_t token;
+    uint32_t finish;            // 0 = token, else FinishReason + 1
+    uint32_t retry_after_ms;    // REJECTED finish only; 0 = never fits
+};
+
+inline uint32_t shmFinishCode(FinishReason reason) {
+    return (uint32_t)reason + 1;
+}
+
+// SPSC ring in shared memory. The consumer parks on the head word; the
+// producer wakes it after publishing if it found it parked.
+template <typename T, uint32_t SLOTS>
+struct ShmRing {
+    static_assert((SLOTS & (SLOTS - 1)) == 0, "ring size must be a power of two");
+
+    alignas(64) std::atomic<uint32_t> head;         // Written by the producer
+    std::atomic<uint32_t> waiting;                  // Consumer parked on head
+    alignas(64) std::atomic<uint32_t> tail;         // Written by the consumer
+    alignas(64) T slots[SLOTS];
+
+    void reset() {
+        head.store(0);
+        tail.store(0);
+        waiting.store(0);
+    }
+
+    // Producer: slot to fill in place, or null when full
+    T* claim() {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= SLOTS) {
+            return nullptr;
+        }
+        return &slots[h & (SLOTS - 1)];
+    }
+
+    void publish() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_seq_cst)) {
+            shmFutexWake(&head);
+        }
+    }
+
+    // Consumer: oldest slot, or null when empty
+    T* front() {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[t & (SLOTS - 1)];
+    }
+
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Sleep until the producer publishes or timeout_ms passes
+    void wait(int timeout_ms) {
+        uint32_t seen = tail.load(std::memory_order_relaxed);
+        waiting.store(1, std::memory_order_seq_cst);
+        if (head.load(std::memory_order_seq_cst) == seen) {
+            shmFutexWait(&head, seen, timeout_ms);
+        }
+        waiting.store(0, std::memory_order_relaxed);
+    }
+};
+
+enum ShmSlotState : uint32_t {
+    SHM_SLOT_FREE = 0,
+    SHM_SLOT_ATTACHED,
+    SHM_SLOT_DETACHED,          // Client left; server resets, then FREE
+    SHM_SLOT_CLAIMING           // Client filling in pid and tenant
+};
+
+struct ShmClientSlot {
+    std::atomic<uint32_t> state;
+    std::atomic<int32_t> pid;
+    char tenant[SHM_TENANT_LEN];    // Written before ATTACHED is visible
+    ShmRing<ShmRequest, SHM_REQUEST_SLOTS> requests;
+    ShmRing<ShmResponse, SHM_RESPONSE_SLOTS> responses;
+};
+
+struct ShmRegion {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_clients;
+    uint32_t max_prompt;
+
+    // Rung by any client after queueing a request; the server parks here
+    alignas(64) std::atomic<uint32_t> server_bell;
+    std::atomic<uint32_t> server_waiting;
+
+    // Predicted queue wait for a new request, refreshed every server poll
+    std::atomic<uint32_t> queue_wait_ms;
+
+    ShmClientSlot clients[SHM_MAX_CLIENTS];
+};
+
+class ShmServer {
+private:
+    class ShmSink;
+
+    // Server-process view of a client slot. The mutex serializes the
+    // response ring's producers (server thread and engine thread).
+    struct ClientState {
+        std::mutex mutex;
+        bool open;
+        uint32_t session;
+        std::string tenant;
+        std::deque<ShmResponse> backlog;        // Ring was full
+        std::unordered_map<uint32_t, std::shared_ptr<ShmSink>> live;
+        bool claim_seen;                        // Sweep found the slot CLAIMING, pid unset
+        std::chrono::steady_clock::time_point claim_since;
+
+        ClientState() : open(false), session(0), claim_seen(false) {}
+    };
+
+    class ShmSink : public TokenSink {
+    private:
+        ShmServer& server;
+        uint32_t client;
+        uint32_t session;
+        uint32_t request_id;
+        std::atomic<bool> cancelled;
+
+    public:
+        ShmSink(ShmServer& s, uint32_t c, uint32_t sess, uint32_t id)
+            : server(s), client(c), session(sess), request_id(id), cancelled(false) {}
+
+        void onToken(uint32_t token) override {
+            server.deliver(client, session, request_id, token, 0);
+        }
+
+        void onFinish(FinishReason reason) override {
+            server.deliver(client, session, request_id, 0, shmFinishCode(reason));
+            server.forget(client, session, request_id);
+        }
+
+        bool isCancelled() const override { return cancelled.load(std::memory_order_acquire); }
+        void cancel() { cancelled.store(true, std::memory_order_release); }
+    };
+
+    int memfd;
+    ShmRegion* region;
+    ClientState clients[SHM_MAX_CLIENTS];
+
+    std::function<bool(Task&)> submit;
+    std::function<void(CommandType)> command;
+    std::function<uint32_t()> wait_estimate;
+
+    std::chrono::steady_clock::time_point last_reap;
+
+    // Stats; responses are counted on the engine thread too
+    uint64_t requests_served;
+    std::atomic<uint64_t> responses_sent;
+    std::atomic<uint64_t> backlogged;
+    uint64_t attaches;
+    uint64_t detaches;
+
+    // Push into the ring, or queue behind earlier overflow. Never blocks
+    // (called from the engine thread). Caller holds cs.mutex.
+    void pushLocked(uint32_t client, ClientState& cs, const ShmResponse& resp) {
+        ShmRing<ShmResponse, SHM_RESPONSE_SLOTS>& ring = region->clients[client].responses;
+        if (cs.backlog.empty()) {
+            ShmResponse* slot = ring.claim();
+            if (slot) {
+                *slot = resp;
+                ring.publish();
+                responses_sent++;
+                return;
+            }
+        }
+        cs.backlog.push_back(resp);
+        backlogged++;
+    }
+
+    void deliver(uint32_t client, uint32_t session, uint32_t request_id,
+                 uint32_t token, uint32_t finish, uint32_t retry_after_ms = 0) {
+        ClientState& cs = clients[client];
+        std::lock_guard<std::mutex> lock(cs.mutex);
+        if (!cs.open || cs.session != session) {
+            return;     // Client left; drop
+        }
+        ShmResponse resp;
+        resp.request_id = request_id;
+        resp.token = token;
+        resp.finish = finish;
+        resp.retry_after_ms = retry_after_ms;
+        pushLocked(client, cs, resp);
+    }
+
+    void forget(uint32_t client, uint32_t session, uint32_t request_id) {
+        ClientState& cs = clients[client];
+        std::lock_guard<std::mutex> lock(cs.mutex);
+        if (cs.session == session) {
+            cs.live.erase(request_id);
+        }
+    }
+
+    void flushBacklog(uint32_t client) {
+        ClientState& cs = clients[client];
+        std::lock_guard<std::mutex> lock(cs.mutex);
+        ShmRing<ShmResponse, SHM_RESPONSE_SLOTS>& ring = region->clients[client].responses;
+        while (!cs.backlog.empty()) {
+            ShmResponse* slot = ring.claim();
+            if (!slot) break;
+            *slot = cs.backlog.front();
+            cs.backlog.pop_front();
+            ring.publish();
+            responses_sent++;
+        }
+    }
+
+    void openClient(uint32_t client) {
+        ClientState& cs = clients[client];
+        std::lock_guard<std::mutex> lock(cs.mutex);
+        ShmClientSlot& slot = region->clients[client];
+        cs.open = true;
+        cs.session++;
+        cs.tenant.assign(slot.tenant, strnlen(slot.tenant, SHM_TENANT_LEN));
+        attaches++;
+        printf("[Shm] Client %u attached (pid %d, tenant %s)\n", client, slot.pid.load(),
+               cs.tenant.empty() ? "default" : cs.tenant.c_str());
+    }
+
+    // Cancel the client's generations and recycle its slot
+    void closeClient(uint32_t client) {
+        ClientState& cs = clients[client];
+        ShmClientSlot& slot = region->clients[client];
+        {
+            std::lock_guard<std::mutex> lock(cs.mutex);
+            for (auto& entry : cs.live) {
+                entry.second->cancel();
+            }
+            cs.live.clear();
+            cs.backlog.clear();
+            cs.open = false;
+            slot.requests.reset();
+            slot.responses.reset();
+        }
+        detaches++;
+        printf("[Shm] Client %u detached\n", client);
+        slot.pid.store(0);
+        slot.state.store(SHM_SLOT_FREE, std::memory_order_release);
+    }
+
+    // Returns false on SHUTDOWN
+    bool handleRequest(uint32_t client, const ShmRequest& req) {
+        ClientState& cs = clients[client];
+        requests_served++;
+
+        switch ((ShmMsgType)req.type) {
+            case ShmMsgType::GENERATE: {
+                uint32_t len = req.prompt_len < SHM_MAX_PROMPT ? req.prompt_len : SHM_MAX_PROMPT;
+                std::shared_ptr<ShmSink> sink;
+                {
+                    std::lock_guard<std::mutex> lock(cs.mutex);
+                    sink = std::make_shared<ShmSink>(*this, client, cs.session, req.request_id);
+                    cs.live[req.request_id] = sink;     // Before submit: may finish at once
+                }
+
+                Task task(0, TaskType::GENERATE, std::string(req.prompt, len));
+                task.max_tokens = req.max_tokens;
+                task.tenant = cs.tenant;
+                task.sink = sink;
+                if (!submit(task)) {
+                    deliver(client, cs.session, req.request_id, 0,
+                            shmFinishCode(FinishReason::REJECTED), task.retry_after_ms);
+                    forget(client, cs.session, req.request_id);
+                }
+                break;
+            }
+
+            case ShmMsgType::CANCEL: {
+                std::lock_guard<std::mutex> lock(cs.mutex);
+                auto it = cs.live.find(req.request_id);
+                if (it != cs.live.end()) {
+                    it->second->cancel();
+                }
+                break;
+            }
+
+            case ShmMsgType::STOP_CURRENT:
+                command(CommandType::STOP_CURRENT);
+                break;
+
+            case ShmMsgType::RESET:
+                command(CommandType::RESET);
+                break;
+
+            case ShmMsgType::SHUTDOWN:
+                printf("[Shm] Shutdown requested by client %u\n", client);
+                return false;
+
+            default:
+                printf("[Shm] Client %u: unknown message type %u\n", client, req.type);
+                break;
+        }
+        return true;
+    }
+
+    // A client that died mid-attach leaves its slot CLAIMING. Free it once
+    // its pid is dead, or if no pid was written within the claim timeout.
+    // The CAS loses to a slow client that finishes attaching meanwhile.
+    void reapClaim(uint32_t client, int32_t pid, std::chrono::steady_clock::time_point now) {
+        ClientState& cs = clients[client];
+        ShmClientSlot& slot = region->clients[client];
+        if (pid > 0) {
+            cs.claim_seen = false;
+            if (kill(pid, 0) == 0 || errno != ESRCH) {
+                return;
+            }
+            printf("[Shm] Client %u (pid %d) exited while attaching\n", client, pid);
+        } else {
+            if (!cs.claim_seen) {
+                cs.claim_seen = true;
+                cs.claim_since = now;
+                return;
+            }
+            if (now - cs.claim_since < std::chrono::milliseconds(SHM_CLAIM_TIMEOUT_MS)) {
+                return;
+            }
+            cs.claim_seen = false;
+            printf("[Shm] Client %u abandoned its attach\n", client);
+        }
+        // A FREE slot always has pid 0
+        slot.pid.compare_exchange_strong(pid, 0);
+        uint32_t expected = SHM_SLOT_CLAIMING;
+        slot.state.compare_exchange_strong(expected, SHM_SLOT_FREE);
+    }
+
+    // Recycle slots whose process died without detaching
+    void reapDeadClients() {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_reap < std::chrono::seconds(1)) {
+            return;
+        }
+        last_reap = now;
+
+        for (uint32_t i = 0; i < SHM_MAX_CLIENTS; i++) {
+            ShmClientSlot& slot = region->clients[i];
+            int32_t pid = slot.pid.load();
+            uint32_t state = slot.state.load();
+            if (state == SHM_SLOT_CLAIMING) {
+                reapClaim(i, pid, now);
+                continue;
+            }
+            clients[i].claim_seen = false;
+            if (state == SHM_SLOT_ATTACHED && pid > 0 &&
+                kill(pid, 0) != 0 && errno == ESRCH) {
+                printf("[Shm] Client %u (pid %d) exited without detaching\n", i, pid);
+                closeClient(i);
+            }
+        }
+    }
+
+public:
+    ShmServer() : memfd(-1), region(nullptr), requests_served(0), responses_sent(0),
+                  backlogged(0), attaches(0), detaches(0) {}
+
+    ~ShmServer() {
+        close();
+    }
+
+    ShmServer(const ShmServer&) = delete;
+    ShmServer& operator=(const ShmServer&) = delete;
+
+    // submit_fn assigns the task id and queues it (false = queue full)
+    bool create(std::function<bool(Task&)> submit_fn,
+                std::function<void(CommandType)> command_fn) {
+        submit = std::move(submit_fn);
+        command = std::move(command_fn);
+
+        memfd = memfd_create("fpga-engine-ipc", 0);
+        if (memfd < 0) {
+            perror("[Shm] memfd_create");
+            return false;
+        }
+        if (ftruncate(memfd, sizeof(ShmRegion)) != 0) {
+            perror("[Shm] ftruncate");
+            close();
+            return false;
+        }
+
+        void* addr = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, memfd, 0);
+        if (addr == MAP_FAILED) {
+            perror("[Shm] mmap");
+            close();
+            return false;
+        }
+
+        // memfd pages start zeroed: every ring empty, every slot FREE
+        region = new (addr) ShmRegion;
+        region->max_clients = SHM_MAX_CLIENTS;
+        region->max_prompt = SHM_MAX_PROMPT;
+        region->version = SHM_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        region->magic = SHM_MAGIC;
+
+        last_reap = std::chrono::steady_clock::now();
+        printf("[Shm] Transport ready: %s (%.1f MB, %u client slots)\n",
+               path().c_str(), sizeof(ShmRegion) / (1024.0 * 1024.0), SHM_MAX_CLIENTS);
+        return true;
+    }
+
+    void close() {
+        if (region) {
+            munmap(region, sizeof(ShmRegion));
+            region = nullptr;
+        }
+        if (memfd >= 0) {
+            ::close(memfd);
+            memfd = -1;
+        }
+    }
+
+    // What clients open to map the region
+    std::string path() const {
+        return "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(memfd);
+    }
+
+    // Source for the queue wait published to clients
+    void setWaitEstimate(std::function<uint32_t()> fn) {
+        wait_estimate = std::move(fn);
+    }
+
+    // Drain every client's requests, waiting up to timeout_ms for a
+    // doorbell when idle. Returns false once a client sent SHUTDOWN.
+    bool poll(int timeout_ms) {
+        uint32_t bell = region->server_bell.load(std::memory_order_acquire);
+        bool busy = false;
+
+        if (wait_estimate) {
+            region->queue_wait_ms.store(wait_estimate(), std::memory_order_relaxed);
+        }
+
+        for (uint32_t i = 0; i < SHM_MAX_CLIENTS; i++) {
+            ShmClientSlot& slot = region->clients[i];
+            uint32_t state = slot.state.load(std::memory_order_acquire);
+
+            if (state == SHM_SLOT_DETACHED) {
+                closeClient(i);
+                continue;
+            }
+            if (state != SHM_SLOT_ATTACHED) {
+                continue;
+            }
+            if (!clients[i].open) {
+                openClient(i);
+            }
+
+            while (ShmRequest* req = slot.requests.front()) {
+                bool keep_going = handleRequest(i, *req);
+                slot.requests.pop();
+                busy = true;
+                if (!keep_going) {
+                    return false;
+                }
+            }
+            flushBacklog(i);
+        }
+
+        reapDeadClients();
+
+        if (!busy && timeout_ms > 0) {
+            region->server_waiting.store(1, std::memory_order_seq_cst);
+            if (region->server_bell.load(std::memory_order_seq_cst) == bell) {
+                shmFutexWait(&region->server_bell, bell, timeout_ms);
+            }
+            region->server_waiting.store(0, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Serve until a client sends SHUTDOWN
+    void run() {
+        while (poll(100)) {
+        }
+    }
+
+    void printStats() {
+        printf("\n[Shm] Transport statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Clients attached:  %lu (%lu detached)\n",
+               (unsigned long)attaches, (unsigned long)detaches);
+        printf("Requests:          %lu\n", (unsigned long)requests_served);
+        printf("Responses:         %lu\n", (unsigned long)responses_sent.load());
+        printf("Ring full:         %lu responses backlogged\n", (unsigned long)backlogged.load());
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+// Reference client. Not thread-safe: one thread per ShmClient.
+class ShmClient {
+private:
+    ShmRegion* region;
+    ShmClientSlot* slot;
+    uint32_t slot_index;
+    uint32_t next_request_id;
+
+    bool send(ShmMsgType type, uint32_t request_id, const std::string& prompt, int max_tokens) {
+        ShmRequest* req = slot->requests.claim();
+        if (!req) {
+            return false;       // Server is behind
+        }
+        req->type = (uint32_t)type;
+        req->request_id = request_id;
+        req->max_tokens = max_tokens;
+        req->prompt_len = prompt.size() < SHM_MAX_PROMPT ? (uint32_t)prompt.size() : SHM_MAX_PROMPT;
+        memcpy(req->prompt, prompt.data(), req->prompt_len);
+        slot->requests.publish();
+
+        region->server_bell.fetch_add(1, std::memory_order_seq_cst);
+        if (region->server_waiting.load(std::memory_order_seq_cst)) {
+            shmFutexWake(&region->server_bell);
+        }
+        return true;
+    }
+
+public:
+    ShmClient() : region(nullptr), slot(nullptr), slot_index(0), next_request_id(1) {}
+
+    ~ShmClient() {
+        detach();
+    }
+
+    ShmClient(const ShmClient&) = delete;
+    ShmClient& operator=(const ShmClient&) = delete;
+
+    // tenant: fair-share group for every request from this client
+    bool attach(const std::string& path, const std::string& tenant = "") {
+        int fd = open(path.c_str(), O_RDWR);
+        if (fd < 0) {
+            perror("[Shm] open");
+            return false;
+        }
+        void* addr = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            perror("[Shm] mmap");
+            return false;
+        }
+
+        region = static_cast<ShmRegion*>(addr);
+        if (region->magic != SHM_MAGIC || region->version != SHM_VERSION) {
+            printf("[Shm] %s is not a v%u engine transport\n", path.c_str(), SHM_VERSION);
+            munmap(region, sizeof(ShmRegion));
+            region = nullptr;
+            return false;
+        }
+
+        // Claim FREE -> CLAIMING first so the server can't see the slot
+        // attached before pid and tenant are filled in. The server frees
+        // a claim it thinks abandoned; if that happened, try the next slot.
+        for (uint32_t i = 0; i < region->max_clients; i++) {
+            uint32_t expected = SHM_SLOT_FREE;
+            ShmClientSlot& candidate = region->clients[i];
+            if (candidate.state.compare_exchange_strong(expected, SHM_SLOT_CLAIMING)) {
+                int32_t unset = 0;
+                if (!candidate.pid.compare_exchange_strong(unset, getpid())) {
+                    continue;
+                }
+                memset(candidate.tenant, 0, SHM_TENANT_LEN);
+                memcpy(candidate.tenant, tenant.data(),
+                       tenant.size() < SHM_TENANT_LEN ? tenant.size() : SHM_TENANT_LEN - 1);
+                expected = SHM_SLOT_CLAIMING;
+                if (!candidate.state.compare_exchange_strong(expected, SHM_SLOT_ATTACHED,
+                                                             std::memory_order_release)) {
+                    int32_t self = getpid();
+                    candidate.pid.compare_exchange_strong(self, 0);
+                    continue;
+                }
+                slot = &candidate;
+                slot_index = i;
+                return true;
+            }
+        }
+
+        printf("[Shm] All %u client slots in use\n", region->max_clients);
+        munmap(region, sizeof(ShmRegion));
+        region = nullptr;
+        return false;
+    }
+
+    void detach() {
+        if (!region) return;
+        if (slot) {
+            slot->state.store(SHM_SLOT_DETACHED, std::memory_order_release);
+            region->server_bell.fetch_add(1, std::memory_order_seq_cst);
+            shmFutexWake(&region->server_bell);
+            slot = nullptr;
+        }
+        munmap(region, sizeof(ShmRegion));
+        region = nullptr;
+    }
+
+    // Returns the request id, or 0 if the request ring is full
+    uint32_t submit(const std::string& prompt, int max_tokens = 0) {
+        uint32_t id = next_request_id++;
+        return send(ShmMsgType::GENERATE, id, prompt, max_tokens) ? id : 0;
+    }
+
+    bool cancel(uint32_t request_id) {
+        return send(ShmMsgType::CANCEL, request_id, "", 0);
+    }
+
+    bool command(ShmMsgType type) {
+        return send(type, 0, "", 0);
+    }
+
+    // Next token or finish for any of this client's requests
+    bool next(ShmResponse& out, int timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            ShmResponse* resp = slot->responses.front();
+            if (resp) {
+                out = *resp;
+                slot->responses.pop();
+                return true;
+            }
+            int remaining = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+                return false;
+            }
+            slot->responses.wait(remaining);
+        }
+    }
+
+    // Server's current prediction of how long a new request would queue
+    uint32_t queueWaitMs() const { return region->queue_wait_ms.load(std::memory_order_relaxed); }
+
+    uint32_t getSlot() const { return slot_index; }
+};
+
+#endif // SHM_TRANSPORT_HPP
@@ -0,0 +1,204 @@
+// task_pipeline.hpp
+// Overlaps preparation of task N+1 with decoding of task N.
+// The next task is tokenized and staged in the accelerator's shadow
+// buffers while the current one runs; its config is written once the
+// kernel raises ap_ready, and AP_START follows ap_done directly.
+
+#ifndef TASK_PIPELINE_HPP
+#define TASK_PIPELINE_HPP
+
+#include "accelerator.hpp"
+#include "constrained_decoding.hpp"
+#include "types.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+
+class TaskPipeline {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Accelerator& accel;
+
+    Task staged_task;
+    bool has_staged;
+    bool staged_warm;       // Staged while the previous run was still active
+    bool staged_launched;   // AP_START already issued from finishRun()
+    bool run_active;
+
+    Clock::time_point run_finished;
+    bool run_finished_valid;
+
+    // Inter-task gap: end of run N to AP_START of run N+1
+    uint64_t warm_launches;     // Next task was staged during run N
+    uint64_t cold_launches;     // Staged after run N ended
+    uint64_t warm_gap_us;
+    uint64_t cold_gap_us;
+    uint64_t max_warm_gap_us;
+    uint64_t launches;
+    uint64_t config_words_written;
+
+    void recordGap(bool warm) {
+        if (!run_finished_valid) {
+            return;
+        }
+
+        uint64_t gap = std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - run_finished).count();
+
+        if (warm) {
+            warm_launches++;
+            warm_gap_us += gap;
+            if (gap > max_warm_gap_us) max_warm_gap_us = gap;
+        } else {
+            cold_launches++;
+            cold_gap_us += gap;
+        }
+        run_finished_valid = false;
+    }
+
+public:
+    explicit TaskPipeline(Accelerator& accelerator)
+        : accel(accelerator), has_staged(false), staged_warm(false),
+          staged_launched(false), run_active(false), run_finished_valid(false),
+          warm_launches(0), cold_launches(0), warm_gap_us(0), cold_gap_us(0),
+          max_warm_gap_us(0), launches(0), config_words_written(0) {}
+
+    // Stage the next task in KV slot kv_slot, or a suspended task in its
+    // own slot (tokens unused). A candidates task passes its first block
+    // tables; a session turn whose earlier context was put back in
+    // kv_slot passes its length and only the new tokens. Safe while the
+    // current task is decoding.
+    bool stage(const Task& task, const std::vector<uint32_t>& tokens, uint32_t kv_slot = 0,
+               const std::vector<uint32_t>* candidate_tables = nullptr, uint32_t kv_prefix = 0) {
+        if (has_staged) {
+            return false;
+        }
+
+        // A constrained task's first step samples under its current state
+        const uint64_t* mask = nullptr;
+        if (task.constraint) {
+            mask = task.constraint->mask(task.resume.valid ? task.resume.constraint_state
+                                                           : task.constraint->start());
+        }
+        if (task.candidates > 0 && candidate_tables) {
+            accel.stageCandidates(task.id, tokens, kv_slot, task.candidates, *candidate_tables);
+        } else if (task.resume.valid) {
+            accel.stageResume(task.id, task.resume, mask);
+        } else if (kv_prefix > 0) {
+            accel.stageContinue(task.id, tokens, kv_slot, kv_prefix, mask);
+        } else {
+            accel.stageTask(task.id, tokens, kv_slot, mask);
+        }
+        staged_task = task;
+        has_staged = true;
+        staged_warm = run_active;
+        return true;
+    }
+
+    bool hasStaged() const { return has_staged; }
+    const Task& stagedTask() const { return staged_task; }
+
+    // Poll once per decode step; preloads the staged config on ap_ready
+    void service() {
+        accel.serviceControl();
+    }
+
+    // Start the staged task in hardware
+    void launchNow() {
+        int written = accel.launchStaged();
+        launches++;
+        if (written > 0) {
+            config_words_written += written;
+        }
+        recordGap(staged_warm);
+        staged_launched = true;
+        run_active = true;
+    }
+
+    // Call when the current run is done (EOS/AP_DONE). If the next task's
+    // config is already in config_in, AP_START is issued right away.
+    void finishRun() {
+        run_active = false;
+        run_finished = Clock::now();
+        run_finished_valid = true;
+
+        if (has_staged && !staged_launched) {
+            accel.serviceControl();  // Consume ap_done
+            if (accel.isStagedPreloaded()) {
+                launchNow();
+            }
+        }
+    }
+
+    // Run ended without ap_done (cancel, reset, token limit); the next
+    // task launches from begin() with a full config write
+    void abandonRun() {
+        if (!staged_launched) {
+            run_active = false;
+        }
+    }
+
+    // Begin the engine-side run of the staged task, launching it if
+    // finishRun() did not already do so
+    bool begin() {
+        if (!has_staged) {
+            return false;
+        }
+
+        if (!staged_launched) {
+            launchNow();
+        }
+        has_staged = false;
+        staged_launched = false;
+        return true;
+    }
+
+    // Forget the staged task (shutdown, preemption). Returns false if
+    // none was staged.
+    bool drop(Task& dropped) {
+        if (!has_staged) {
+            return false;
+        }
+        accel.dropStaged();
+        dropped = staged_task;
+        has_staged = false;
+        staged_launched = false;
+        return true;
+    }
+
+    uint64_t getLaunches() const { return launches; }
+    uint64_t getWarmLaunches() const { return warm_launches; }
+    uint64_t getColdLaunches() const { return cold_launches; }
+
+    double getMeanWarmGapUs() const {
+        return warm_launches ? (double)warm_gap_us / warm_launches : 0.0;
+    }
+
+    double getMeanColdGapUs() const {
+        return cold_launches ? (double)cold_gap_us / cold_launches : 0.0;
+    }
+
+    void printStats() {
+        printf("\n[Pipeline] Inter-task gap:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Launches:              %lu\n", (unsigned long)launches);
+        printf("  Staged during run:   %lu (mean %.1f us, max %lu us)\n",
+               (unsigned long)warm_launches, getMeanWarmGapUs(),
+               (unsigned long)max_warm_gap_us);
+        printf("  Staged after run:    %lu (mean %.1f us)\n",
+               (unsigned long)cold_launches, getMeanColdGapUs());
+        printf("Config words/launch:   %.1f (%lu preloaded on ap_ready)\n",
+               launches ? (double)config_words_written / launches : 0.0,
+               (unsigned long)accel.getPreloadCount());
+        printf("Kernel dead time:      %lu us total, max %lu us over %lu runs (%lu back-to-back)\n",
+               (unsigned long)accel.getSimDeadTimeUs(),
+               (unsigned long)accel.getSimMaxDeadTimeUs(),
+               (unsigned long)accel.getSimRuns(),
+               (unsigned long)accel.getSimBackToBackRuns());
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // TASK_PIPELINE_HPP
@@ -0,0 +1,390 @@
+// tenant_scheduler.hpp
+// Per-tenant task queues with weighted fair sharing of the accelerator,
+// replacing the engine's single FIFO so one team's bulk jobs can't
+// starve everyone else.
+//
+// Deficit round robin, costed in tokens: when a tenant's turn comes it
+// earns QUANTUM_TOKENS x weight of credit and dispatches head tasks while
+// their expected output (max_tokens) fits its credit. When a task ends,
+// tokens it was charged for but didn't generate are refunded, so over
+// time each tenant's share of generated tokens tracks its weight.
+//
+// Tenants in a higher priority class are served first (DRR only shares
+// within a class), and the engine preempts a running task for queued
+// work of a higher class. A preempted task goes back to the front of its
+// tenant's queue and is charged only for what it generated.
+//
+// On top of that, per tenant:
+//   max_inflight      tasks dispatched (staged or running) at once
+//   tokens_per_sec    token bucket on generated tokens; a tenant in debt
+//                     is skipped until it refills
+//   max_queued        entries it may hold in the shared queue
+//
+// Not thread-safe; the engine calls it under its queue mutex.
+
+#ifndef TENANT_SCHEDULER_HPP
+#define TENANT_SCHEDULER_HPP
+
+#include "types.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TenantConfig {
+    int priority;               // Class; higher is served first and preempts lower
+    uint32_t weight;            // Share relative to other tenants
+    uint32_t max_inflight;      // 0 = unlimited
+    double tokens_per_sec;      // 0 = unlimited
+    double burst_tokens;        // Bucket size; 0 = one second of rate
+    uint32_t max_queued;        // 0 = scheduler capacity
+
+    TenantConfig() : priority(0), weight(1), max_inflight(0), tokens_per_sec(0),
+                     burst_tokens(0), max_queued(0) {}
+};
+
+class TenantScheduler {
+public:
+    static constexpr const char* DEFAULT_TENANT = "default";
+    static const int32_t QUANTUM_TOKENS = 64;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct QueuedTask {
+        Task task;
+        Clock::time_point enqueued;
+    };
+
+    struct Tenant {
+        std::string name;
+        TenantConfig config;
+        std::deque<QueuedTask> queue;
+        int64_t deficit;            // Token credit this round
+        bool in_round;              // On the active list
+        uint32_t inflight;
+        double bucket;              // Rate limit credit (tokens)
+        Clock::time_point refilled;
+
+        // Metrics
+        uint64_t submitted;
+        uint64_t refused;           // Queue limit
+        uint64_t dispatched;
+        uint64_t completed;
+        uint64_t tokens;
+        uint64_t throttled;         // Pickups skipped by cap or rate limit
+        uint64_t preempted;
+        double wait_ms_total;
+        double wait_ms_max;
+
+        Tenant() : deficit(0), in_round(false), inflight(0), bucket(0),
+                   submitted(0), refused(0), dispatched(0), completed(0),
+                   tokens(0), throttled(0), preempted(0), wait_ms_total(0), wait_ms_max(0) {}
+    };
+
+    std::vector<Tenant> tenants;
+    std::unordered_map<std::string, size_t> index;
+    std::deque<size_t> active;          // Tenants with queued work, in turn order
+    bool turn_started;                  // Front of active already got its quantum
+    size_t capacity;
+    size_t queued;
+    uint32_t default_max_tokens;
+
+    double burstOf(const Tenant& t) const {
+        return t.config.burst_tokens > 0 ? t.config.burst_tokens : t.config.tokens_per_sec;
+    }
+
+    size_t tenantIndex(const std::string& name) {
+        const std::string& key = name.empty() ? std::string(DEFAULT_TENANT) : name;
+        auto it = index.find(key);
+        if (it != index.end()) {
+            return it->second;
+        }
+        Tenant t;
+        t.name = key;
+        t.refilled = Clock::now();
+        tenants.push_back(t);
+        index[key] = tenants.size() - 1;
+        return tenants.size() - 1;
+    }
+
+    void refill(Tenant& t, Clock::time_point now) {
+        if (t.config.tokens_per_sec <= 0) return;
+        double seconds = std::chrono::duration<double>(now - t.refilled).count();
+        t.refilled = now;
+        t.bucket += seconds * t.config.tokens_per_sec;
+        if (t.bucket > burstOf(t)) t.bucket = burstOf(t);
+    }
+
+    bool eligible(Tenant& t, Clock::time_point now) {
+        if (t.config.max_inflight > 0 && t.inflight >= t.config.max_inflight) {
+            return false;
+        }
+        refill(t, now);
+        return t.config.tokens_per_sec <= 0 || t.bucket > 0;
+    }
+
+    // Tokens still to generate; a resumed task owes only the rest
+    int64_t costOf(const Task& task) const {
+        int64_t limit = task.max_tokens > 0 ? task.max_tokens : default_max_tokens;
+        if (task.resume.valid) limit -= task.resume.generated;
+        return limit > 0 ? limit : 1;
+    }
+
+    // Highest class with an eligible tenant; false if none can run
+    bool topPriority(Clock::time_point now, int& top) {
+        bool found = false;
+        for (size_t i : active) {
+            Tenant& t = tenants[i];
+            if (eligible(t, now) && (!found || t.config.priority > top)) {
+                top = t.config.priority;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Back to the head of its tenant's queue, ahead of newer work
+    void pushFront(size_t i, const Task& task) {
+        Tenant& t = tenants[i];
+        QueuedTask entry;
+        entry.task = task;
+        entry.enqueued = Clock::now();
+        t.queue.push_front(entry);
+        queued++;
+
+        if (!t.in_round) {
+            t.in_round = true;
+            t.deficit = 0;
+            active.push_back(i);
+        }
+    }
+
+    void nextTurn() {
+        size_t front = active.front();
+        active.pop_front();
+        active.push_back(front);
+        turn_started = false;
+    }
+
+public:
+    explicit TenantScheduler(size_t cap = 100, uint32_t default_tokens = 50)
+        : turn_started(false), capacity(cap), queued(0), default_max_tokens(default_tokens) {}
+
+    TenantConfig config(const std::string& name) {
+        return tenants[tenantIndex(name)].config;
+    }
+
+    int priorityOf(const Task& task) {
+        return tenants[tenantIndex(task.tenant)].config.priority;
+    }
+
+    void configure(const std::string& name, const TenantConfig& config) {
+        Tenant& t = tenants[tenantIndex(name)];
+        t.config = config;
+        if (t.config.weight == 0) t.config.weight = 1;
+        t.bucket = burstOf(t);
+        t.refilled = Clock::now();
+    }
+
+    bool push(const Task& task) {
+        if (queued >= capacity) {
+            return false;
+        }
+        size_t i = tenantIndex(task.tenant);
+        Tenant& t = tenants[i];
+
+        size_t limit = t.config.max_queued > 0 ? t.config.max_queued : capacity;
+        if (t.queue.size() >= limit) {
+            t.refused++;
+            return false;
+        }
+        t.submitted++;
+
+        QueuedTask entry;
+        entry.task = task;
+        entry.enqueued = Clock::now();
+        t.queue.push_back(entry);
+        queued++;
+
+        if (!t.in_round) {
+            t.in_round = true;
+            t.deficit = 0;
+            active.push_back(i);
+        }
+        return true;
+    }
+
+    // Next task by DRR within the highest class that can run, skipping
+    // capped or rate-limited tenants. False when nothing is queued or
+    // every tenant with work is held back.
+    bool pop(Task& out) {
+        Clock::time_point now = Clock::now();
+        size_t blocked = 0;
+        int top = 0;
+        if (!topPriority(now, top)) {
+            return false;
+        }
+
+        while (!active.empty() && blocked < active.size()) {
+            Tenant& t = tenants[active.front()];
+
+            if (!eligible(t, now)) {
+                if (!turn_started) t.throttled++;
+                nextTurn();
+                blocked++;
+                continue;
+            }
+            if (t.config.priority < top) {
+                nextTurn();
+                blocked++;
+                continue;
+            }
+
+            if (!turn_started) {
+                t.deficit += (int64_t)QUANTUM_TOKENS * t.config.weight;
+                turn_started = true;
+            }
+
+            int64_t cost = costOf(t.queue.front().task);
+            if (cost > t.deficit) {
+                // Keeps its credit; each turn adds a quantum until it fits
+                nextTurn();
+                blocked = 0;
+                continue;
+            }
+
+            QueuedTask entry = t.queue.front();
+            t.queue.pop_front();
+            queued--;
+            t.deficit -= cost;
+            t.inflight++;
+            t.dispatched++;
+
+            double wait = std::chrono::duration<double, std::milli>(now - entry.enqueued).count();
+            t.wait_ms_total += wait;
+            if (wait > t.wait_ms_max) t.wait_ms_max = wait;
+
+            if (t.queue.empty()) {
+                // Idle tenants don't bank credit
+                t.in_round = false;
+                t.deficit = 0;
+                active.pop_front();
+                turn_started = false;
+            }
+
+            out = entry.task;
+            return true;
+        }
+        return false;
+    }
+
+    // A dispatched task ended (any reason) after generating tokens
+    void complete(const Task& task, uint32_t generated) {
+        Tenant& t = tenants[tenantIndex(task.tenant)];
+        if (t.inflight > 0) t.inflight--;
+        t.completed++;
+        t.tokens += generated;
+
+        if (t.config.tokens_per_sec > 0) {
+            refill(t, Clock::now());
+            t.bucket -= generated;
+        }
+
+        // Refund what was charged but not generated
+        int64_t unused = costOf(task) - (int64_t)generated;
+        if (t.in_round && unused > 0) {
+            t.deficit += unused;
+        }
+    }
+
+    // Queued work in a higher class than priority that could run now
+    bool waitingAbove(int priority) {
+        int top = 0;
+        return topPriority(Clock::now(), top) && top > priority;
+    }
+
+    // A popped task goes back unrun (staged, then displaced by preemption)
+    void unstage(const Task& task) {
+        size_t i = tenantIndex(task.tenant);
+        Tenant& t = tenants[i];
+        if (t.inflight > 0) t.inflight--;
+        if (t.dispatched > 0) t.dispatched--;
+        if (t.in_round) t.deficit += costOf(task);
+        pushFront(i, task);
+    }
+
+    // charged: the task as popped; resumed: its ResumeState filled in.
+    // Charged for generated tokens only, then requeued at the front.
+    void suspend(const Task& charged, const Task& resumed, uint32_t generated) {
+        size_t i = tenantIndex(charged.tenant);
+        Tenant& t = tenants[i];
+        if (t.inflight > 0) t.inflight--;
+        t.tokens += generated;
+        t.preempted++;
+
+        if (t.config.tokens_per_sec > 0) {
+            refill(t, Clock::now());
+            t.bucket -= generated;
+        }
+
+        int64_t unused = costOf(charged) - (int64_t)generated;
+        if (t.in_round && unused > 0) {
+            t.deficit += unused;
+        }
+        pushFront(i, resumed);
+    }
+
+    // Everything still queued, for shutdown
+    bool drain(Task& out) {
+        for (Tenant& t : tenants) {
+            if (!t.queue.empty()) {
+                out = t.queue.front().task;
+                t.queue.pop_front();
+                queued--;
+                return true;
+            }
+        }
+        active.clear();
+        for (Tenant& t : tenants) t.in_round = false;
+        return false;
+    }
+
+    size_t size() const { return queued; }
+    bool full() const { return queued >= capacity; }
+    bool empty() const { return queued == 0; }
+
+    void printStats() const {
+        uint64_t total_tokens = 0;
+        uint32_t total_weight = 0;
+        for (const Tenant& t : tenants) {
+            total_tokens += t.tokens;
+            total_weight += t.config.weight;
+        }
+
+        printf("\n[Scheduler] Tenants (deficit round robin, %d-token quantum):\n", QUANTUM_TOKENS);
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("%-14s %4s %6s %7s %6s %6s %8s %7s %7s %9s %9s\n", "Tenant", "Prio", "Weight",
+               "Queued", "Runs", "Done", "Tokens", "Share", "Target", "Wait avg", "Wait max");
+        for (const Tenant& t : tenants) {
+            double share = total_tokens ? 100.0 * t.tokens / total_tokens : 0;
+            double target = total_weight ? 100.0 * t.config.weight / total_weight : 0;
+            double avg = t.dispatched ? t.wait_ms_total / t.dispatched : 0;
+            printf("%-14s %4d %6u %7zu %6lu %6lu %8lu %6.1f%% %6.1f%% %7.0fms %7.0fms\n",
+                   t.name.c_str(), t.config.priority, t.config.weight, t.queue.size(),
+                   (unsigned long)t.dispatched, (unsigned long)t.completed,
+                   (unsigned long)t.tokens, share, target, avg, t.wait_ms_max);
+            if (t.refused || t.throttled || t.preempted) {
+                printf("%-14s   %lu refused (queue limit), %lu pickups held (cap/rate), "
+                       "%lu preempted\n", "", (unsigned long)t.refused,
+                       (unsigned long)t.throttled, (unsigned long)t.preempted);
+            }
+        }
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+#endif // TENANT_SCHEDULER_HPP
@@ -0,0 +1,444 @@
+// thread_pool.hpp
+// Work-stealing task scheduler shared by the weight loader, tokenizer
+// and CPU kernels, so parallel sections don't each spawn their own
+// threads and oversubscribe the cores.
+//
+// Each worker owns a Chase-Lev deque: it pushes and pops at the bottom,
+// idle workers steal from the top. Tasks submitted from outside the pool
+// go through a shared injection queue. Workers with nothing to run or
+// steal park on a condition variable until new work is published.
+//
+// Long-lived blocking loops (engine thread, IRQ thread) keep their own
+// std::threads; running them here would pin a worker forever.
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct PoolTask {
+    std::function<void()> fn;
+    std::atomic<int>* pending;      // Owning TaskGroup counter (may be null)
+};
+
+// Chase-Lev deque (Le et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models"). Only the owner calls push/pop; any thread may steal.
+class WorkStealingDeque {
+private:
+    struct Array {
+        int64_t capacity;
+        std::atomic<PoolTask*>* slots;
+
+        explicit Array(int64_t cap) : capacity(cap), slots(new std::atomic<PoolTask*>[cap]) {}
+        ~Array() { delete[] slots; }
+
+        // Acquire/release on the slot itself publishes the task contents
+        // to a thief (the fences alone are invisible to ThreadSanitizer)
+        PoolTask* get(int64_t i) const {
+            return slots[i & (capacity - 1)].load(std::memory_order_acquire);
+        }
+        void put(int64_t i, PoolTask* task) {
+            slots[i & (capacity - 1)].store(task, std::memory_order_release);
+        }
+    };
+
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::atomic<Array*> array;
+    std::vector<Array*> retired;    // Thieves may still read old arrays
+
+    Array* grow(Array* old, int64_t b, int64_t t) {
+        Array* bigger = new Array(old->capacity * 2);
+        for (int64_t i = t; i < b; i++) {
+            bigger->put(i, old->get(i));
+        }
+        retired.push_back(old);
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256)
+        : top(0), bottom(0), array(new Array(capacity)) {}
+
+    ~WorkStealingDeque() {
+        delete array.load();
+        for (Array* a : retired) {
+            delete a;
+        }
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    void push(PoolTask* task) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array* a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = grow(a, b, t);
+        }
+        a->put(b, task);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    PoolTask* pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        PoolTask* task = a->get(b);
+        if (t == b) {
+            // Last element: race a thief for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+                task = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    PoolTask* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return nullptr;
+        }
+
+        Array* a = array.load(std::memory_order_acquire);
+        PoolTask* task = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            return nullptr;     // Lost the race; caller tries elsewhere
+        }
+        return task;
+    }
+
+    bool empty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+};
+
+class ThreadPool {
+private:
+    unsigned num_workers;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+
+    // Submissions from threads outside the pool
+    std::mutex inject_mutex;
+    std::deque<PoolTask*> injected;
+    std::atomic<size_t> injected_size;
+
+    // Parking: epoch changes whenever work is published
+    std::mutex park_mutex;
+    std::condition_variable park_cv;
+    std::atomic<uint64_t> epoch;
+    std::atomic<int> sleepers;
+    std::atomic<bool> stopping;
+
+    // Statistics
+    std::atomic<uint64_t> executed;
+    std::atomic<uint64_t> steals;
+    std::atomic<uint64_t> parks;
+    std::atomic<uint64_t> external_submits;
+
+    static const int SPIN_ROUNDS = 64;
+    
+    // A waiting thread that steals may pick up a task that itself waits,
+    // nesting on the stack. Past this depth it only drains its own deque.
+    static const int MAX_HELP_DEPTH = 32;
+
+    // Worker identity of the calling thread (-1 outside any pool)
+    static ThreadPool*& currentPool() {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static int& currentWorker() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    static int& helpDepth() {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    int selfIndex() const {
+        return currentPool() == this ? currentWorker() : -1;
+    }
+
+    void publish() {
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(park_mutex);
+            park_cv.notify_one();
+        }
+    }
+
+    PoolTask* popInjected() {
+        if (injected_size.load(std::memory_order_acquire) == 0) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(inject_mutex);
+        if (injected.empty()) {
+            return nullptr;
+        }
+        PoolTask* task = injected.front();
+        injected.pop_front();
+        injected_size.store(injected.size(), std::memory_order_release);
+        return task;
+    }
+
+    PoolTask* findTask(int self) {
+        if (self >= 0) {
+            PoolTask* task = deques[self]->pop();
+            if (task) return task;
+        }
+
+        PoolTask* task = popInjected();
+        if (task) return task;
+
+        // Sweep the other deques starting at a per-thread rotating victim
+        static thread_local unsigned victim_seed = 0;
+        unsigned start = victim_seed++;
+        for (unsigned i = 0; i < num_workers; i++) {
+            unsigned victim = (start + i) % num_workers;
+            if ((int)victim == self) continue;
+            task = deques[victim]->steal();
+            if (task) {
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void runTask(PoolTask* task) {
+        task->fn();
+        if (task->pending) {
+            task->pending->fetch_sub(1, std::memory_order_acq_rel);
+        }
+        delete task;
+        executed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void workerLoop(int index) {
+        currentPool() = this;
+        currentWorker() = index;
+
+        while (!stopping.load(std::memory_order_acquire)) {
+            PoolTask* task = findTask(index);
+            for (int spin = 0; !task && spin < SPIN_ROUNDS; spin++) {
+                std::this_thread::yield();
+                task = findTask(index);
+            }
+            if (task) {
+                runTask(task);
+                continue;
+            }
+
+            // Re-check after sampling the epoch so a publish between the
+            // last search and the wait cannot be missed
+            uint64_t seen = epoch.load(std::memory_order_seq_cst);
+            task = findTask(index);
+            if (task) {
+                runTask(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(park_mutex);
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            parks.fetch_add(1, std::memory_order_relaxed);
+            park_cv.wait(lock, [&] {
+                return stopping.load(std::memory_order_acquire) ||
+                       epoch.load(std::memory_order_seq_cst) != seen;
+            });
+            sleepers.fetch_sub(1, std::memory_order_seq_cst);
+        }
+    }
+
+public:
+    // workers = 0: one per core, leaving one for the engine thread
+    explicit ThreadPool(unsigned workers = 0)
+        : injected_size(0), epoch(0), sleepers(0), stopping(false),
+          executed(0), steals(0), parks(0), external_submits(0) {
+        if (workers == 0) {
+            unsigned cores = std::thread::hardware_concurrency();
+            workers = cores > 1 ? cores - 1 : 1;
+        }
+        num_workers = workers;
+
+        for (unsigned i = 0; i < num_workers; i++) {
+            deques.emplace_back(new WorkStealingDeque());
+        }
+        for (unsigned i = 0; i < num_workers; i++) {
+            threads.emplace_back(&ThreadPool::workerLoop, this, (int)i);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(park_mutex);
+            stopping.store(true, std::memory_order_release);
+        }
+        park_cv.notify_all();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+
+        // Drop anything never run
+        for (unsigned i = 0; i < num_workers; i++) {
+            while (PoolTask* task = deques[i]->steal()) delete task;
+        }
+        for (PoolTask* task : injected) delete task;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned getWorkerCount() const { return num_workers; }
+
+    // Queue fn. From a worker it goes to that worker's deque (LIFO, cache
+    // warm); from other threads to the injection queue.
+    void submit(std::function<void()> fn, std::atomic<int>* pending = nullptr) {
+        PoolTask* task = new PoolTask{std::move(fn), pending};
+
+        int self = selfIndex();
+        if (self >= 0) {
+            deques[self]->push(task);
+        } else {
+            std::lock_guard<std::mutex> lock(inject_mutex);
+            injected.push_back(task);
+            injected_size.store(injected.size(), std::memory_order_release);
+            external_submits.fetch_add(1, std::memory_order_relaxed);
+        }
+        publish();
+    }
+
+    // Run queued tasks on the calling thread until counter drops to zero.
+    // Lets a waiting thread (worker or not) help instead of blocking.
+    void helpWhile(const std::atomic<int>& counter) {
+        int self = selfIndex();
+        bool may_steal = ++helpDepth() <= MAX_HELP_DEPTH;
+        while (counter.load(std::memory_order_acquire) > 0) {
+            PoolTask* task = nullptr;
+            if (may_steal) {
+                task = findTask(self);
+            } else if (self >= 0) {
+                task = deques[self]->pop();
+            }
+            if (task) {
+                runTask(task);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        --helpDepth();
+    }
+
+    // fn(lo, hi) over [begin, end) in chunks of at least grain elements.
+    // The calling thread runs the last chunk and helps until all finish.
+    void parallel_for(size_t begin, size_t end, size_t grain,
+                      const std::function<void(size_t, size_t)>& fn);
+
+    uint64_t getExecutedCount() const { return executed.load(); }
+    uint64_t getStealCount() const { return steals.load(); }
+
+    void printStats() {
+        printf("\n[ThreadPool] Statistics:\n");
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+        printf("Workers:           %u\n", num_workers);
+        printf("Tasks executed:    %lu (%lu submitted from outside)\n",
+               (unsigned long)executed.load(), (unsigned long)external_submits.load());
+        printf("Steals:            %lu\n", (unsigned long)steals.load());
+        printf("Parks:             %lu\n", (unsigned long)parks.load());
+        printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n\n");
+    }
+};
+
+// Fork/join scope: run() queues tasks, wait() (or the destructor) helps
+// execute pool work until every task in the group has finished
+class TaskGroup {
+private:
+    ThreadPool& pool;
+    std::atomic<int> pending;
+
+public:
+    explicit TaskGroup(ThreadPool& p) : pool(p), pending(0) {}
+
+    ~TaskGroup() {
+        wait();
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(std::function<void()> fn) {
+        pending.fetch_add(1, std::memory_order_acq_rel);
+        pool.submit(std::move(fn), &pending);
+    }
+
+    void wait() {
+        pool.helpWhile(pending);
+    }
+};
+
+inline void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain,
+                                     const std::function<void(size_t, size_t)>& fn) {
+    if (end <= begin) {
+        return;
+    }
+    size_t n = end - begin;
+    if (grain == 0) grain = 1;
+
+    // A few chunks per thread so stealing can even out imbalance
+    size_t max_chunks = 4 * ((size_t)num_workers + 1);
+    size_t chunks = (n + grain - 1) / grain;
+    if (chunks > max_chunks) chunks = max_chunks;
+    if (chunks <= 1) {
+        fn(begin, end);
+        return;
+    }
+
+    size_t chunk = (n + chunks - 1) / chunks;
+    TaskGroup group(*this);
+    size_t lo = begin;
+    while (lo + chunk < end) {
+        size_t hi = lo + chunk;
+        group.run([&fn, lo, hi] { fn(lo, hi); });
+        lo = hi;
+    }
+    fn(lo, end);
+    group.wait();
+}
+
+// Process-wide pool; created on first use
+inline ThreadPool& sharedThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,133 @@
+// thread_pool_bench.cpp
+// Scaling benchmark for the work-stealing pool. Runs each workload with
+// 1, 2, 4, ... workers up to the core count and prints speedup over the
+// single-worker run.
+//
+//   convert   FP32 -> FP16 over a large tensor (parallel_for, bandwidth-bound)
+//   dequant   INT4 unpack + dequantize (parallel_for, compute-bound)
+//   forkjoin  Recursive TaskGroup tree (scheduling and stealing overhead)
+//
+// Build: g++ -std=c++17 -O2 thread_pool_bench.cpp -o thread_pool_bench -pthread
+
+#include "thread_pool.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+static const size_t CONVERT_ELEMENTS = 32 * 1024 * 1024;
+static const size_t DEQUANT_WEIGHTS = 64 * 1024 * 1024;
+static const int FORK_DEPTH = 18;
+static const int REPEATS = 3;
+
+static uint16_t toFp16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exp = ((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = (bits >> 13) & 0x3FF;
+    if (exp <= 0) return (uint16_t)sign;
+    if (exp >= 31) return (uint16_t)(sign | 0x7C00);
+    return (uint16_t)(sign | (exp << 10) | mantissa);
+}
+
+static void convert(ThreadPool& pool, const std::vector<float>& src, std::vector<uint16_t>& dst) {
+    pool.parallel_for(0, src.size(), 64 * 1024, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            dst[i] = toFp16(src[i]);
+        }
+    });
+}
+
+static void dequant(ThreadPool& pool, const std::vector<uint8_t>& packed,
+                    std::vector<float>& out, float scale) {
+    pool.parallel_for(0, packed.size(), 32 * 1024, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            int8_t w0 = (int8_t)(packed[i] << 4) >> 4;
+            int8_t w1 = (int8_t)packed[i] >> 4;
+            out[2 * i] = tanhf(w0 * scale);
+            out[2 * i + 1] = tanhf(w1 * scale);
+        }
+    });
+}
+
+static void forkJoin(ThreadPool& pool, int depth, std::atomic<uint64_t>& leaves) {
+    if (depth == 0) {
+        leaves.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    TaskGroup group(pool);
+    group.run([&pool, depth, &leaves] { forkJoin(pool, depth - 1, leaves); });
+    forkJoin(pool, depth - 1, leaves);
+    group.wait();
+}
+
+template <typename Fn>
+static double bestOf(Fn fn) {
+    double best = 1e30;
+    for (int r = 0; r < REPEATS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        if (ms < best) best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    unsigned max_workers = std::thread::hardware_concurrency();
+    if (argc > 1) {
+        max_workers = (unsigned)atoi(argv[1]);
+    }
+    if (max_workers == 0) max_workers = 1;
+
+    std::vector<float> src(CONVERT_ELEMENTS);
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (float)(i % 1000) * 0.001f - 0.5f;
+    }
+    std::vector<uint16_t> fp16(CONVERT_ELEMENTS);
+
+    std::vector<uint8_t> packed(DEQUANT_WEIGHTS / 2);
+    for (size_t i = 0; i < packed.size(); i++) {
+        packed[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    std::vector<float> dequantized(DEQUANT_WEIGHTS);
+
+    printf("[Bench] Work-stealing pool scaling (%u cores, best of %d)\n",
+           std::thread::hardware_concurrency(), REPEATS);
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    printf("%-8s %14s %14s %14s\n", "Workers", "convert", "dequant", "forkjoin");
+
+    double base[3] = {0, 0, 0};
+    for (unsigned workers = 1; workers <= max_workers; workers *= 2) {
+        ThreadPool pool(workers);
+
+        double ms[3];
+        ms[0] = bestOf([&] { convert(pool, src, fp16); });
+        ms[1] = bestOf([&] { dequant(pool, packed, dequantized, 0.25f); });
+        ms[2] = bestOf([&] {
+            std::atomic<uint64_t> leaves(0);
+            forkJoin(pool, FORK_DEPTH, leaves);
+        });
+
+        if (workers == 1) {
+            for (int i = 0; i < 3; i++) base[i] = ms[i];
+        }
+
+        printf("%-8u", workers);
+        for (int i = 0; i < 3; i++) {
+            printf(" %7.1f ms %4.1fx", ms[i], base[i] / ms[i]);
+        }
+        printf("\n");
+
+        if (workers < max_workers && workers * 2 > max_workers) {
+            workers = max_workers / 2;  // Always finish on max_workers
+        }
+    }
+    printf("━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\n");
+    return 0;
+}
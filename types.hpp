@@ -5,25 +5,101 @@
 
 #include <cstdint>
 #include <string>
+#include <memory>
+#include <vector>
+
+class TokenConstraint;      // constrained_decoding.hpp
 
 enum class TaskType {
     GENERATE
 };
 
+enum class FinishReason {
+    EOS,
+    MAX_TOKENS,
+    CANCELLED,
+    FAILED,         // Accelerator error, retries exhausted
+    SHUTDOWN,
+    REJECTED        // Not admitted (queue full, over wait SLO, too large)
+};
+
+// How a candidates task (Task::candidates) picks its outputs
+enum class CandidateMode {
+    SAMPLE,         // Independent samples
+    BEAM            // Beam search, width = candidates
+};
+
+// One ranked output of a candidates task
+struct CandidateOutput {
+    std::vector<uint32_t> tokens;
+    double logprob;         // Sum over tokens, and EOS if it ended there
+    FinishReason finish;    // EOS or MAX_TOKENS
+
+    CandidateOutput() : logprob(0), finish(FinishReason::MAX_TOKENS) {}
+};
+
+// Receives a task's output. Called on the engine thread; implementations
+// must not block.
+class TokenSink {
+public:
+    virtual ~TokenSink() {}
+    virtual void onToken(uint32_t token) = 0;
+    virtual void onFinish(FinishReason reason) = 0;
+    
+    // Candidates tasks stream no tokens: their outputs arrive here, best
+    // first, once before onFinish
+    virtual void onCandidates(const std::vector<CandidateOutput>& ranked) { (void)ranked; }
+    
+    // Polled at token boundaries; true stops this task only
+    virtual bool isCancelled() const { return false; }
+};
+
+// Where a preempted task stopped. Its KV stays pinned in kv_slot so it
+// resumes decoding without re-running the prompt.
+struct ResumeState {
+    bool valid;
+    uint32_t kv_slot;
+    uint32_t kv_epoch;      // Accelerator KV epoch; a reset invalidates
+    uint32_t position;      // KV entries written (prompt + generated - 1)
+    uint32_t generated;     // Tokens delivered before suspension
+    uint32_t last_token;    // Sampled but not yet fed back
+    uint32_t preemptions;
+    uint32_t constraint_state;  // Grammar state after last_token
+    
+    ResumeState() : valid(false), kv_slot(0), kv_epoch(0), position(0), generated(0),
+                    last_token(0), preemptions(0), constraint_state(0) {}
+};
+
 struct Task {
     int id;
     TaskType type;
     std::string prompt;
+    int attempts;           // Runs already failed by accelerator errors
+    int max_tokens;         // 0 = engine default
+    std::shared_ptr<TokenSink> sink;    // Null = output to UI only
+    uint32_t retry_after_ms;    // Set when submit rejects; 0 = never fits
+    std::string tenant;         // Fair-share group; empty = "default"
+    ResumeState resume;         // Valid while suspended by preemption
+    std::shared_ptr<const TokenConstraint> constraint;  // Null = unconstrained
+    uint32_t candidates;        // 0 = one streamed output; else samples or beam width
+    CandidateMode candidate_mode;
+    std::string session;        // Conversation whose KV is kept between turns; empty = none
+    uint32_t delivered;         // Output tokens already sent; a retry doesn't send them again
     
-    Task() : id(0), type(TaskType::GENERATE), prompt("") {}
+    Task() : id(0), type(TaskType::GENERATE), prompt(""), attempts(0), max_tokens(0),
+             retry_after_ms(0), candidates(0), candidate_mode(CandidateMode::SAMPLE),
+             delivered(0) {}
     Task(int _id, TaskType _type, const std::string& _prompt) 
-        : id(_id), type(_type), prompt(_prompt) {}
+        : id(_id), type(_type), prompt(_prompt), attempts(0), max_tokens(0),
+          retry_after_ms(0), candidates(0), candidate_mode(CandidateMode::SAMPLE),
+          delivered(0) {}
 };
 
 enum class CommandType {
     STOP_CURRENT,   
     RESET,         
-    SHUTDOWN        
+    SHUTDOWN,
+    SNAPSHOT_SESSIONS   // Write session KV to the snapshot file between runs
 };
 
 struct Command {
@@ -36,21 +112,11 @@ struct Command {
 enum class EngineStatus {
     IDLE,
     GENERATING,
+    COMPLETING,     // Run finished (EOS, AP_DONE, cancel), collecting results
+    RESETTING,      // Clearing KV cache
     SHUTTING_DOWN
 };
 
-struct EngineState {
-    EngineStatus status;
-    int currentTaskId;      // -1 means null
-    bool cancelCurrent;
-    bool resetRequested;
-    
-    EngineState() : status(EngineStatus::IDLE), 
-                    currentTaskId(-1),
-                    cancelCurrent(false),
-                    resetRequested(false) {}
-};
-
 const uint32_t EOS_TOKEN = 0xFFFFFFFF;
 
 #endif // TYPES_HPP
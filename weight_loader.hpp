@@ -7,11 +7,93 @@
 #include <fstream>
 #include <cstring>
 #include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <type_traits>
+#include "async_file_reader.hpp"
+#include "thread_pool.hpp"
+
+// One aligned allocation holding every tensor of a model, or a read-only
+// view of one held elsewhere (weight_share.hpp). Tensors are placed by
+// take() and addressed by offset, so the arena can grow while loading and
+// be mapped at any address; teardown is a single free.
+class WeightArena {
+public:
+    static const size_t ALIGN = 64;
+    
+private:
+    uint8_t* base;
+    size_t used;
+    size_t capacity;
+    bool owned;
+    
+    static size_t alignUp(size_t n, size_t to) { return (n + to - 1) / to * to; }
+    
+public:
+    WeightArena() : base(nullptr), used(0), capacity(0), owned(true) {}
+    ~WeightArena() { release(); }
+    
+    WeightArena(const WeightArena&) = delete;
+    WeightArena& operator=(const WeightArena&) = delete;
+    
+    void release() {
+        if (base && owned) free(base);
+        base = nullptr;
+        used = 0;
+        capacity = 0;
+        owned = true;
+    }
+    
+    // Room for at least bytes in total, keeping what is placed so far
+    bool reserve(size_t bytes) {
+        if (bytes <= capacity) return true;
+        if (!owned) return false;
+        
+        size_t rounded = alignUp(bytes, ALIGN);
+        uint8_t* grown = static_cast<uint8_t*>(aligned_alloc(ALIGN, rounded));
+        if (!grown) return false;
+        if (base) {
+            memcpy(grown, base, used);
+            free(base);
+        }
+        base = grown;
+        capacity = rounded;
+        return true;
+    }
+    
+    // Place bytes at the next multiple of align; false when out of memory.
+    // Growing moves the arena, so resolve pointers after the last take().
+    bool take(size_t bytes, size_t align, uint64_t& offset) {
+        size_t at = alignUp(used, align);
+        if (at + bytes > capacity && !reserve(std::max(at + bytes, capacity + capacity / 2))) {
+            return false;
+        }
+        offset = at;
+        used = at + bytes;
+        return true;
+    }
+    
+    // Point at an arena held elsewhere, which must outlive this
+    void view(const uint8_t* data, size_t bytes) {
+        release();
+        base = const_cast<uint8_t*>(data);
+        used = bytes;
+        capacity = bytes;
+        owned = false;
+    }
+    
+    const uint8_t* data() const { return base; }
+    uint8_t* mutableData() { return owned ? base : nullptr; }
+    size_t size() const { return used; }
+    bool isView() const { return !owned; }
+};
 
 // INT4 weight storage format
 // 2 weights per byte: [weight1 (4 bits) | weight0 (4 bits)]
+// A view of one tensor in a WeightArena (ModelWeights::int4).
 struct INT4Weights {
-    uint8_t* data;          // Packed INT4 data (2 weights per byte)
+    const uint8_t* data;    // Packed INT4 data (2 weights per byte)
     size_t num_weights;     // Total number of weights
     size_t data_size;       // Size in bytes (num_weights / 2)
     
@@ -21,10 +103,6 @@ struct INT4Weights {
     INT4Weights() : data(nullptr), num_weights(0), data_size(0), 
                     scale(1.0f), zero_point(0) {}
     
-    ~INT4Weights() {
-        if (data) delete[] data;
-    }
-    
     // Get weight at index (unpacks from INT4)
     int8_t getWeight(size_t idx) const {
         if (idx >= num_weights) return 0;
@@ -49,36 +127,6 @@ struct INT4Weights {
         return value;
     }
     
-    // Set weight at index (packs to INT4)
-    void setWeight(size_t idx, int8_t value) {
-        if (idx >= num_weights) return;
-        
-        // Clamp to 4-bit signed range [-8, 7]
-        if (value > 7) value = 7;
-        if (value < -8) value = -8;
-        
-        size_t byte_idx = idx / 2;
-        bool is_upper = (idx % 2) == 1;
-        
-        uint8_t masked_value = value & 0x0F;
-        
-        if (is_upper) {
-            data[byte_idx] = (data[byte_idx] & 0x0F) | (masked_value << 4);
-        } else {
-            data[byte_idx] = (data[byte_idx] & 0xF0) | masked_value;
-        }
-    }
-    
-    // Allocate storage
-    bool allocate(size_t num_weights_) {
-        num_weights = num_weights_;
-        data_size = (num_weights + 1) / 2;  // Round up
-        data = new uint8_t[data_size];
-        if (!data) return false;
-        memset(data, 0, data_size);
-        return true;
-    }
-    
     // Dequantize to float
     float dequantize(size_t idx) const {
         int8_t quantized = getWeight(idx);
@@ -86,43 +134,86 @@ struct INT4Weights {
     }
 };
 
-// Layer weights structure
-struct LayerWeights {
-    std::string name;
+// FP32 tensor: a view of one in a WeightArena (ModelWeights::floats)
+struct FloatWeights {
+    const float* values;
+    size_t count;
     
-    // Attention weights
-    INT4Weights q_weights;      // Query projection
-    INT4Weights k_weights;      // Key projection
-    INT4Weights v_weights;      // Value projection
-    INT4Weights o_weights;      // Output projection
+    FloatWeights() : values(nullptr), count(0) {}
+    FloatWeights(const float* values_, size_t count_) : values(values_), count(count_) {}
     
-    // FFN weights
-    INT4Weights ffn_up;         // Feed-forward up projection
-    INT4Weights ffn_down;       // Feed-forward down projection
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const float* data() const { return values; }
+    const float* begin() const { return values; }
+    const float* end() const { return values + count; }
+    const float& operator[](size_t i) const { return values[i]; }
+};
+
+// Where a tensor sits in the model's arena
+struct TensorDesc {
+    uint64_t offset;        // Bytes from the arena start
+    uint64_t count;         // FP32 values, or INT4 weights
+};
+
+enum LayerTensor : uint32_t {
+    LAYER_Q, LAYER_K, LAYER_V, LAYER_O,         // Attention projections
+    LAYER_FFN_UP, LAYER_FFN_DOWN,               // Feed-forward projections
+    LAYER_INT4_TENSORS
+};
+
+enum LayerNorm : uint32_t {
+    LAYER_LN1_WEIGHT, LAYER_LN1_BIAS, LAYER_LN2_WEIGHT, LAYER_LN2_BIAS,
+    LAYER_NORMS
+};
+
+// Layer descriptor: offsets, sizes and quantization of a layer's tensors
+// in the arena. The INT4 tensors are packed back to back in file order,
+// as in the DDR image, so a layer's INT4 data is one contiguous range;
+// the FP32 layer norms follow as a second range. Plain data, so the
+// descriptor table can be copied as-is (weight_share.hpp).
+struct LayerWeights {
+    uint64_t int4_offset[LAYER_INT4_TENSORS];
+    uint64_t int4_weights[LAYER_INT4_TENSORS];
+    float scale[LAYER_INT4_TENSORS];
+    int8_t zero_point[LAYER_INT4_TENSORS];
+    uint8_t pad[2];
     
-    // Layer norm weights (FP16 for precision)
-    std::vector<float> ln1_weight;
-    std::vector<float> ln1_bias;
-    std::vector<float> ln2_weight;
-    std::vector<float> ln2_bias;
+    uint64_t norm_offset;   // LAYER_NORMS tensors of norm_size floats each
+    uint32_t norm_size;
     
     // Metadata
-    size_t layer_idx;
-    size_t hidden_size;
-    size_t intermediate_size;
+    uint32_t layer_idx;
+    uint32_t hidden_size;
+    uint32_t intermediate_size;
+    
+    static uint64_t int4Bytes(uint64_t weights) { return (weights + 1) / 2; }
+    
+    // The INT4 range: from int4_offset[LAYER_Q], this many bytes
+    uint64_t int4RangeBytes() const {
+        uint64_t last = LAYER_INT4_TENSORS - 1;
+        return int4_offset[last] + int4Bytes(int4_weights[last]) - int4_offset[LAYER_Q];
+    }
+    
+    uint64_t normValues() const { return (uint64_t)norm_size * LAYER_NORMS; }
 };
 
-// Complete model weights
+static_assert(std::is_trivially_copyable<LayerWeights>::value, "copied into shared segments");
+
+// Complete model weights: every tensor lives in the arena, found through
+// the descriptors below
 struct ModelWeights {
-    // Embedding table (typically FP16 or INT8)
-    std::vector<float> token_embeddings;
-    std::vector<float> position_embeddings;
+    WeightArena arena;
     
-    // Layer weights (INT4)
+    // Embedding tables (FP32 on the host, FP16 in DDR)
+    TensorDesc token_embeddings;
+    TensorDesc position_embeddings;
+    
+    // Layer descriptors (INT4 projections, FP32 layer norms)
     std::vector<LayerWeights> layers;
     
-    // Output projection (FP16)
-    std::vector<float> lm_head;
+    // Output projection (FP32 on the host, FP16 in DDR; absent in WTNT files)
+    TensorDesc lm_head;
     
     // Model config
     uint32_t num_layers;
@@ -131,8 +222,461 @@ struct ModelWeights {
     uint32_t vocab_size;
     uint32_t max_seq_len;
     
-    ModelWeights() : num_layers(0), hidden_size(0), 
-                     num_heads(0), vocab_size(0), max_seq_len(0) {}
+    // FNV-1a over the file's checksum section: identifies these exact
+    // weights (e.g. for cache keys). 0 = file had no checksums.
+    uint64_t checksum_hash;
+    
+    ModelWeights() : token_embeddings(), position_embeddings(), lm_head(), num_layers(0),
+                     hidden_size(0), num_heads(0), vocab_size(0), max_seq_len(0),
+                     checksum_hash(0) {}
+    
+    FloatWeights floats(const TensorDesc& d) const {
+        return FloatWeights(d.count ? (const float*)(arena.data() + d.offset) : nullptr,
+                            (size_t)d.count);
+    }
+    
+    FloatWeights norm(const LayerWeights& layer, LayerNorm which) const {
+        return FloatWeights((const float*)(arena.data() + layer.norm_offset) +
+                                (size_t)which * layer.norm_size,
+                            layer.norm_size);
+    }
+    
+    INT4Weights int4(const LayerWeights& layer, LayerTensor which) const {
+        INT4Weights t;
+        t.data = arena.data() + layer.int4_offset[which];
+        t.num_weights = (size_t)layer.int4_weights[which];
+        t.data_size = (size_t)LayerWeights::int4Bytes(layer.int4_weights[which]);
+        t.scale = layer.scale[which];
+        t.zero_point = layer.zero_point[which];
+        return t;
+    }
+};
+
+// WTNT file header ("WTNT" = WeighTs iNT4)
+struct WeightFileHeader {
+    uint32_t magic;         // 0x57544E54
+    uint32_t version;
+    uint32_t num_layers;
+    uint32_t hidden_size;
+    uint32_t num_heads;
+    uint32_t vocab_size;
+    uint32_t max_seq_len;
+    uint32_t intermediate_size;
+};
+
+const uint32_t WTNT_MAGIC = 0x57544E54;
+
+// Per-tensor record preceding INT4 data. Matches struct.pack('fbi') in
+// convert_weights.py, which pads the int8 zero point to 4 bytes.
+struct WeightTensorMeta {
+    float scale;
+    int8_t zero_point;
+    uint8_t pad[3];
+    uint32_t data_size;
+};
+
+static_assert(sizeof(WeightTensorMeta) == 12, "must match convert_weights.py layout");
+
+// Convert FP16 to FP32 (inverse of WeightLoader::float_to_fp16)
+inline float fp16_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t)(h >> 15) << 31;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+
+    if (exp == 0) {
+        bits = sign;  // Zero / subnormal flushed to zero
+    } else if (exp == 31) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exp - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Incremental parser for the WTNT stream. Bytes are fed in file order in
+// arbitrarily sized chunks, so reads can be large and queued while earlier
+// chunks are being converted.
+class WeightStreamParser {
+private:
+    enum class Stage {
+        HEADER,
+        TOKEN_EMBED,
+        POS_EMBED,
+        TENSOR_META,
+        TENSOR_DATA,
+        GAP,            // Bytes between last tensor and checksum section
+        CHECKSUMS,
+        DONE
+    };
+
+    static const size_t HEADER_BYTES = sizeof(WeightFileHeader) + sizeof(uint32_t);
+    static const int TENSORS_PER_LAYER = LAYER_INT4_TENSORS;
+
+    ModelWeights& weights;
+    WeightFileHeader header;
+    uint32_t checksum_offset;
+
+    Stage stage;
+    uint64_t stream_pos;
+    size_t remaining;       // Bytes left in current stage
+
+    uint8_t scratch[HEADER_BYTES];
+    size_t scratch_fill;
+
+    float* f_dest;          // FP16 -> FP32 destination
+    uint8_t* b_dest;        // Raw INT4 destination
+    size_t layer_idx;
+    int tensor_idx;
+
+    std::vector<uint8_t> checksum_section;
+    bool failed;
+
+    // Arena bytes for the model the header describes, placed as the
+    // stream places it. Fused tensors of other sizes grow the arena.
+    static size_t plannedBytes(const WeightFileHeader& h) {
+        size_t hidden = h.hidden_size;
+        size_t slack = WeightArena::ALIGN;
+        size_t total = (size_t)h.vocab_size * hidden * sizeof(float) + slack;
+        total += (size_t)h.max_seq_len * hidden * sizeof(float) + slack;
+        size_t per_layer = (4 * hidden * hidden + 2 * hidden * h.intermediate_size + 1) / 2;
+        per_layer += LAYER_NORMS * hidden * sizeof(float) + 2 * slack;
+        return total + per_layer * h.num_layers;
+    }
+
+    bool placeFloats(size_t count, TensorDesc& desc) {
+        desc.count = count;
+        return weights.arena.take(count * sizeof(float), WeightArena::ALIGN, desc.offset);
+    }
+
+    float* floatDest(const TensorDesc& desc) {
+        return (float*)(weights.arena.mutableData() + desc.offset);
+    }
+
+    // Layer norms are not in the file yet: zeros after the INT4 range
+    bool placeNorms(LayerWeights& layer) {
+        size_t bytes = (size_t)layer.normValues() * sizeof(float);
+        if (!weights.arena.take(bytes, WeightArena::ALIGN, layer.norm_offset)) {
+            printf("[WeightLoader] Out of memory for layer %u norms\n", layer.layer_idx);
+            return false;
+        }
+        memset(weights.arena.mutableData() + layer.norm_offset, 0, bytes);
+        return true;
+    }
+
+    size_t expectedTensorWeights(int idx) const {
+        size_t h = header.hidden_size;
+        size_t i = header.intermediate_size;
+        if (idx < 4) return h * h;
+        return h * i;
+    }
+
+    size_t accumulate(const uint8_t* data, size_t len, size_t want) {
+        size_t n = want - scratch_fill;
+        if (n > len) n = len;
+        memcpy(scratch + scratch_fill, data, n);
+        scratch_fill += n;
+        return n;
+    }
+
+    size_t convertFp16(const uint8_t* data, size_t len) {
+        size_t n = remaining < len ? remaining : len;
+        size_t consumed = 0;
+
+        // Finish a value split across chunks
+        if (scratch_fill == 1 && n > 0) {
+            uint16_t h = (uint16_t)(scratch[0] | (data[0] << 8));
+            *f_dest++ = fp16_to_float(h);
+            scratch_fill = 0;
+            consumed = 1;
+        }
+
+        size_t pairs = (n - consumed) / 2;
+        for (size_t k = 0; k < pairs; k++) {
+            uint16_t h;
+            memcpy(&h, data + consumed + k * 2, 2);
+            f_dest[k] = fp16_to_float(h);
+        }
+        f_dest += pairs;
+        consumed += pairs * 2;
+
+        if (consumed < n) {
+            scratch[0] = data[consumed];
+            scratch_fill = 1;
+            consumed++;
+        }
+
+        remaining -= n;
+        return n;
+    }
+
+    bool parseHeader() {
+        memcpy(&header, scratch, sizeof(header));
+        memcpy(&checksum_offset, scratch + sizeof(header), sizeof(checksum_offset));
+        scratch_fill = 0;
+
+        if (header.magic != WTNT_MAGIC) {
+            printf("[WeightLoader] Invalid magic number: 0x%08X\n", header.magic);
+            return false;
+        }
+
+        printf("[WeightLoader] Model config:\n");
+        printf("  Version: %u\n", header.version);
+        printf("  Layers: %u\n", header.num_layers);
+        printf("  Hidden: %u\n", header.hidden_size);
+        printf("  Heads: %u\n", header.num_heads);
+        printf("  Vocab: %u\n", header.vocab_size);
+
+        weights.num_layers = header.num_layers;
+        weights.hidden_size = header.hidden_size;
+        weights.num_heads = header.num_heads;
+        weights.vocab_size = header.vocab_size;
+        weights.max_seq_len = header.max_seq_len;
+
+        weights.arena.release();
+        weights.lm_head = TensorDesc();
+        size_t planned = plannedBytes(header);
+        if (!weights.arena.reserve(planned) ||
+            !placeFloats((size_t)header.vocab_size * header.hidden_size,
+                         weights.token_embeddings) ||
+            !placeFloats((size_t)header.max_seq_len * header.hidden_size,
+                         weights.position_embeddings)) {
+            printf("[WeightLoader] Out of memory for a %.2f MB weight arena\n",
+                   planned / (1024.0 * 1024.0));
+            return false;
+        }
+
+        weights.layers.assign(header.num_layers, LayerWeights());
+        for (size_t i = 0; i < header.num_layers; i++) {
+            LayerWeights& layer = weights.layers[i];
+            layer.layer_idx = (uint32_t)i;
+            layer.hidden_size = header.hidden_size;
+            layer.intermediate_size = header.intermediate_size;
+            layer.norm_size = header.hidden_size;
+        }
+
+        stage = Stage::TOKEN_EMBED;
+        f_dest = floatDest(weights.token_embeddings);
+        remaining = weights.token_embeddings.count * 2;
+        return true;
+    }
+
+    bool beginTensor() {
+        WeightTensorMeta meta;
+        memcpy(&meta, scratch, sizeof(meta));
+        scratch_fill = 0;
+
+        LayerWeights& layer = weights.layers[layer_idx];
+
+        size_t expected = expectedTensorWeights(tensor_idx);
+        size_t num_weights = expected;
+        if ((expected + 1) / 2 != meta.data_size) {
+            // Converter writes fused or placeholder tensors with their own size
+            printf("[WeightLoader] Layer %zu tensor %d: %u bytes (expected %zu)\n",
+                   layer_idx, tensor_idx, meta.data_size, (expected + 1) / 2);
+            num_weights = (size_t)meta.data_size * 2;
+        }
+
+        // A layer's INT4 tensors are packed into one range, as in DDR
+        size_t align = tensor_idx == 0 ? WeightArena::ALIGN : 1;
+        uint64_t offset;
+        if (!weights.arena.take(meta.data_size, align, offset)) {
+            printf("[WeightLoader] Out of memory for layer %zu\n", layer_idx);
+            return false;
+        }
+        layer.int4_offset[tensor_idx] = offset;
+        layer.int4_weights[tensor_idx] = num_weights;
+        layer.scale[tensor_idx] = meta.scale;
+        layer.zero_point[tensor_idx] = meta.zero_point;
+
+        b_dest = weights.arena.mutableData() + offset;
+        remaining = meta.data_size;
+        stage = Stage::TENSOR_DATA;
+        return true;
+    }
+
+    // Move to the next stage once the current one is exhausted
+    void advance() {
+        while (remaining == 0 && !failed) {
+            switch (stage) {
+                case Stage::TOKEN_EMBED:
+                    stage = Stage::POS_EMBED;
+                    f_dest = floatDest(weights.position_embeddings);
+                    remaining = weights.position_embeddings.count * 2;
+                    break;
+
+                case Stage::POS_EMBED:
+                case Stage::TENSOR_DATA:
+                    if (stage == Stage::TENSOR_DATA && ++tensor_idx == TENSORS_PER_LAYER) {
+                        if (!placeNorms(weights.layers[layer_idx])) {
+                            failed = true;
+                            return;
+                        }
+                        tensor_idx = 0;
+                        layer_idx++;
+                    }
+                    if (layer_idx < weights.layers.size()) {
+                        stage = Stage::TENSOR_META;
+                        remaining = sizeof(WeightTensorMeta);
+                        return;
+                    }
+                    stage = Stage::GAP;
+                    remaining = checksum_offset > stream_pos ? checksum_offset - stream_pos : 0;
+                    if (checksum_offset == 0) {
+                        stage = Stage::DONE;
+                        return;
+                    }
+                    break;
+
+                case Stage::GAP:
+                    stage = Stage::CHECKSUMS;
+                    return;
+
+                default:
+                    return;
+            }
+        }
+    }
+
+    bool parseChecksums() {
+        printf("[WeightLoader] Verifying checksums...\n");
+
+        const uint8_t* p = checksum_section.data();
+        const uint8_t* end = p + checksum_section.size();
+
+        uint32_t num_checksums;
+        if (end - p < 4) return false;
+        memcpy(&num_checksums, p, 4);
+        p += 4;
+
+        printf("[WeightLoader]   Found %u checksums\n", num_checksums);
+
+        for (uint32_t i = 0; i < num_checksums; i++) {
+            uint32_t name_len;
+            if (end - p < 4) return false;
+            memcpy(&name_len, p, 4);
+            p += 4;
+
+            if (name_len > 255 || (size_t)(end - p) < name_len + 32) return false;
+
+            char name_buf[256];
+            memcpy(name_buf, p, name_len);
+            name_buf[name_len] = '\0';
+            p += name_len;
+
+            const uint8_t* checksum = p;  // SHA-256
+            p += 32;
+
+            // For PoC
+            if (i < 3) {
+                printf("[WeightLoader]   %s: ", name_buf);
+                for (int j = 0; j < 8; j++) {
+                    printf("%02x", checksum[j]);
+                }
+                printf("...\n");
+            }
+        }
+
+        uint64_t hash = checksumHash(checksum_section.data(), checksum_section.size());
+        weights.checksum_hash = hash;
+
+        printf("[WeightLoader] Checksum verification complete ✓ (model %016llx)\n",
+               (unsigned long long)hash);
+        return true;
+    }
+
+public:
+    // ModelWeights::checksum_hash of a checksum section
+    static uint64_t checksumHash(const uint8_t* section, size_t len) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < len; i++) {
+            hash = (hash ^ section[i]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    explicit WeightStreamParser(ModelWeights& w)
+        : weights(w), checksum_offset(0), stage(Stage::HEADER), stream_pos(0),
+          remaining(HEADER_BYTES), scratch_fill(0), f_dest(nullptr), b_dest(nullptr),
+          layer_idx(0), tensor_idx(0), failed(false) {
+        memset(&header, 0, sizeof(header));
+    }
+
+    // Feed the next len bytes of the file
+    bool feed(const uint8_t* data, size_t len) {
+        while (len > 0 && !failed) {
+            size_t n = 0;
+
+            switch (stage) {
+                case Stage::HEADER:
+                    n = accumulate(data, len, HEADER_BYTES);
+                    remaining -= n;
+                    if (remaining == 0 && !parseHeader()) failed = true;
+                    break;
+
+                case Stage::TOKEN_EMBED:
+                case Stage::POS_EMBED:
+                    n = convertFp16(data, len);
+                    break;
+
+                case Stage::TENSOR_META:
+                    n = accumulate(data, len, sizeof(WeightTensorMeta));
+                    remaining -= n;
+                    if (remaining == 0 && !beginTensor()) failed = true;
+                    break;
+
+                case Stage::TENSOR_DATA:
+                    n = remaining < len ? remaining : len;
+                    memcpy(b_dest, data, n);
+                    b_dest += n;
+                    remaining -= n;
+                    break;
+
+                case Stage::GAP:
+                    n = remaining < len ? remaining : len;
+                    remaining -= n;
+                    break;
+
+                case Stage::CHECKSUMS:
+                    checksum_section.insert(checksum_section.end(), data, data + len);
+                    n = len;
+                    break;
+
+                case Stage::DONE:
+                    n = len;
+                    break;
+            }
+
+            data += n;
+            len -= n;
+            stream_pos += n;
+
+            advance();
+        }
+
+        return !failed;
+    }
+
+    // Call after the whole file has been fed
+    bool finish() {
+        if (failed) return false;
+
+        if (stage != Stage::CHECKSUMS && stage != Stage::DONE) {
+            printf("[WeightLoader] Truncated file (stopped at byte %lu)\n",
+                   (unsigned long)stream_pos);
+            return false;
+        }
+
+        if (stage == Stage::CHECKSUMS && !parseChecksums()) {
+            printf("[WeightLoader] Malformed checksum section\n");
+            return false;
+        }
+
+        return true;
+    }
 };
 
 // Weight loader class
@@ -142,6 +686,51 @@ private:
     std::string model_path;
     bool loaded;
     
+    // Staging for file reads: STAGING_CHUNKS reads of STAGING_CHUNK_SIZE in flight
+    static const size_t STAGING_CHUNK_SIZE = 1024 * 1024;
+    static const unsigned STAGING_CHUNKS = 32;
+    static const size_t FP16_GRAIN = 64 * 1024;      // Elements per conversion task
+    
+    struct StagingBuffer {
+        uint8_t* data;
+        size_t expect;      // Bytes of the file in this chunk
+        size_t filled;      // Bytes read so far
+        size_t read_from;   // Start of the read in flight
+        bool ready;
+    };
+    
+    // Account a finished read of staging buffer sb. A short read (signal,
+    // page cache pressure, a filesystem that splits large reads) is
+    // resubmitted for the rest of the chunk; under O_DIRECT from the
+    // aligned offset below it. Fails on an error or on a zero-byte read
+    // before the chunk is complete, which is EOF inside the file.
+    static bool readCompleted(AsyncFileReader& reader, StagingBuffer& sb, const ReadCompletion& done) {
+        uint64_t chunk_start = done.tag * STAGING_CHUNK_SIZE;
+        if (done.result <= 0) {
+            printf("[WeightLoader] Read failed at offset %lu (%s, %zu of %zu bytes)\n",
+                   (unsigned long)(chunk_start + sb.read_from),
+                   done.result < 0 ? strerror((int)-done.result) : "unexpected EOF",
+                   sb.filled, sb.expect);
+            return false;
+        }
+        sb.filled = std::max(sb.filled, sb.read_from + (size_t)done.result);
+        if (sb.filled >= sb.expect) {
+            sb.ready = true;
+            return true;
+        }
+        
+        sb.read_from = reader.isDirect()
+            ? sb.filled & ~(AsyncFileReader::DIRECT_ALIGN - 1) : sb.filled;
+        if (!reader.submitRead(sb.data + sb.read_from, STAGING_CHUNK_SIZE - sb.read_from,
+                               chunk_start + sb.read_from, done.tag)) {
+            printf("[WeightLoader] Failed to resubmit short read at offset %lu\n",
+                   (unsigned long)(chunk_start + sb.filled));
+            return false;
+        }
+        reader.submit();
+        return true;
+    }
+    
     // Memory regions (physical addresses for DMA)
     uint64_t ddr_weights_phys;
     void* ddr_weights_virt;
@@ -152,27 +741,16 @@ private:
         size_t total = 0;
         
         // Embeddings (FP16 = 2 bytes per element)
-        total += weights.token_embeddings.size() * 2;
-        total += weights.position_embeddings.size() * 2;
+        total += weights.token_embeddings.count * 2;
+        total += weights.position_embeddings.count * 2;
         
-        // Layer weights (INT4 = 0.5 bytes per weight)
+        // Layer weights (INT4 = 0.5 bytes per weight, FP16 layer norms)
         for (const auto& layer : weights.layers) {
-            total += layer.q_weights.data_size;
-            total += layer.k_weights.data_size;
-            total += layer.v_weights.data_size;
-            total += layer.o_weights.data_size;
-            total += layer.ffn_up.data_size;
-            total += layer.ffn_down.data_size;
-            
-            // Layer norms (FP16)
-            total += layer.ln1_weight.size() * 2;
-            total += layer.ln1_bias.size() * 2;
-            total += layer.ln2_weight.size() * 2;
-            total += layer.ln2_bias.size() * 2;
+            total += layerDDRSize(layer);
         }
         
         // LM head (FP16)
-        total += weights.lm_head.size() * 2;
+        total += weights.lm_head.count * 2;
         
         return total;
     }
@@ -219,139 +797,166 @@ public:
     bool loadFromBinary(const std::string& bin_file) {
         printf("[WeightLoader] Loading from binary: %s\n", bin_file.c_str());
         
-        std::ifstream file(bin_file, std::ios::binary);
-        if (!file.good()) {
+        AsyncFileReader reader;
+        if (!reader.open(bin_file, STAGING_CHUNKS, true)) {
             printf("[WeightLoader] Failed to open file\n");
             return false;
         }
         
-        // Read header
-        struct Header {
-            uint32_t magic;         // 0x57544E54 ("WTNT" = WeighTs iNT4)
-            uint32_t version;
-            uint32_t num_layers;
-            uint32_t hidden_size;
-            uint32_t num_heads;
-            uint32_t vocab_size;
-            uint32_t max_seq_len;
-            uint32_t intermediate_size;
-        } header;
+        printf("[WeightLoader] Reader: %s%s, queue depth %u, %zu KB chunks\n",
+               reader.usingIoUring() ? "io_uring" : "pread",
+               reader.isDirect() ? " + O_DIRECT" : "",
+               reader.getQueueDepth(), STAGING_CHUNK_SIZE / 1024);
         
-        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        // Chunk c always lands in staging[c % depth]; at most depth chunks
+        // are in flight ahead of the consumer so slots never collide.
+        unsigned depth = reader.getQueueDepth();
+        uint64_t file_size = reader.getFileSize();
+        size_t num_chunks = (file_size + STAGING_CHUNK_SIZE - 1) / STAGING_CHUNK_SIZE;
         
-        if (header.magic != 0x57544E54) {
-            printf("[WeightLoader] Invalid magic number: 0x%08X\n", header.magic);
-            return false;
+        std::vector<StagingBuffer> staging(depth);
+        for (auto& sb : staging) {
+            sb.data = static_cast<uint8_t*>(
+                aligned_alloc(AsyncFileReader::DIRECT_ALIGN, STAGING_CHUNK_SIZE));
+            sb.expect = 0;
+            sb.filled = 0;
+            sb.read_from = 0;
+            sb.ready = false;
         }
         
-        printf("[WeightLoader] Model config:\n");
-        printf("  Version: %u\n", header.version);
-        printf("  Layers: %u\n", header.num_layers);
-        printf("  Hidden: %u\n", header.hidden_size);
-        printf("  Heads: %u\n", header.num_heads);
-        printf("  Vocab: %u\n", header.vocab_size);
-        
-        // Store config
-        weights.num_layers = header.num_layers;
-        weights.hidden_size = header.hidden_size;
-        weights.num_heads = header.num_heads;
-        weights.vocab_size = header.vocab_size;
-        weights.max_seq_len = header.max_seq_len;
-        
-        uint32_t checksum_offset;
-        file.read(reinterpret_cast<char*>(&checksum_offset), sizeof(checksum_offset));
-        
-        size_t embed_size = header.vocab_size * header.hidden_size;
-        weights.token_embeddings.resize(embed_size);
-        
-        // For PoC: just read size
-        file.seekg(embed_size * 2, std::ios::cur);  // Skip FP16 data
+        auto start = std::chrono::steady_clock::now();
         
-        size_t pos_embed_size = header.max_seq_len * header.hidden_size;
-        weights.position_embeddings.resize(pos_embed_size);
-        file.seekg(pos_embed_size * 2, std::ios::cur);  // Skip FP16 data
+        WeightStreamParser parser(weights);
+        size_t next_submit = 0;
+        size_t next_consume = 0;
+        bool ok = true;
         
-        // Simulate loading layers
-        weights.layers.resize(header.num_layers);
-        for (size_t i = 0; i < header.num_layers; i++) {
-            LayerWeights& layer = weights.layers[i];
-            layer.layer_idx = i;
-            layer.hidden_size = header.hidden_size;
-            layer.intermediate_size = header.intermediate_size;
-            
-            // Allocate weight storage
-            size_t qkv_size = header.hidden_size * header.hidden_size;
-            layer.q_weights.allocate(qkv_size);
-            layer.k_weights.allocate(qkv_size);
-            layer.v_weights.allocate(qkv_size);
-            layer.o_weights.allocate(qkv_size);
-            
-            size_t ffn_up_size = header.hidden_size * header.intermediate_size;
-            size_t ffn_down_size = header.intermediate_size * header.hidden_size;
-            layer.ffn_up.allocate(ffn_up_size);
-            layer.ffn_down.allocate(ffn_down_size);
-            
-            // Layer norms
-            layer.ln1_weight.resize(header.hidden_size);
-            layer.ln1_bias.resize(header.hidden_size);
-            layer.ln2_weight.resize(header.hidden_size);
-            layer.ln2_bias.resize(header.hidden_size);
-            
-            for (int w = 0; w < 6; w++) {  // q, k, v, o, ffn_up, ffn_down
-                float scale;
-                int8_t zero_point;
-                uint32_t data_size;
-                
-                file.read(reinterpret_cast<char*>(&scale), sizeof(scale));
-                file.read(reinterpret_cast<char*>(&zero_point), sizeof(zero_point));
-                file.read(reinterpret_cast<char*>(&data_size), sizeof(data_size));
-                
-                // Skip actual data for PoC
-                file.seekg(data_size, std::ios::cur);
+        while (ok && next_consume < num_chunks) {
+            // Keep the queue full
+            while (next_submit < num_chunks && next_submit < next_consume + depth) {
+                StagingBuffer& sb = staging[next_submit % depth];
+                if (!sb.data) {
+                    ok = false;
+                    break;
+                }
+                uint64_t offset = (uint64_t)next_submit * STAGING_CHUNK_SIZE;
+                sb.expect = (size_t)std::min<uint64_t>((uint64_t)STAGING_CHUNK_SIZE, file_size - offset);
+                sb.filled = 0;
+                sb.read_from = 0;
+                sb.ready = false;
+                if (!reader.submitRead(sb.data, STAGING_CHUNK_SIZE, offset, next_submit)) {
+                    break;
+                }
+                next_submit++;
             }
-        }
-        
-        // Verify checksums
-        if (checksum_offset > 0) {
-            printf("[WeightLoader] Verifying checksums...\n");
-            
-            file.seekg(checksum_offset);
-            
-            uint32_t num_checksums;
-            file.read(reinterpret_cast<char*>(&num_checksums), sizeof(num_checksums));
-            
-            printf("[WeightLoader]   Found %u checksums\n", num_checksums);
+            reader.submit();
             
-            for (uint32_t i = 0; i < num_checksums; i++) {
-                uint32_t name_len;
-                file.read(reinterpret_cast<char*>(&name_len), sizeof(name_len));
-                
-                char name_buf[256];
-                file.read(name_buf, name_len);
-                name_buf[name_len] = '\0';
-                
-                uint8_t checksum[32];  // SHA-256
-                file.read(reinterpret_cast<char*>(checksum), 32);
-                
-                // For PoC
-                if (i < 3) {
-                    printf("[WeightLoader]   %s: ", name_buf);
-                    for (int j = 0; j < 8; j++) {
-                        printf("%02x", checksum[j]);
-                    }
-                    printf("...\n");
+            StagingBuffer& head = staging[next_consume % depth];
+            if (!head.ready) {
+                ReadCompletion done[64];
+                int n = reader.wait(done, 64, 1);
+                if (n < 0) {
+                    ok = false;
+                }
+                for (int k = 0; k < n && ok; k++) {
+                    ok = readCompleted(reader, staging[done[k].tag % depth], done[k]);
                 }
+                continue;
             }
             
-            printf("[WeightLoader] Checksum verification complete ✓\n");
+            // Convert this chunk while the following ones are still reading
+            ok = parser.feed(head.data, head.expect);
+            next_consume++;
+        }
+        
+        reader.close();  // Drains outstanding reads before buffers are freed
+        for (auto& sb : staging) {
+            free(sb.data);
+        }
+        
+        if (!ok || !parser.finish()) {
+            printf("[WeightLoader] Failed to load weights\n");
+            return false;
         }
         
+        double secs = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        printf("[WeightLoader] Read %.2f MB in %.3f s (%.1f MB/s)\n",
+               file_size / (1024.0 * 1024.0), secs,
+               secs > 0 ? file_size / (1024.0 * 1024.0) / secs : 0.0);
+        printf("[WeightLoader] Arena: %.2f MB, %zu layer descriptors\n",
+               weights.arena.size() / (1024.0 * 1024.0), weights.layers.size());
+        
         loaded = true;
         printf("[WeightLoader] Weights loaded successfully\n");
         
         return true;
     }
     
+    // Read only the WTNT header, for sizing memory before the full load
+    static bool readHeader(const std::string& bin_file, WeightFileHeader& header) {
+        FILE* f = fopen(bin_file.c_str(), "rb");
+        if (!f) {
+            return false;
+        }
+
+        size_t n = fread(&header, sizeof(header), 1, f);
+        fclose(f);
+
+        if (n != 1 || header.magic != WTNT_MAGIC) {
+            printf("[WeightLoader] %s: not a WTNT file\n", bin_file.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // The checksum_hash a full load would produce, from the header and the
+    // checksum section alone. False if the file has no checksums.
+    static bool readChecksumHash(const std::string& bin_file, uint64_t& hash) {
+        FILE* f = fopen(bin_file.c_str(), "rb");
+        if (!f) {
+            return false;
+        }
+        
+        WeightFileHeader header;
+        uint32_t checksum_offset = 0;
+        std::vector<uint8_t> section;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == WTNT_MAGIC &&
+                  fread(&checksum_offset, sizeof(checksum_offset), 1, f) == 1 &&
+                  checksum_offset != 0 && fseeko(f, 0, SEEK_END) == 0;
+        if (ok) {
+            off_t end = ftello(f);
+            ok = end > (off_t)checksum_offset && fseeko(f, checksum_offset, SEEK_SET) == 0;
+            if (ok) {
+                section.resize((size_t)(end - checksum_offset));
+                ok = fread(section.data(), 1, section.size(), f) == section.size();
+            }
+        }
+        fclose(f);
+        
+        if (ok) {
+            hash = WeightStreamParser::checksumHash(section.data(), section.size());
+        }
+        return ok;
+    }
+    
+    // DDR image size calculateDDRSize() will report once the file is
+    // loaded. WTNT files carry no separate lm_head.
+    static size_t estimateDDRSize(const WeightFileHeader& header) {
+        size_t h = header.hidden_size;
+        size_t i = header.intermediate_size;
+
+        size_t total = 0;
+        total += (size_t)header.vocab_size * h * 2;
+        total += (size_t)header.max_seq_len * h * 2;
+
+        size_t per_layer = (4 * h * h + 2 * h * i) / 2;   // INT4
+        per_layer += 4 * h * 2;                           // Layer norms (FP16)
+        total += per_layer * header.num_layers;
+
+        return total;
+    }
+
     bool allocateDDR(uint64_t phys_addr, void* virt_addr, size_t size) {
         ddr_weights_phys = phys_addr;
         ddr_weights_virt = virt_addr;
@@ -372,6 +977,35 @@ public:
         return true;
     }
     
+    static size_t layerDDRSize(const LayerWeights& layer) {
+        return (size_t)(layer.int4RangeBytes() + layer.normValues() * 2);
+    }
+    
+    // FP32 -> FP16 into DDR, split across the pool for large tensors
+    void storeFp16(ThreadPool& pool, FloatWeights src, uint8_t* dst) {
+        pool.parallel_for(0, src.size(), FP16_GRAIN, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                uint16_t fp16 = float_to_fp16(src[i]);
+                memcpy(dst + i * 2, &fp16, 2);
+            }
+        });
+    }
+    
+    // The INT4 range in one copy, then the layer norms as FP16
+    void copyLayer(const LayerWeights& layer, uint8_t* dst) {
+        const uint8_t* arena = weights.arena.data();
+        size_t int4_bytes = (size_t)layer.int4RangeBytes();
+        memcpy(dst, arena + layer.int4_offset[LAYER_Q], int4_bytes);
+        dst += int4_bytes;
+        
+        const float* norms = (const float*)(arena + layer.norm_offset);
+        for (uint64_t i = 0; i < layer.normValues(); i++) {
+            uint16_t fp16 = float_to_fp16(norms[i]);
+            memcpy(dst, &fp16, 2);
+            dst += 2;
+        }
+    }
+    
     bool copyToDDR() {
         if (!loaded) {
             printf("[WeightLoader] No weights loaded\n");
@@ -384,54 +1018,43 @@ public:
         }
         
         printf("[WeightLoader] Copying weights to DDR...\n");
+        auto t0 = std::chrono::steady_clock::now();
         
         uint8_t* ddr_ptr = static_cast<uint8_t*>(ddr_weights_virt);
-        size_t offset = 0;
+        ThreadPool& pool = sharedThreadPool();
         
-        // Copy embeddings (convert FP32 → FP16)
-        for (float val : weights.token_embeddings) {
-            uint16_t fp16 = float_to_fp16(val);
-            memcpy(ddr_ptr + offset, &fp16, 2);
-            offset += 2;
-        }
+        // Layout matches getLayerAddress(): embeddings, then per layer the
+        // INT4 tensors followed by the FP16 layer norms
+        size_t offset = 0;
+        storeFp16(pool, weights.floats(weights.token_embeddings), ddr_ptr + offset);
+        offset += weights.token_embeddings.count * 2;
+        storeFp16(pool, weights.floats(weights.position_embeddings), ddr_ptr + offset);
+        offset += weights.position_embeddings.count * 2;
         
         printf("[WeightLoader]   Embeddings: %zu bytes\n", offset);
         size_t embed_offset = offset;
         
-        // Copy layer weights
+        // Layers are independent; one task each
+        uint64_t phys_base = ddr_weights_phys;
+        TaskGroup group(pool);
         for (size_t i = 0; i < weights.layers.size(); i++) {
-            const LayerWeights& layer = weights.layers[i];
-            
-            // Copy INT4 weights (already packed)
-            memcpy(ddr_ptr + offset, layer.q_weights.data, layer.q_weights.data_size);
-            offset += layer.q_weights.data_size;
-            
-            memcpy(ddr_ptr + offset, layer.k_weights.data, layer.k_weights.data_size);
-            offset += layer.k_weights.data_size;
-            
-            memcpy(ddr_ptr + offset, layer.v_weights.data, layer.v_weights.data_size);
-            offset += layer.v_weights.data_size;
-            
-            memcpy(ddr_ptr + offset, layer.o_weights.data, layer.o_weights.data_size);
-            offset += layer.o_weights.data_size;
-            
-            memcpy(ddr_ptr + offset, layer.ffn_up.data, layer.ffn_up.data_size);
-            offset += layer.ffn_up.data_size;
-            
-            memcpy(ddr_ptr + offset, layer.ffn_down.data, layer.ffn_down.data_size);
-            offset += layer.ffn_down.data_size;
-            
-            // Layer norms (FP32 → FP16)
-            for (float val : layer.ln1_weight) {
-                uint16_t fp16 = float_to_fp16(val);
-                memcpy(ddr_ptr + offset, &fp16, 2);
-                offset += 2;
-            }
+            uint8_t* dst = ddr_ptr + (getLayerAddress(i) - phys_base);
+            const LayerWeights* layer = &weights.layers[i];
+            group.run([this, layer, dst] { copyLayer(*layer, dst); });
         }
+        group.wait();
         
+        for (const auto& layer : weights.layers) {
+            offset += layerDDRSize(layer);
+        }
+        
+        storeFp16(pool, weights.floats(weights.lm_head), ddr_ptr + offset);
+        offset += weights.lm_head.count * 2;
+        
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
         printf("[WeightLoader]   Layer weights: %zu bytes\n", offset - embed_offset);
-        printf("[WeightLoader]   Total copied: %zu bytes (%.2f MB)\n", 
-               offset, offset / (1024.0 * 1024.0));
+        printf("[WeightLoader]   Total copied: %zu bytes (%.2f MB) in %.3f s on %u workers\n", 
+               offset, offset / (1024.0 * 1024.0), secs, pool.getWorkerCount());
         
         return true;
     }
@@ -441,21 +1064,11 @@ public:
         
         size_t offset = 0;
         
-        offset += weights.token_embeddings.size() * 2;
-        offset += weights.position_embeddings.size() * 2;
+        offset += weights.token_embeddings.count * 2;
+        offset += weights.position_embeddings.count * 2;
         
         for (size_t i = 0; i < layer_idx; i++) {
-            const LayerWeights& layer = weights.layers[i];
-            offset += layer.q_weights.data_size;
-            offset += layer.k_weights.data_size;
-            offset += layer.v_weights.data_size;
-            offset += layer.o_weights.data_size;
-            offset += layer.ffn_up.data_size;
-            offset += layer.ffn_down.data_size;
-            offset += layer.ln1_weight.size() * 2;
-            offset += layer.ln1_bias.size() * 2;
-            offset += layer.ln2_weight.size() * 2;
-            offset += layer.ln2_bias.size() * 2;
+            offset += layerDDRSize(weights.layers[i]);
         }
         
         return ddr_weights_phys + offset;
@@ -463,6 +1076,11 @@ public:
     
     const ModelWeights& getWeights() const { return weights; }
     bool isLoaded() const { return loaded; }
+    
+    // Weights filled from outside the file (a shared segment,
+    // weight_share.hpp) rather than by loadFromBinary
+    ModelWeights& getMutableWeights() { return weights; }
+    void setLoaded() { loaded = true; }
     size_t getRequiredDDRSize() const { return calculateDDRSize(); }
 };
 
@@ -0,0 +1,358 @@
+// weight_share.hpp
+// Host weights shared by engine processes on one machine. The first
+// process to load a model copies its ModelWeights into a segment named
+// after the model's WTNT checksum hash. Later processes map the segment
+// read-only and point their ModelWeights at it, so they skip the file
+// read and FP16 conversion and hold no private copy. The publisher
+// switches to the segment too, so N processes hold one copy.
+//
+//   segment   <dir>/fpga-weights-<hash>: header, the layer descriptor
+//             table, then the model's weight arena (weight_loader.hpp)
+//             byte for byte, so descriptors need no rewriting. dir is
+//             /dev/shm by default; a hugetlbfs mount gives huge pages
+//             (the size is rounded to its page).
+//   publish   created O_EXCL, reserved with fallocate and filled through
+//             a writable mapping. The header turns READY last, so readers
+//             never map a partial segment; they wait for a live publisher
+//             and remove a dead one's leftovers.
+//
+// Segments outlive the processes, so a restart attaches too; delete the
+// file to reclaim the memory. Only models with checksums are shared,
+// since the hash is their only identity. The DDR image is still written
+// by each process.
+
+#ifndef WEIGHT_SHARE_HPP
+#define WEIGHT_SHARE_HPP
+
+#include "weight_loader.hpp"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+struct SharedWeightOptions {
+    bool enabled;
+    std::string dir;                // /dev/shm, or a hugetlbfs mount
+    uint32_t wait_ms;               // For a segment another process is publishing
+
+    SharedWeightOptions() : enabled(false), dir("/dev/shm"), wait_ms(30000) {}
+};
+
+class SharedWeights {
+public:
+    static const uint32_t MAGIC = 0x52485357;          // "WSHR"
+    static const uint32_t VERSION = 2;
+
+private:
+    enum : uint32_t { STATE_WRITING = 0, STATE_READY = 1 };
+
+    static const size_t COPY_GRAIN = 16 * 1024 * 1024;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        std::atomic<uint32_t> state;
+        int32_t publisher_pid;
+        uint64_t checksum_hash;
+        uint64_t segment_bytes;
+        uint32_t num_layers;
+        uint32_t hidden_size;
+        uint32_t num_heads;
+        uint32_t vocab_size;
+        uint32_t max_seq_len;
+        uint64_t arena_offset;      // From the segment start; layers precede it
+        uint64_t arena_bytes;
+        TensorDesc token_embeddings;
+        TensorDesc position_embeddings;
+        TensorDesc lm_head;
+    };
+
+    std::string path;
+    void* base;
+    size_t bytes;
+    bool published;
+
+    static uint64_t align(uint64_t n, uint64_t to) { return (n + to - 1) / to * to; }
+
+    static uint64_t arenaOffset(uint32_t num_layers) {
+        return align(sizeof(Header) + (uint64_t)num_layers * sizeof(LayerWeights),
+                     WeightArena::ALIGN);
+    }
+
+    // count elements of elem_bytes at offset lie inside the arena
+    static bool fits(uint64_t offset, uint64_t count, uint64_t elem_bytes, uint64_t arena) {
+        return offset <= arena && count <= (arena - offset) / elem_bytes;
+    }
+
+    static bool layerFits(const LayerWeights& layer, uint64_t arena) {
+        for (uint32_t t = 0; t < LAYER_INT4_TENSORS; t++) {
+            if (!fits(layer.int4_offset[t], LayerWeights::int4Bytes(layer.int4_weights[t]), 1,
+                      arena)) {
+                return false;
+            }
+        }
+        return fits(layer.norm_offset, layer.normValues(), sizeof(float), arena);
+    }
+
+    // Size fd to bytes and reserve the pages now rather than SIGBUS on a
+    // full tmpfs later. 0 or an errno.
+    static int reserve(int fd, uint64_t bytes) {
+        if (ftruncate(fd, (off_t)bytes) != 0) {
+            return errno;
+        }
+        return posix_fallocate(fd, 0, (off_t)bytes);
+    }
+
+    static bool processAlive(int32_t pid) {
+        return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+    }
+
+    static double msSince(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t)
+            .count();
+    }
+
+    void unmap() {
+        if (base) {
+            munmap(base, bytes);
+        }
+        base = nullptr;
+        bytes = 0;
+    }
+
+    bool mapReadOnly(int fd, size_t size) {
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            perror("[WeightShare] mmap");
+            return false;
+        }
+        base = addr;
+        bytes = size;
+        return true;
+    }
+
+    // Point weights at the mapped segment once its index checks out
+    bool viewSegment(uint64_t hash, ModelWeights& weights) {
+        const uint8_t* p = (const uint8_t*)base;
+        const Header* h = (const Header*)p;
+        if (h->magic != MAGIC || h->version != VERSION || h->checksum_hash != hash ||
+            h->segment_bytes > bytes || h->arena_offset != arenaOffset(h->num_layers) ||
+            !fits(h->arena_offset, h->arena_bytes, 1, h->segment_bytes)) {
+            printf("[WeightShare] %s does not hold model %016llx\n", path.c_str(),
+                   (unsigned long long)hash);
+            return false;
+        }
+        const LayerWeights* layers = (const LayerWeights*)(p + sizeof(Header));
+        bool valid = fits(h->token_embeddings.offset, h->token_embeddings.count, sizeof(float),
+                          h->arena_bytes) &&
+                     fits(h->position_embeddings.offset, h->position_embeddings.count,
+                          sizeof(float), h->arena_bytes) &&
+                     fits(h->lm_head.offset, h->lm_head.count, sizeof(float), h->arena_bytes);
+        for (uint32_t i = 0; valid && i < h->num_layers; i++) {
+            valid = layerFits(layers[i], h->arena_bytes);
+        }
+        if (!valid) {
+            printf("[WeightShare] %s: descriptor outside the arena\n", path.c_str());
+            return false;
+        }
+
+        weights.num_layers = h->num_layers;
+        weights.hidden_size = h->hidden_size;
+        weights.num_heads = h->num_heads;
+        weights.vocab_size = h->vocab_size;
+        weights.max_seq_len = h->max_seq_len;
+        weights.checksum_hash = h->checksum_hash;
+        weights.token_embeddings = h->token_embeddings;
+        weights.position_embeddings = h->position_embeddings;
+        weights.lm_head = h->lm_head;
+        weights.layers.assign(layers, layers + h->num_layers);
+        weights.arena.view(p + h->arena_offset, (size_t)h->arena_bytes);
+        return true;
+    }
+
+public:
+    SharedWeights() : base(nullptr), bytes(0), published(false) {}
+    ~SharedWeights() { unmap(); }
+
+    SharedWeights(const SharedWeights&) = delete;
+    SharedWeights& operator=(const SharedWeights&) = delete;
+
+    static std::string segmentPath(const SharedWeightOptions& options, uint64_t hash) {
+        char name[64];
+        snprintf(name, sizeof(name), "/fpga-weights-%016llx", (unsigned long long)hash);
+        return options.dir + name;
+    }
+
+    // Map the model's segment, waiting for a publisher still filling it.
+    // False = not published (or unusable): load the file and publish().
+    bool attach(const SharedWeightOptions& options, uint64_t hash, ModelWeights& weights) {
+        path = segmentPath(options, hash);
+        auto start = std::chrono::steady_clock::now();
+
+        while (true) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            bool sized = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header);
+            bool mapped = sized && mapReadOnly(fd, (size_t)st.st_size);
+            ::close(fd);
+            if (sized && !mapped) {
+                return false;
+            }
+
+            const Header* h = mapped ? (const Header*)base : nullptr;
+            if (h && h->state.load(std::memory_order_acquire) == STATE_READY) {
+                if (h->magic == MAGIC && h->version != VERSION) {
+                    // Processes still using it keep their mapping
+                    printf("[WeightShare] Replacing %s (segment format v%u)\n", path.c_str(),
+                           h->version);
+                    unmap();
+                    unlink(path.c_str());
+                    return false;
+                }
+                if (!viewSegment(hash, weights)) {
+                    unmap();
+                    return false;
+                }
+                printf("[WeightShare] Attached model %016llx from %s (%.1f MB) in %.1f ms\n",
+                       (unsigned long long)hash, path.c_str(), bytes / (1024.0 * 1024.0),
+                       msSince(start));
+                return true;
+            }
+
+            // A publisher is still writing, or died partway. Until its
+            // header is in (pid 0) it is still creating the file.
+            int32_t pid = h ? h->publisher_pid : 0;
+            unmap();
+            bool expired = msSince(start) > options.wait_ms;
+            if (pid ? !processAlive(pid) : expired) {
+                printf("[WeightShare] Removing unfinished segment %s\n", path.c_str());
+                unlink(path.c_str());
+                return false;
+            }
+            if (expired) {
+                printf("[WeightShare] %s still being published by pid %d; loading the file\n",
+                       path.c_str(), pid);
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    // Copy freshly loaded weights into a new segment and switch them to it,
+    // freeing the private copy. False leaves weights as they were.
+    bool publish(const SharedWeightOptions& options, ModelWeights& weights) {
+        if (weights.checksum_hash == 0) {
+            printf("[WeightShare] No WTNT checksums to identify the model; not shared\n");
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        path = segmentPath(options, weights.checksum_hash);
+
+        uint32_t num_layers = (uint32_t)weights.layers.size();
+        uint64_t arena_offset = arenaOffset(num_layers);
+        uint64_t arena_bytes = weights.arena.size();
+
+        // hugetlbfs only takes whole huge pages
+        struct statfs fs;
+        uint64_t page = statfs(options.dir.c_str(), &fs) == 0 && fs.f_bsize > 0
+            ? (uint64_t)fs.f_bsize : 4096;
+        uint64_t segment_bytes = align(arena_offset + arena_bytes, page);
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            if (errno == EEXIST) {
+                printf("[WeightShare] %s was published meanwhile; keeping this copy\n",
+                       path.c_str());
+            } else {
+                printf("[WeightShare] Cannot create %s: %s\n", path.c_str(), strerror(errno));
+            }
+            return false;
+        }
+        // The header page first, publisher_pid included: reserving the
+        // rest of a multi-GB segment takes a while, and an attacher that
+        // finds no live publisher removes the file
+        int err = reserve(fd, page);
+        void* addr = err == 0 ? mmap(nullptr, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                              : MAP_FAILED;
+        if (addr != MAP_FAILED) {
+            Header* h = new (addr) Header();
+            h->magic = MAGIC;
+            h->version = VERSION;
+            h->state.store(STATE_WRITING, std::memory_order_relaxed);
+            h->publisher_pid = (int32_t)getpid();
+            munmap(addr, page);
+            err = reserve(fd, segment_bytes);
+            addr = err == 0 ? mmap(nullptr, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                   fd, 0)
+                            : MAP_FAILED;
+        }
+        if (addr == MAP_FAILED) {
+            printf("[WeightShare] Cannot size %s to %.1f MB: %s\n", path.c_str(),
+                   segment_bytes / (1024.0 * 1024.0), strerror(err ? err : errno));
+            ::close(fd);
+            unlink(path.c_str());
+            return false;
+        }
+
+        uint8_t* p = (uint8_t*)addr;
+        Header* h = (Header*)p;
+        h->checksum_hash = weights.checksum_hash;
+        h->segment_bytes = segment_bytes;
+        h->num_layers = num_layers;
+        h->hidden_size = weights.hidden_size;
+        h->num_heads = weights.num_heads;
+        h->vocab_size = weights.vocab_size;
+        h->max_seq_len = weights.max_seq_len;
+        h->arena_offset = arena_offset;
+        h->arena_bytes = arena_bytes;
+        h->token_embeddings = weights.token_embeddings;
+        h->position_embeddings = weights.position_embeddings;
+        h->lm_head = weights.lm_head;
+        if (num_layers) {
+            memcpy(p + sizeof(Header), weights.layers.data(), num_layers * sizeof(LayerWeights));
+        }
+
+        // The arena as one range, split across the pool
+        const uint8_t* src = weights.arena.data();
+        uint8_t* dst = p + arena_offset;
+        sharedThreadPool().parallel_for(0, (size_t)arena_bytes, COPY_GRAIN,
+                                        [&](size_t lo, size_t hi) {
+            memcpy(dst + lo, src + lo, hi - lo);
+        });
+        h->state.store(STATE_READY, std::memory_order_release);
+        munmap(addr, segment_bytes);
+
+        bool mapped = mapReadOnly(fd, segment_bytes);
+        ::close(fd);
+        if (!mapped || !viewSegment(weights.checksum_hash, weights)) {
+            unmap();
+            return false;
+        }
+        published = true;
+        printf("[WeightShare] Published model %016llx to %s (%.1f MB) in %.1f ms\n",
+               (unsigned long long)weights.checksum_hash, path.c_str(),
+               bytes / (1024.0 * 1024.0), msSince(start));
+        return true;
+    }
+
+    bool attached() const { return base != nullptr; }
+    bool isPublisher() const { return published; }
+    const std::string& segment() const { return path; }
+};
+
+#endif // WEIGHT_SHARE_HPP
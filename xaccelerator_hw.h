@@ -98,6 +98,15 @@
 
 #define XACCELERATOR_IRQ_CLEAR_IN             0xD4  // irq_clear_in[31:0]
 
+// ==============================================================
+// Suspend Request
+// Polled by the kernel between tokens: nonzero ends the run at the
+// next token boundary with ap_done, keeping the KV written so far.
+// ap_ctrl_hs has no other way to stop a run once started.
+// ==============================================================
+
+#define XACCELERATOR_SUSPEND_IN               0xDC  // suspend_in[31:0]
+
 // ==============================================================
 // Helper Macros
 // ==============================================================